@@ -4,6 +4,8 @@
 #include <string.h>
 #include <assert.h>
 #include <stdio.h>
+#include <time.h>
+#include <stdatomic.h>
 
 ///////////////////////
 // utf8 utills
@@ -396,10 +398,191 @@ size_t utf8_get_length(const char* str) {
     return count;
 }
 
-#define CHK 1
+///////////////////////
+// UTFString index
+///////////////////////
+
+//index keeps a checkpoint every UTF_INDEX_STRIDE characters
+//it's only built for strings that are at least UTF_INDEX_MIN_SIZE bytes long
+//and have non ascii characters (ascii only strings don't need it)
+#define UTF_INDEX_STRIDE 256
+#define UTF_INDEX_MIN_SIZE 4096
+
+static void utf_index_clear(UTFString* str)
+{
+    free(str->index);
+    str->index = NULL;
+    str->index_size = 0;
+    str->index_capacity = 0;
+}
+
+//makes room for how_many entries at position at
+static bool utf_index_make_room(UTFString* str, size_t at, size_t how_many)
+{
+    size_t needed = str->index_size + how_many;
+    if (needed > str->index_capacity || !str->index) {
+        size_t new_capacity = str->index_capacity ? str->index_capacity : 16;
+        while (new_capacity < needed) {
+            new_capacity *= 2;
+        }
+        UTFIndexEntry* new_index = realloc(str->index, new_capacity * sizeof(UTFIndexEntry));
+        if (!new_index) {
+            fprintf(stderr, "%s:%d:ERROR : failed to grow a string index!!!\n", __FILE__, __LINE__);
+            utf_index_clear(str);
+            return false;
+        }
+        str->index = new_index;
+        str->index_capacity = new_capacity;
+    }
+    if (how_many > 0 && at < str->index_size) {
+        memmove(str->index + at + how_many, str->index + at, (str->index_size - at) * sizeof(UTFIndexEntry));
+    }
+    str->index_size += how_many;
+    return true;
+}
+
+//puts checkpoints between from and to at index position at
+//only the bytes between from and to are scanned
+static void utf_index_fill(UTFString* str, size_t at, UTFIndexEntry from, UTFIndexEntry to)
+{
+    if (to.count - from.count <= UTF_INDEX_STRIDE) {
+        return;
+    }
+    size_t how_many = (to.count - from.count - 1) / UTF_INDEX_STRIDE;
+    if (!utf_index_make_room(str, at, how_many)) {
+        return;
+    }
+
+    size_t count = from.count;
+    size_t next_checkpoint = from.count + UTF_INDEX_STRIDE;
+    size_t end = at + how_many;
+    for (size_t i = from.byte; i < to.byte && at < end; i++) {
+        if ((str->data[i] & 0b11000000) != 0b10000000) {
+            if (count == next_checkpoint) {
+                UTFIndexEntry entry = {.byte = i, .count = count};
+                str->index[at++] = entry;
+                next_checkpoint += UTF_INDEX_STRIDE;
+            }
+            count++;
+        }
+    }
+}
+
+static void utf_index_build(UTFString* str)
+{
+    UTFIndexEntry begin = {.byte = 0, .count = 0};
+    UTFIndexEntry end = {.byte = str->data_size, .count = str->count};
+    str->index_size = 0;
+    //make sure index is allocated even if there is nothing to put in it
+    //so that we don't try to build it again on every lookup
+    if (utf_index_make_room(str, 0, 0)) {
+        utf_index_fill(str, 0, begin, end);
+    }
+}
+
+//returns position of first checkpoint that is after the character
+//(or byte if by_byte is true)
+static size_t utf_index_upper_bound(UTFString* str, size_t value, bool by_byte)
+{
+    size_t low = 0;
+    size_t high = str->index_size;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        size_t mid_value = by_byte ? str->index[mid].byte : str->index[mid].count;
+        if (mid_value <= value) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+static UTFIndexEntry utf_index_checkpoint_before(UTFString* str, size_t pos)
+{
+    UTFIndexEntry begin = {.byte = 0, .count = 0};
+    return pos > 0 ? str->index[pos - 1] : begin;
+}
+
+//called after inserted_size bytes were inserted at at_byte
+//and str->count was updated
+static void utf_index_on_insert(UTFString* str, size_t at_byte, size_t inserted_size, size_t inserted_count)
+{
+    if (!str->index) {
+        return;
+    }
+
+    size_t pos = utf_index_upper_bound(str, at_byte, true);
+    for (size_t i = pos; i < str->index_size; i++) {
+        str->index[i].byte += inserted_size;
+        str->index[i].count += inserted_count;
+    }
+
+    UTFIndexEntry from = utf_index_checkpoint_before(str, pos);
+    UTFIndexEntry to = {.byte = str->data_size, .count = str->count};
+    if (pos < str->index_size) {
+        to = str->index[pos];
+    }
+
+    //don't split the gap on every small insertion
+    if (to.count - from.count > 2 * UTF_INDEX_STRIDE) {
+        utf_index_fill(str, pos, from, to);
+    }
+}
+
+//called after bytes between from_byte and to_byte were erased
+//and str->count was updated
+static void utf_index_on_erase(UTFString* str, size_t from_byte, size_t to_byte, size_t erased_count)
+{
+    if (!str->index) {
+        return;
+    }
+
+    size_t erased_size = to_byte - from_byte;
+    size_t kept = 0;
+    for (size_t i = 0; i < str->index_size; i++) {
+        UTFIndexEntry entry = str->index[i];
+        if (entry.byte > from_byte && entry.byte <= to_byte) {
+            continue;
+        }
+        if (entry.byte > to_byte) {
+            entry.byte -= erased_size;
+            entry.count -= erased_count;
+        }
+        if (entry.byte >= str->data_size) {
+            continue;
+        }
+        str->index[kept++] = entry;
+    }
+    str->index_size = kept;
+}
+
+static bool utf_index_is_valid(UTFString* str)
+{
+    size_t count = 0;
+    size_t entry = 0;
+    for (size_t i = 0; i < str->data_size && entry < str->index_size; i++) {
+        bool is_char_start = (str->data[i] & 0b11000000) != 0b10000000;
+        if (str->index[entry].byte == i) {
+            if (!is_char_start || str->index[entry].count != count) {
+                return false;
+            }
+            entry++;
+        }
+        if (is_char_start) {
+            count++;
+        }
+    }
+    return entry == str->index_size;
+}
 
 bool utf_is_valid(UTFString *str){
-#if CHK
+    if (str->index && !utf_index_is_valid(str)) {
+        fprintf(stderr, "%s:%d:ERROR : str is not valid!!!", __FILE__, __LINE__);
+        fprintf(stderr, " str index is out of date\n");
+        return false;
+    }
     if( str->count != utf8_get_length(str->data)){
         fprintf(stderr, "%s:%d:ERROR : str is not valid!!!", __FILE__, __LINE__);
         fprintf(stderr, " cached count : %zu, count : %zu\n", str->count, utf_count(str));
@@ -410,33 +593,158 @@ bool utf_is_valid(UTFString *str){
         fprintf(stderr, " str is not null terminated");
         return false;
     }
-#endif
     return true;
 }
 
 bool utf_sv_is_valid(UTFStringView sv){
-#if CHK
     if( sv.count != utf_sv_count(sv)){
         fprintf(stderr, "%s:%d:ERROR : sv is not valid!!!", __FILE__, __LINE__);
         fprintf(stderr, " cached count : %zu, count : %zu\n", sv.count, utf_sv_count(sv));
         return false;
     }
+    return true;
+}
+
+///////////////////////
+// validation
+///////////////////////
+
+//with UTF_VALIDATION_SAMPLED only one in UTF_VALIDATION_SAMPLE_RATE checks is done
+#define UTF_VALIDATION_SAMPLE_RATE 64
+
+//default level, can be changed with utf_set_validation_level or KEWL_UTF_VALIDATION
+#ifndef UTF_VALIDATION_DEFAULT
+#define UTF_VALIDATION_DEFAULT UTF_VALIDATION_SAMPLED
 #endif
+
+//find, load and autosave workers make strings too,
+//so the level is atomic and every thread counts its own stats(and its own samples)
+static _Atomic int validation_level = UTF_VALIDATION_DEFAULT;
+static _Thread_local UTFValidationStats validation_stats;
+
+void utf_set_validation_level(UTFValidationLevel level)
+{
+    atomic_store_explicit(&validation_level, (int)level, memory_order_relaxed);
+}
+
+UTFValidationLevel utf_get_validation_level()
+{
+    return (UTFValidationLevel)atomic_load_explicit(&validation_level, memory_order_relaxed);
+}
+
+void utf_validation_init_from_env()
+{
+    const char* level = getenv("KEWL_UTF_VALIDATION");
+    if (!level) {
+        return;
+    }
+
+    if (strcmp(level, "off") == 0) {
+        utf_set_validation_level(UTF_VALIDATION_OFF);
+    }
+    else if (strcmp(level, "sampled") == 0) {
+        utf_set_validation_level(UTF_VALIDATION_SAMPLED);
+    }
+    else if (strcmp(level, "full") == 0) {
+        utf_set_validation_level(UTF_VALIDATION_FULL);
+    }
+    else {
+        fprintf(stderr, "%s:%d:ERROR : unknown KEWL_UTF_VALIDATION value \"%s\", ", __FILE__, __LINE__, level);
+        fprintf(stderr, "expected off, sampled or full\n");
+    }
+}
+
+UTFValidationStats utf_get_validation_stats()
+{
+    return validation_stats;
+}
+
+void utf_reset_validation_stats()
+{
+    UTFValidationStats zero = {0};
+    validation_stats = zero;
+}
+
+//returns true if check should be done at current validation level
+static bool utf_should_validate()
+{
+    switch (utf_get_validation_level()) {
+        case UTF_VALIDATION_OFF:
+            validation_stats.skipped++;
+            return false;
+        case UTF_VALIDATION_SAMPLED:
+            if ((validation_stats.checked + validation_stats.skipped) % UTF_VALIDATION_SAMPLE_RATE != 0) {
+                validation_stats.skipped++;
+                return false;
+            }
+            break;
+        case UTF_VALIDATION_FULL:
+            break;
+    }
+    validation_stats.checked++;
     return true;
 }
 
+//called by functions that create or modify strings
+static void utf_validate(UTFString* str)
+{
+    if (utf_should_validate() && !utf_is_valid(str)) {
+        validation_stats.violations++;
+    }
+}
+
+static void utf_sv_validate(UTFStringView sv)
+{
+    if (utf_should_validate() && !utf_sv_is_valid(sv)) {
+        validation_stats.violations++;
+    }
+}
+
 ///////////////////////
 // UTFString functions
 ///////////////////////
 
 size_t utf_count_to_byte(UTFString* str, size_t count)
 {
-    return utf_sv_count_to_byte(utf_sv_from_str(str), count);
+    //ascii only, every character is one byte
+    if (str->count == str->data_size) {
+        return count < str->data_size ? count : str->data_size;
+    }
+    if (str->data_size < UTF_INDEX_MIN_SIZE) {
+        return utf_sv_count_to_byte(utf_sv_from_str(str), count);
+    }
+
+    if (!str->index) {
+        utf_index_build(str);
+    }
+    UTFIndexEntry checkpoint = utf_index_checkpoint_before(str, utf_index_upper_bound(str, count, false));
+    UTFStringView rest = {
+        .data = str->data + checkpoint.byte,
+        .data_size = str->data_size - checkpoint.byte,
+        .count = str->count - checkpoint.count
+    };
+    return checkpoint.byte + utf_sv_count_to_byte(rest, count - checkpoint.count);
 }
 
 size_t utf_byte_to_count(UTFString* str, size_t byte)
 {
-    return utf_sv_byte_to_count(utf_sv_from_str(str), byte);
+    if (str->count == str->data_size) {
+        return byte < str->data_size ? byte : str->data_size;
+    }
+    if (str->data_size < UTF_INDEX_MIN_SIZE) {
+        return utf_sv_byte_to_count(utf_sv_from_str(str), byte);
+    }
+
+    if (!str->index) {
+        utf_index_build(str);
+    }
+    UTFIndexEntry checkpoint = utf_index_checkpoint_before(str, utf_index_upper_bound(str, byte, true));
+    UTFStringView rest = {
+        .data = str->data + checkpoint.byte,
+        .data_size = str->data_size - checkpoint.byte,
+        .count = str->count - checkpoint.count
+    };
+    return checkpoint.count + utf_sv_byte_to_count(rest, byte - checkpoint.byte);
 }
 
 #define UTF_STR_DEFAULT_ALLOC 128
@@ -488,7 +796,11 @@ UTFString* utf_from_cstr(const char* str) {
         to_return->count = 0;
     }
 
-    utf_is_valid(to_return);
+    to_return->index = NULL;
+    to_return->index_size = 0;
+    to_return->index_capacity = 0;
+
+    utf_validate(to_return);
 
     return to_return;
 }
@@ -510,7 +822,11 @@ UTFString* utf_from_sv(UTFStringView sv)
     //make it null terminated
     to_return->data[to_return->data_size] = 0;
 
-    utf_is_valid(to_return);
+    to_return->index = NULL;
+    to_return->index_size = 0;
+    to_return->index_capacity = 0;
+
+    utf_validate(to_return);
 
     return to_return;
 }
@@ -535,6 +851,7 @@ UTFString* utf_copy(UTFString* str)
 void utf_destroy(UTFString* str) {
     if (!str) { return; }
     if (str->data) { free(str->data); }
+    utf_index_clear(str);
     free(str);
 }
 
@@ -574,8 +891,9 @@ void utf_set_cstr(UTFString* str, const char* to_set)
 
     str->data_size = str_len;
     str->count = utf8_get_length(to_set);
+    utf_index_clear(str);
 
-    utf_is_valid(str);
+    utf_validate(str);
 }
 void utf_set_str(UTFString* str, UTFString* to_set)
 {
@@ -588,8 +906,9 @@ void utf_set_str(UTFString* str, UTFString* to_set)
 
     str->data_size = str_len;
     str->count = to_set->count;
+    utf_index_clear(str);
 
-    utf_is_valid(str);
+    utf_validate(str);
 }
 void utf_set_sv(UTFString* str, UTFStringView to_set)
 {
@@ -598,12 +917,14 @@ void utf_set_sv(UTFString* str, UTFStringView to_set)
 
     utf_grow(str, null_included);
 
-    memcpy(str->data, to_set.data, null_included);
+    memcpy(str->data, to_set.data, str_len);
+    str->data[str_len] = 0;
 
     str->data_size = str_len;
     str->count = to_set.count;
+    utf_index_clear(str);
 
-    utf_is_valid(str);
+    utf_validate(str);
 }
 
 void utf_append_cstr(UTFString* str, const char* to_append) {
@@ -612,13 +933,16 @@ void utf_append_cstr(UTFString* str, const char* to_append) {
 
     utf_grow(str, null_included + str->data_size);
 
+    size_t at_byte = str->data_size;
     memcpy(str->data + str->data_size, to_append, null_included);
     str->data_size += str_len;
 
     size_t str_count = utf8_get_length(to_append);
     str->count += str_count;
 
-    utf_is_valid(str);
+    utf_index_on_insert(str, at_byte, str_len, str_count);
+
+    utf_validate(str);
 }
 
 void utf_append_str(UTFString* str, UTFString* to_append)
@@ -633,6 +957,7 @@ void utf_append_sv(UTFString* str, UTFStringView to_append)
 
     utf_grow(str, null_included + str->data_size);
 
+    size_t at_byte = str->data_size;
     memcpy(str->data + str->data_size, to_append.data, str_len);
     str->data_size += str_len;
 
@@ -640,36 +965,13 @@ void utf_append_sv(UTFString* str, UTFStringView to_append)
 
     str->count += to_append.count;
 
-    utf_is_valid(str);
+    utf_index_on_insert(str, at_byte, str_len, to_append.count);
+
+    utf_validate(str);
 }
 
 void utf_insert_cstr(UTFString* str, size_t at, const char* to_insert) {
-    size_t char_count = str->count;
-    if (at > char_count) {
-        fprintf(stderr, "%s:%d:ERROR : at(%zu) is bigger than string size(%zu)\n", __FILE__, __LINE__, at, char_count);
-        return;
-    }
-
-    at = utf_count_to_byte(str, at);
-
-    size_t str_len = strlen(to_insert);
-    size_t null_included = str_len + 1;
-
-    utf_grow(str, null_included + str->data_size);
-
-    //last+1 > at instead of last >= at because it wraps aroud when at is 0
-    for (size_t last = str->data_size - 1; last + 1 > at; last--) {
-        str->data[last + str_len] = str->data[last];
-    }
-
-    memcpy(str->data + at, to_insert, str_len);
-    str->data_size += str_len;
-    str->data[str->data_size] = 0;
-
-    size_t str_count = utf8_get_length(to_insert);
-    str->count += str_count;
-
-    utf_is_valid(str);
+    utf_insert_sv(str, at, utf_sv_from_cstr(to_insert));
 }
 
 void utf_insert_str(UTFString* str, size_t at, UTFString* to_insert)
@@ -686,27 +988,57 @@ void utf_insert_sv(UTFString* str, size_t at, UTFStringView to_insert)
         return;
     }
 
-    at = utf_count_to_byte(str, at);
+    utf_insert_sv_at_byte(str, utf_count_to_byte(str, at), to_insert);
+}
+
+void utf_insert_sv_at_byte(UTFString* str, size_t at_byte, UTFStringView to_insert)
+{
+    if (at_byte > str->data_size) {
+        fprintf(stderr, "%s:%d:ERROR : at_byte(%zu) is bigger than string data size(%zu)\n", __FILE__, __LINE__, at_byte, str->data_size);
+        return;
+    }
 
     size_t str_len = to_insert.data_size;
     size_t null_included = str_len + 1;
 
     utf_grow(str, null_included + str->data_size);
 
-    //last+1 > at instead of last >= at because it wraps aroud when at is 0
-    /*for (size_t last = str->data_size - 1; last + 1 > at; last--) {
-        str->data[last + str_len] = str->data[last];
-    }*/
-    memmove(str->data + at + to_insert.data_size, str->data + at, str->data_size - at);
+    memmove(str->data + at_byte + str_len, str->data + at_byte, str->data_size - at_byte);
 
-    memcpy(str->data + at, to_insert.data, str_len);
+    memcpy(str->data + at_byte, to_insert.data, str_len);
 
     str->data_size += str_len;
     str->data[str->data_size] = 0;
 
     str->count += to_insert.count;
 
-    utf_is_valid(str);
+    utf_index_on_insert(str, at_byte, str_len, to_insert.count);
+
+    utf_validate(str);
+}
+
+void utf_erase_byte_range(UTFString* str, size_t from_byte, size_t to_byte)
+{
+    if (to_byte < from_byte) {
+        size_t tmp = to_byte;
+        to_byte = from_byte;
+        from_byte = tmp;
+    }
+    if (to_byte > str->data_size) { to_byte = str->data_size; }
+    if (from_byte > str->data_size) { from_byte = str->data_size; }
+
+    UTFStringView erased = { .data = str->data + from_byte, .data_size = to_byte - from_byte };
+    size_t erased_count = utf_sv_count(erased);
+    str->count -= erased_count;
+
+    memmove(str->data + from_byte, str->data + to_byte, str->data_size - to_byte);
+
+    str->data_size -= to_byte - from_byte;
+    str->data[str->data_size] = 0;
+
+    utf_index_on_erase(str, from_byte, to_byte, erased_count);
+
+    utf_validate(str);
 }
 
 void utf_erase_range(UTFString* str, size_t from, size_t to) {
@@ -719,6 +1051,7 @@ void utf_erase_range(UTFString* str, size_t from, size_t to) {
         str->data_size = 0;
         str->count = 0;
         str->data[0] = 0;
+        utf_index_clear(str);
         return;
     }
 
@@ -727,22 +1060,27 @@ void utf_erase_range(UTFString* str, size_t from, size_t to) {
     if(char_count <= to){to = char_count;}
     if(char_count <= from){from = char_count;}
 
-    str->count -= to - from;
+    size_t erased_count = to - from;
 
+    //convert before changing count, conversion uses it
     from = utf_count_to_byte(str, from);
     to = utf_count_to_byte(str, to);
 
+    str->count -= erased_count;
+
     size_t distance = to - from;
 
     /*for (size_t i = from; i < str->data_size; i++) {
         str->data[i] = str->data[i + distance];
     }*/
-    memmove(str->data+from, str->data + distance + from, str->data_size - from);
+    memmove(str->data+from, str->data + to, str->data_size - to);
 
     str->data_size -= distance;
     str->data[str->data_size] = 0;
 
-    utf_is_valid(str);
+    utf_index_on_erase(str, from, to, erased_count);
+
+    utf_validate(str);
 }
 
 void utf_erase_right(UTFString* str, size_t how_many)
@@ -752,19 +1090,21 @@ void utf_erase_right(UTFString* str, size_t how_many)
         str->data_size = 0;
         str->data[str->data_size] = 0;
         str->count = 0;
+        utf_index_clear(str);
         return;
     }
 
-    str->count -= how_many;
-
-    how_many = str_count - how_many;
+    size_t new_size = utf_count_to_byte(str, str_count - how_many);
+    size_t old_size = str->data_size;
 
-    how_many = utf_count_to_byte(str, how_many);
+    str->count -= how_many;
 
-    str->data_size = how_many;
+    str->data_size = new_size;
     str->data[str->data_size] = 0;
 
-    utf_is_valid(str);
+    utf_index_on_erase(str, new_size, old_size, how_many);
+
+    utf_validate(str);
 }
 
 void utf_erase_left(UTFString* str, size_t how_many)
@@ -773,21 +1113,24 @@ void utf_erase_left(UTFString* str, size_t how_many)
         str->data_size = 0;
         str->data[str->data_size] = 0;
         str->count = 0;
+        utf_index_clear(str);
         return;
     }
 
-    str->count -= how_many;
+    size_t erased_size = utf_count_to_byte(str, how_many);
 
-    how_many = utf_count_to_byte(str, how_many);
+    str->count -= how_many;
 
     /*for (size_t i = how_many; i < str->data_size; i++) {
         str->data[i - how_many] = str->data[i];
     }*/
-    memmove(str->data, str->data + how_many, str->data_size - how_many);
-    str->data_size -= how_many;
+    memmove(str->data, str->data + erased_size, str->data_size - erased_size);
+    str->data_size -= erased_size;
     str->data[str->data_size] = 0;
 
-    utf_is_valid(str);
+    utf_index_on_erase(str, 0, erased_size, how_many);
+
+    utf_validate(str);
 }
 
 ////////////////////////////
@@ -799,6 +1142,10 @@ size_t utf_sv_count_to_byte(UTFStringView sv, size_t count)
     if (count == 0) {
         return 0;
     }
+    //ascii only, every character is one byte
+    if (sv.count == sv.data_size) {
+        return count < sv.data_size ? count : sv.data_size;
+    }
     count++;
     for(size_t i=0; i< sv.data_size; i++){
         if ((sv.data[i] & 0b11000000) != 0b10000000) {
@@ -813,6 +1160,9 @@ size_t utf_sv_count_to_byte(UTFStringView sv, size_t count)
 
 size_t utf_sv_byte_to_count(UTFStringView sv, size_t byte)
 {
+    if (sv.count == sv.data_size) {
+        return byte < sv.data_size ? byte : sv.data_size;
+    }
     size_t count = 0;
     for(size_t i=0; i< byte; i++){
         if((sv.data[i] & 0b11000000) != 0b10000000){
@@ -871,7 +1221,7 @@ UTFStringView utf_sv_sub_str(UTFString* str, size_t from, size_t to)
     sv.data_size = to - from;
     sv.data = str->data + from;
 
-    utf_sv_is_valid(sv);
+    utf_sv_validate(sv);
 
     return sv;
 }
@@ -913,7 +1263,7 @@ UTFStringView utf_sv_sub_sv(UTFStringView str, size_t from, size_t to)
     sv.data_size = to - from;
     sv.data = str.data + from;
 
-    utf_sv_is_valid(sv);
+    utf_sv_validate(sv);
 
     return sv;
 }
@@ -980,7 +1330,8 @@ size_t utf_sv_prev(UTFStringView sv, size_t pos)
         pos = sv.data_size;
     }
 
-    if ((sv.data[pos] & 0b11000000) != 0b10000000) {
+    //view might not be null terminated so data[data_size] is not read
+    if (pos == sv.data_size || (sv.data[pos] & 0b11000000) != 0b10000000) {
         pos--;
     }
     while (pos > 0 && (sv.data[pos] & 0b11000000) == 0b10000000) {
@@ -989,6 +1340,153 @@ size_t utf_sv_prev(UTFStringView sv, size_t pos)
     return pos;
 }
 
+///////////////////////
+// iterator
+///////////////////////
+
+//utf8 decoder as a DFA, from Bjoern Hoehrmann's "Flexible and Economical UTF-8 Decoder"
+//bytes are mapped to classes first, then state and class give the next state
+//it rejects overlong forms, surrogates and code points after U+10FFFF
+#define UTF_DFA_ACCEPT 0
+#define UTF_DFA_REJECT 12
+
+static const uint8_t UTF_DFA[] = {
+    //byte classes
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1, 9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,
+    7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7, 7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,
+    8,8,2,2,2,2,2,2,2,2,2,2,2,2,2,2, 2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,
+    10,3,3,3,3,3,3,3,3,3,3,3,3,4,3,3, 11,6,6,6,5,8,8,8,8,8,8,8,8,8,8,8,
+
+    //transitions, states are multiples of 12
+    0,12,24,36,60,96,84,12,12,12,48,72, 12,12,12,12,12,12,12,12,12,12,12,12,
+    12, 0,12,12,12,12,12, 0,12, 0,12,12, 12,24,12,12,12,12,12,24,12,24,12,12,
+    12,12,12,12,12,12,12,24,12,12,12,12, 12,24,12,12,12,12,12,12,12,24,12,12,
+    12,12,12,12,12,12,12,36,12,36,12,12, 12,36,12,12,12,12,12,36,12,36,12,12,
+    12,36,12,12,12,12,12,12,12,12,12,12,
+};
+
+static bool utf_is_continuation(const char* data, size_t pos)
+{
+    return (data[pos] & 0b11000000) == 0b10000000;
+}
+
+//decodes the character at pos, sets its size and returns its code point
+static uint32_t utf_decode_char(UTFStringView sv, size_t pos, size_t* size)
+{
+    const unsigned char* data = (const unsigned char*)sv.data;
+    size_t end = sv.data_size;
+
+    //ascii doesn't need the DFA
+    if (data[pos] < 0x80 && (pos + 1 >= end || !utf_is_continuation(sv.data, pos + 1))) {
+        *size = 1;
+        return data[pos];
+    }
+
+    //lead byte starts from the accepting state, states after reject wait for continuation bytes
+    uint32_t class = UTF_DFA[data[pos]];
+    uint32_t codepoint = (0xFFu >> class) & data[pos];
+    uint32_t state = UTF_DFA[256 + class];
+    size_t i = pos + 1;
+    while (i < end && state > UTF_DFA_REJECT) {
+        codepoint = (data[i] & 0x3Fu) | (codepoint << 6);
+        state = UTF_DFA[256 + state + UTF_DFA[data[i]]];
+        i++;
+    }
+
+    //character takes every continuation byte after the lead byte, valid or not
+    bool is_valid = state == UTF_DFA_ACCEPT;
+    while (i < end && utf_is_continuation(sv.data, i)) {
+        is_valid = false;
+        i++;
+    }
+
+    *size = i - pos;
+    return is_valid ? codepoint : UTF_REPLACEMENT_CHAR;
+}
+
+UTFIterator utf_iter_at(UTFStringView sv, size_t byte_offset, size_t index)
+{
+    UTFIterator it = { .sv = sv, .byte_offset = byte_offset, .index = index };
+    return it;
+}
+
+UTFIterator utf_iter_begin(UTFStringView sv)
+{
+    return utf_iter_at(sv, 0, 0);
+}
+
+UTFIterator utf_iter_end(UTFStringView sv)
+{
+    return utf_iter_at(sv, sv.data_size, sv.count);
+}
+
+bool utf_iter_next(UTFIterator* it, UTFChar* c)
+{
+    if (it->byte_offset >= it->sv.data_size) {
+        return false;
+    }
+
+    size_t size = 0;
+    uint32_t codepoint = utf_decode_char(it->sv, it->byte_offset, &size);
+    if (c) {
+        c->codepoint = codepoint;
+        c->byte_offset = it->byte_offset;
+        c->size = size;
+        c->index = it->index;
+    }
+
+    it->byte_offset += size;
+    it->index++;
+    return true;
+}
+
+bool utf_iter_prev(UTFIterator* it, UTFChar* c)
+{
+    if (it->byte_offset == 0) {
+        return false;
+    }
+
+    size_t end = it->byte_offset;
+    size_t start = end - 1;
+    while (start > 0 && utf_is_continuation(it->sv.data, start)) {
+        start--;
+    }
+    it->byte_offset = start;
+    it->index--;
+
+    if (c) {
+        //decoding stops at end, view might go on after it
+        UTFStringView sv = { .data = it->sv.data, .data_size = end };
+        size_t size = 0;
+        c->codepoint = utf_decode_char(sv, start, &size);
+        c->byte_offset = start;
+        c->size = end - start;
+        c->index = it->index;
+    }
+    return true;
+}
+
+void utf_iter_skip(UTFIterator* it, size_t how_many)
+{
+    const char* data = it->sv.data;
+    size_t size = it->sv.data_size;
+    size_t pos = it->byte_offset;
+
+    while (how_many > 0 && pos < size) {
+        pos++;
+        while (pos < size && utf_is_continuation(data, pos)) {
+            pos++;
+        }
+        how_many--;
+        it->index++;
+    }
+    it->byte_offset = pos;
+}
+
 UTFStringView utf_sv_trim_left(UTFStringView sv, size_t how_many)
 {
     size_t sv_count = sv.count;
@@ -998,13 +1496,15 @@ UTFStringView utf_sv_trim_left(UTFStringView sv, size_t how_many)
         return sv;
     }
 
-    sv.count -= how_many;
+    //convert before changing count, conversion uses it
+    size_t trimmed_count = how_many;
     how_many = utf_sv_count_to_byte(sv, how_many);
+    sv.count -= trimmed_count;
 
     sv.data += how_many;
     sv.data_size -= how_many;
 
-    utf_sv_is_valid(sv);
+    utf_sv_validate(sv);
 
     return sv;
 }
@@ -1019,14 +1519,70 @@ UTFStringView utf_sv_trim_right(UTFStringView sv, size_t how_many)
         return sv;
     }
 
-    sv.count -= how_many;
+    //convert before changing count, conversion uses it
+    size_t kept_count = sv_count - how_many;
+    size_t kept_size = utf_sv_count_to_byte(sv, kept_count);
 
-    how_many = sv_count - how_many;
-    how_many = utf_sv_count_to_byte(sv, how_many);
+    sv.count = kept_count;
+    sv.data_size = kept_size;
+
+    utf_sv_validate(sv);
+
+    return sv;
+}
 
-    sv.data_size = how_many;
+UTFStringView utf_sv_sub_str_bytes(UTFString* str, size_t from_byte, size_t to_byte)
+{
+    return utf_sv_sub_sv_bytes(utf_sv_from_str(str), from_byte, to_byte);
+}
+
+UTFStringView utf_sv_sub_sv_bytes(UTFStringView sv, size_t from_byte, size_t to_byte)
+{
+    if (to_byte < from_byte) {
+        size_t tmp = to_byte;
+        to_byte = from_byte;
+        from_byte = tmp;
+    }
+    if (to_byte > sv.data_size) { to_byte = sv.data_size; }
+    if (from_byte > sv.data_size) { from_byte = sv.data_size; }
+
+    UTFStringView sub = { .data = sv.data + from_byte, .data_size = to_byte - from_byte };
+    //only count what's inside the range
+    sub.count = utf_sv_count(sub);
+
+    return sub;
+}
+
+UTFStringView utf_sv_trim_left_bytes(UTFStringView sv, size_t how_many_bytes)
+{
+    if (how_many_bytes >= sv.data_size) {
+        sv.data_size = 0;
+        sv.count = 0;
+        return sv;
+    }
+
+    //only count what's trimmed
+    UTFStringView trimmed = { .data = sv.data, .data_size = how_many_bytes };
+    sv.count -= utf_sv_count(trimmed);
 
-    utf_sv_is_valid(sv);
+    sv.data += how_many_bytes;
+    sv.data_size -= how_many_bytes;
+
+    return sv;
+}
+
+UTFStringView utf_sv_trim_right_bytes(UTFStringView sv, size_t how_many_bytes)
+{
+    if (how_many_bytes >= sv.data_size) {
+        sv.data_size = 0;
+        sv.count = 0;
+        return sv;
+    }
+
+    UTFStringView trimmed = { .data = sv.data + sv.data_size - how_many_bytes, .data_size = how_many_bytes };
+    sv.count -= utf_sv_count(trimmed);
+
+    sv.data_size -= how_many_bytes;
 
     return sv;
 }
@@ -1036,73 +1592,180 @@ bool utf_sv_cmp(UTFStringView str1, UTFStringView str2) {
         return false;
     }
 
-    for (size_t i = 0; i < str1.data_size; i++) {
-        if (str1.data[i] != str2.data[i]) {
-            return false;
+    return memcmp(str1.data, str2.data, str1.data_size) == 0;
+}
+
+//needles shorter than this are found with memchr on the first byte + memcmp
+//longer ones use Horspool
+#define UTF_FIND_HORSPOOL_MIN_SIZE 8
+
+size_t utf_sv_find_right_from_bytes(UTFStringView str, UTFStringView to_find, size_t from_byte)
+{
+    size_t needle_size = to_find.data_size;
+    if (from_byte > str.data_size || str.data_size - from_byte < needle_size) {
+        return UTF_NOT_FOUND;
+    }
+    if (needle_size == 0) {
+        return from_byte;
+    }
+
+    const unsigned char* hay = (const unsigned char*)str.data;
+    const unsigned char* needle = (const unsigned char*)to_find.data;
+    size_t last_start = str.data_size - needle_size;
+    size_t pos = from_byte;
+
+    if (needle_size < UTF_FIND_HORSPOOL_MIN_SIZE) {
+        while (pos <= last_start) {
+            const unsigned char* found = memchr(hay + pos, needle[0], last_start - pos + 1);
+            if (!found) {
+                return UTF_NOT_FOUND;
+            }
+            pos = found - hay;
+            if (memcmp(hay + pos + 1, needle + 1, needle_size - 1) == 0) {
+                return pos;
+            }
+            pos++;
         }
+        return UTF_NOT_FOUND;
     }
-    return true;
+
+    //how far window can move when byte under the last needle byte is c
+    size_t shift[256];
+    for (size_t i = 0; i < 256; i++) {
+        shift[i] = needle_size;
+    }
+    for (size_t i = 0; i + 1 < needle_size; i++) {
+        shift[needle[i]] = needle_size - 1 - i;
+    }
+
+    unsigned char needle_last = needle[needle_size - 1];
+    while (pos <= last_start) {
+        unsigned char c = hay[pos + needle_size - 1];
+        if (c == needle_last && memcmp(hay + pos, needle, needle_size - 1) == 0) {
+            return pos;
+        }
+        pos += shift[c];
+    }
+    return UTF_NOT_FOUND;
 }
 
-int utf_sv_find(UTFStringView str, UTFStringView to_find)
+size_t utf_sv_find_left_from_bytes(UTFStringView str, UTFStringView to_find, size_t end_byte)
 {
-    if (str.data_size < to_find.data_size) {
-        return -1;
+    size_t needle_size = to_find.data_size;
+    if (end_byte > str.data_size) {
+        end_byte = str.data_size;
+    }
+    if (end_byte < needle_size) {
+        return UTF_NOT_FOUND;
+    }
+    if (needle_size == 0) {
+        return end_byte;
+    }
+
+    const unsigned char* hay = (const unsigned char*)str.data;
+    const unsigned char* needle = (const unsigned char*)to_find.data;
+    size_t pos = end_byte - needle_size;
+
+    if (needle_size < UTF_FIND_HORSPOOL_MIN_SIZE) {
+        while (true) {
+            if (hay[pos] == needle[0] && memcmp(hay + pos + 1, needle + 1, needle_size - 1) == 0) {
+                return pos;
+            }
+            if (pos == 0) {
+                return UTF_NOT_FOUND;
+            }
+            pos--;
+        }
     }
 
-    size_t byte_offset = 0;
+    //same as above but window moves backwards
+    //so shift is based on the byte under the first needle byte
+    size_t shift[256];
+    for (size_t i = 0; i < 256; i++) {
+        shift[i] = needle_size;
+    }
+    for (size_t i = needle_size - 1; i > 0; i--) {
+        shift[needle[i]] = i;
+    }
 
-    while (byte_offset + to_find.data_size <= str.data_size) {
-        UTFStringView sub = {.data = str.data + byte_offset, .data_size = to_find.data_size};
-        if (utf_sv_cmp(sub, to_find)) {
-            return utf_sv_byte_to_count(str, byte_offset);
+    while (true) {
+        unsigned char c = hay[pos];
+        if (c == needle[0] && memcmp(hay + pos + 1, needle + 1, needle_size - 1) == 0) {
+            return pos;
         }
-        byte_offset++;
+        if (pos < shift[c]) {
+            return UTF_NOT_FOUND;
+        }
+        pos -= shift[c];
     }
-    return -1;
 }
 
-int utf_sv_find_last(UTFStringView str, UTFStringView to_find) {
-    if (str.data_size < to_find.data_size) {
+size_t utf_sv_find_bytes(UTFStringView str, UTFStringView to_find)
+{
+    return utf_sv_find_right_from_bytes(str, to_find, 0);
+}
+
+size_t utf_sv_find_last_bytes(UTFStringView str, UTFStringView to_find)
+{
+    return utf_sv_find_left_from_bytes(str, to_find, str.data_size);
+}
+
+int utf_sv_find(UTFStringView str, UTFStringView to_find)
+{
+    size_t found_byte = utf_sv_find_bytes(str, to_find);
+    if (found_byte == UTF_NOT_FOUND) {
         return -1;
     }
+    return utf_sv_byte_to_count(str, found_byte);
+}
 
-    int byte_offset = str.data_size - to_find.data_size;
-
-    while (byte_offset >= 0) {
-        UTFStringView sub = { .data = str.data + byte_offset, .data_size = to_find.data_size };
-        if (utf_sv_cmp(sub, to_find)) {
-            return utf_sv_byte_to_count(str, byte_offset);
-        }
-        byte_offset--;
+int utf_sv_find_last(UTFStringView str, UTFStringView to_find) {
+    size_t found_byte = utf_sv_find_last_bytes(str, to_find);
+    if (found_byte == UTF_NOT_FOUND) {
+        return -1;
     }
-    return -1;
+    return utf_sv_byte_to_count(str, found_byte);
 }
 
 int utf_sv_find_left_from(UTFStringView str, UTFStringView to_find, size_t from)
 {
-    UTFStringView sub = utf_sv_sub_sv(str, 0, from);
-    return utf_sv_find_last(sub, to_find);
+    size_t from_byte = utf_sv_count_to_byte(str, from);
+    size_t found_byte = utf_sv_find_left_from_bytes(str, to_find, from_byte);
+    if (found_byte == UTF_NOT_FOUND) {
+        return -1;
+    }
+    return utf_sv_byte_to_count(str, found_byte);
 }
 
 int utf_sv_find_right_from(UTFStringView str, UTFStringView to_find, size_t from)
 {
-    UTFStringView sub = utf_sv_sub_sv(str, from, str.count);
-    int found_at = utf_sv_find(sub, to_find);
-    if(found_at < 0){
+    if (from > str.count) {
+        return -1;
+    }
+    size_t from_byte = utf_sv_count_to_byte(str, from);
+    size_t found_byte = utf_sv_find_right_from_bytes(str, to_find, from_byte);
+    if (found_byte == UTF_NOT_FOUND) {
         return -1;
     }
-    return found_at + from;
+    //only count characters between from and the match
+    UTFStringView skipped = {.data = str.data + from_byte, .data_size = found_byte - from_byte};
+    return from + utf_sv_count(skipped);
 }
 
 bool utf_sv_starts_with(UTFStringView sv, UTFStringView with)
 {
-    return (utf_sv_find(sv, with) == 0);
+    if (sv.data_size < with.data_size) {
+        return false;
+    }
+    return memcmp(sv.data, with.data, with.data_size) == 0;
 }
 
 bool utf_sv_ends_with(UTFStringView sv, UTFStringView with)
 {
-    return (utf_sv_find_last(sv, with) == (int)(sv.count - with.count));
+    if (sv.data_size < with.data_size) {
+        return false;
+    }
+    return memcmp(sv.data + sv.data_size - with.data_size, with.data, with.data_size) == 0;
 }
 
 void utf_sv_fprint(UTFStringView sv, FILE* file)
@@ -1150,6 +1813,106 @@ static bool utf32_strcmp(uint32_t* str1, uint32_t* str2) {
     return true;
 }
 
+void utf_validation_benchmark()
+{
+    const UTFValidationLevel levels[] = {UTF_VALIDATION_OFF, UTF_VALIDATION_SAMPLED, UTF_VALIDATION_FULL};
+    const char* level_names[] = {"off", "sampled", "full"};
+    const size_t iterations = 2000;
+
+    UTFValidationLevel prev_level = utf_get_validation_level();
+    UTFValidationStats prev_stats = utf_get_validation_stats();
+
+    //long non ascii line
+    UTFString* line = utf_from_cstr(u8"");
+    utf_set_validation_level(UTF_VALIDATION_OFF);
+    for (size_t i = 0; i < 64 * 1024; i++) {
+        utf_append_cstr(line, u8"가a");
+    }
+
+    printf("utf validation benchmark, %zu bytes line, %zu iterations\n", line->data_size, iterations);
+
+    for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+        utf_set_validation_level(levels[l]);
+        utf_reset_validation_stats();
+
+        clock_t start = clock();
+        for (size_t i = 0; i < iterations; i++) {
+            size_t middle = line->count / 2;
+            utf_insert_cstr(line, middle, u8"x");
+            utf_erase_range(line, middle, middle + 1);
+            UTFStringView sv = utf_sv_sub_str(line, middle, middle + 16);
+            sv = utf_sv_trim_left(sv, 1);
+        }
+        clock_t end = clock();
+
+        double us_per_iteration = (double)(end - start) / CLOCKS_PER_SEC * 1000000.0 / iterations;
+        UTFValidationStats stats = utf_get_validation_stats();
+        printf("%-8s : %10.2f us/iteration (checked %zu, skipped %zu, violations %zu)\n",
+            level_names[l], us_per_iteration, stats.checked, stats.skipped, stats.violations);
+    }
+
+    utf_destroy(line);
+
+    utf_set_validation_level(prev_level);
+    validation_stats = prev_stats;
+}
+
+void utf_iter_benchmark()
+{
+    //long non ascii line
+    UTFString* line = utf_from_cstr(u8"");
+    for (size_t i = 0; i < 4 * 1024; i++) {
+        utf_append_cstr(line, u8"가a😀");
+    }
+    UTFStringView sv = utf_sv_from_str(line);
+
+    printf("utf iterator benchmark, %zu characters line\n", sv.count);
+
+    //how the code used to walk a line, a character sliced out at a time
+    clock_t start = clock();
+    uint32_t sliced_sum = 0;
+    for (size_t i = 0; i < sv.count; i++) {
+        UTFStringView character = utf_sv_sub_sv(sv, i, i + 1);
+        uint32_t codepoint = 0;
+        size_t size = 1;
+        utf8_to_32(character.data, character.data_size, &codepoint, &size);
+        sliced_sum += codepoint;
+    }
+    double sliced_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    const size_t iterations = 1000;
+    start = clock();
+    uint32_t iter_sum = 0;
+    for (size_t i = 0; i < iterations; i++) {
+        iter_sum = 0;
+        UTFIterator it = utf_iter_begin(sv);
+        UTFChar c;
+        while (utf_iter_next(&it, &c)) {
+            iter_sum += c.codepoint;
+        }
+    }
+    double iter_time = (double)(clock() - start) / CLOCKS_PER_SEC / iterations;
+
+    start = clock();
+    uint32_t back_sum = 0;
+    for (size_t i = 0; i < iterations; i++) {
+        back_sum = 0;
+        UTFIterator it = utf_iter_end(sv);
+        UTFChar c;
+        while (utf_iter_prev(&it, &c)) {
+            back_sum += c.codepoint;
+        }
+    }
+    double back_time = (double)(clock() - start) / CLOCKS_PER_SEC / iterations;
+
+    assert(sliced_sum == iter_sum && iter_sum == back_sum);
+    printf("sliced    : %10.3f ms\n", sliced_time * 1000.0);
+    printf("forward   : %10.3f ms\n", iter_time * 1000.0);
+    printf("backward  : %10.3f ms\n", back_time * 1000.0);
+
+    utf_destroy(line);
+}
+
 bool utf_test()
 {
     {
@@ -1214,6 +1977,35 @@ bool utf_test()
         assert(str.count == 0);
     }
 
+    {
+        ////////////////////////////////
+        // find test
+        ////////////////////////////////
+        UTFStringView sv = utf_sv_from_cstr(u8"고양이 cat 고양이 cat, a long needle 고양이");
+
+        assert(utf_sv_find(sv, utf_sv_from_cstr(u8"cat")) == 4);
+        assert(utf_sv_find_last(sv, utf_sv_from_cstr(u8"cat")) == 12);
+        assert(utf_sv_find(sv, utf_sv_from_cstr(u8"양이")) == 1);
+        assert(utf_sv_find_last(sv, utf_sv_from_cstr(u8"양이")) == 32);
+        assert(utf_sv_find_right_from(sv, utf_sv_from_cstr(u8"cat"), 5) == 12);
+        assert(utf_sv_find_left_from(sv, utf_sv_from_cstr(u8"cat"), 14) == 4);
+        assert(utf_sv_find_left_from(sv, utf_sv_from_cstr(u8"cat"), 15) == 12);
+
+        //long needles
+        assert(utf_sv_find(sv, utf_sv_from_cstr(u8"a long needle 고양")) == 17);
+        assert(utf_sv_find_last(sv, utf_sv_from_cstr(u8"고양이 cat, a long")) == 8);
+        assert(utf_sv_find(sv, utf_sv_from_cstr(u8"a long needle 고양이!")) < 0);
+        assert(utf_sv_find_last(sv, utf_sv_from_cstr(u8"!고양이 cat, a long")) < 0);
+
+        assert(utf_sv_find_bytes(sv, utf_sv_from_cstr(u8"cat")) == 10);
+        assert(utf_sv_find_right_from_bytes(sv, utf_sv_from_cstr(u8"cat"), 11) == 24);
+        assert(utf_sv_find_last_bytes(sv, utf_sv_from_cstr(u8"dog")) == UTF_NOT_FOUND);
+
+        assert(utf_sv_starts_with(sv, utf_sv_from_cstr(u8"고양이 ")));
+        assert(!utf_sv_starts_with(sv, utf_sv_from_cstr(u8"cat")));
+        assert(utf_sv_ends_with(sv, utf_sv_from_cstr(u8"needle 고양이")));
+        assert(!utf_sv_ends_with(sv, utf_sv_from_cstr(u8"cat")));
+    }
     {
         UTFStringView sv = utf_sv_from_cstr(u8"Long Text");
         assert(utf_sv_find(sv, utf_sv_from_cstr(u8"does not exist")) < 0);
@@ -1340,13 +2132,175 @@ bool utf_test()
         utf16_to_8(str, (sizeof(str) / sizeof(uint16_t)), utf8_vec, &utf8_vec_size);
         assert(strcmp(utf8_vec, u8"a߿일😀") == 0);
     }
+    {
+        ////////////////////////////////
+        // byte offset functions test
+        ////////////////////////////////
+        UTFString* str = utf_from_cstr(u8"고양이");
+        //"고" is 3 bytes
+        utf_insert_sv_at_byte(str, 3, utf_sv_from_cstr(u8"a"));
+        assert(utf_sv_cmp(utf_sv_from_str(str), utf_sv_from_cstr(u8"고a양이")));
+        assert(str->count == 4);
+        utf_insert_sv_at_byte(str, str->data_size, utf_sv_from_cstr(u8"!"));
+        assert(utf_sv_cmp(utf_sv_from_str(str), utf_sv_from_cstr(u8"고a양이!")));
+
+        UTFStringView sub = utf_sv_sub_str_bytes(str, 3, 7);
+        assert(utf_sv_cmp(sub, utf_sv_from_cstr(u8"a양")));
+        assert(sub.count == 2);
+
+        UTFStringView trimmed = utf_sv_trim_left_bytes(utf_sv_from_str(str), 4);
+        assert(utf_sv_cmp(trimmed, utf_sv_from_cstr(u8"양이!")));
+        assert(trimmed.count == 3);
+        trimmed = utf_sv_trim_right_bytes(trimmed, 1);
+        assert(utf_sv_cmp(trimmed, utf_sv_from_cstr(u8"양이")));
+        assert(trimmed.count == 2);
+
+        utf_erase_byte_range(str, 3, 7);
+        assert(utf_sv_cmp(utf_sv_from_str(str), utf_sv_from_cstr(u8"고이!")));
+        assert(str->count == 3);
+        utf_erase_byte_range(str, 0, str->data_size);
+        assert(str->count == 0 && str->data_size == 0);
+        utf_destroy(str);
+    }
+    {
+        ////////////////////////////////
+        // validation level test
+        ////////////////////////////////
+        UTFValidationLevel prev_level = utf_get_validation_level();
+        UTFValidationStats prev_stats = utf_get_validation_stats();
+
+        UTFStringView sv = utf_sv_from_cstr(u8"고양이abc");
+
+        utf_set_validation_level(UTF_VALIDATION_FULL);
+        utf_reset_validation_stats();
+        utf_sv_trim_left(sv, 1);
+        utf_sv_trim_right(sv, 1);
+        assert(utf_get_validation_stats().checked == 2);
+
+        utf_set_validation_level(UTF_VALIDATION_OFF);
+        utf_reset_validation_stats();
+        utf_sv_trim_left(sv, 1);
+        assert(utf_get_validation_stats().checked == 0);
+        assert(utf_get_validation_stats().skipped == 1);
+
+        utf_set_validation_level(UTF_VALIDATION_SAMPLED);
+        utf_reset_validation_stats();
+        for (size_t i = 0; i < UTF_VALIDATION_SAMPLE_RATE * 2; i++) {
+            utf_sv_trim_left(sv, 1);
+        }
+        assert(utf_get_validation_stats().checked == 2);
+        assert(utf_get_validation_stats().violations == 0);
+
+        utf_set_validation_level(prev_level);
+        validation_stats = prev_stats;
+    }
+    {
+        ////////////////////////////////
+        // long string index test
+        ////////////////////////////////
+        UTFString* str = utf_from_cstr(u8"");
+        for (size_t i = 0; i < 3000; i++) {
+            utf_append_cstr(str, u8"가a");
+        }
+        //index is built on first lookup
+        assert(utf_count_to_byte(str, 4001) == 2000 * 4 + 3);
+        assert(str->index != NULL);
+        assert(utf_byte_to_count(str, 2000 * 4 + 3) == 4001);
+
+        utf_insert_cstr(str, 10, u8"😀😀");
+        utf_insert_sv(str, 5000, utf_sv_from_cstr(u8"xyz"));
+        utf_erase_range(str, 100, 2000);
+        utf_erase_left(str, 3);
+        utf_erase_right(str, 7);
+        utf_append_cstr(str, u8"일이삼");
+        assert(utf_is_valid(str));
+
+        UTFStringView sv = utf_sv_from_str(str);
+        for (size_t i = 0; i <= str->count; i += 97) {
+            size_t byte = utf_sv_count_to_byte(sv, i);
+            assert(utf_count_to_byte(str, i) == byte);
+            assert(utf_byte_to_count(str, byte) == i);
+        }
+        utf_destroy(str);
+    }
+    {
+        //ascii only strings don't need index
+        UTFString* str = utf_from_cstr(u8"");
+        for (size_t i = 0; i < 3000; i++) {
+            utf_append_cstr(str, u8"ab");
+        }
+        assert(utf_count_to_byte(str, 4001) == 4001);
+        assert(str->index == NULL);
+        utf_destroy(str);
+    }
     {
         UTFString* str = utf_from_cstr(u8"random string");
         utf_set_cstr(str, u8"고양이");
         assert(utf_sv_cmp(utf_sv_from_str(str), utf_sv_from_cstr(u8"고양이")));
         utf_destroy(str);
     }
+    {
+        //iterator gives the same code points as utf8_to_32, both ways
+        UTFStringView sv = utf_sv_from_cstr(u8"a가\u00e9😀\u0800z");
+        uint32_t expected[6] = {0};
+        size_t expected_count = 6;
+        utf8_to_32(sv.data, sv.data_size, expected, &expected_count);
+
+        UTFIterator it = utf_iter_begin(sv);
+        UTFChar c;
+        size_t i = 0;
+        while (utf_iter_next(&it, &c)) {
+            assert(c.codepoint == expected[i] && c.index == i);
+            assert(c.byte_offset + c.size == it.byte_offset);
+            assert(c.byte_offset == utf_sv_count_to_byte(sv, i));
+            i++;
+        }
+        assert(i == sv.count && it.index == sv.count && it.byte_offset == sv.data_size);
+
+        while (utf_iter_prev(&it, &c)) {
+            i--;
+            assert(c.codepoint == expected[i] && c.index == i && c.byte_offset == it.byte_offset);
+            assert(c.size == utf_sv_next(sv, c.byte_offset) - c.byte_offset);
+        }
+        assert(i == 0 && it.index == 0);
 
+        it = utf_iter_begin(sv);
+        utf_iter_skip(&it, 3);
+        assert(it.index == 3 && it.byte_offset == utf_sv_count_to_byte(sv, 3));
+        utf_iter_skip(&it, 100);
+        assert(it.index == sv.count && it.byte_offset == sv.data_size);
+    }
+    {
+        //every code point survives a round trip, surrogates are not characters
+        for (uint32_t codepoint = 1; codepoint < 0x110000; codepoint += (codepoint < 0x10000 ? 1 : 61)) {
+            if (codepoint >= 0xD800 && codepoint <= 0xDFFF) {
+                continue;
+            }
+            char bytes[4];
+            size_t size = 0;
+            utf32_to_8(&codepoint, 1, NULL, &size);
+            utf32_to_8(&codepoint, 1, bytes, &size);
+            UTFStringView sv = { .data = bytes, .data_size = size, .count = 1 };
+            UTFIterator it = utf_iter_begin(sv);
+            UTFChar c;
+            assert(utf_iter_next(&it, &c) && c.codepoint == codepoint && c.size == size);
+            assert(utf_iter_prev(&it, &c) && c.codepoint == codepoint);
+        }
+    }
+    {
+        //overlong, surrogate, too large, truncated and stray continuation bytes
+        const char* invalid[] = {"\xC0\x80", "\xE0\x80\x80", "\xED\xA0\x80", "\xF4\x90\x80\x80", "\xE4\xB8", "a\x80", "\xF5\x80"};
+        for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+            UTFStringView sv = utf_sv_from_cstr(invalid[i]);
+            assert(sv.count == 1);
+            UTFIterator it = utf_iter_begin(sv);
+            UTFChar c;
+            assert(utf_iter_next(&it, &c));
+            assert(c.codepoint == UTF_REPLACEMENT_CHAR && c.size == sv.data_size);
+            assert(!utf_iter_next(&it, &c));
+            assert(utf_iter_prev(&it, &c) && c.codepoint == UTF_REPLACEMENT_CHAR);
+        }
+    }
 
     return true;
 }
@@ -18,11 +18,26 @@ void utf32_to_16(const uint32_t* char_array, size_t array_size, uint16_t* ret_ar
 void utf8_to_16(const char* char_array, size_t array_size, uint16_t* ret_array, size_t* ret_array_size);
 void utf16_to_8(const uint16_t* char_array, size_t array_size, char* ret_array, size_t* ret_array_size);
 
+//checkpoint in UTFString index
+//count is the number of characters before byte
+typedef struct UTFIndexEntry {
+    size_t byte;
+    size_t count;
+}UTFIndexEntry;
+
 typedef struct UTFString {
     char* data;
     size_t raw_size;
     size_t data_size; //does not include null terminated character
     size_t count;
+
+    //optional index for long strings so that we don't have to scan
+    //the whole string to convert character index to byte offset
+    //it's built on first lookup and kept up to date by functions that modify the string
+    //NULL when it's not built
+    UTFIndexEntry* index;
+    size_t index_size;
+    size_t index_capacity;
 }UTFString;
 
 typedef struct UTFStringView {
@@ -67,6 +82,13 @@ void utf_erase_range(UTFString* str, size_t from, size_t to);
 void utf_erase_right(UTFString* str, size_t how_many);
 void utf_erase_left(UTFString* str, size_t how_many);
 
+//byte offset versions of above functions
+//these don't have to convert character index to byte offset
+//so they don't scan the string from the beginning
+//byte offsets must be on character boundary
+void utf_insert_sv_at_byte(UTFString* str, size_t at_byte, UTFStringView to_insert);
+void utf_erase_byte_range(UTFString* str, size_t from_byte, size_t to_byte);
+
 
 
 size_t utf_sv_count_to_byte(UTFStringView sv, size_t index);
@@ -85,9 +107,46 @@ size_t utf_sv_count_right_from(UTFStringView sv, size_t from);
 size_t utf_sv_next(UTFStringView sv, size_t pos);
 size_t utf_sv_prev(UTFStringView sv, size_t pos);
 
+//iterating over code points without allocating or slicing the string
+//a character is a lead byte and the continuation bytes after it (same as utf_sv_next and counting),
+//if they are not one valid sequence its codepoint is UTF_REPLACEMENT_CHAR
+#define UTF_REPLACEMENT_CHAR 0xFFFD
+
+typedef struct UTFChar {
+    uint32_t codepoint;
+    size_t byte_offset; //where the character starts
+    size_t size;        //how many bytes it takes
+    size_t index;       //character index
+}UTFChar;
+
+typedef struct UTFIterator {
+    UTFStringView sv;
+    size_t byte_offset; //always between characters
+    size_t index;       //characters before byte_offset
+}UTFIterator;
+
+//byte_offset must be on character boundary and index is how many characters are before it
+UTFIterator utf_iter_at(UTFStringView sv, size_t byte_offset, size_t index);
+UTFIterator utf_iter_begin(UTFStringView sv);
+//uses sv.count for the index
+UTFIterator utf_iter_end(UTFStringView sv);
+//decodes the character after the iterator and moves over it, false at the end
+bool utf_iter_next(UTFIterator* it, UTFChar* c);
+//moves back over the character before the iterator and decodes it, false at the start
+bool utf_iter_prev(UTFIterator* it, UTFChar* c);
+//moves over how_many characters without decoding them, stops at the end
+void utf_iter_skip(UTFIterator* it, size_t how_many);
+
 UTFStringView utf_sv_trim_left(UTFStringView sv, size_t how_many);
 UTFStringView utf_sv_trim_right(UTFStringView sv, size_t how_many);
 
+//byte offset versions of above functions
+//byte offsets must be on character boundary
+UTFStringView utf_sv_sub_str_bytes(UTFString* str, size_t from_byte, size_t to_byte);
+UTFStringView utf_sv_sub_sv_bytes(UTFStringView sv, size_t from_byte, size_t to_byte);
+UTFStringView utf_sv_trim_left_bytes(UTFStringView sv, size_t how_many_bytes);
+UTFStringView utf_sv_trim_right_bytes(UTFStringView sv, size_t how_many_bytes);
+
 bool utf_sv_cmp(UTFStringView str1, UTFStringView str2);
 
 int utf_sv_find(UTFStringView str, UTFStringView to_find);
@@ -95,12 +154,58 @@ int utf_sv_find_last(UTFStringView str, UTFStringView to_find);
 int utf_sv_find_left_from(UTFStringView str, UTFStringView to_find, size_t from);
 int utf_sv_find_right_from(UTFStringView str, UTFStringView to_find, size_t from);
 
+//byte offset versions of find functions
+//they return byte offset of the match or UTF_NOT_FOUND
+//and don't count characters at all
+#define UTF_NOT_FOUND ((size_t)-1)
+size_t utf_sv_find_bytes(UTFStringView str, UTFStringView to_find);
+size_t utf_sv_find_last_bytes(UTFStringView str, UTFStringView to_find);
+//match has to end before end_byte
+size_t utf_sv_find_left_from_bytes(UTFStringView str, UTFStringView to_find, size_t end_byte);
+size_t utf_sv_find_right_from_bytes(UTFStringView str, UTFStringView to_find, size_t from_byte);
+
 bool utf_sv_starts_with(UTFStringView sv, UTFStringView with);
 bool utf_sv_ends_with(UTFStringView sv, UTFStringView with);
 
 void utf_sv_fprint(UTFStringView sv, FILE* file);
 void utf_sv_fprintln(UTFStringView sv, FILE* file);
 
+//validation
+//checks that cached character count matches the data (and that index is up to date)
+//these always do the full check, it's O(n)
+bool utf_is_valid(UTFString* str);
+bool utf_sv_is_valid(UTFStringView sv);
+
+//functions that create or modify strings validate them at this level
+typedef enum UTFValidationLevel {
+    UTF_VALIDATION_OFF,
+    UTF_VALIDATION_SAMPLED, //validate only some of the calls
+    UTF_VALIDATION_FULL,    //validate every call, makes every operation O(n)
+}UTFValidationLevel;
+
+typedef struct UTFValidationStats {
+    size_t checked;
+    size_t skipped;
+    size_t violations;
+}UTFValidationStats;
+
+void utf_set_validation_level(UTFValidationLevel level);
+UTFValidationLevel utf_get_validation_level();
+
+//sets level from KEWL_UTF_VALIDATION environment variable (off, sampled or full)
+//does nothing when it's not set
+void utf_validation_init_from_env();
+
+//stats are counted by each thread, these get and reset the calling thread's
+UTFValidationStats utf_get_validation_stats();
+void utf_reset_validation_stats();
+
+//prints how much each validation level costs
+void utf_validation_benchmark();
+
+//compares walking a string with the iterator to slicing it a character at a time
+void utf_iter_benchmark();
+
 bool utf_test();
 
 #endif
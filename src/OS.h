@@ -130,6 +130,10 @@ typedef enum
     OS_KEY_ESC,
     OS_KEY_TAB,
     OS_KEY_BACKSPACE,
+    OS_KEY_PAGE_UP,
+    OS_KEY_PAGE_DOWN,
+    OS_KEY_HOME,
+    OS_KEY_END,
 }OS_KeySym;
 
 typedef struct
@@ -162,6 +166,9 @@ typedef struct
 typedef struct
 {
     UTFStringView paste_sv;
+    //big paste comes in pieces a frame at a time, every piece but the last one sets this
+    //(last piece can be empty when the transfer ends after the text that came so far is in)
+    bool more_to_come;
 } OS_TextPasteEvent;
 
 typedef struct
@@ -186,5 +193,112 @@ void os_set_ime_preedit_pos(int x, int y);
 OS_Keymod os_get_mod_state();
 void os_request_text_paste();
 void os_set_clipboard_text(UTFStringView sv);
+//take clipboard ownership for text box's clipboard snapshot
+void os_claim_clipboard();
+
+//////////////////////////
+//Thread Stuff
+//////////////////////////
+
+typedef struct OS_Thread OS_Thread;
+typedef struct OS_Mutex OS_Mutex;
+
+typedef void (*OS_ThreadFunction)(void* data);
+
+//returns NULL if thread couldn't be created
+OS_Thread* os_thread_create(OS_ThreadFunction function, void* data);
+//waits for the thread to finish and frees it
+void os_thread_join(OS_Thread* thread);
+
+OS_Mutex* os_mutex_create();
+void os_mutex_destroy(OS_Mutex* mutex);
+void os_mutex_lock(OS_Mutex* mutex);
+void os_mutex_unlock(OS_Mutex* mutex);
+
+size_t os_get_processor_count();
+
+//seconds from some point in the past, only good for measuring time between two calls
+double os_get_time();
+//lets other threads run for about that many seconds
+void os_sleep(double seconds);
+
+//////////////////////////
+//File Stuff
+//////////////////////////
+
+// Read only view of a whole file
+//
+// Pages are read from the disk when they are first touched,
+// so mapping a file costs the same no matter how big it is.
+// File shouldn't be truncated by someone else while it is mapped
+typedef struct OS_FileMapping OS_FileMapping;
+
+//returns NULL if the file couldn't be opened
+OS_FileMapping* os_map_file(const char* path);
+void os_unmap_file(OS_FileMapping* mapping);
+
+//data is NULL for an empty file
+const char* os_file_mapping_data(OS_FileMapping* mapping);
+size_t os_file_mapping_size(OS_FileMapping* mapping);
+
+// Writes a file that replaces the target only once it's completely written
+//
+// Data goes to a temporary file next to the target.
+// On commit it's flushed to the disk and renamed over the target,
+// so the target is either the old file or the whole new one, never half of it
+typedef struct OS_FileWriter OS_FileWriter;
+
+typedef struct OS_WriteBuffer {
+    const void* data;
+    size_t size;
+} OS_WriteBuffer;
+
+//returns NULL if the temporary file couldn't be created
+OS_FileWriter* os_file_writer_create(const char* path);
+//writes buffers in order with as few calls as it can, returns false if it failed
+bool os_file_writer_write(OS_FileWriter* writer, const OS_WriteBuffer* buffers, size_t count);
+//returns false if the target couldn't be replaced, writer is freed either way
+bool os_file_writer_commit(OS_FileWriter* writer);
+//removes the temporary file and frees the writer
+void os_file_writer_abort(OS_FileWriter* writer);
+
+// File that is only written at the end
+//
+// Writes only reach the OS, they are on the disk once the file is synced
+typedef struct OS_AppendFile OS_AppendFile;
+
+//file is created if it doesn't exist, returns NULL if it couldn't be opened
+OS_AppendFile* os_append_file_open(const char* path);
+void os_append_file_close(OS_AppendFile* file);
+//returns false if it couldn't write all of it
+bool os_append_file_write(OS_AppendFile* file, const void* data, size_t size);
+//returns false if what was written couldn't be flushed to the disk
+bool os_append_file_sync(OS_AppendFile* file);
+
+// Reads what is written to the end of a file while it grows
+//
+// File is only read after the OS says it changed, so following a file
+// that doesn't change costs nothing but a check
+typedef struct OS_FileFollower OS_FileFollower;
+
+//reading starts at offset, returns NULL if the file couldn't be opened or watched
+OS_FileFollower* os_file_follower_create(const char* path, size_t offset);
+void os_file_follower_destroy(OS_FileFollower* follower);
+//reads at most buffer_size bytes that were added since the last read, doesn't wait
+//returns how many bytes it read, 0 if nothing was added
+size_t os_file_follower_read(OS_FileFollower* follower, char* buffer, size_t buffer_size);
+
+// When a file was last written and how big it is, to tell if someone else changed it
+typedef struct OS_FileStamp {
+    uint64_t modified_time;
+    uint64_t size;
+} OS_FileStamp;
+
+//returns false if the file couldn't be checked
+bool os_get_file_stamp(const char* path, OS_FileStamp* stamp);
+
+//creates an empty file with a unique name in the system's temporary directory
+//and writes its path to path, returns false if it couldn't be created
+bool os_create_temp_file(const char* prefix, char* path, size_t path_size);
 
 #endif
@@ -0,0 +1,1812 @@
+#include "Regex.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+#include <time.h>
+
+//limits so that a pattern can't make us allocate forever
+#define REGEX_MAX_REPEAT 1000
+#define REGEX_MAX_NFA_STATES (64 * 1024)
+#define REGEX_MAX_NESTING 256
+
+//DFA cache is thrown away and built again when it gets this big
+//must be less than half of REGEX_DFA_TABLE_SIZE
+#define REGEX_MAX_DFA_STATES 4096
+#define REGEX_DFA_TABLE_SIZE (REGEX_MAX_DFA_STATES * 2)
+
+#define REGEX_CACHE_SIZE 8
+
+#define REGEX_MAX_CODEPOINT 0x10FFFF
+
+////////////////////////////////
+// Syntax tree
+////////////////////////////////
+
+typedef struct RegexRange {
+    uint32_t lo;
+    uint32_t hi;
+} RegexRange;
+
+typedef enum RegexNodeType {
+    REGEX_NODE_EMPTY,
+    REGEX_NODE_CLASS,
+    REGEX_NODE_CONCAT,
+    REGEX_NODE_ALTERNATE,
+    REGEX_NODE_REPEAT,
+    REGEX_NODE_LINE_START,
+    REGEX_NODE_LINE_END,
+} RegexNodeType;
+
+typedef struct RegexNode {
+    RegexNodeType type;
+
+    //codepoint ranges of class
+    RegexRange* ranges;
+    size_t range_count;
+    size_t range_capacity;
+
+    //children of concat and alternate, repeat has one
+    struct RegexNode** children;
+    size_t child_count;
+    size_t child_capacity;
+
+    //max is -1 if there is no limit
+    int min;
+    int max;
+} RegexNode;
+
+typedef struct RegexParser {
+    uint32_t* chars;
+    size_t count;
+    size_t pos;
+
+    bool ignore_case;
+    size_t nesting;
+
+    //every node is kept here so that they can be freed at once
+    RegexNode** nodes;
+    size_t node_count;
+    size_t node_capacity;
+
+    const char* error;
+} RegexParser;
+
+////////////////////////////////
+// NFA
+////////////////////////////////
+
+typedef enum RegexStateType {
+    REGEX_STATE_MATCH,
+    //consumes a byte in [lo, hi]
+    REGEX_STATE_BYTE,
+    REGEX_STATE_SPLIT,
+    REGEX_STATE_EMPTY,
+    //begin and end are in the direction NFA reads the input
+    //so for the reversed NFA, begin is the end of the line
+    REGEX_STATE_AT_BEGIN,
+    REGEX_STATE_AT_END,
+} RegexStateType;
+
+typedef struct RegexState {
+    uint8_t type;
+    uint8_t lo;
+    uint8_t hi;
+    int32_t out;
+    int32_t out1;
+} RegexState;
+
+typedef struct RegexNFA {
+    RegexState* states;
+    size_t count;
+    size_t capacity;
+    int32_t start;
+} RegexNFA;
+
+struct Regex {
+    UTFString* pattern;
+
+    RegexNFA forward;
+    //reads the input backwards, used to find where matches start
+    RegexNFA reverse;
+
+    //bytes that no state tells apart share a class
+    //so DFA transition tables only need class_count entries
+    uint8_t byte_classes[256];
+    //a byte of each class
+    uint8_t class_bytes[256];
+    size_t class_count;
+
+    //if every match starts with this byte, memchr skips to it while no match is in progress
+    //-1 if there is no such byte
+    int first_byte;
+
+    size_t ref_count;
+    uint64_t last_used;
+};
+
+////////////////////////////////
+// Lazy DFA
+////////////////////////////////
+
+typedef struct RegexDFAState {
+    //NFA states in sets
+    size_t set_start;
+    size_t set_count;
+
+    uint32_t hash;
+    bool at_begin;
+
+    bool is_match;
+    bool is_dead;
+    //-1 if not known yet
+    int8_t is_match_at_end;
+} RegexDFAState;
+
+typedef struct RegexDFA {
+    Regex* regex;
+    RegexNFA* nfa;
+
+    //NFA start state is added after every byte so a match can start anywhere
+    bool is_unanchored;
+
+    RegexDFAState* states;
+    size_t state_count;
+    size_t state_capacity;
+
+    int32_t* sets;
+    size_t sets_size;
+    size_t sets_capacity;
+
+    //next state for each state and byte class, -1 if not built yet
+    int32_t* transitions;
+
+    //open addressing hash table of state ids, -1 is empty
+    int32_t* table;
+
+    //index is at_begin
+    int32_t start_states[2];
+
+    size_t flush_count;
+
+    //for building states
+    int32_t* stack;
+    int32_t* set;
+    size_t set_count;
+    uint32_t* marks;
+    uint32_t mark;
+} RegexDFA;
+
+struct RegexMatcher {
+    Regex* regex;
+
+    //tells if there is any match
+    RegexDFA forward_search;
+    //finds where a match ends
+    RegexDFA forward_longest;
+    //finds where matches start
+    RegexDFA reverse_search;
+
+    //bit for each byte position where a match starts
+    uint8_t* starts;
+    size_t starts_capacity;
+};
+
+////////////////////////////////
+// Parser
+////////////////////////////////
+
+static RegexNode* parser_new_node(RegexParser* parser, RegexNodeType type)
+{
+    if (parser->node_count >= parser->node_capacity) {
+        parser->node_capacity = parser->node_capacity ? parser->node_capacity * 2 : 16;
+        parser->nodes = realloc(parser->nodes, parser->node_capacity * sizeof(RegexNode*));
+    }
+
+    RegexNode* node = calloc(1, sizeof(RegexNode));
+    node->type = type;
+    parser->nodes[parser->node_count++] = node;
+    return node;
+}
+
+static void node_add_child(RegexNode* node, RegexNode* child)
+{
+    if (node->child_count >= node->child_capacity) {
+        node->child_capacity = node->child_capacity ? node->child_capacity * 2 : 4;
+        node->children = realloc(node->children, node->child_capacity * sizeof(RegexNode*));
+    }
+    node->children[node->child_count++] = child;
+}
+
+static void class_add_range(RegexNode* node, uint32_t lo, uint32_t hi)
+{
+    if (node->range_count >= node->range_capacity) {
+        node->range_capacity = node->range_capacity ? node->range_capacity * 2 : 4;
+        node->ranges = realloc(node->ranges, node->range_capacity * sizeof(RegexRange));
+    }
+    node->ranges[node->range_count++] = (RegexRange){ .lo = lo, .hi = hi };
+}
+
+static int compare_ranges(const void* a, const void* b)
+{
+    uint32_t lo_a = ((const RegexRange*)a)->lo;
+    uint32_t lo_b = ((const RegexRange*)b)->lo;
+    return (lo_a > lo_b) - (lo_a < lo_b);
+}
+
+//sorts ranges and merges overlapping ones
+static void class_normalize(RegexNode* node)
+{
+    if (node->range_count == 0) {
+        return;
+    }
+
+    qsort(node->ranges, node->range_count, sizeof(RegexRange), compare_ranges);
+
+    size_t merged = 0;
+    for (size_t i = 1; i < node->range_count; i++) {
+        RegexRange* last = &node->ranges[merged];
+        RegexRange range = node->ranges[i];
+        if (range.lo <= last->hi + 1) {
+            if (range.hi > last->hi) {
+                last->hi = range.hi;
+            }
+        }
+        else {
+            node->ranges[++merged] = range;
+        }
+    }
+    node->range_count = merged + 1;
+}
+
+//adds every valid codepoint that is not in ranges
+//ranges have to be normalized
+static void class_add_complement(RegexNode* node, const RegexRange* ranges, size_t range_count)
+{
+    //surrogates are not valid in UTF-8
+    const RegexRange valid[] = { { 0, 0xD7FF }, { 0xE000, REGEX_MAX_CODEPOINT } };
+
+    for (size_t v = 0; v < 2; v++) {
+        uint32_t next = valid[v].lo;
+        for (size_t i = 0; i < range_count && next <= valid[v].hi; i++) {
+            if (ranges[i].hi < next || ranges[i].lo > valid[v].hi) {
+                continue;
+            }
+            if (ranges[i].lo > next) {
+                class_add_range(node, next, ranges[i].lo - 1);
+            }
+            next = ranges[i].hi + 1;
+        }
+        if (next <= valid[v].hi) {
+            class_add_range(node, next, valid[v].hi);
+        }
+    }
+}
+
+static void class_negate(RegexNode* node)
+{
+    class_normalize(node);
+
+    RegexRange* ranges = node->ranges;
+    size_t range_count = node->range_count;
+
+    node->ranges = NULL;
+    node->range_count = 0;
+    node->range_capacity = 0;
+    class_add_complement(node, ranges, range_count);
+
+    free(ranges);
+}
+
+//adds the other case of ASCII letters
+static void class_fold_case(RegexNode* node)
+{
+    size_t range_count = node->range_count;
+    for (size_t i = 0; i < range_count; i++) {
+        RegexRange range = node->ranges[i];
+
+        uint32_t lo = range.lo > 'a' ? range.lo : 'a';
+        uint32_t hi = range.hi < 'z' ? range.hi : 'z';
+        if (lo <= hi) {
+            class_add_range(node, lo - 'a' + 'A', hi - 'a' + 'A');
+        }
+
+        lo = range.lo > 'A' ? range.lo : 'A';
+        hi = range.hi < 'Z' ? range.hi : 'Z';
+        if (lo <= hi) {
+            class_add_range(node, lo - 'A' + 'a', hi - 'A' + 'a');
+        }
+    }
+}
+
+static const RegexRange digit_ranges[] = { { '0', '9' } };
+static const RegexRange word_ranges[] = { { '0', '9' }, { 'A', 'Z' }, { '_', '_' }, { 'a', 'z' } };
+static const RegexRange space_ranges[] = { { '\t', '\r' }, { ' ', ' ' } };
+
+//adds \d \w \s \D \W \S to the class
+//returns false if c is not one of them
+static bool class_add_shorthand(RegexNode* node, uint32_t c)
+{
+    const RegexRange* ranges = NULL;
+    size_t range_count = 0;
+
+    switch (c) {
+        case 'd': case 'D': {
+            ranges = digit_ranges;
+            range_count = sizeof(digit_ranges) / sizeof(digit_ranges[0]);
+        }break;
+        case 'w': case 'W': {
+            ranges = word_ranges;
+            range_count = sizeof(word_ranges) / sizeof(word_ranges[0]);
+        }break;
+        case 's': case 'S': {
+            ranges = space_ranges;
+            range_count = sizeof(space_ranges) / sizeof(space_ranges[0]);
+        }break;
+        default: {
+            return false;
+        }
+    }
+
+    if (c == 'D' || c == 'W' || c == 'S') {
+        class_add_complement(node, ranges, range_count);
+    }
+    else {
+        for (size_t i = 0; i < range_count; i++) {
+            class_add_range(node, ranges[i].lo, ranges[i].hi);
+        }
+    }
+    return true;
+}
+
+static bool parser_at_end(RegexParser* parser)
+{
+    return parser->pos >= parser->count;
+}
+
+static uint32_t parser_peek(RegexParser* parser)
+{
+    return parser->chars[parser->pos];
+}
+
+//parses escaped character after '\'
+static bool parse_escaped_char(RegexParser* parser, uint32_t* c)
+{
+    if (parser_at_end(parser)) {
+        parser->error = "pattern ends with \\";
+        return false;
+    }
+
+    uint32_t escaped = parser->chars[parser->pos++];
+    switch (escaped) {
+        case 't': *c = '\t'; return true;
+        case 'n': *c = '\n'; return true;
+        case 'r': *c = '\r'; return true;
+        case 'f': *c = '\f'; return true;
+        case 'v': *c = '\v'; return true;
+    }
+
+    //letters and digits might mean something in other engines, so don't guess
+    bool is_alnum = (escaped >= '0' && escaped <= '9') ||
+                    (escaped >= 'a' && escaped <= 'z') ||
+                    (escaped >= 'A' && escaped <= 'Z');
+    if (is_alnum) {
+        parser->error = "unsupported escape";
+        return false;
+    }
+
+    *c = escaped;
+    return true;
+}
+
+static RegexNode* parse_bracket_class(RegexParser* parser)
+{
+    //'[' is already consumed
+    RegexNode* node = parser_new_node(parser, REGEX_NODE_CLASS);
+
+    bool negate = false;
+    if (!parser_at_end(parser) && parser_peek(parser) == '^') {
+        negate = true;
+        parser->pos++;
+    }
+
+    bool first = true;
+    while (true) {
+        if (parser_at_end(parser)) {
+            parser->error = "missing ]";
+            return NULL;
+        }
+
+        uint32_t c = parser->chars[parser->pos++];
+        if (c == ']' && !first) {
+            break;
+        }
+        first = false;
+
+        if (c == '\\') {
+            if (!parser_at_end(parser) && class_add_shorthand(node, parser_peek(parser))) {
+                parser->pos++;
+                continue;
+            }
+            if (!parse_escaped_char(parser, &c)) {
+                return NULL;
+            }
+        }
+
+        uint32_t hi = c;
+        bool is_range = parser->pos + 1 < parser->count &&
+                        parser->chars[parser->pos] == '-' &&
+                        parser->chars[parser->pos + 1] != ']';
+        if (is_range) {
+            parser->pos++;
+            hi = parser->chars[parser->pos++];
+            if (hi == '\\' && !parse_escaped_char(parser, &hi)) {
+                return NULL;
+            }
+            if (hi < c) {
+                parser->error = "invalid range in []";
+                return NULL;
+            }
+        }
+
+        class_add_range(node, c, hi);
+    }
+
+    if (parser->ignore_case) {
+        class_fold_case(node);
+    }
+    if (negate) {
+        class_negate(node);
+    }
+    class_normalize(node);
+
+    return node;
+}
+
+static RegexNode* parse_alternate(RegexParser* parser);
+
+static RegexNode* parse_atom(RegexParser* parser)
+{
+    uint32_t c = parser->chars[parser->pos++];
+
+    switch (c) {
+        case '(': {
+            if (parser->nesting >= REGEX_MAX_NESTING) {
+                parser->error = "too many nested groups";
+                return NULL;
+            }
+
+            if (!parser_at_end(parser) && parser_peek(parser) == '?') {
+                if (parser->pos + 1 < parser->count && parser->chars[parser->pos + 1] == ':') {
+                    parser->pos += 2;
+                }
+                else {
+                    parser->error = "unsupported group";
+                    return NULL;
+                }
+            }
+
+            parser->nesting++;
+            RegexNode* node = parse_alternate(parser);
+            parser->nesting--;
+            if (!node) {
+                return NULL;
+            }
+
+            if (parser_at_end(parser) || parser_peek(parser) != ')') {
+                parser->error = "missing )";
+                return NULL;
+            }
+            parser->pos++;
+            return node;
+        }
+        case '[': {
+            return parse_bracket_class(parser);
+        }
+        case '.': {
+            RegexNode* node = parser_new_node(parser, REGEX_NODE_CLASS);
+            const RegexRange newline = { '\n', '\n' };
+            class_add_complement(node, &newline, 1);
+            return node;
+        }
+        case '^': {
+            return parser_new_node(parser, REGEX_NODE_LINE_START);
+        }
+        case '$': {
+            return parser_new_node(parser, REGEX_NODE_LINE_END);
+        }
+        case '*':
+        case '+':
+        case '?': {
+            parser->error = "nothing to repeat";
+            return NULL;
+        }
+        case '\\': {
+            RegexNode* node = parser_new_node(parser, REGEX_NODE_CLASS);
+            if (!parser_at_end(parser) && class_add_shorthand(node, parser_peek(parser))) {
+                parser->pos++;
+                class_normalize(node);
+                return node;
+            }
+            if (!parse_escaped_char(parser, &c)) {
+                return NULL;
+            }
+            class_add_range(node, c, c);
+            if (parser->ignore_case) {
+                class_fold_case(node);
+                class_normalize(node);
+            }
+            return node;
+        }
+        default: {
+            RegexNode* node = parser_new_node(parser, REGEX_NODE_CLASS);
+            class_add_range(node, c, c);
+            if (parser->ignore_case) {
+                class_fold_case(node);
+                class_normalize(node);
+            }
+            return node;
+        }
+    }
+}
+
+static bool parse_number(RegexParser* parser, int* number)
+{
+    size_t start = parser->pos;
+    int value = 0;
+    while (!parser_at_end(parser) && parser_peek(parser) >= '0' && parser_peek(parser) <= '9') {
+        if (value <= REGEX_MAX_REPEAT) {
+            value = value * 10 + (int)(parser_peek(parser) - '0');
+        }
+        parser->pos++;
+    }
+    *number = value;
+    return parser->pos > start;
+}
+
+//parses {n}, {n,} or {n,m}
+//if it is not one of them, '{' is just a character and false is returned
+static bool parse_repeat_count(RegexParser* parser, int* min, int* max)
+{
+    size_t start = parser->pos;
+
+    //skip '{'
+    parser->pos++;
+    if (!parse_number(parser, min)) {
+        parser->pos = start;
+        return false;
+    }
+
+    *max = *min;
+    if (!parser_at_end(parser) && parser_peek(parser) == ',') {
+        parser->pos++;
+        if (!parse_number(parser, max)) {
+            *max = -1;
+        }
+    }
+
+    if (parser_at_end(parser) || parser_peek(parser) != '}') {
+        parser->pos = start;
+        return false;
+    }
+    parser->pos++;
+    return true;
+}
+
+static RegexNode* parse_repeat(RegexParser* parser)
+{
+    RegexNode* node = parse_atom(parser);
+    if (!node) {
+        return NULL;
+    }
+
+    while (!parser_at_end(parser)) {
+        int min = 0;
+        int max = -1;
+
+        uint32_t c = parser_peek(parser);
+        if (c == '*') {
+            parser->pos++;
+        }
+        else if (c == '+') {
+            min = 1;
+            parser->pos++;
+        }
+        else if (c == '?') {
+            max = 1;
+            parser->pos++;
+        }
+        else if (c != '{' || !parse_repeat_count(parser, &min, &max)) {
+            break;
+        }
+
+        if (min > REGEX_MAX_REPEAT || max > REGEX_MAX_REPEAT) {
+            parser->error = "repeat count is too big";
+            return NULL;
+        }
+        if (max != -1 && min > max) {
+            parser->error = "invalid repeat count";
+            return NULL;
+        }
+
+        RegexNode* repeat = parser_new_node(parser, REGEX_NODE_REPEAT);
+        repeat->min = min;
+        repeat->max = max;
+        node_add_child(repeat, node);
+        node = repeat;
+    }
+
+    return node;
+}
+
+static RegexNode* parse_concat(RegexParser* parser)
+{
+    RegexNode* node = parser_new_node(parser, REGEX_NODE_CONCAT);
+
+    while (!parser_at_end(parser) && parser_peek(parser) != '|' && parser_peek(parser) != ')') {
+        RegexNode* child = parse_repeat(parser);
+        if (!child) {
+            return NULL;
+        }
+        node_add_child(node, child);
+    }
+
+    if (node->child_count == 0) {
+        node->type = REGEX_NODE_EMPTY;
+    }
+    else if (node->child_count == 1) {
+        return node->children[0];
+    }
+    return node;
+}
+
+static RegexNode* parse_alternate(RegexParser* parser)
+{
+    RegexNode* first = parse_concat(parser);
+    if (!first || parser_at_end(parser) || parser_peek(parser) != '|') {
+        return first;
+    }
+
+    RegexNode* node = parser_new_node(parser, REGEX_NODE_ALTERNATE);
+    node_add_child(node, first);
+
+    while (!parser_at_end(parser) && parser_peek(parser) == '|') {
+        parser->pos++;
+        RegexNode* child = parse_concat(parser);
+        if (!child) {
+            return NULL;
+        }
+        node_add_child(node, child);
+    }
+
+    return node;
+}
+
+static void parser_destroy(RegexParser* parser)
+{
+    for (size_t i = 0; i < parser->node_count; i++) {
+        free(parser->nodes[i]->ranges);
+        free(parser->nodes[i]->children);
+        free(parser->nodes[i]);
+    }
+    free(parser->nodes);
+    free(parser->chars);
+}
+
+////////////////////////////////
+// Compiler
+////////////////////////////////
+
+typedef struct RegexCompiler {
+    RegexNFA* nfa;
+    bool is_reverse;
+    const char* error;
+} RegexCompiler;
+
+static int32_t nfa_add_state(RegexCompiler* compiler, RegexStateType type, uint8_t lo, uint8_t hi, int32_t out, int32_t out1)
+{
+    RegexNFA* nfa = compiler->nfa;
+    if (nfa->count >= REGEX_MAX_NFA_STATES) {
+        compiler->error = "pattern is too big";
+        return -1;
+    }
+
+    if (nfa->count >= nfa->capacity) {
+        nfa->capacity = nfa->capacity ? nfa->capacity * 2 : 64;
+        nfa->states = realloc(nfa->states, nfa->capacity * sizeof(RegexState));
+    }
+
+    nfa->states[nfa->count] = (RegexState){ .type = type, .lo = lo, .hi = hi, .out = out, .out1 = out1 };
+    return (int32_t)nfa->count++;
+}
+
+static size_t utf8_encode(uint32_t c, uint8_t* bytes)
+{
+    if (c <= 0x7F) {
+        bytes[0] = (uint8_t)c;
+        return 1;
+    }
+    if (c <= 0x7FF) {
+        bytes[0] = (uint8_t)(0xC0 | (c >> 6));
+        bytes[1] = (uint8_t)(0x80 | (c & 0x3F));
+        return 2;
+    }
+    if (c <= 0xFFFF) {
+        bytes[0] = (uint8_t)(0xE0 | (c >> 12));
+        bytes[1] = (uint8_t)(0x80 | ((c >> 6) & 0x3F));
+        bytes[2] = (uint8_t)(0x80 | (c & 0x3F));
+        return 3;
+    }
+    bytes[0] = (uint8_t)(0xF0 | (c >> 18));
+    bytes[1] = (uint8_t)(0x80 | ((c >> 12) & 0x3F));
+    bytes[2] = (uint8_t)(0x80 | ((c >> 6) & 0x3F));
+    bytes[3] = (uint8_t)(0x80 | (c & 0x3F));
+    return 4;
+}
+
+//adds byte sequences matching codepoints in [lo, hi] as alternatives to entry
+//range is split until every byte of the sequence is a simple byte range
+static bool compile_codepoint_range(RegexCompiler* compiler, uint32_t lo, uint32_t hi, int32_t next, int32_t* entry)
+{
+    //split by encoded length
+    static const uint32_t length_max[] = { 0x7F, 0x7FF, 0xFFFF };
+    for (size_t i = 0; i < 3; i++) {
+        if (lo <= length_max[i] && hi > length_max[i]) {
+            return compile_codepoint_range(compiler, lo, length_max[i], next, entry) &&
+                   compile_codepoint_range(compiler, length_max[i] + 1, hi, next, entry);
+        }
+    }
+
+    //split until continuation bytes cover their full range
+    for (size_t i = 1; i < 4; i++) {
+        uint32_t mask = (1u << (6 * i)) - 1;
+        if ((lo & ~mask) != (hi & ~mask)) {
+            if ((lo & mask) != 0) {
+                return compile_codepoint_range(compiler, lo, lo | mask, next, entry) &&
+                       compile_codepoint_range(compiler, (lo | mask) + 1, hi, next, entry);
+            }
+            if ((hi & mask) != mask) {
+                return compile_codepoint_range(compiler, lo, (hi & ~mask) - 1, next, entry) &&
+                       compile_codepoint_range(compiler, hi & ~mask, hi, next, entry);
+            }
+        }
+    }
+
+    uint8_t lo_bytes[4];
+    uint8_t hi_bytes[4];
+    size_t length = utf8_encode(lo, lo_bytes);
+    utf8_encode(hi, hi_bytes);
+
+    int32_t state = next;
+    for (size_t i = 0; i < length; i++) {
+        //forward NFA is built from the last byte
+        size_t byte = compiler->is_reverse ? i : length - 1 - i;
+        state = nfa_add_state(compiler, REGEX_STATE_BYTE, lo_bytes[byte], hi_bytes[byte], state, -1);
+        if (state < 0) {
+            return false;
+        }
+    }
+
+    if (*entry >= 0) {
+        state = nfa_add_state(compiler, REGEX_STATE_SPLIT, 0, 0, state, *entry);
+        if (state < 0) {
+            return false;
+        }
+    }
+    *entry = state;
+    return true;
+}
+
+//builds NFA of the node that continues to next, returns its entry state
+//states are built backwards from the match state so that every out is known
+static int32_t compile_node(RegexCompiler* compiler, RegexNode* node, int32_t next)
+{
+    switch (node->type) {
+        case REGEX_NODE_EMPTY: {
+            return next;
+        }
+        case REGEX_NODE_CLASS: {
+            int32_t entry = -1;
+            for (size_t i = 0; i < node->range_count; i++) {
+                if (!compile_codepoint_range(compiler, node->ranges[i].lo, node->ranges[i].hi, next, &entry)) {
+                    return -1;
+                }
+            }
+            //empty class never matches
+            if (entry < 0) {
+                entry = nfa_add_state(compiler, REGEX_STATE_BYTE, 1, 0, next, -1);
+            }
+            return entry;
+        }
+        case REGEX_NODE_CONCAT: {
+            for (size_t i = 0; i < node->child_count && next >= 0; i++) {
+                size_t child = compiler->is_reverse ? i : node->child_count - 1 - i;
+                next = compile_node(compiler, node->children[child], next);
+            }
+            return next;
+        }
+        case REGEX_NODE_ALTERNATE: {
+            int32_t entry = compile_node(compiler, node->children[node->child_count - 1], next);
+            for (size_t i = node->child_count - 1; i > 0 && entry >= 0; i--) {
+                int32_t child = compile_node(compiler, node->children[i - 1], next);
+                if (child < 0) {
+                    return -1;
+                }
+                entry = nfa_add_state(compiler, REGEX_STATE_SPLIT, 0, 0, child, entry);
+            }
+            return entry;
+        }
+        case REGEX_NODE_REPEAT: {
+            RegexNode* child = node->children[0];
+            int32_t entry = next;
+
+            if (node->max < 0) {
+                int32_t loop = nfa_add_state(compiler, REGEX_STATE_SPLIT, 0, 0, -1, next);
+                if (loop < 0) {
+                    return -1;
+                }
+                int32_t body = compile_node(compiler, child, loop);
+                if (body < 0) {
+                    return -1;
+                }
+                compiler->nfa->states[loop].out = body;
+                entry = loop;
+            }
+            else {
+                for (int i = node->min; i < node->max; i++) {
+                    int32_t body = compile_node(compiler, child, entry);
+                    if (body < 0) {
+                        return -1;
+                    }
+                    entry = nfa_add_state(compiler, REGEX_STATE_SPLIT, 0, 0, body, next);
+                    if (entry < 0) {
+                        return -1;
+                    }
+                }
+            }
+
+            for (int i = 0; i < node->min && entry >= 0; i++) {
+                entry = compile_node(compiler, child, entry);
+            }
+            return entry;
+        }
+        case REGEX_NODE_LINE_START: {
+            RegexStateType type = compiler->is_reverse ? REGEX_STATE_AT_END : REGEX_STATE_AT_BEGIN;
+            return nfa_add_state(compiler, type, 0, 0, next, -1);
+        }
+        case REGEX_NODE_LINE_END: {
+            RegexStateType type = compiler->is_reverse ? REGEX_STATE_AT_BEGIN : REGEX_STATE_AT_END;
+            return nfa_add_state(compiler, type, 0, 0, next, -1);
+        }
+    }
+    return -1;
+}
+
+static bool compile_nfa(RegexNFA* nfa, RegexNode* root, bool is_reverse, const char** error)
+{
+    RegexCompiler compiler = { .nfa = nfa, .is_reverse = is_reverse, .error = NULL };
+
+    int32_t match = nfa_add_state(&compiler, REGEX_STATE_MATCH, 0, 0, -1, -1);
+    nfa->start = compile_node(&compiler, root, match);
+    if (nfa->start < 0) {
+        *error = compiler.error;
+        return false;
+    }
+    return true;
+}
+
+static void compute_byte_classes(Regex* regex)
+{
+    bool is_boundary[257] = { 0 };
+    for (size_t i = 0; i < regex->forward.count; i++) {
+        RegexState state = regex->forward.states[i];
+        if (state.type == REGEX_STATE_BYTE && state.lo <= state.hi) {
+            is_boundary[state.lo] = true;
+            is_boundary[state.hi + 1] = true;
+        }
+    }
+
+    size_t class = 0;
+    regex->class_bytes[0] = 0;
+    for (size_t byte = 0; byte < 256; byte++) {
+        if (byte > 0 && is_boundary[byte]) {
+            class++;
+            regex->class_bytes[class] = (uint8_t)byte;
+        }
+        regex->byte_classes[byte] = (uint8_t)class;
+    }
+    regex->class_count = class + 1;
+}
+
+static void compute_first_byte(Regex* regex);
+
+Regex* regex_compile(UTFStringView pattern, const char** error)
+{
+    RegexParser parser = { 0 };
+
+    size_t char_count = 0;
+    utf8_to_32(pattern.data, pattern.data_size, NULL, &char_count);
+    parser.chars = malloc((char_count + 1) * sizeof(uint32_t));
+    parser.count = char_count;
+    if (char_count > 0) {
+        utf8_to_32(pattern.data, pattern.data_size, parser.chars, &char_count);
+    }
+
+    const uint32_t ignore_case_flag[] = { '(', '?', 'i', ')' };
+    if (parser.count >= 4 && memcmp(parser.chars, ignore_case_flag, sizeof(ignore_case_flag)) == 0) {
+        parser.ignore_case = true;
+        parser.pos = 4;
+    }
+
+    RegexNode* root = parse_alternate(&parser);
+    if (root && !parser_at_end(&parser)) {
+        //parse_alternate only stops early at ')'
+        parser.error = "unmatched )";
+        root = NULL;
+    }
+    if (!root) {
+        *error = parser.error;
+        parser_destroy(&parser);
+        return NULL;
+    }
+
+    Regex* regex = calloc(1, sizeof(Regex));
+    regex->pattern = utf_from_sv(pattern);
+    regex->ref_count = 1;
+
+    bool compiled = compile_nfa(&regex->forward, root, false, error) &&
+                    compile_nfa(&regex->reverse, root, true, error);
+    parser_destroy(&parser);
+
+    if (!compiled) {
+        regex_release(regex);
+        return NULL;
+    }
+
+    compute_byte_classes(regex);
+    compute_first_byte(regex);
+    return regex;
+}
+
+void regex_retain(Regex* regex)
+{
+    regex->ref_count++;
+}
+
+void regex_release(Regex* regex)
+{
+    if (--regex->ref_count > 0) {
+        return;
+    }
+
+    utf_destroy(regex->pattern);
+    free(regex->forward.states);
+    free(regex->reverse.states);
+    free(regex);
+}
+
+UTFStringView regex_pattern(Regex* regex)
+{
+    return utf_sv_from_str(regex->pattern);
+}
+
+////////////////////////////////
+// Lazy DFA
+////////////////////////////////
+
+static void dfa_clear(RegexDFA* dfa)
+{
+    dfa->state_count = 0;
+    dfa->sets_size = 0;
+    memset(dfa->table, 0xff, REGEX_DFA_TABLE_SIZE * sizeof(int32_t));
+    dfa->start_states[0] = -1;
+    dfa->start_states[1] = -1;
+    dfa->flush_count++;
+}
+
+static void dfa_init(RegexDFA* dfa, Regex* regex, RegexNFA* nfa, bool is_unanchored)
+{
+    memset(dfa, 0, sizeof(RegexDFA));
+    dfa->regex = regex;
+    dfa->nfa = nfa;
+    dfa->is_unanchored = is_unanchored;
+
+    dfa->table = malloc(REGEX_DFA_TABLE_SIZE * sizeof(int32_t));
+
+    //every state is expanded once and pushes at most two
+    dfa->stack = malloc((nfa->count * 2 + 1) * sizeof(int32_t));
+    dfa->set = malloc(nfa->count * sizeof(int32_t));
+    dfa->marks = calloc(nfa->count, sizeof(uint32_t));
+
+    dfa_clear(dfa);
+}
+
+static void dfa_free(RegexDFA* dfa)
+{
+    free(dfa->states);
+    free(dfa->sets);
+    free(dfa->transitions);
+    free(dfa->table);
+    free(dfa->stack);
+    free(dfa->set);
+    free(dfa->marks);
+}
+
+static void dfa_closure_begin(RegexDFA* dfa)
+{
+    dfa->set_count = 0;
+    dfa->mark++;
+    if (dfa->mark == 0) {
+        memset(dfa->marks, 0, dfa->nfa->count * sizeof(uint32_t));
+        dfa->mark = 1;
+    }
+}
+
+//adds the state and every state reachable from it without reading a byte
+//only states that read a byte, match, or wait for the end are kept in the set
+static void dfa_closure_add(RegexDFA* dfa, int32_t start, bool at_begin, bool at_end)
+{
+    size_t top = 0;
+    dfa->stack[top++] = start;
+
+    while (top > 0) {
+        int32_t id = dfa->stack[--top];
+        if (dfa->marks[id] == dfa->mark) {
+            continue;
+        }
+        dfa->marks[id] = dfa->mark;
+
+        RegexState state = dfa->nfa->states[id];
+        switch (state.type) {
+            case REGEX_STATE_MATCH:
+            case REGEX_STATE_BYTE: {
+                dfa->set[dfa->set_count++] = id;
+            }break;
+            case REGEX_STATE_SPLIT: {
+                dfa->stack[top++] = state.out1;
+                dfa->stack[top++] = state.out;
+            }break;
+            case REGEX_STATE_EMPTY: {
+                dfa->stack[top++] = state.out;
+            }break;
+            case REGEX_STATE_AT_BEGIN: {
+                if (at_begin) {
+                    dfa->stack[top++] = state.out;
+                }
+            }break;
+            case REGEX_STATE_AT_END: {
+                if (at_end) {
+                    dfa->stack[top++] = state.out;
+                }
+                else {
+                    dfa->set[dfa->set_count++] = id;
+                }
+            }break;
+        }
+    }
+}
+
+static int compare_ints(const void* a, const void* b)
+{
+    int32_t int_a = *(const int32_t*)a;
+    int32_t int_b = *(const int32_t*)b;
+    return (int_a > int_b) - (int_a < int_b);
+}
+
+//returns id of the state with the NFA states in dfa->set, adding it if needed
+static int32_t dfa_intern(RegexDFA* dfa, bool at_begin)
+{
+    qsort(dfa->set, dfa->set_count, sizeof(int32_t), compare_ints);
+
+    //FNV-1a
+    uint32_t hash = 2166136261u ^ (uint32_t)at_begin;
+    for (size_t i = 0; i < dfa->set_count; i++) {
+        hash = (hash ^ (uint32_t)dfa->set[i]) * 16777619u;
+    }
+
+    size_t mask = REGEX_DFA_TABLE_SIZE - 1;
+    size_t slot = hash & mask;
+    while (dfa->table[slot] >= 0) {
+        RegexDFAState* state = &dfa->states[dfa->table[slot]];
+        bool is_same = state->hash == hash &&
+                       state->at_begin == at_begin &&
+                       state->set_count == dfa->set_count &&
+                       memcmp(dfa->sets + state->set_start, dfa->set, dfa->set_count * sizeof(int32_t)) == 0;
+        if (is_same) {
+            return dfa->table[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    if (dfa->state_count >= REGEX_MAX_DFA_STATES) {
+        dfa_clear(dfa);
+        slot = hash & mask;
+    }
+
+    size_t class_count = dfa->regex->class_count;
+    if (dfa->state_count >= dfa->state_capacity) {
+        dfa->state_capacity = dfa->state_capacity ? dfa->state_capacity * 2 : 16;
+        dfa->states = realloc(dfa->states, dfa->state_capacity * sizeof(RegexDFAState));
+        dfa->transitions = realloc(dfa->transitions, dfa->state_capacity * class_count * sizeof(int32_t));
+    }
+    if (dfa->sets_size + dfa->set_count > dfa->sets_capacity) {
+        while (dfa->sets_size + dfa->set_count > dfa->sets_capacity) {
+            dfa->sets_capacity = dfa->sets_capacity ? dfa->sets_capacity * 2 : 256;
+        }
+        dfa->sets = realloc(dfa->sets, dfa->sets_capacity * sizeof(int32_t));
+    }
+
+    RegexDFAState state = {
+        .set_start = dfa->sets_size,
+        .set_count = dfa->set_count,
+        .hash = hash,
+        .at_begin = at_begin,
+        .is_match = false,
+        .is_dead = dfa->set_count == 0,
+        .is_match_at_end = -1,
+    };
+    for (size_t i = 0; i < dfa->set_count; i++) {
+        if (dfa->nfa->states[dfa->set[i]].type == REGEX_STATE_MATCH) {
+            state.is_match = true;
+        }
+    }
+    if (dfa->set_count > 0) {
+        memcpy(dfa->sets + dfa->sets_size, dfa->set, dfa->set_count * sizeof(int32_t));
+    }
+    dfa->sets_size += dfa->set_count;
+
+    int32_t id = (int32_t)dfa->state_count++;
+    dfa->states[id] = state;
+    memset(dfa->transitions + (size_t)id * class_count, 0xff, class_count * sizeof(int32_t));
+    dfa->table[slot] = id;
+
+    return id;
+}
+
+static int32_t dfa_start(RegexDFA* dfa, bool at_begin)
+{
+    if (dfa->start_states[at_begin] < 0) {
+        dfa_closure_begin(dfa);
+        dfa_closure_add(dfa, dfa->nfa->start, at_begin, false);
+        int32_t id = dfa_intern(dfa, at_begin);
+        dfa->start_states[at_begin] = id;
+    }
+    return dfa->start_states[at_begin];
+}
+
+static int32_t dfa_build_next(RegexDFA* dfa, int32_t from, size_t byte_class)
+{
+    uint8_t byte = dfa->regex->class_bytes[byte_class];
+    RegexDFAState state = dfa->states[from];
+
+    dfa_closure_begin(dfa);
+    for (size_t i = 0; i < state.set_count; i++) {
+        RegexState nfa_state = dfa->nfa->states[dfa->sets[state.set_start + i]];
+        if (nfa_state.type == REGEX_STATE_BYTE && nfa_state.lo <= byte && byte <= nfa_state.hi) {
+            dfa_closure_add(dfa, nfa_state.out, false, false);
+        }
+    }
+    if (dfa->is_unanchored) {
+        dfa_closure_add(dfa, dfa->nfa->start, false, false);
+    }
+
+    size_t flush_count = dfa->flush_count;
+    int32_t next = dfa_intern(dfa, false);
+
+    //from is gone if cache was flushed
+    if (flush_count == dfa->flush_count) {
+        dfa->transitions[(size_t)from * dfa->regex->class_count + byte_class] = next;
+    }
+    return next;
+}
+
+static inline int32_t dfa_next(RegexDFA* dfa, int32_t from, uint8_t byte)
+{
+    size_t byte_class = dfa->regex->byte_classes[byte];
+    int32_t next = dfa->transitions[(size_t)from * dfa->regex->class_count + byte_class];
+    if (next < 0) {
+        next = dfa_build_next(dfa, from, byte_class);
+    }
+    return next;
+}
+
+static bool dfa_is_match_at_end(RegexDFA* dfa, int32_t id)
+{
+    RegexDFAState state = dfa->states[id];
+    if (state.is_match_at_end < 0) {
+        dfa_closure_begin(dfa);
+        for (size_t i = 0; i < state.set_count; i++) {
+            dfa_closure_add(dfa, dfa->sets[state.set_start + i], state.at_begin, true);
+        }
+
+        bool is_match = false;
+        for (size_t i = 0; i < dfa->set_count; i++) {
+            if (dfa->nfa->states[dfa->set[i]].type == REGEX_STATE_MATCH) {
+                is_match = true;
+            }
+        }
+        dfa->states[id].is_match_at_end = is_match;
+    }
+    return dfa->states[id].is_match_at_end;
+}
+
+static void compute_first_byte(Regex* regex)
+{
+    regex->first_byte = -1;
+
+    RegexDFA dfa;
+    dfa_init(&dfa, regex, &regex->forward, false);
+    dfa_closure_begin(&dfa);
+    dfa_closure_add(&dfa, regex->forward.start, false, false);
+
+    for (size_t i = 0; i < dfa.set_count; i++) {
+        RegexState state = regex->forward.states[dfa.set[i]];
+        bool is_same_byte = state.type == REGEX_STATE_BYTE &&
+                            state.lo == state.hi &&
+                            (regex->first_byte < 0 || regex->first_byte == state.lo);
+        if (!is_same_byte) {
+            regex->first_byte = -1;
+            break;
+        }
+        regex->first_byte = state.lo;
+    }
+
+    dfa_free(&dfa);
+}
+
+////////////////////////////////
+// Matcher
+////////////////////////////////
+
+RegexMatcher* regex_matcher_create(Regex* regex)
+{
+    RegexMatcher* matcher = calloc(1, sizeof(RegexMatcher));
+    matcher->regex = regex;
+    dfa_init(&matcher->forward_search, regex, &regex->forward, true);
+    dfa_init(&matcher->forward_longest, regex, &regex->forward, false);
+    dfa_init(&matcher->reverse_search, regex, &regex->reverse, true);
+    return matcher;
+}
+
+void regex_matcher_destroy(RegexMatcher* matcher)
+{
+    dfa_free(&matcher->forward_search);
+    dfa_free(&matcher->forward_longest);
+    dfa_free(&matcher->reverse_search);
+    free(matcher->starts);
+    free(matcher);
+}
+
+bool regex_is_match(RegexMatcher* matcher, UTFStringView sv)
+{
+    RegexDFA* dfa = &matcher->forward_search;
+    Regex* regex = matcher->regex;
+    const uint8_t* bytes = (const uint8_t*)sv.data;
+    size_t size = sv.data_size;
+
+    //state where no match is in progress
+    dfa_start(dfa, false);
+    int32_t state = dfa_start(dfa, true);
+    int32_t idle = dfa->start_states[0];
+
+    //this is the hot loop, so tables are kept in locals
+    //they only change when a new state is built
+    const uint8_t* byte_classes = regex->byte_classes;
+    size_t class_count = regex->class_count;
+    RegexDFAState* states = dfa->states;
+    int32_t* transitions = dfa->transitions;
+
+    for (size_t i = 0; i < size; i++) {
+        if (states[state].is_match) {
+            return true;
+        }
+        //pattern that starts with ^ can't match after the first byte
+        if (states[state].is_dead) {
+            return false;
+        }
+
+        if (state == idle && regex->first_byte >= 0) {
+            const uint8_t* found = memchr(bytes + i, regex->first_byte, size - i);
+            if (!found) {
+                break;
+            }
+            i = (size_t)(found - bytes);
+        }
+
+        int32_t next = transitions[(size_t)state * class_count + byte_classes[bytes[i]]];
+        if (next < 0) {
+            next = dfa_build_next(dfa, state, byte_classes[bytes[i]]);
+            states = dfa->states;
+            transitions = dfa->transitions;
+            idle = dfa->start_states[0];
+        }
+        state = next;
+    }
+    return dfa_is_match_at_end(dfa, state);
+}
+
+//returns end of the longest match that starts at from, UTF_NOT_FOUND if there is none
+static size_t regex_longest_match(RegexMatcher* matcher, UTFStringView sv, size_t from)
+{
+    RegexDFA* dfa = &matcher->forward_longest;
+    const uint8_t* bytes = (const uint8_t*)sv.data;
+
+    int32_t state = dfa_start(dfa, from == 0);
+    size_t end = dfa->states[state].is_match ? from : UTF_NOT_FOUND;
+
+    for (size_t i = from; i < sv.data_size; i++) {
+        state = dfa_next(dfa, state, bytes[i]);
+        if (dfa->states[state].is_dead) {
+            return end;
+        }
+        if (dfa->states[state].is_match) {
+            end = i + 1;
+        }
+    }
+
+    if (dfa_is_match_at_end(dfa, state)) {
+        end = sv.data_size;
+    }
+    return end;
+}
+
+//sets a bit for every position where a match starts
+//it reads the line backwards once, so finding every match stays linear
+static void regex_mark_starts(RegexMatcher* matcher, UTFStringView sv)
+{
+    size_t starts_size = sv.data_size / 8 + 1;
+    if (starts_size > matcher->starts_capacity) {
+        matcher->starts = realloc(matcher->starts, starts_size);
+        matcher->starts_capacity = starts_size;
+    }
+    memset(matcher->starts, 0, starts_size);
+
+    RegexDFA* dfa = &matcher->reverse_search;
+    const uint8_t* bytes = (const uint8_t*)sv.data;
+
+    int32_t state = dfa_start(dfa, true);
+    for (size_t i = sv.data_size; ; i--) {
+        bool is_match = i == 0 ? dfa_is_match_at_end(dfa, state) : dfa->states[state].is_match;
+        if (is_match) {
+            matcher->starts[i / 8] |= (uint8_t)(1 << (i % 8));
+        }
+        if (i == 0) {
+            break;
+        }
+        state = dfa_next(dfa, state, bytes[i - 1]);
+    }
+}
+
+void regex_find_all(RegexMatcher* matcher, UTFStringView sv, RegexMatchFunction on_match, void* data)
+{
+    //most lines don't match, so check that first
+    if (!regex_is_match(matcher, sv)) {
+        return;
+    }
+
+    regex_mark_starts(matcher, sv);
+
+    size_t pos = 0;
+    while (pos <= sv.data_size) {
+        if (matcher->starts[pos / 8] == 0) {
+            pos = (pos / 8 + 1) * 8;
+            continue;
+        }
+        if (!(matcher->starts[pos / 8] & (1 << (pos % 8)))) {
+            pos++;
+            continue;
+        }
+
+        size_t end = regex_longest_match(matcher, sv, pos);
+        if (end == UTF_NOT_FOUND || end == pos) {
+            pos++;
+            continue;
+        }
+
+        RegexMatch match = { .start_byte = pos, .end_byte = end };
+        if (!on_match(data, match)) {
+            return;
+        }
+        pos = end;
+    }
+}
+
+////////////////////////////////
+// Cache
+////////////////////////////////
+
+static Regex* regex_cache[REGEX_CACHE_SIZE];
+static uint64_t regex_cache_clock;
+
+Regex* regex_cache_get(UTFStringView pattern, const char** error)
+{
+    //empty slot or the least recently used one
+    size_t victim = 0;
+
+    for (size_t i = 0; i < REGEX_CACHE_SIZE; i++) {
+        Regex* regex = regex_cache[i];
+        if (!regex) {
+            if (regex_cache[victim]) {
+                victim = i;
+            }
+            continue;
+        }
+
+        if (utf_sv_cmp(regex_pattern(regex), pattern)) {
+            regex->last_used = ++regex_cache_clock;
+            regex_retain(regex);
+            return regex;
+        }
+
+        if (regex_cache[victim] && regex->last_used < regex_cache[victim]->last_used) {
+            victim = i;
+        }
+    }
+
+    Regex* regex = regex_compile(pattern, error);
+    if (!regex) {
+        return NULL;
+    }
+
+    if (regex_cache[victim]) {
+        regex_release(regex_cache[victim]);
+    }
+    regex->last_used = ++regex_cache_clock;
+    regex_retain(regex);
+    regex_cache[victim] = regex;
+
+    return regex;
+}
+
+void regex_cache_clear()
+{
+    for (size_t i = 0; i < REGEX_CACHE_SIZE; i++) {
+        if (regex_cache[i]) {
+            regex_release(regex_cache[i]);
+            regex_cache[i] = NULL;
+        }
+    }
+}
+
+////////////////////////////////
+// Benchmark
+////////////////////////////////
+
+//what a backtracking engine does, walks the NFA trying one path at a time
+//steps is the budget, so patterns that blow up don't hang the benchmark
+static bool backtrack(RegexNFA* nfa, int32_t id, const uint8_t* bytes, size_t size, size_t pos, size_t depth, size_t* steps)
+{
+    while (true) {
+        if (*steps == 0 || depth > 4096) {
+            *steps = 0;
+            return false;
+        }
+        (*steps)--;
+
+        RegexState state = nfa->states[id];
+        switch (state.type) {
+            case REGEX_STATE_MATCH: {
+                return true;
+            }
+            case REGEX_STATE_BYTE: {
+                if (pos >= size || bytes[pos] < state.lo || bytes[pos] > state.hi) {
+                    return false;
+                }
+                pos++;
+                id = state.out;
+            }break;
+            case REGEX_STATE_SPLIT: {
+                if (backtrack(nfa, state.out, bytes, size, pos, depth + 1, steps)) {
+                    return true;
+                }
+                id = state.out1;
+            }break;
+            case REGEX_STATE_EMPTY: {
+                id = state.out;
+            }break;
+            case REGEX_STATE_AT_BEGIN: {
+                if (pos != 0) {
+                    return false;
+                }
+                id = state.out;
+            }break;
+            case REGEX_STATE_AT_END: {
+                if (pos != size) {
+                    return false;
+                }
+                id = state.out;
+            }break;
+        }
+    }
+}
+
+//returns -1 if it ran out of steps
+static int backtrack_is_match(Regex* regex, UTFStringView sv, size_t max_steps)
+{
+    size_t steps = max_steps;
+    for (size_t start = 0; start <= sv.data_size; start++) {
+        if (backtrack(&regex->forward, regex->forward.start, (const uint8_t*)sv.data, sv.data_size, start, 0, &steps)) {
+            return 1;
+        }
+        if (steps == 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void regex_benchmark()
+{
+    const size_t line_count = 20000;
+    const size_t backtrack_steps = 100000;
+
+    const char* levels[] = { "INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR" };
+    const char* messages[] = {
+        "request handled",
+        "cache miss for key session",
+        "upstream timeout after retry",
+        u8"요청 처리 실패 connection reset",
+        "slow query detected",
+    };
+    const char* users[] = { "alice", "bob", "carol", "dave" };
+
+    UTFStringView* lines = malloc(line_count * sizeof(UTFStringView));
+    size_t total_bytes = 0;
+    uint32_t random = 12345;
+    for (size_t i = 0; i < line_count; i++) {
+        random = random * 1103515245u + 12345u;
+        uint32_t r = random >> 8;
+
+        char buffer[256];
+        int size = snprintf(buffer, sizeof(buffer),
+            "2026-10-19 12:%02u:%02u %s worker[%u] %s id=%u user=%s@example.com status=%u took %ums",
+            (unsigned)(i / 60 % 60), (unsigned)(i % 60),
+            levels[r % 6], r % 16, messages[(r >> 4) % 5], r % 100000, users[(r >> 8) % 4],
+            (r >> 10) % 9 == 0 ? 503u : 200u, (r >> 12) % 2000);
+
+        char* data = malloc((size_t)size + 1);
+        memcpy(data, buffer, (size_t)size + 1);
+        lines[i] = (UTFStringView){ .data = data, .data_size = (size_t)size, .count = 0 };
+        lines[i].count = utf_sv_count(lines[i]);
+        total_bytes += (size_t)size;
+    }
+
+    const char* patterns[] = {
+        "ERROR",
+        "ERROR.*timeout",
+        "status=5\\d\\d",
+        "^\\d{4}-\\d\\d-\\d\\d \\d\\d:\\d\\d:\\d\\d (WARN|ERROR)",
+        "user=[a-z]+@example\\.com",
+        "(?i)TIMEOUT",
+        u8"요청.*실패",
+        "(\\w+\\s?)+!",
+    };
+
+    printf("regex benchmark, %zu lines, %zu bytes, backtracking gives up after %zu steps per line\n",
+        line_count, total_bytes, backtrack_steps);
+
+    for (size_t p = 0; p < sizeof(patterns) / sizeof(patterns[0]); p++) {
+        const char* error = NULL;
+        Regex* regex = regex_compile(utf_sv_from_cstr(patterns[p]), &error);
+        if (!regex) {
+            printf("%-56s : %s\n", patterns[p], error);
+            continue;
+        }
+        RegexMatcher* matcher = regex_matcher_create(regex);
+
+        clock_t start = clock();
+        size_t dfa_lines = 0;
+        for (size_t i = 0; i < line_count; i++) {
+            dfa_lines += regex_is_match(matcher, lines[i]);
+        }
+        clock_t end = clock();
+        double dfa_ms = (double)(end - start) / CLOCKS_PER_SEC * 1000.0;
+
+        start = clock();
+        size_t backtrack_lines = 0;
+        size_t gave_up = 0;
+        for (size_t i = 0; i < line_count; i++) {
+            int result = backtrack_is_match(regex, lines[i], backtrack_steps);
+            if (result < 0) {
+                gave_up++;
+            }
+            else {
+                backtrack_lines += (size_t)result;
+            }
+        }
+        end = clock();
+        double backtrack_ms = (double)(end - start) / CLOCKS_PER_SEC * 1000.0;
+
+        printf("%-56s : dfa %8.2f ms %6zu lines | backtracking %8.2f ms %6zu lines, gave up on %zu%s\n",
+            patterns[p], dfa_ms, dfa_lines, backtrack_ms, backtrack_lines, gave_up,
+            gave_up == 0 && backtrack_lines != dfa_lines ? " MISMATCH" : "");
+
+        regex_matcher_destroy(matcher);
+        regex_release(regex);
+    }
+
+    for (size_t i = 0; i < line_count; i++) {
+        free((char*)lines[i].data);
+    }
+    free(lines);
+}
+
+////////////////////////////////
+// Test
+////////////////////////////////
+
+typedef struct RegexTestMatches {
+    RegexMatch matches[16];
+    size_t count;
+} RegexTestMatches;
+
+static bool regex_test_collect(void* data, RegexMatch match)
+{
+    RegexTestMatches* matches = data;
+    if (matches->count >= 16) {
+        return false;
+    }
+    matches->matches[matches->count++] = match;
+    return true;
+}
+
+static RegexTestMatches regex_test_find_all(const char* pattern, const char* text)
+{
+    const char* error = NULL;
+    Regex* regex = regex_compile(utf_sv_from_cstr(pattern), &error);
+    assert(regex);
+
+    RegexTestMatches matches = { .count = 0 };
+    RegexMatcher* matcher = regex_matcher_create(regex);
+    regex_find_all(matcher, utf_sv_from_cstr(text), regex_test_collect, &matches);
+    regex_matcher_destroy(matcher);
+    regex_release(regex);
+
+    return matches;
+}
+
+static bool regex_test_is_match(const char* pattern, const char* text)
+{
+    const char* error = NULL;
+    Regex* regex = regex_compile(utf_sv_from_cstr(pattern), &error);
+    assert(regex);
+
+    RegexMatcher* matcher = regex_matcher_create(regex);
+    bool is_match = regex_is_match(matcher, utf_sv_from_cstr(text));
+    regex_matcher_destroy(matcher);
+    regex_release(regex);
+
+    return is_match;
+}
+
+void regex_test()
+{
+    {
+        const char* invalid[] = { "(", "a)", "[a", "*a", "a{3,2}", "\\q", "a{1001}", "(?<x>a)", "a\\" };
+        for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+            const char* error = NULL;
+            assert(regex_compile(utf_sv_from_cstr(invalid[i]), &error) == NULL);
+            assert(error != NULL);
+        }
+    }
+
+    {
+        assert(regex_test_is_match("cat", "concatenate"));
+        assert(!regex_test_is_match("dog", "concatenate"));
+        assert(regex_test_is_match("", ""));
+        assert(regex_test_is_match("^$", ""));
+        assert(!regex_test_is_match("^$", "a"));
+        assert(regex_test_is_match("^a.c$", "abc"));
+        assert(!regex_test_is_match("^a.c$", "abcd"));
+        assert(regex_test_is_match("colou?r", "color"));
+        assert(regex_test_is_match("colou?r", "colour"));
+        assert(regex_test_is_match("(cat|dog)s", "hotdogs"));
+        assert(regex_test_is_match("a{2,3}b", "xaab"));
+        assert(!regex_test_is_match("^a{2,3}b", "ab"));
+        assert(!regex_test_is_match("^a{2,3}b", "aaaab"));
+        assert(regex_test_is_match("\\d+\\.\\d+", "version 1.25"));
+        assert(regex_test_is_match("a{2}{3}", "aaaaaa"));
+        assert(!regex_test_is_match("^a{2}{3}$", "aaaaa"));
+        assert(regex_test_is_match("x{", "x{"));
+        assert(regex_test_is_match("[]a]", "]"));
+        assert(regex_test_is_match("[a-]", "-"));
+        assert(!regex_test_is_match("[^\\s\\S]", "abc"));
+        assert(regex_test_is_match("(?i)error", "ErRoR"));
+        assert(!regex_test_is_match("error", "ERROR"));
+
+        //. is one character, not one byte
+        assert(regex_test_is_match(u8"^.$", u8"가"));
+        assert(regex_test_is_match(u8"^.$", u8"😀"));
+        assert(!regex_test_is_match(u8"^.$", u8"ab"));
+        assert(regex_test_is_match(u8"^[^a-z]$", u8"한"));
+        assert(regex_test_is_match(u8"^[가-힣]+$", u8"한글"));
+        assert(!regex_test_is_match(u8"^[가-힣]+$", u8"한a글"));
+        assert(regex_test_is_match(u8"^\\W\\W$", u8"é😀"));
+
+        //nothing blows up, no matter how bad the pattern is for backtracking
+        assert(!regex_test_is_match("^(a|aa)*b$", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"));
+        assert(regex_test_is_match("(a*)*b", "aaaaaaaaab"));
+    }
+
+    {
+        RegexTestMatches matches = regex_test_find_all("a+", "caaab aa");
+        assert(matches.count == 2);
+        assert(matches.matches[0].start_byte == 1 && matches.matches[0].end_byte == 4);
+        assert(matches.matches[1].start_byte == 6 && matches.matches[1].end_byte == 8);
+
+        //leftmost-longest
+        matches = regex_test_find_all("a|ab", "xab");
+        assert(matches.count == 1);
+        assert(matches.matches[0].start_byte == 1 && matches.matches[0].end_byte == 3);
+
+        //leftmost, even if another match ends earlier
+        matches = regex_test_find_all("abcd|c", "abcd");
+        assert(matches.count == 1);
+        assert(matches.matches[0].start_byte == 0 && matches.matches[0].end_byte == 4);
+
+        matches = regex_test_find_all("\\d{2,3}", "1 12 1234");
+        assert(matches.count == 2);
+        assert(matches.matches[0].start_byte == 2 && matches.matches[0].end_byte == 4);
+        assert(matches.matches[1].start_byte == 5 && matches.matches[1].end_byte == 8);
+
+        //empty matches are skipped
+        matches = regex_test_find_all("x*", "axxb");
+        assert(matches.count == 1);
+        assert(matches.matches[0].start_byte == 1 && matches.matches[0].end_byte == 3);
+
+        matches = regex_test_find_all("^a", "aa");
+        assert(matches.count == 1 && matches.matches[0].start_byte == 0);
+        matches = regex_test_find_all("a$", "aa");
+        assert(matches.count == 1 && matches.matches[0].start_byte == 1);
+
+        matches = regex_test_find_all(u8"[가-힣]+", u8"abc 한글 def 고양이");
+        assert(matches.count == 2);
+        assert(matches.matches[0].start_byte == 4 && matches.matches[0].end_byte == 10);
+        assert(matches.matches[1].start_byte == 15 && matches.matches[1].end_byte == 24);
+    }
+
+    {
+        //needs more DFA states than the cache holds, so the cache gets flushed while matching
+        const char* error = NULL;
+        Regex* regex = regex_compile(utf_sv_from_cstr("a[ab]{13}$"), &error);
+        assert(regex);
+        RegexMatcher* matcher = regex_matcher_create(regex);
+
+        size_t size = 64 * 1024;
+        char* text = malloc(size + 1);
+        uint32_t random = 1;
+        for (size_t i = 0; i < size; i++) {
+            random = random * 1103515245u + 12345u;
+            text[i] = (random >> 16) & 1 ? 'a' : 'b';
+        }
+        text[size] = '\0';
+
+        UTFStringView sv = { .data = text, .data_size = size, .count = size };
+        text[size - 14] = 'a';
+        assert(regex_is_match(matcher, sv));
+        text[size - 14] = 'b';
+        assert(!regex_is_match(matcher, utf_sv_sub_sv_bytes(sv, size - 14, size)));
+
+        RegexTestMatches matches = { .count = 0 };
+        text[size - 14] = 'a';
+        regex_find_all(matcher, sv, regex_test_collect, &matches);
+        assert(matches.count == 1);
+        assert(matches.matches[0].start_byte <= size - 14 && matches.matches[0].end_byte == size);
+
+        free(text);
+        regex_matcher_destroy(matcher);
+        regex_release(regex);
+    }
+
+    {
+        const char* error = NULL;
+        Regex* first = regex_cache_get(utf_sv_from_cstr("warn|error"), &error);
+        Regex* second = regex_cache_get(utf_sv_from_cstr("warn|error"), &error);
+        assert(first && first == second);
+        assert(regex_cache_get(utf_sv_from_cstr("(warn"), &error) == NULL);
+        regex_release(first);
+        regex_release(second);
+        regex_cache_clear();
+    }
+}
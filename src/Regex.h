@@ -0,0 +1,68 @@
+#ifndef Regex_HEADER_GUARD
+#define Regex_HEADER_GUARD
+
+#include "UTFString.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Regular expression matched by a lazy DFA
+//
+// Pattern is compiled to a Thompson NFA over UTF-8 bytes,
+// and DFA states are built from the NFA while matching and cached.
+// There is no backtracking, so matching time is linear in the input
+// no matter what the pattern is.
+//
+// Supported syntax :
+//     literals  .  [abc]  [^a-z]  \d \w \s \D \W \S  \t \n \r  \ before any punctuation
+//     *  +  ?  {n}  {n,}  {n,m}  a|b  (group)  (?:group)
+//     ^ $ which match at the start and the end of the line
+//     (?i) at the start of the pattern for ASCII case insensitive matching
+//
+// Matches are leftmost-longest (POSIX), not leftmost-first like Perl.
+// It only matters for where a match ends, which lines match is the same.
+//
+// Regex doesn't change once it is compiled so it can be shared between threads,
+// but RegexMatcher holds the DFA cache so each thread needs its own.
+
+typedef struct Regex Regex;
+typedef struct RegexMatcher RegexMatcher;
+
+typedef struct RegexMatch {
+    size_t start_byte;
+    size_t end_byte;
+} RegexMatch;
+
+//returns NULL if the pattern is invalid and error is set to a static message
+//returned regex has one reference
+Regex* regex_compile(UTFStringView pattern, const char** error);
+void regex_retain(Regex* regex);
+void regex_release(Regex* regex);
+
+UTFStringView regex_pattern(Regex* regex);
+
+RegexMatcher* regex_matcher_create(Regex* regex);
+void regex_matcher_destroy(RegexMatcher* matcher);
+
+bool regex_is_match(RegexMatcher* matcher, UTFStringView sv);
+
+//return false to stop
+typedef bool (*RegexMatchFunction)(void* data, RegexMatch match);
+
+//calls on_match for every non empty, non overlapping match from left to right
+void regex_find_all(RegexMatcher* matcher, UTFStringView sv, RegexMatchFunction on_match, void* data);
+
+// Compiled pattern cache
+//
+// Keeps recently used patterns compiled,
+// so typing a pattern again or switching between patterns doesn't compile it again.
+// Returned regex has a reference for the caller, release it with regex_release.
+// Use it only from the main thread.
+Regex* regex_cache_get(UTFStringView pattern, const char** error);
+void regex_cache_clear();
+
+//compares against a backtracking matcher on a generated log
+void regex_benchmark();
+
+void regex_test();
+
+#endif
@@ -2,6 +2,8 @@
 
 #include <SDL2/SDL.h>
 #include <stdio.h>
+#include <string.h>
+#include <stdint.h>
 #include <assert.h>
 
 #pragma execution_character_set("utf-8")
@@ -26,6 +28,27 @@ u8"참고로 다른 과일인 배와 복숭아도 같은 지역이 원산지이
 #define MISSING_GLYPH "?"
 
 #define min(a, b) ((a) > (b) ?  b : a)
+#define max(a, b) ((a) > (b) ?  a : b)
+
+//how many TextLines are created at once when something reaches the last line of an opened file
+//or a line in a span(see TextLine.span_count)
+#define TEXT_BOX_LINE_BATCH 1024
+
+//lookups keep every line they walk this many lines past a kept line
+#define TEXT_BOX_LINE_JUMP_DISTANCE 128
+
+//seconds between autosaves while the document keeps changing
+#define TEXT_BOX_AUTOSAVE_INTERVAL 30.0
+#define TEXT_BOX_AUTOSAVE_SUFFIX ".autosave"
+
+//most bytes a followed file gives in one poll, so a burst of writes can't stall a frame
+#define TEXT_BOX_FOLLOW_READ_SIZE (1024 * 1024)
+
+//seconds between checks of whether someone else changed the opened file
+#define TEXT_BOX_RELOAD_CHECK_INTERVAL 1.0
+
+//removed lines copied text can keep alive before it's serialized so they can be freed
+#define TEXT_BOX_CLIPBOARD_KEPT_LINES (64 * 1024)
 
 bool sv_fits(UTFStringView sv, TTF_Font* font, int w, size_t* text_count, int* text_width) {
 	if (sv.count == 0) {
@@ -43,22 +66,29 @@ bool sv_fits(UTFStringView sv, TTF_Font* font, int w, size_t* text_count, int* t
 
     bool fits = true;
 
-	for (size_t i = 1; i <= sv.count; i++)
+	//text is copied once and cut with a null character after each character,
+	//instead of copying every prefix again
+	char* text = malloc(sv.data_size + 1);
+	memcpy(text, sv.data, sv.data_size);
+	text[sv.data_size] = '\0';
+
+	UTFIterator it = utf_iter_begin(sv);
+	while (it.byte_offset < sv.data_size)
     {
         int tmp_width = 0;
+        utf_iter_skip(&it, 1);
 
-        UTFString *sub_str = utf_sub_sv(sv, 0, i);
-
-        int res = TTF_SizeUTF8(font, sub_str->data, &tmp_width, NULL);
-
-        utf_destroy(sub_str);
+        char cut = text[it.byte_offset];
+        text[it.byte_offset] = '\0';
+        int res = TTF_SizeUTF8(font, text, &tmp_width, NULL);
+        text[it.byte_offset] = cut;
 
         if (res == -1){
 			fprintf(stderr, "%s:%d:ERROR : Failed to get a size of text : %s\n", __FILE__, __LINE__, TTF_GetError());
         }
 
         if (tmp_width <= w){
-            measured_count = i;
+            measured_count = it.index;
             measured_width = tmp_width;
         }else{
             fits = false;
@@ -66,23 +96,338 @@ bool sv_fits(UTFStringView sv, TTF_Font* font, int w, size_t* text_count, int* t
         }
     }
 
+	free(text);
+
 	if (text_count) { *text_count = measured_count; }
 	if (text_width) { *text_width = measured_width; }
 
     return fits;
 }
 
+int sv_width(TTF_Font* font, UTFStringView sv)
+{
+	if (sv.count == 0) {
+		return 0;
+	}
+	int width = 0;
+	UTFString* tmp = utf_from_sv(sv);
+	if (TTF_SizeUTF8(font, tmp->data, &width, NULL) == -1) {
+		fprintf(stderr, "%s:%d:ERROR : Failed to get a size of text : %s\n", __FILE__, __LINE__, TTF_GetError());
+	}
+	utf_destroy(tmp);
+	return width;
+}
+
+void defer_text_line_update(TextBox* box, TextLine* line);
+void drop_clipboard_snapshot(TextBox* box);
+
+//call it before a line's next pointer changes
+//running autosave keeps writing the line as it was, copied text, find and reload workers keep reading it
+void freeze_line(TextBox* box, TextLine* line)
+{
+	if (box->autosave_snapshot) {
+		text_snapshot_freeze_line(box->autosave_snapshot, line);
+	}
+	if (box->clipboard.snapshot) {
+		text_snapshot_freeze_line(box->clipboard.snapshot, line);
+	}
+	if (box->reload_snapshot) {
+		text_snapshot_freeze_line(box->reload_snapshot, line);
+	}
+	text_find_freeze_line(&box->find, line);
+}
+
+//call it before a line's text changes
+void prepare_line_edit(TextBox* box, TextLine* line)
+{
+	freeze_line(box, line);
+	text_line_materialize(line);
+	box->change_count++;
+}
+
+//number of the line after it, a span stands for more than one line
+size_t get_number_after(TextLine* line)
+{
+	return line->line_number + (line->span_count > 0 ? line->span_count : 1);
+}
+
+//creates TextLines for lines of the opened file that don't have one yet
+//and puts them after the last line
+//returns false if every line already has one
+bool append_pending_lines(TextBox* box, TextLine* last_line, size_t count)
+{
+	assert(last_line->next == NULL);
+
+	TextLine* new_last = NULL;
+	TextLine* new_first = text_line_index_create_lines(&box->line_index, count, get_number_after(last_line), &new_last);
+	if (!new_first) {
+		return false;
+	}
+
+	//running autosave writes these lines from the mapping already
+	//and find searches them from the index
+	freeze_line(box, last_line);
+	last_line->next = new_first;
+	new_first->prev = last_line;
+
+	for (TextLine* line = new_first; line != NULL; line = line->next) {
+		defer_text_line_update(box, line);
+	}
+	return true;
+}
+
+//same as append_pending_lines but only the lines around line_number are created,
+//lines before them are left in a span when there are too many of them
+//returns false if every line already has one
+bool append_pending_lines_up_to(TextBox* box, TextLine* last_line, size_t line_number)
+{
+	TextLineIndex* index = &box->line_index;
+	size_t count = min(line_number - last_line->line_number, text_line_index_pending_count(index));
+
+	//spans are only made of a finished index so find workers can read it
+	if (index->is_finished && count > TEXT_BOX_LINE_BATCH) {
+		size_t span_count = count - TEXT_BOX_LINE_BATCH / 2;
+		TextLine* span = text_line_index_create_span(index, index->next_line, index->next_line + span_count, last_line->line_number + 1);
+		index->next_line += span_count;
+
+		freeze_line(box, last_line);
+		last_line->next = span;
+		span->prev = last_line;
+		last_line = span;
+	}
+
+	return append_pending_lines(box, last_line, TEXT_BOX_LINE_BATCH);
+}
+
+//Creates TextLines for the lines of a span around line_number and returns the one at line_number
+//
+//Rest of the lines stay in the span before them and in a new span after them.
+//If there is nothing before them the span becomes the first of them,
+//so lookups that point to it keep pointing to the same line number
+TextLine* create_lines_in_span(TextBox* box, TextLine* span, size_t line_number)
+{
+	TextLineIndex* index = &box->line_index;
+	size_t span_line = text_line_index_line_at(index, span->mapped_data);
+	size_t span_count = span->span_count;
+
+	//line is in the middle of the created ones, so walking away from it either way doesn't split the span right away
+	size_t offset = line_number - span->line_number;
+	size_t start = offset > TEXT_BOX_LINE_BATCH / 2 ? offset - TEXT_BOX_LINE_BATCH / 2 : 0;
+	size_t end = min(start + TEXT_BOX_LINE_BATCH, span_count);
+
+	//running autosave, copied text and find keep reading the span as it was
+	freeze_line(box, span);
+	TextLine* after = span->next;
+
+	TextLine* last = span;
+	if (start > 0) {
+		text_line_index_set_span(index, span, span_line, span_line + start);
+	}
+	else {
+		text_line_index_set_line(index, span, span_line);
+		defer_text_line_update(box, span);
+		start = 1;
+	}
+
+	TextLine* new_last = NULL;
+	TextLine* new_first = text_line_index_create_lines_at(index, span_line + start, end - start, span->line_number + start, &new_last);
+	if (new_first) {
+		last->next = new_first;
+		new_first->prev = last;
+		last = new_last;
+	}
+	if (end < span_count) {
+		TextLine* rest = text_line_index_create_span(index, span_line + end, span_line + span_count, span->line_number + end);
+		last->next = rest;
+		rest->prev = last;
+		last = rest;
+	}
+	last->next = after;
+	if (after) {
+		after->prev = last;
+	}
+
+	TextLine* line = span;
+	TextLine* created = new_first;
+	for (size_t i = start; i < end; i++) {
+		defer_text_line_update(box, created);
+		if (created->line_number == line_number) {
+			line = created;
+		}
+		created = created->next;
+	}
+	return line;
+}
+
+//same as line->next but numbers the next line if it isn't numbered yet
+//line itself has to have the right number
+TextLine* get_numbered_next(TextBox* box, TextLine* line)
+{
+	TextLine* next = line->next;
+	if (next && next == box->unnumbered_line) {
+		next->line_number = get_number_after(line);
+		box->unnumbered_line = next->next;
+	}
+	return next;
+}
+
+//same as get_numbered_next but creates lines of the opened file when it reaches the last line or a span
+TextLine* get_next_line(TextBox* box, TextLine* line)
+{
+	if (line->next == NULL) {
+		append_pending_lines(box, line, TEXT_BOX_LINE_BATCH);
+	}
+	TextLine* next = get_numbered_next(box, line);
+	if (next && next->span_count > 0) {
+		next = create_lines_in_span(box, next, next->line_number);
+	}
+	return next;
+}
+
+//same as line->prev but creates lines when it's a span
+TextLine* get_prev_line(TextBox* box, TextLine* line)
+{
+	TextLine* prev = line->prev;
+	if (prev && prev->span_count > 0) {
+		prev = create_lines_in_span(box, prev, line->line_number - 1);
+	}
+	return prev;
+}
+
+//how many jumps are at or before line_number
+size_t count_line_jumps_up_to(TextBox* box, size_t line_number)
+{
+	size_t low = 0;
+	size_t high = box->line_jump_count;
+	while (low < high) {
+		size_t mid = low + (high - low) / 2;
+		if (box->line_jumps[mid]->line_number <= line_number) {
+			low = mid + 1;
+		}
+		else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
+void add_line_jump(TextBox* box, TextLine* line)
+{
+	size_t index = count_line_jumps_up_to(box, line->line_number);
+	if (index > 0 && box->line_jumps[index - 1] == line) {
+		return;
+	}
+
+	if (box->line_jump_count == box->line_jump_capacity) {
+		size_t new_capacity = box->line_jump_capacity ? box->line_jump_capacity * 2 : 256;
+		TextLine** new_jumps = realloc(box->line_jumps, new_capacity * sizeof(TextLine*));
+		//lookups just walk further without it
+		if (!new_jumps) {
+			return;
+		}
+		box->line_jumps = new_jumps;
+		box->line_jump_capacity = new_capacity;
+	}
+
+	memmove(box->line_jumps + index + 1, box->line_jumps + index, (box->line_jump_count - index) * sizeof(TextLine*));
+	box->line_jumps[index] = line;
+	box->line_jump_count++;
+}
+
+//call it before lines first_line_number to last_line_number are detached from the text box
+void forget_lines(TextBox* box, size_t first_line_number, size_t last_line_number)
+{
+	box->line_hint = NULL;
+
+	size_t start = first_line_number > 0 ? count_line_jumps_up_to(box, first_line_number - 1) : 0;
+	size_t end = count_line_jumps_up_to(box, last_line_number);
+	if (start == end) {
+		return;
+	}
+	memmove(box->line_jumps + start, box->line_jumps + end, (box->line_jump_count - end) * sizeof(TextLine*));
+	box->line_jump_count -= end - start;
+}
+
+//call it before every line is freed or replaced
+void forget_all_lines(TextBox* box)
+{
+	box->line_hint = NULL;
+	box->line_jump_count = 0;
+	box->unnumbered_line = NULL;
+}
+
+//call it after lines are inserted or removed after kept_line, kept_line's number didn't change
+//lines after it are numbered when something walks to them, so an edit doesn't go through the rest of the document
+void number_lines_lazily_after(TextBox* box, TextLine* kept_line)
+{
+	//jumps after it have old numbers, lookups add them again as they walk
+	box->line_jump_count = count_line_jumps_up_to(box, kept_line->line_number);
+	box->unnumbered_line = kept_line->next;
+	box->line_hint = kept_line;
+}
+
 TextLine* get_line_from_line_number(TextBox* box, size_t line_number) {
 	TextLine* line = box->first_line;
-	for (size_t i = 0; i < line_number; i++) {
-		if (line->next == NULL) {
-			return line;
+
+	//closest line before it that a lookup went over
+	size_t jump_count = count_line_jumps_up_to(box, line_number);
+	if (jump_count > 0) {
+		line = box->line_jumps[jump_count - 1];
+	}
+
+	//edits usually happen near each other, so it walks from the last line when that's closer
+	TextLine* hint = box->line_hint;
+	if (hint && hint->line_number <= line_number) {
+		if (hint->line_number > line->line_number) {
+			line = hint;
+		}
+	}
+	else if (hint && hint->line_number - line_number < line_number - line->line_number) {
+		line = hint;
+		while (line->line_number > line_number) {
+			line = line->prev;
+		}
+		if (line->span_count > 0) {
+			line = create_lines_in_span(box, line, line_number);
+		}
+		box->line_hint = line;
+		return line;
+	}
+
+	size_t walked_count = 0;
+	while (true) {
+		//only lines around it are created, lines that are walked over stay in the span
+		if (line->span_count > 0 && line_number < get_number_after(line)) {
+			line = create_lines_in_span(box, line, line_number);
+		}
+		if (line->line_number >= line_number) {
+			break;
+		}
+		if (line->next == NULL && !append_pending_lines_up_to(box, line, line_number)) {
+			break;
+		}
+		line = get_numbered_next(box, line);
+
+		//there is no jump between the start and the line, so next lookups don't walk here again
+		if (++walked_count % TEXT_BOX_LINE_JUMP_DISTANCE == 0) {
+			add_line_jump(box, line);
 		}
-		line = line->next;
 	}
+	box->line_hint = line;
 	return line;
 }
 
+void ensure_text_line_updated(TextBox* box, TextLine* line);
+
+//sets cursor to char_offset in the line
+//this scans the line to find byte offset so use it only when cursor jumps
+TextCursor set_cursor_char_offset(TextLine* line, TextCursor cursor, size_t char_offset)
+{
+	cursor.char_offset = char_offset;
+	cursor.byte_offset = text_line_char_to_byte(line, char_offset);
+	return cursor;
+}
+
 //TextLine* get_cursor_line(TextBox* box) {
 //	return get_line_from_line_number(box, box->cursor.line_number);
 //}
@@ -98,6 +443,7 @@ void get_char_coord_from_cursor(
 	}
 
 	TextLine* line = get_line_from_line_number(box, cursor.line_number);
+	ensure_text_line_updated(box, line);
 
 	size_t total_char_size = 0;
 	for (size_t i = 0; i < line->wrapped_line_count; i++) {
@@ -133,66 +479,172 @@ void get_char_coord_from_cursor(
 
 UTFString* replace_missing_glyph_with_char(UTFStringView sv, TTF_Font* font, UTFStringView replacement) {
 
-	size_t bit_offset = 0;
-	const char *ptr = sv.data;
-
 	UTFString* copy = utf_from_cstr("");
 
 	if (sv.count == 0) {
 		return copy;
 	}
 
-	for (size_t i = 0; i < sv.count; i++) {
-		//size_t next = utf_next(str, bit_offset);
-		size_t next = utf_sv_next(sv, bit_offset);
-		uint32_t codepoint = 0;
-		size_t size = 1;
-		utf8_to_32(ptr + bit_offset, next - bit_offset, &codepoint, &size);
-
-		if (!TTF_GlyphIsProvided32(font, codepoint)) {
+	//characters the font has are appended in runs, not one by one
+	size_t run_start = 0;
+	UTFIterator it = utf_iter_begin(sv);
+	UTFChar c;
+	while (utf_iter_next(&it, &c)) {
+		if (!TTF_GlyphIsProvided32(font, c.codepoint)) {
+			utf_append_sv(copy, utf_sv_sub_sv_bytes(sv, run_start, c.byte_offset));
 			utf_append_sv(copy, replacement);
+			run_start = it.byte_offset;
 		}
-		else {
-			UTFStringView character = utf_sv_sub_sv(sv, i, i + 1);
-			utf_append_sv(copy, character);
-		}
-		bit_offset = next;
 	}
+	utf_append_sv(copy, utf_sv_sub_sv_bytes(sv, run_start, sv.data_size));
 
 	return copy;
 }
 
-void get_cursor_screen_pos(TextBox* box, int* cursor_x, int* cursor_y)
+//how many rows the line takes, line that couldn't fit a character still takes one
+size_t get_line_row_count(TextBox* box, TextLine* line)
 {
-	TextLine* cursor_line = get_line_from_line_number(box, box->cursor.line_number);
+	ensure_text_line_updated(box, line);
+	return max(line->wrapped_line_count, 1);
+}
 
-	size_t cursor_char_x, cursor_char_y;
+//returns false if it's the first row of the document
+bool move_row_up(TextBox* box, TextBoxScroll* row)
+{
+	if (row->wrapped_line > 0) {
+		row->wrapped_line--;
+		return true;
+	}
+	if (row->line_number == 0) {
+		return false;
+	}
 
-	get_char_coord_from_cursor(box, box->cursor, &cursor_char_x, &cursor_char_y);
+	row->line_number--;
+	row->wrapped_line = get_line_row_count(box, get_line_from_line_number(box, row->line_number)) - 1;
+	return true;
+}
 
-	int offset_y = 0;
-	size_t line_number = box->cursor.line_number;
+//returns false if it's the last row of the document
+bool move_row_down(TextBox* box, TextBoxScroll* row)
+{
+	TextLine* line = get_line_from_line_number(box, row->line_number);
+	if (row->wrapped_line + 1 < get_line_row_count(box, line)) {
+		row->wrapped_line++;
+		return true;
+	}
+	if (row->line_number + 1 >= box->line_count) {
+		return false;
+	}
 
-	{
-		TextLine* line = box->first_line;
-		for (size_t i = 0; i < line_number; i++) {
-			offset_y += line->size_y;
-			if (line->next) {
-				line = line->next;
-			}
-			else {
-				fprintf(stderr, "%s:%d:ERROR : Failed to get a cursor y offset\n", __FILE__, __LINE__);
-				fprintf(stderr, "line %zu does not have a next line\n", line->line_number);
-				return;
-			}
+	row->line_number++;
+	row->wrapped_line = 0;
+	return true;
+}
+
+int compare_rows(TextBoxScroll a, TextBoxScroll b)
+{
+	if (a.line_number != b.line_number) {
+		return a.line_number < b.line_number ? -1 : 1;
+	}
+	if (a.wrapped_line != b.wrapped_line) {
+		return a.wrapped_line < b.wrapped_line ? -1 : 1;
+	}
+	return 0;
+}
+
+//keeps the top row in the document after lines were removed or got shorter
+void clamp_box_scroll(TextBox* box)
+{
+	if (box->scroll.line_number >= box->line_count) {
+		box->scroll.line_number = box->line_count - 1;
+		box->scroll.wrapped_line = SIZE_MAX;
+	}
+
+	size_t row_count = get_line_row_count(box, get_line_from_line_number(box, box->scroll.line_number));
+	if (box->scroll.wrapped_line >= row_count) {
+		box->scroll.wrapped_line = row_count - 1;
+		box->scroll.pixel_offset = 0;
+	}
+}
+
+//y of the row from the top of the text box
+//only rows within a text box height of it are walked to,
+//the ones further away are somewhere below -h or above h
+int get_row_view_y(TextBox* box, TextBoxScroll row)
+{
+	int font_height = TTF_FontHeight(box->font);
+
+	clamp_box_scroll(box);
+	TextBoxScroll at = box->scroll;
+	int y = -box->scroll.pixel_offset;
+
+	while (compare_rows(row, at) < 0 && y >= -box->h) {
+		move_row_up(box, &at);
+		y -= font_height;
+	}
+	while (compare_rows(row, at) > 0 && y <= box->h) {
+		if (!move_row_down(box, &at)) {
+			break;
 		}
+		y += font_height;
 	}
 
+	return y;
+}
+
+//scrolls down by pixels(up if it's negative), it stops at the first and the last row
+void scroll_box_by(TextBox* box, int pixels)
+{
 	int font_height = TTF_FontHeight(box->font);
 
-	offset_y += font_height * cursor_char_y;
+	clamp_box_scroll(box);
+	int pixel_offset = box->scroll.pixel_offset + pixels;
+
+	while (pixel_offset < 0) {
+		if (!move_row_up(box, &box->scroll)) {
+			pixel_offset = 0;
+			break;
+		}
+		pixel_offset += font_height;
+	}
+	while (pixel_offset >= font_height) {
+		if (!move_row_down(box, &box->scroll)) {
+			pixel_offset = 0;
+			break;
+		}
+		pixel_offset -= font_height;
+	}
+
+	box->scroll.pixel_offset = pixel_offset;
+}
+
+TextBoxScroll get_cursor_row(TextBox* box)
+{
+	size_t cursor_char_y = 0;
+	get_char_coord_from_cursor(box, box->cursor, NULL, &cursor_char_y);
+
+	TextBoxScroll row = {.line_number = box->cursor.line_number, .wrapped_line = cursor_char_y};
+	return row;
+}
+
+//cursor_y is from the top of the text box
+void get_cursor_screen_pos(TextBox* box, int* cursor_x, int* cursor_y)
+{
+	TextLine* cursor_line = get_line_from_line_number(box, box->cursor.line_number);
+	ensure_text_line_updated(box, cursor_line);
+
+	size_t cursor_char_x, cursor_char_y;
+
+	get_char_coord_from_cursor(box, box->cursor, &cursor_char_x, &cursor_char_y);
+
+	TextBoxScroll cursor_row = {.line_number = box->cursor.line_number, .wrapped_line = cursor_char_y};
+	int offset_y = get_row_view_y(box, cursor_row);
 
-	UTFStringView sv = utf_sv_sub_str((cursor_line->str), 0, box->cursor.char_offset);
+	UTFStringView sv = {
+		.data = text_line_sv(cursor_line).data,
+		.data_size = box->cursor.byte_offset,
+		.count = box->cursor.char_offset
+	};
 
 	for (size_t i = 0; i < min(cursor_line->wrapped_line_count, cursor_char_y); i++) {
 		sv = utf_sv_trim_left(sv, cursor_line->wrapped_line_sizes[i]);
@@ -200,8 +652,8 @@ void get_cursor_screen_pos(TextBox* box, int* cursor_x, int* cursor_y)
 
 	UTFString* copy = replace_missing_glyph_with_char(sv, box->font, utf_sv_from_cstr(MISSING_GLYPH));
 
-	int measured_x = 0;
-	sv_fits(utf_sv_from_str(copy), box->font, box->w, NULL, &measured_x);
+	//text before the cursor on its row fits the row, so it's measured once
+	int measured_x = sv_width(box->font, utf_sv_from_str(copy));
 
 	if (cursor_x) {
 		*cursor_x = measured_x;
@@ -213,22 +665,26 @@ void get_cursor_screen_pos(TextBox* box, int* cursor_x, int* cursor_y)
 	utf_destroy(copy);
 }
 
-int calculate_new_box_offset_y(TextBox* box, TextCursor cursor) {
+//scrolls the least to show the row, it's at the top or the bottom then
+void scroll_to_row(TextBox* box, TextBoxScroll row)
+{
 	int font_height = TTF_FontHeight(box->font);
 
-	int offset_y = box->offset_y;
+	int row_y = get_row_view_y(box, row);
+	row.pixel_offset = 0;
 
-	int cursor_x = 0;
-	int cursor_y = 0;
-	get_cursor_screen_pos(box, &cursor_x, &cursor_y);
-	if (cursor_y + box->offset_y < 0) {
-		offset_y = -cursor_y;
+	if (row_y < 0) {
+		box->scroll = row;
 	}
-	else if (cursor_y + box->offset_y > box->h - font_height) {
-		offset_y = box->h - cursor_y - font_height;
+	else if (row_y > box->h - font_height) {
+		box->scroll = row;
+		scroll_box_by(box, -(box->h - font_height));
 	}
+}
 
-	return offset_y;
+void scroll_to_cursor(TextBox* box)
+{
+	scroll_to_row(box, get_cursor_row(box));
 }
 
 Selection set_selection_to_cursor(TextCursor cursor) {
@@ -253,6 +709,160 @@ bool has_selection(TextBox* box, Selection selection)
 	return !no_selection;
 }
 
+//handles events while find bar is open
+//returns true if event was used by the find bar
+bool handle_find_event(TextBox* box, OS_Event* event, bool holding_shift, bool holding_ctrl)
+{
+	switch (event->type) {
+		case OS_TEXT_INPUT_EVENT: {
+			UTFString* query = utf_copy(box->find.query);
+			utf_append_sv(query, event->text_input_event.text_sv);
+			text_box_set_find_query(box, utf_sv_from_str(query));
+			utf_destroy(query);
+			return true;
+		}
+		case OS_TEXT_PASTE_EVENT: {
+			//only the first line of the pasted text goes to the query
+			UTFStringView paste_sv = event->text_paste_event.paste_sv;
+			size_t line_end = 0;
+			while (line_end < paste_sv.data_size && paste_sv.data[line_end] != '\n' && paste_sv.data[line_end] != '\r') {
+				line_end++;
+			}
+			UTFString* query = utf_copy(box->find.query);
+			UTFStringView first_line = { .data = paste_sv.data, .data_size = line_end };
+			first_line.count = utf_sv_count(first_line);
+			utf_append_sv(query, first_line);
+			text_box_set_find_query(box, utf_sv_from_str(query));
+			utf_destroy(query);
+			return true;
+		}
+		case OS_KEY_PRESS_EVENT: {
+			switch (event->keyboard_event.key_sym) {
+				case OS_KEY_ESC: {
+					box->is_finding = false;
+					text_box_set_find_query(box, utf_sv_from_cstr(u8""));
+					return true;
+				}
+				case OS_KEY_BACKSPACE: {
+					UTFString* query = utf_copy(box->find.query);
+					utf_erase_right(query, 1);
+					text_box_set_find_query(box, utf_sv_from_str(query));
+					utf_destroy(query);
+					return true;
+				}
+				case OS_KEY_ENTER: {
+					text_box_find_next(box, holding_shift);
+					return true;
+				}
+				case OS_KEY_f:
+				case OS_KEY_F: {
+					return holding_ctrl;
+				}
+				case OS_KEY_r:
+				case OS_KEY_R: {
+					if (holding_ctrl) {
+						text_box_set_find_regex(box, !box->find.is_regex);
+						return true;
+					}
+					return false;
+				}
+				default: {
+					return false;
+				}
+			}
+		}
+		default: {
+			return false;
+		}
+	}
+}
+
+//go to line bar takes digits, enter jumps to the line
+bool handle_go_to_line_event(TextBox* box, OS_Event* event)
+{
+	switch (event->type) {
+		case OS_TEXT_INPUT_EVENT: {
+			UTFStringView text = event->text_input_event.text_sv;
+			for (size_t i = 0; i < text.data_size; i++) {
+				//bigger numbers go to the last line anyway
+				if (text.data[i] >= '0' && text.data[i] <= '9' && box->go_to_line_number < SIZE_MAX / 100) {
+					box->go_to_line_number = box->go_to_line_number * 10 + (text.data[i] - '0');
+				}
+			}
+			box->need_to_render = true;
+			return true;
+		}
+		case OS_TEXT_PASTE_EVENT: {
+			return true;
+		}
+		case OS_KEY_PRESS_EVENT: {
+			switch (event->keyboard_event.key_sym) {
+				case OS_KEY_ESC: {
+					box->is_going_to_line = false;
+					box->need_to_render = true;
+					return true;
+				}
+				case OS_KEY_BACKSPACE: {
+					box->go_to_line_number /= 10;
+					box->need_to_render = true;
+					return true;
+				}
+				case OS_KEY_ENTER: {
+					//lines are shown from 1
+					if (box->go_to_line_number > 0) {
+						text_box_go_to_line(box, box->go_to_line_number - 1);
+					}
+					box->is_going_to_line = false;
+					box->need_to_render = true;
+					return true;
+				}
+				default: {
+					return false;
+				}
+			}
+		}
+		default: {
+			return false;
+		}
+	}
+}
+
+//whether the event would change the document
+bool is_editing_event(OS_Event* event, bool holding_ctrl)
+{
+	switch (event->type) {
+		case OS_TEXT_INPUT_EVENT:
+		case OS_TEXT_PASTE_EVENT: {
+			return true;
+		}
+		case OS_KEY_PRESS_EVENT: {
+			switch (event->keyboard_event.key_sym) {
+				case OS_KEY_ENTER:
+				case OS_KEY_BACKSPACE: {
+					return true;
+				}
+				//paste, undo, redo, save, reload and follow
+				case OS_KEY_v: case OS_KEY_V:
+				case OS_KEY_z: case OS_KEY_Z:
+				case OS_KEY_y: case OS_KEY_Y:
+				case OS_KEY_s: case OS_KEY_S:
+				case OS_KEY_r: case OS_KEY_R:
+				case OS_KEY_t: case OS_KEY_T: {
+					return holding_ctrl;
+				}
+				default: {
+					return false;
+				}
+			}
+		}
+		default: {
+			return false;
+		}
+	}
+}
+
+void insert_paste_piece(TextBox* box, OS_TextPasteEvent paste_event);
+
 void text_box_handle_event(TextBox* box, OS_Event* event)
 {
 	OS_Keymod key_mode =  os_get_mod_state();
@@ -260,15 +870,42 @@ void text_box_handle_event(TextBox* box, OS_Event* event)
 	bool holding_shift = key_mode & OS_KMOD_SHIFT;
 	bool holding_ctrl = key_mode & OS_KMOD_CTRL;
 
-	//if holding shift and text box is not selecting
-	//then begin selection
-	if (holding_shift && !box->is_selecting) {
-		box->selection = set_selection_to_cursor(box->cursor);
-		box->is_selecting = true;
+	//rest of the paste goes where its first piece went, edits would move that place so they wait
+	if (box->is_pasting) {
+		if (event->type == OS_TEXT_PASTE_EVENT) {
+			insert_paste_piece(box, event->text_paste_event);
+			return;
+		}
+		if (box->is_pasting_to_document && is_editing_event(event, holding_ctrl)) {
+			return;
+		}
+	}
+	if (event->type == OS_TEXT_PASTE_EVENT) {
+		box->is_pasting = event->text_paste_event.more_to_come;
+		box->is_pasting_to_document = false;
 	}
 
-	bool have_selection = has_selection(box,box->selection);
-
+	if (box->is_finding && handle_find_event(box, event, holding_shift, holding_ctrl)) {
+		return;
+	}
+	if (box->is_going_to_line && handle_go_to_line_event(box, event)) {
+		return;
+	}
+
+	//viewed file can only be moved around in, searched and copied from
+	if (box->is_read_only && is_editing_event(event, holding_ctrl)) {
+		return;
+	}
+
+	//if holding shift and text box is not selecting
+	//then begin selection
+	if (holding_shift && !box->is_selecting) {
+		box->selection = set_selection_to_cursor(box->cursor);
+		box->is_selecting = true;
+	}
+
+	bool have_selection = has_selection(box,box->selection);
+
 	switch (event->type) {
         case OS_TEXT_INPUT_EVENT: {
             if (have_selection) {
@@ -279,7 +916,7 @@ void text_box_handle_event(TextBox* box, OS_Event* event)
             if (!holding_shift) {
                 box->is_selecting = false;
             }
-            box->offset_y = calculate_new_box_offset_y(box, box->cursor);
+            scroll_to_cursor(box);
         }break;
 
         case OS_KEY_PRESS_EVENT: {
@@ -296,9 +933,11 @@ void text_box_handle_event(TextBox* box, OS_Event* event)
                     if (!holding_shift) {
                         box->is_selecting = false;
                     }
-                    box->offset_y = calculate_new_box_offset_y(box, box->cursor);
+                    scroll_to_cursor(box);
                 }break;
                 case OS_KEY_LEFT: {
+                    //cursor jumped so next edit is undone separately
+                    text_undo_seal(&box->undo);
                     if (holding_shift) {
                         if(holding_ctrl){
                             box->cursor = text_box_move_cursor_left_word(box, box->cursor);
@@ -321,9 +960,10 @@ void text_box_handle_event(TextBox* box, OS_Event* event)
                         box->need_to_render = true;
                     }
 
-                    box->offset_y = calculate_new_box_offset_y(box, box->cursor);
+                    scroll_to_cursor(box);
                 }break;
                 case OS_KEY_RIGHT: {
+                    text_undo_seal(&box->undo);
                     if (holding_shift) {
                         if(holding_ctrl){
                             box->cursor = text_box_move_cursor_right_word(box, box->cursor);
@@ -346,9 +986,10 @@ void text_box_handle_event(TextBox* box, OS_Event* event)
                         box->need_to_render = true;
                     }
 
-                    box->offset_y = calculate_new_box_offset_y(box, box->cursor);
+                    scroll_to_cursor(box);
                 }break;
                 case OS_KEY_UP: {
+                    text_undo_seal(&box->undo);
                     box->cursor = text_box_move_cursor_up(box, box->cursor);
                     if (holding_shift) {
                         box->selection = set_selection_end(box->selection, box->cursor);
@@ -357,9 +998,10 @@ void text_box_handle_event(TextBox* box, OS_Event* event)
                         box->is_selecting = false;
                     }
 
-                    box->offset_y = calculate_new_box_offset_y(box, box->cursor);
+                    scroll_to_cursor(box);
                 }break;
                 case OS_KEY_DOWN: {
+                    text_undo_seal(&box->undo);
                     box->cursor = text_box_move_cursor_down(box, box->cursor);
                     if (holding_shift) {
                         box->selection = set_selection_end(box->selection, box->cursor);
@@ -368,7 +1010,44 @@ void text_box_handle_event(TextBox* box, OS_Event* event)
                         box->is_selecting = false;
                     }
 
-                    box->offset_y = calculate_new_box_offset_y(box, box->cursor);
+                    scroll_to_cursor(box);
+                }break;
+                case OS_KEY_PAGE_UP:
+                case OS_KEY_PAGE_DOWN:
+                case OS_KEY_HOME:
+                case OS_KEY_END: {
+                    text_undo_seal(&box->undo);
+                    if (key == OS_KEY_PAGE_UP) {
+                        box->cursor = text_box_move_cursor_page_up(box, box->cursor);
+                    }
+                    else if (key == OS_KEY_PAGE_DOWN) {
+                        box->cursor = text_box_move_cursor_page_down(box, box->cursor);
+                    }
+                    else if (key == OS_KEY_HOME) {
+                        if (holding_ctrl) {
+                            box->cursor = text_box_move_cursor_document_start(box, box->cursor);
+                        }
+                        else {
+                            box->cursor = text_box_move_cursor_line_start(box, box->cursor);
+                        }
+                    }
+                    else {
+                        if (holding_ctrl) {
+                            box->cursor = text_box_move_cursor_document_end(box, box->cursor);
+                        }
+                        else {
+                            box->cursor = text_box_move_cursor_line_end(box, box->cursor);
+                        }
+                    }
+
+                    if (holding_shift) {
+                        box->selection = set_selection_end(box->selection, box->cursor);
+                    }
+                    else {
+                        box->is_selecting = false;
+                    }
+
+                    scroll_to_cursor(box);
                 }break;
                 case OS_KEY_BACKSPACE: {
                     if (have_selection) {
@@ -383,16 +1062,16 @@ void text_box_handle_event(TextBox* box, OS_Event* event)
                     else {
                         box->is_selecting = false;
                     }
-                    box->offset_y = calculate_new_box_offset_y(box, box->cursor);
+                    scroll_to_cursor(box);
                 }break;
 
                 case OS_KEY_F1: {
                     box->cursor = text_box_type(box, box->cursor, utf_sv_from_cstr(TEST_TEXT_ENGLISH));
-                    box->offset_y = calculate_new_box_offset_y(box, box->cursor);
+                    scroll_to_cursor(box);
                 }break;
                 case OS_KEY_F2: {
                     box->cursor = text_box_type(box, box->cursor, utf_sv_from_cstr(TEST_TEXT_KOREAN));
-                    box->offset_y = calculate_new_box_offset_y(box, box->cursor);
+                    scroll_to_cursor(box);
                 }break;
 
                 case OS_KEY_F3: {
@@ -413,18 +1092,93 @@ void text_box_handle_event(TextBox* box, OS_Event* event)
                     }
                 }break;
 
+                //handle ctrl z event
+                case OS_KEY_z:
+                case OS_KEY_Z: {
+                    if(holding_ctrl){
+                        if(holding_shift){
+                            text_box_redo(box);
+                        }
+                        else{
+                            text_box_undo(box);
+                        }
+                    }
+                }break;
+
+                //handle ctrl y event
+                case OS_KEY_y:
+                case OS_KEY_Y: {
+                    if(holding_ctrl){
+                        text_box_redo(box);
+                    }
+                }break;
+
+                //handle ctrl s event
+                case OS_KEY_s:
+                case OS_KEY_S: {
+                    if(holding_ctrl && box->file_path){
+                        if(!text_box_save_file(box, box->file_path)){
+                            fprintf(stderr, "%s:%d:ERROR : Failed to save %s\n", __FILE__, __LINE__, box->file_path);
+                        }
+                    }
+                }break;
+
+                //handle ctrl f event
+                case OS_KEY_f:
+                case OS_KEY_F: {
+                    if(holding_ctrl){
+                        text_box_start_find(box);
+                    }
+                }break;
+
+                //handle ctrl g event
+                case OS_KEY_g:
+                case OS_KEY_G: {
+                    if(holding_ctrl){
+                        box->is_finding = false;
+                        box->is_going_to_line = true;
+                        box->go_to_line_number = 0;
+                        box->need_to_render = true;
+                    }
+                }break;
+
+                //handle ctrl r event
+                case OS_KEY_r:
+                case OS_KEY_R: {
+                    if(holding_ctrl && box->file_path){
+                        if(!text_box_reload_file(box)){
+                            fprintf(stderr, "%s:%d:ERROR : Failed to reload %s\n", __FILE__, __LINE__, box->file_path);
+                        }
+                    }
+                }break;
+
+                //handle ctrl t event
+                case OS_KEY_t:
+                case OS_KEY_T: {
+                    if(holding_ctrl){
+                        if(box->follower){
+                            text_box_stop_follow(box);
+                        }
+                        else{
+                            text_box_start_follow(box);
+                        }
+                        box->need_to_render = true;
+                    }
+                }break;
+
                 //handle ctrl c event
                 case OS_KEY_c:
                 case OS_KEY_C: {
                     if(holding_ctrl){
+						//this only remembers the selection
+						//text is built when someone actually pastes it
 						if(have_selection){
-							UTFString* tmp = text_box_get_selection_str(box, box->selection);
-							os_set_clipboard_text(utf_sv_from_str(tmp));
-							utf_destroy(tmp);
+							text_box_copy_selection(box, box->selection);
 						}
 						else{
-							os_set_clipboard_text(utf_sv_from_cstr(u8""));
+							text_box_copy_selection(box, set_selection_to_cursor(box->cursor));
 						}
+						os_claim_clipboard();
                     }
                 }break;
 				default : { /*pass*/ } break;
@@ -436,11 +1190,13 @@ void text_box_handle_event(TextBox* box, OS_Event* event)
                 box->cursor = text_box_delete_range(box, box->selection);
             }
             box->cursor = text_box_type(box, box->cursor, event->text_paste_event.paste_sv);
+            box->paste_end = box->cursor;
+            box->is_pasting_to_document = true;
             box->selection = set_selection_to_cursor(box->cursor);
             if (!holding_shift) {
                 box->is_selecting = false;
             }
-            box->offset_y = calculate_new_box_offset_y(box, box->cursor);
+            scroll_to_cursor(box);
         }break;
 		default : { /*pass*/ } break;
 	}
@@ -449,29 +1205,36 @@ void text_box_handle_event(TextBox* box, OS_Event* event)
 	int cursor_pos_x, cursor_pos_y;
 	get_cursor_screen_pos(box, &cursor_pos_x, &cursor_pos_y);
 	int font_height = TTF_FontHeight(box->font);
-	os_set_ime_preedit_pos(cursor_pos_x, cursor_pos_y + font_height + box->offset_y);
+	os_set_ime_preedit_pos(cursor_pos_x, cursor_pos_y + font_height);
 }
 
 void update_text_line(TextBox* box, TextLine* line)
 {
-	UTFString* copy = replace_missing_glyph_with_char(utf_sv_from_str(line->str), box->font, utf_sv_from_cstr(MISSING_GLYPH));
+	//replayed lines might change many times before they are shown
+	if (box->is_replaying) {
+		defer_text_line_update(box, line);
+		return;
+	}
+
+	UTFString* copy = replace_missing_glyph_with_char(text_line_sv(line), box->font, utf_sv_from_cstr(MISSING_GLYPH));
 
 	UTFStringView sv = utf_sv_from_str(copy);
 	int font_height = TTF_FontHeight(box->font);
 
+	line->needs_update = false;
+
 	if (sv.count == 0) {
 		line->size_y = font_height;
 		line->size_x = box->w;
-		line->wrapped_line_count = 1;
-		line->wrapped_line_sizes[0] = 0;
+		text_line_clear_wrapped_line_sizes(line);
+		text_line_push_wrapped_line_size(line, 0);
 		utf_destroy(copy);
 		return;
 	}
 
 	line->size_x = box->w;
 
-	size_t size_offset = 0;
-	line->wrapped_line_count = 0;
+	text_line_clear_wrapped_line_sizes(line);
 	line->size_y = 0;
 
 	while (true) {
@@ -484,8 +1247,7 @@ void update_text_line(TextBox* box, TextLine* line)
 			break;
 		}
 
-		line->wrapped_line_sizes[size_offset++] = measured_count;
-		line->wrapped_line_count++;
+		text_line_push_wrapped_line_size(line, measured_count);
 		line->size_y += font_height;
 		sv = utf_sv_trim_left(sv, measured_count);
 		if (fits) {
@@ -494,7 +1256,30 @@ void update_text_line(TextBox* box, TextLine* line)
 	}
 
 	utf_destroy(copy);
+}
+
+//Skip laying out the line until it's actually needed.
+//Until then line is treated as a single unwrapped row
+void defer_text_line_update(TextBox* box, TextLine* line)
+{
+	line->needs_update = true;
+	line->size_x = box->w;
+	line->size_y = TTF_FontHeight(box->font);
+	line->wrapped_line_count = 1;
+	//mapped line is not read just to count characters
+	if (line->str) {
+		line->wrapped_line_sizes[0] = line->str->count;
+	}
+	else {
+		line->wrapped_line_sizes[0] = line->mapped_count != SIZE_MAX ? line->mapped_count : line->mapped_size;
+	}
+}
 
+void ensure_text_line_updated(TextBox* box, TextLine* line)
+{
+	if (line->needs_update) {
+		update_text_line(box, line);
+	}
 }
 
 TextBox* text_box_create(
@@ -511,9 +1296,10 @@ TextBox* text_box_create(
 
 	box->font = font;
 
-	box->offset_y = 0;
+	memset(&box->scroll, 0, sizeof(TextBoxScroll));
 
 	box->cursor.char_offset = 0;
+	box->cursor.byte_offset = 0;
 	box->cursor.line_number = 0;
 	box->cursor.place_after_last_char_before_wrapping = false;
 
@@ -523,11 +1309,20 @@ TextBox* text_box_create(
 		return NULL;
 	}
 
+	box->is_replaying = false;
+
 	box->first_line = create_lines_from_cstr(text);
+	box->line_hint = NULL;
+	box->line_jumps = NULL;
+	box->line_jump_count = 0;
+	box->line_jump_capacity = 0;
+	box->unnumbered_line = NULL;
+	box->line_count = 0;
 
 	//calculate line pixel width and height
 	for (TextLine* line = box->first_line; line != NULL; line = line->next) {
 		update_text_line(box, line);
+		box->line_count++;
 	}
 
 	box->selection.start_char = 0;
@@ -548,232 +1343,904 @@ TextBox* text_box_create(
 
 	box->composite_str = utf_from_cstr(u8"");
 
+	box->clipboard.has_snapshot = false;
+	box->clipboard.snapshot = NULL;
+	box->clipboard.start_line = NULL;
+	box->clipboard.start_byte = 0;
+	box->clipboard.end_line = NULL;
+	box->clipboard.end_byte = 0;
+	box->clipboard.counted_removed_lines = NULL;
+	box->clipboard.removed_line_count = 0;
+	box->clipboard.str = NULL;
+	box->clipboard.generation = 0;
+
+	box->is_pasting = false;
+	box->is_pasting_to_document = false;
+
+	box->removed_lines = NULL;
+	text_undo_init(&box->undo, &box->removed_lines);
+
+	box->mapping = NULL;
+	memset(&box->line_index, 0, sizeof(TextLineIndex));
+	box->load = NULL;
+	box->file_path = NULL;
+	box->file_change_count = 0;
+	memset(&box->file_stamp, 0, sizeof(OS_FileStamp));
+	box->last_reload_check_time = 0;
+
+	box->change_count = 0;
+	box->autosaved_change_count = 0;
+	box->autosave_change_count = 0;
+	box->last_autosave_time = 0;
+	box->autosave_snapshot = NULL;
+	box->autosave_job = NULL;
+	box->journal = NULL;
+	memset(&box->journal_base, 0, sizeof(TextJournalBase));
+	box->has_journal_base = false;
+
+	box->follower = NULL;
+	box->follow_buffer = NULL;
+	box->follow_carry_size = 0;
+
+	box->is_finding = false;
+	text_find_init(&box->find);
+
+	box->is_going_to_line = false;
+	box->go_to_line_number = 0;
+
+	box->is_read_only = false;
+	box->index_cache = NULL;
+	box->index_cache_job = NULL;
+
+	box->reload_job = NULL;
+	box->reload_snapshot = NULL;
+	box->reload_mapping = NULL;
+
 	box->preedit_pos_setter = pos_setter;
 
 	return box;
 }
 
+void stop_autosave(TextBox* box);
+void stop_reload_job(TextBox* box);
+void remove_journal(TextBox* box);
+
+//job reads the index, so it's stopped before the index goes away
+void stop_index_cache_job(TextBox* box)
+{
+	if (box->index_cache_job) {
+		text_index_cache_job_destroy(box->index_cache_job);
+		box->index_cache_job = NULL;
+	}
+}
+
+//index of a viewed file is kept next to it once the file is split
+void start_index_cache_job(TextBox* box)
+{
+	if (!box->is_read_only || !box->mapping || box->index_cache || box->index_cache_job) {
+		return;
+	}
+
+	char* cache_path = get_path_with_suffix(box->file_path, TEXT_BOX_INDEX_CACHE_SUFFIX);
+	box->index_cache_job = text_index_cache_job_start(cache_path, &box->line_index, box->file_stamp);
+	free(cache_path);
+}
+
+void poll_index_cache_job(TextBox* box)
+{
+	bool success = false;
+	if (!box->index_cache_job || !text_index_cache_job_poll(box->index_cache_job, &success)) {
+		return;
+	}
+
+	if (!success) {
+		fprintf(stderr, "%s:%d:ERROR : Failed to keep the line index of %s\n", __FILE__, __LINE__, box->file_path);
+	}
+	stop_index_cache_job(box);
+}
+
 void text_box_destroy(TextBox* box)
 {
 	if (!box) {
 		return;
 	}
 
+	//autosave reads the lines
+	stop_autosave(box);
+	//so do the copied text, find and reload workers
+	drop_clipboard_snapshot(box);
+	text_find_wait(&box->find);
+	stop_reload_job(box);
+
+	//edits that weren't saved are dropped on purpose, only a crash leaves the journal behind
+	remove_journal(box);
+
+	text_box_stop_follow(box);
+
 	for (TextLine* line = box->first_line; line != NULL; ) {
 		TextLine* tmp_next = line->next;
 		text_line_destroy(line);
 		line = tmp_next;
 	}
 
+	//undo gives its lines to removed lines
+	text_undo_destroy(&box->undo);
+	text_box_free_removed_lines(box, SIZE_MAX);
+
+	//lines are gone so nothing points to the mapping anymore
+	if (box->load) {
+		text_load_destroy(box->load);
+	}
+	stop_index_cache_job(box);
+	if (box->mapping) {
+		os_unmap_file(box->mapping);
+		text_line_index_destroy(&box->line_index);
+	}
+	if (box->index_cache) {
+		text_index_cache_close(box->index_cache);
+	}
+
+	free(box->line_jumps);
+	free(box->file_path);
+
 	if(box->composite_str){
         utf_destroy(box->composite_str);
 	}
 
+	if (box->clipboard.str) {
+		utf_destroy(box->clipboard.str);
+	}
+
+	text_find_destroy(&box->find);
+
 	if (box->render_surface)
 		SDL_FreeSurface(box->render_surface);
 
 	free(box);
 }
 
-TextCursor text_box_type(TextBox* box, TextCursor cursor, UTFStringView sv)
+//Inserts text that has new lines in it
+//
+//Lines are split in one pass and only the lines cursor ends up on are laid out,
+//rest of them are laid out when they are actually displayed.
+//Returns cursor at the end of the inserted text
+TextCursor text_box_insert_lines(TextBox* box, TextCursor cursor, UTFStringView sv)
 {
 	TextLine* cursor_line = get_line_from_line_number(box, cursor.line_number);
+	prepare_line_edit(box, cursor_line);
 	TextCursor new_cursor_pos = cursor;
 
-	int new_line_index = utf_sv_find(sv, utf_sv_from_cstr(u8"\n"));
-	bool has_new_line = new_line_index >= 0;
+	TextLine* new_lines = create_lines_from_sv(sv);
+	TextLine* new_lines_last = new_lines;
+	size_t new_line_count = 1;
+	while (new_lines_last->next) {
+		new_lines_last = new_lines_last->next;
+		new_line_count++;
+	}
+
+	//text that was after the cursor goes to the end of the last inserted line
+	size_t insertion_byte = cursor.byte_offset;
+	UTFStringView after_insertion = {
+		.data = cursor_line->str->data + insertion_byte,
+		.data_size = cursor_line->str->data_size - insertion_byte,
+		.count = cursor_line->str->count - cursor.char_offset
+	};
 
-	if (!has_new_line) {
-		size_t char_offset = cursor.char_offset;
-		utf_insert_sv(cursor_line->str, char_offset, sv);
-		update_text_line(box, cursor_line);
-		new_cursor_pos.char_offset = char_offset + sv.count;
+	size_t cursor_char_pos = new_lines_last->str->count;
+	size_t cursor_byte_pos = new_lines_last->str->data_size;
+	utf_append_sv(new_lines_last->str, after_insertion);
+
+	//new lines follows inserted cursor line's new line ending
+	new_lines_last->ends_with_crlf = cursor_line->ends_with_crlf;
+	new_lines_last->ends_with_lf = cursor_line->ends_with_lf;
+
+	//first inserted line is merged to the cursor line
+	utf_erase_right(cursor_line->str, after_insertion.count);
+	utf_append_str(cursor_line->str, new_lines->str);
+	cursor_line->ends_with_crlf = new_lines->ends_with_crlf;
+	cursor_line->ends_with_lf = new_lines->ends_with_lf;
+
+	TextLine* first_to_insert = new_lines->next;
+	text_line_destroy(new_lines);
+
+	//insert new lines after current line
+	TextLine* prev_right = cursor_line->next;
+	cursor_line->next = first_to_insert;
+	first_to_insert->prev = cursor_line;
+	new_lines_last->next = prev_right;
+	if (prev_right) {
+		prev_right->prev = new_lines_last;
 	}
-	else {
-		size_t afer_new_line_start = new_line_index + 1;
-		//check if new_line_index is actuall crlf
-		//and if it is move it left
-		if (new_line_index >= 1) {
-			if (utf_sv_cmp(utf_sv_sub_sv(sv, new_line_index - 1, new_line_index), utf_sv_from_cstr(u8"\r"))) {
-				new_line_index--;
-				afer_new_line_start = new_line_index + 2;
-			}
-		}
 
-		//divide typed lines to before new line and after new line
-		UTFStringView before_new_line = utf_sv_sub_sv(sv, 0, new_line_index);
-		UTFStringView after_new_line = utf_sv_sub_sv(sv, afer_new_line_start, sv.count);
+	for (TextLine* line = first_to_insert; line != prev_right; line = line->next) {
+		defer_text_line_update(box, line);
+	}
+	update_text_line(box, cursor_line);
+	update_text_line(box, new_lines_last);
+
+	number_lines_lazily_after(box, cursor_line);
+	box->line_count += new_line_count - 1;
 
-		//create new sub string from original string that starts from insertion point
-		size_t insertion_point = cursor.char_offset;
-		UTFString* after_insertion = utf_sub_str(cursor_line->str, insertion_point, cursor_line->str->count);
+	//calulate cursor pos
+	new_cursor_pos.line_number = cursor.line_number + new_line_count - 1;
+	new_cursor_pos.char_offset = cursor_char_pos;
+	new_cursor_pos.byte_offset = cursor_byte_pos;
 
-		//trim current line to where insertion happens
-		utf_erase_right(cursor_line->str, cursor_line->str->count - insertion_point);
-		//append before new line to current line
-		utf_append_sv(cursor_line->str, before_new_line);
+	box->need_to_render = true;
 
-		size_t cursor_char_pos = 0;
+	return new_cursor_pos;
+}
 
-		//create new text lines from after new line
-		TextLine* new_lines;
-		TextLine* new_lines_last;
+//Copied text is read from the snapshot until it's needed as a whole
+//or the lines it points to are about to be freed
+void serialize_clipboard_snapshot(TextBox* box)
+{
+	if (!box->clipboard.snapshot) {
+		return;
+	}
 
-		if (after_new_line.count == 0) {
-			//if after_new_line is empty then new_lines is just after insertion
-			cursor_char_pos = 0;
+	size_t size = text_box_clipboard_size(box);
+	char* data = malloc(size + 1);
+	ClipboardReader reader = text_box_clipboard_reader(box);
+	UTFStringView sv = {.data = data, .data_size = text_box_clipboard_read(box, &reader, data, size)};
+	sv.count = utf_sv_count(sv);
 
-			//new lines follows inserted cursor line's new line ending
-			//NOTE : Maybe in this case it should follow os's convention
-			new_lines = text_line_create(after_insertion, 0, cursor_line->ends_with_lf, cursor_line->ends_with_crlf);
-			new_lines_last = new_lines;
-		}
-		else {
-			//else we create new lines from after_new_line and append after_insertion at the end
-			new_lines = create_lines_from_sv(after_new_line);
-			//text_line_push_back(new_lines, text_line_create(after_insertion, 0));
-			new_lines_last = text_line_last(new_lines);
-			cursor_char_pos = new_lines_last->str->count;
-			utf_append_cstr(new_lines_last->str, after_insertion->data);
-			utf_destroy(after_insertion);
-
-			//new lines follows inserted cursor line's new line ending
-			new_lines_last->ends_with_crlf = cursor_line->ends_with_crlf;
-			new_lines_last->ends_with_lf = cursor_line->ends_with_lf;
-		}
-
-		//update new lines
-		for (TextLine* line = new_lines; line != NULL; line = line->next) {
-			update_text_line(box, line);
-		}
-		//insert new lines after current line
-		text_line_insert_right(cursor_line, new_lines);
-		text_line_set_number_right(cursor_line, cursor_line->line_number);
-		//update current line
-		update_text_line(box, cursor_line);
+	box->clipboard.str = utf_from_sv(sv);
+	free(data);
+
+	drop_clipboard_snapshot(box);
+}
 
-		//calulate cursor pos
-		new_cursor_pos.line_number = new_lines_last->line_number;
-		new_cursor_pos.char_offset = cursor_char_pos;
+void start_journal(TextBox* box);
+void restart_journal(TextBox* box);
+void mark_document_as_file(TextBox* box);
+
+//Opens the file by mapping it
+//
+//Only line boundaries are found here. Lines point to the mapping
+//and are copied when they are first edited, and they are laid out when they are first shown,
+//so opening a file costs one pass over it and memory for what is actually viewed or edited
+//
+//Read only file doesn't even need that pass when its index was kept from the last time
+bool open_file(TextBox* box, const char* path, bool is_read_only)
+{
+	OS_FileMapping* mapping = os_map_file(path);
+	if (!mapping) {
+		return false;
 	}
 
-	int font_height = TTF_FontHeight(box->font);
+	serialize_clipboard_snapshot(box);
+	//matches point to lines that are about to be freed, and workers might still read them
+	text_find_restart(&box->find);
+	text_find_wait(&box->find);
+	//so do autosave and reload
+	stop_autosave(box);
+	stop_reload_job(box);
+	//old file is closed like the box was destroyed
+	remove_journal(box);
+	text_box_stop_follow(box);
+	//rest of a paste that is still coming in is dropped
+	box->is_pasting_to_document = false;
+
+	//old lines might point to the old mapping so they are freed before it's unmapped
+	text_undo_destroy(&box->undo);
+	for (TextLine* line = box->first_line; line != NULL; ) {
+		TextLine* tmp_next = line->next;
+		text_line_destroy(line);
+		line = tmp_next;
+	}
+	forget_all_lines(box);
+	text_box_free_removed_lines(box, SIZE_MAX);
 
-	int cursor_x = 0;
-	int cursor_y = 0;
-	get_cursor_screen_pos(box, &cursor_x, &cursor_y);
-	if (cursor_y + box->offset_y > box->h - font_height) {
-		box->offset_y = box->h - cursor_y - font_height;
+	if (box->load) {
+		text_load_destroy(box->load);
+		box->load = NULL;
+	}
+	stop_index_cache_job(box);
+	if (box->mapping) {
+		os_unmap_file(box->mapping);
+		text_line_index_destroy(&box->line_index);
 	}
+	if (box->index_cache) {
+		text_index_cache_close(box->index_cache);
+		box->index_cache = NULL;
+	}
+	box->mapping = mapping;
+	box->is_read_only = is_read_only;
 
-	box->need_to_render = true;
+	text_undo_init(&box->undo, &box->removed_lines);
 
-	return new_cursor_pos;
-}
+	const char* data = os_file_mapping_data(mapping);
+	size_t size = os_file_mapping_size(mapping);
 
-size_t get_line_num_from_line_and_char_offset(TextLine* line, size_t char_offset)
-{
-	size_t offset = 0;
-	for (size_t i = 0; i < line->wrapped_line_count; i++) {
-		if (char_offset < offset + line->wrapped_line_sizes[i]) {
-			return i;
-		}
-		offset += line->wrapped_line_sizes[i];
+	//index kept next to the file is used as it is, file doesn't have to be read at all
+	if (!os_get_file_stamp(path, &box->file_stamp)) {
+		memset(&box->file_stamp, 0, sizeof(OS_FileStamp));
+	}
+	if (is_read_only) {
+		char* cache_path = get_path_with_suffix(path, TEXT_BOX_INDEX_CACHE_SUFFIX);
+		box->index_cache = text_index_cache_open(cache_path, data, size, box->file_stamp);
+		free(cache_path);
 	}
-	return line->wrapped_line_count - 1;
-}
 
-bool draw_sv(
-	TextBox* box,
-	UTFStringView sv,
-	int pos_x,
-	int pos_y,
-	bool shaded,
-	SDL_Color text_color,
-	SDL_Color fg_color,
-	SDL_Color bg_color,
-	int* rendered_size_x,
-	int* rendered_size_y
-) {
-	if (sv.count == 0) {
-		if (rendered_size_x) {
-			*rendered_size_x = 0;
+	bool indexed = true;
+	if (box->index_cache) {
+		text_index_cache_get_index(box->index_cache, &box->line_index, data, size);
+	}
+	else if ((indexed = text_line_index_init(&box->line_index, data, size))) {
+		//file is split into lines on a worker thread while the editor is already running
+		box->load = text_load_start(data, size);
+		if (box->load) {
+			//only waits for the first line, rest of them come in with text_box_load_poll
+			while (text_line_index_pending_count(&box->line_index) == 0 && !text_load_is_done(box->load)) {
+				text_load_poll(box->load, &box->line_index);
+			}
 		}
-		if (rendered_size_y) {
-			*rendered_size_y = 0;
+		else {
+			text_line_index_destroy(&box->line_index);
+			indexed = text_line_index_build(&box->line_index, data, size);
 		}
-		return true;
 	}
-	SDL_Surface* surface;
-	UTFString *tmp = utf_from_sv(sv);
 
-	if (!shaded) {
-		//surface = TTF_RenderUTF8_LCD(box->font, sv.data, text_color, box->bg_color);
-		surface = TTF_RenderUTF8_Shaded(box->font, tmp->data, text_color, box->bg_color);
+	if (!indexed) {
+		fprintf(stderr, "%s:%d:ERROR : Failed to index %s\n", __FILE__, __LINE__, path);
+		os_unmap_file(mapping);
+		box->mapping = NULL;
+		box->first_line = create_lines_from_cstr("");
+		update_text_line(box, box->first_line);
+		box->line_count = 1;
 	}
 	else {
-		//surface = TTF_RenderUTF8_LCD(box->font, sv.data, fg_color, bg_color);
-		surface = TTF_RenderUTF8_Shaded(box->font, tmp->data, fg_color, bg_color);
+		//rest of the lines are created when something reaches them
+		box->first_line = text_line_index_create_lines(&box->line_index, TEXT_BOX_LINE_BATCH, 0, NULL);
+		for (TextLine* line = box->first_line; line != NULL; line = line->next) {
+			defer_text_line_update(box, line);
+		}
+		//last line can't be reached until it's known where it ends
+		box->line_count = text_line_index_ended_count(&box->line_index);
 	}
 
-	utf_destroy(tmp);
+	box->cursor.line_number = 0;
+	box->cursor.char_offset = 0;
+	box->cursor.byte_offset = 0;
+	box->cursor.place_after_last_char_before_wrapping = false;
 
-	if (!surface) {
-		fprintf(stderr, "%s:%d:ERROR : Failed to create a surface for text box\n", __FILE__, __LINE__);
-		fprintf(stderr, "%s\n", SDL_GetError());
-		return false;
-	}
+	box->selection = set_selection_to_cursor(box->cursor);
+	box->is_selecting = false;
 
-	SDL_Rect line_rect = { .x = pos_x, .y = pos_y, .w = surface->w, .h = surface->h };
+	memset(&box->scroll, 0, sizeof(TextBoxScroll));
+	box->need_to_render = true;
 
-	//SDL_RenderCopy(box->renderer, texture, NULL, &line_rect);
-	SDL_BlitSurface(surface, NULL, box->render_surface, &line_rect);
+	free(box->file_path);
+	box->file_path = strdup(path);
 
-	if (rendered_size_x) {
-		*rendered_size_x = surface->w;
-	}
-	if (rendered_size_y) {
-		*rendered_size_y = surface->h;
+	box->autosaved_change_count = box->change_count;
+	box->last_autosave_time = os_get_time();
+
+	//replayed edits are not in the file
+	box->file_change_count = box->change_count;
+	box->last_reload_check_time = box->last_autosave_time;
+
+	//nothing is edited so there is nothing to journal
+	if (box->mapping && !is_read_only) {
+		start_journal(box);
 	}
 
-	SDL_FreeSurface(surface);
+	//index that was built right here can be kept already
+	if (!box->load) {
+		start_index_cache_job(box);
+	}
 
 	return true;
 }
 
-Selection normalize_selection(Selection selection)
+bool text_box_open_file(TextBox* box, const char* path)
 {
-	Selection to_return = selection;
+	return open_file(box, path, false);
+}
 
-	if (selection.start_line_number == selection.end_line_number) {
-		if (selection.start_char > selection.end_char) {
-			to_return.end_char = selection.start_char;
-			to_return.start_char = selection.end_char;
-		}
+bool text_box_view_file(TextBox* box, const char* path)
+{
+	return open_file(box, path, true);
+}
+
+//document as it is now, rest of the opened file is written from the mapping
+TextSnapshot* create_snapshot(TextBox* box)
+{
+	const char* tail = NULL;
+	size_t tail_size = 0;
+
+	//lines of the file that don't have TextLines yet start at next_line,
+	//even the ones the load didn't get to
+	TextLineIndex* index = &box->line_index;
+	if (index->next_line < index->line_count) {
+		size_t start = index->line_starts[index->next_line];
+		tail = index->data + start;
+		tail_size = index->size - start;
 	}
-	else {
-		if (selection.start_line_number > selection.end_line_number) {
-			to_return.start_line_number = selection.end_line_number;
-			to_return.start_char = selection.end_char;
 
-			to_return.end_line_number = selection.start_line_number;
-			to_return.end_char = selection.start_char;
-		}
+	return text_snapshot_create(TEXT_SNAPSHOT_AUTOSAVE, box->first_line, tail, tail_size);
+}
+
+void stop_autosave(TextBox* box)
+{
+	if (box->autosave_job) {
+		text_snapshot_job_destroy(box->autosave_job);
+		box->autosave_job = NULL;
+	}
+	if (box->autosave_snapshot) {
+		text_snapshot_destroy(box->autosave_snapshot);
+		box->autosave_snapshot = NULL;
 	}
+}
 
-	return to_return;
+//autosave and journal are written next to the file
+char* get_path_with_suffix(const char* path, const char* suffix)
+{
+	size_t size = strlen(path) + strlen(suffix) + 1;
+	char* path_with_suffix = malloc(size);
+	snprintf(path_with_suffix, size, "%s%s", path, suffix);
+	return path_with_suffix;
 }
 
+bool text_box_save_file(TextBox* box, const char* path)
+{
+	//file is about to have everything autosave would write
+	stop_autosave(box);
 
-void text_box_render(TextBox* box) {
-	if (!box->need_to_render) {
-		return;
+	OS_FileWriter* writer = os_file_writer_create(path);
+	if (!writer) {
+		return false;
 	}
-	//Clear render surface with bg color
-	SDL_FillRect(box->render_surface, NULL,
-		SDL_MapRGBA(box->render_surface->format, box->bg_color.r, box->bg_color.g, box->bg_color.b, box->bg_color.a)) ;
 
-	int font_height = TTF_FontHeight(box->font);
+	//nothing changes while it's written so no line gets frozen
+	TextSnapshot* snapshot = create_snapshot(box);
+	if (!snapshot) {
+		os_file_writer_abort(writer);
+		return false;
+	}
+	bool success = text_snapshot_write(snapshot, writer);
+	text_snapshot_destroy(snapshot);
+
+	if (!success) {
+		os_file_writer_abort(writer);
+		return false;
+	}
+	if (!os_file_writer_commit(writer)) {
+		return false;
+	}
+
+	if (box->file_path && strcmp(path, box->file_path) == 0) {
+		mark_document_as_file(box);
+	}
+
+	return true;
+}
+
+//document is the same as the opened file now
+void mark_document_as_file(TextBox* box)
+{
+	box->autosaved_change_count = box->change_count;
+	box->file_change_count = box->change_count;
+
+	//so writing it isn't taken as someone else changing it
+	if (!os_get_file_stamp(box->file_path, &box->file_stamp)) {
+		memset(&box->file_stamp, 0, sizeof(OS_FileStamp));
+	}
+
+	char* autosave_path = get_path_with_suffix(box->file_path, TEXT_BOX_AUTOSAVE_SUFFIX);
+	remove(autosave_path);
+	free(autosave_path);
+
+	//file has every edit, new journal starts from it
+	restart_journal(box);
+}
+
+bool text_box_autosave_poll(TextBox* box)
+{
+	if (box->autosave_job) {
+		bool success = false;
+		if (!text_snapshot_job_poll(box->autosave_job, &success)) {
+			return true;
+		}
+
+		if (success) {
+			box->autosaved_change_count = box->autosave_change_count;
+		}
+		else {
+			fprintf(stderr, "%s:%d:ERROR : Failed to autosave %s\n", __FILE__, __LINE__, box->file_path);
+		}
+		stop_autosave(box);
+		return false;
+	}
+
+	if (!box->file_path || box->change_count == box->autosaved_change_count) {
+		return false;
+	}
+
+	double now = os_get_time();
+	if (now - box->last_autosave_time < TEXT_BOX_AUTOSAVE_INTERVAL) {
+		return false;
+	}
+	box->last_autosave_time = now;
+
+	box->autosave_snapshot = create_snapshot(box);
+	if (!box->autosave_snapshot) {
+		return false;
+	}
+
+	char* autosave_path = get_path_with_suffix(box->file_path, TEXT_BOX_AUTOSAVE_SUFFIX);
+	box->autosave_job = text_snapshot_job_start(box->autosave_snapshot, autosave_path);
+	free(autosave_path);
+
+	if (!box->autosave_job) {
+		stop_autosave(box);
+		return false;
+	}
+	box->autosave_change_count = box->change_count;
+
+	return true;
+}
+
+TextUndoPosition undo_position_from_cursor(TextCursor cursor)
+{
+	TextUndoPosition pos = {.line_number = cursor.line_number, .char_offset = cursor.char_offset};
+	return pos;
+}
+
+//journal is created by the first edit, so a file that is only looked at leaves nothing behind
+//returns NULL if edits are not journaled
+TextJournal* get_journal(TextBox* box)
+{
+	if (box->journal || !box->has_journal_base) {
+		return box->journal;
+	}
+
+	char* journal_path = get_path_with_suffix(box->file_path, TEXT_BOX_JOURNAL_SUFFIX);
+	box->journal = text_journal_create(journal_path, box->journal_base, NULL, 0);
+	if (!box->journal) {
+		fprintf(stderr, "%s:%d:ERROR : Failed to create %s, edits are not journaled\n", __FILE__, __LINE__, journal_path);
+		//so it isn't tried again on every edit
+		box->has_journal_base = false;
+	}
+	free(journal_path);
+	return box->journal;
+}
+
+//every change to the text goes to the journal, including undo and redo
+void journal_insert(TextBox* box, TextUndoPosition pos, UTFStringView sv)
+{
+	TextJournal* journal = get_journal(box);
+	if (journal) {
+		text_journal_insert(journal, pos, sv);
+	}
+}
+
+//returns the number of the delete in the journal, SIZE_MAX if there is no journal
+size_t journal_delete(TextBox* box, TextUndoPosition start, TextUndoPosition end)
+{
+	TextJournal* journal = get_journal(box);
+	if (journal) {
+		return text_journal_delete(journal, start, end);
+	}
+	return SIZE_MAX;
+}
+
+//inserts text without recording it
+TextCursor insert_text(TextBox* box, TextCursor cursor, UTFStringView sv)
+{
+	journal_insert(box, undo_position_from_cursor(cursor), sv);
+
+	TextLine* cursor_line = get_line_from_line_number(box, cursor.line_number);
+	prepare_line_edit(box, cursor_line);
+	TextCursor new_cursor_pos = cursor;
+
+	bool has_new_line = memchr(sv.data, '\n', sv.data_size) != NULL;
+
+	if (!has_new_line) {
+		utf_insert_sv_at_byte(cursor_line->str, cursor.byte_offset, sv);
+		update_text_line(box, cursor_line);
+		new_cursor_pos.char_offset = cursor.char_offset + sv.count;
+		new_cursor_pos.byte_offset = cursor.byte_offset + sv.data_size;
+	}
+	else {
+		new_cursor_pos = text_box_insert_lines(box, cursor, sv);
+	}
+
+	return new_cursor_pos;
+}
+
+TextCursor text_box_type(TextBox* box, TextCursor cursor, UTFStringView sv)
+{
+	//matches point to lines that are about to change
+	text_find_restart(&box->find);
+
+	TextCursor new_cursor_pos = insert_text(box, cursor, sv);
+
+	text_undo_record_insert(&box->undo, undo_position_from_cursor(cursor), undo_position_from_cursor(new_cursor_pos), sv);
+
+	//cursor might be on a new row
+	TextBoxScroll cursor_row = {.line_number = new_cursor_pos.line_number};
+	get_char_coord_from_cursor(box, new_cursor_pos, NULL, &cursor_row.wrapped_line);
+	scroll_to_row(box, cursor_row);
+
+	box->need_to_render = true;
+
+	return new_cursor_pos;
+}
+
+//inserts next piece of a paste that comes in pieces right after the last one
+//so the paste ends up in one place and is undone as one record
+void insert_paste_piece(TextBox* box, OS_TextPasteEvent paste_event)
+{
+	box->is_pasting = paste_event.more_to_come;
+
+	UTFStringView sv = paste_event.paste_sv;
+	//find bar only took the first line of the first piece
+	if (!box->is_pasting_to_document || sv.data_size == 0) {
+		return;
+	}
+
+	text_find_restart(&box->find);
+
+	TextCursor piece_start = box->paste_end;
+	box->paste_end = insert_text(box, piece_start, sv);
+	text_undo_record_insert_piece(&box->undo, undo_position_from_cursor(piece_start), undo_position_from_cursor(box->paste_end), sv);
+
+	//cursor stays at the end of the paste like it was pasted at once
+	box->cursor = box->paste_end;
+	box->selection = set_selection_to_cursor(box->cursor);
+	box->is_selecting = false;
+	scroll_to_cursor(box);
+
+	box->need_to_render = true;
+}
+
+size_t get_line_num_from_line_and_char_offset(TextLine* line, size_t char_offset)
+{
+	size_t offset = 0;
+	for (size_t i = 0; i < line->wrapped_line_count; i++) {
+		if (char_offset < offset + line->wrapped_line_sizes[i]) {
+			return i;
+		}
+		offset += line->wrapped_line_sizes[i];
+	}
+	return line->wrapped_line_count - 1;
+}
+
+bool draw_sv(
+	TextBox* box,
+	UTFStringView sv,
+	int pos_x,
+	int pos_y,
+	bool shaded,
+	SDL_Color text_color,
+	SDL_Color fg_color,
+	SDL_Color bg_color,
+	int* rendered_size_x,
+	int* rendered_size_y
+) {
+	if (sv.count == 0) {
+		if (rendered_size_x) {
+			*rendered_size_x = 0;
+		}
+		if (rendered_size_y) {
+			*rendered_size_y = 0;
+		}
+		return true;
+	}
+	SDL_Surface* surface;
+	UTFString *tmp = utf_from_sv(sv);
+
+	if (!shaded) {
+		//surface = TTF_RenderUTF8_LCD(box->font, sv.data, text_color, box->bg_color);
+		surface = TTF_RenderUTF8_Shaded(box->font, tmp->data, text_color, box->bg_color);
+	}
+	else {
+		//surface = TTF_RenderUTF8_LCD(box->font, sv.data, fg_color, bg_color);
+		surface = TTF_RenderUTF8_Shaded(box->font, tmp->data, fg_color, bg_color);
+	}
+
+	utf_destroy(tmp);
+
+	if (!surface) {
+		fprintf(stderr, "%s:%d:ERROR : Failed to create a surface for text box\n", __FILE__, __LINE__);
+		fprintf(stderr, "%s\n", SDL_GetError());
+		return false;
+	}
+
+	SDL_Rect line_rect = { .x = pos_x, .y = pos_y, .w = surface->w, .h = surface->h };
+
+	//SDL_RenderCopy(box->renderer, texture, NULL, &line_rect);
+	SDL_BlitSurface(surface, NULL, box->render_surface, &line_rect);
+
+	if (rendered_size_x) {
+		*rendered_size_x = surface->w;
+	}
+	if (rendered_size_y) {
+		*rendered_size_y = surface->h;
+	}
+
+	SDL_FreeSurface(surface);
+
+	return true;
+}
+
+Selection normalize_selection(Selection selection)
+{
+	Selection to_return = selection;
+
+	if (selection.start_line_number == selection.end_line_number) {
+		if (selection.start_char > selection.end_char) {
+			to_return.end_char = selection.start_char;
+			to_return.start_char = selection.end_char;
+		}
+	}
+	else {
+		if (selection.start_line_number > selection.end_line_number) {
+			to_return.start_line_number = selection.end_line_number;
+			to_return.start_char = selection.end_char;
+
+			to_return.end_line_number = selection.start_line_number;
+			to_return.end_char = selection.start_char;
+		}
+	}
+
+	return to_return;
+}
+
+
+//underlines find matches on the line
+void draw_find_matches(TextBox* box, TextLine* line, UTFStringView sv, int pixel_offset_y)
+{
+	TextFind* find = &box->find;
+	int font_height = TTF_FontHeight(box->font);
+	Uint32 color = SDL_MapRGBA(box->render_surface->format,
+		box->selection_bg.r, box->selection_bg.g, box->selection_bg.b, box->selection_bg.a);
+
+	size_t i = text_find_match_after(find, line->line_number, 0);
+	for (; i < find->match_count && find->matches[i].line_number == line->line_number; i++) {
+		FindMatch match = find->matches[i];
+
+		size_t wrapped_start = 0;
+		UTFIterator row_it = utf_iter_begin(sv);
+		for (size_t wrapped = 0; wrapped < line->wrapped_line_count; wrapped++) {
+			size_t wrapped_end = wrapped_start + line->wrapped_line_sizes[wrapped];
+			int y = pixel_offset_y + (int)(wrapped + 1) * font_height - 2;
+			if (y > box->h) {
+				break;
+			}
+
+			size_t row_start_byte = row_it.byte_offset;
+			utf_iter_skip(&row_it, line->wrapped_line_sizes[wrapped]);
+
+			size_t from = match.start_char > wrapped_start ? match.start_char : wrapped_start;
+			size_t to = min(match.end_char, wrapped_end);
+			if (from < to) {
+				//only the row is counted through, not the line before it
+				UTFStringView row_sv = utf_sv_sub_sv_bytes(sv, row_start_byte, row_it.byte_offset);
+				int x_from = sv_width(box->font, utf_sv_sub_sv(row_sv, 0, from - wrapped_start));
+				int x_to = sv_width(box->font, utf_sv_sub_sv(row_sv, 0, to - wrapped_start));
+				SDL_Rect rect = { .x = x_from, .y = y, .w = x_to - x_from, .h = 2 };
+				SDL_FillRect(box->render_surface, &rect, color);
+			}
+
+			wrapped_start = wrapped_end;
+		}
+	}
+}
+
+//one line bar at the bottom of the text box
+void draw_bar(TextBox* box, UTFStringView text)
+{
+	int font_height = TTF_FontHeight(box->font);
+	SDL_Rect bar_rect = { .x = 0, .y = box->h - font_height, .w = box->w, .h = font_height };
+	SDL_FillRect(box->render_surface, &bar_rect,
+		SDL_MapRGBA(box->render_surface->format, box->selection_bg.r, box->selection_bg.g, box->selection_bg.b, box->selection_bg.a));
+
+	draw_sv(box, text, 0, bar_rect.y,
+		true,
+		box->text_color, box->selection_fg, box->selection_bg,
+		NULL, NULL
+	);
+}
+
+void draw_find_bar(TextBox* box)
+{
+	char status[128];
+	if (box->find.regex_error) {
+		snprintf(status, sizeof(status), "   invalid regex : %s", box->find.regex_error);
+	}
+	else {
+		snprintf(status, sizeof(status), "   %zu%s matches%s",
+			box->find.match_count,
+			box->find.is_truncated ? "+" : "",
+			text_find_is_done(&box->find) && !box->load ? "" : "...");
+	}
+
+	UTFString* bar_text = utf_from_cstr(box->find.is_regex ? u8"Regex : " : u8"Find : ");
+	utf_append_str(bar_text, box->find.query);
+	utf_append_cstr(bar_text, status);
+
+	draw_bar(box, utf_sv_from_str(bar_text));
+
+	utf_destroy(bar_text);
+}
+
+void draw_load_bar(TextBox* box)
+{
+	size_t size = box->line_index.size;
+	size_t progress = text_load_progress(box->load);
+
+	char status[128];
+	snprintf(status, sizeof(status), "Loading : %zu lines (%zu%%)",
+		box->line_count, size ? (size_t)((double)progress / size * 100) : 100);
+
+	draw_bar(box, utf_sv_from_cstr(status));
+}
+
+void draw_go_to_line_bar(TextBox* box)
+{
+	char status[128];
+	if (box->go_to_line_number > 0) {
+		snprintf(status, sizeof(status), "Go to line : %zu (of %zu)", box->go_to_line_number, box->line_count);
+	}
+	else {
+		snprintf(status, sizeof(status), "Go to line : (of %zu)", box->line_count);
+	}
+
+	draw_bar(box, utf_sv_from_cstr(status));
+}
+
+void draw_view_bar(TextBox* box)
+{
+	char status[128];
+	snprintf(status, sizeof(status), "Viewing : %zu lines (read only)", box->line_count);
+
+	draw_bar(box, utf_sv_from_cstr(status));
+}
+
+void draw_follow_bar(TextBox* box)
+{
+	char status[128];
+	snprintf(status, sizeof(status), "Following : %zu lines", box->line_count);
+
+	draw_bar(box, utf_sv_from_cstr(status));
+}
+
+//shows where the visible lines are in the whole document
+void draw_scroll_bar(TextBox* box, size_t first_visible_line, size_t visible_line_count)
+{
+	if (box->line_count == 0 || visible_line_count >= box->line_count) {
+		return;
+	}
+
+	int bar_w = 6;
+	int min_thumb_h = 8;
+
+	int thumb_h = (int)((double)visible_line_count / box->line_count * box->h);
+	if (thumb_h < min_thumb_h) {
+		thumb_h = min_thumb_h;
+	}
+	int thumb_y = (int)((double)first_visible_line / box->line_count * box->h);
+	if (thumb_y + thumb_h > box->h) {
+		thumb_y = box->h - thumb_h;
+	}
+
+	SDL_Rect thumb_rect = { .x = box->w - bar_w, .y = thumb_y, .w = bar_w, .h = thumb_h };
+	SDL_FillRect(box->render_surface, &thumb_rect,
+		SDL_MapRGBA(box->render_surface->format, box->selection_bg.r, box->selection_bg.g, box->selection_bg.b, box->selection_bg.a));
+}
+
+void text_box_render(TextBox* box) {
+	if (!box->need_to_render) {
+		return;
+	}
+	//Clear render surface with bg color
+	SDL_FillRect(box->render_surface, NULL,
+		SDL_MapRGBA(box->render_surface->format, box->bg_color.r, box->bg_color.g, box->bg_color.b, box->bg_color.a)) ;
+
+	int font_height = TTF_FontHeight(box->font);
 
 	bool no_selection = !box->is_selecting;
 	no_selection = no_selection ||
@@ -786,9 +2253,13 @@ void text_box_render(TextBox* box) {
 	/////////////////////////////
 	// Render Text
 	/////////////////////////////
-	int pixel_offset_y = box->offset_y;
+	clamp_box_scroll(box);
+	int pixel_offset_y = -(int)box->scroll.wrapped_line * font_height - box->scroll.pixel_offset;
 
-	for (TextLine* line = box->first_line; line != NULL; line = line->next) {
+	size_t first_visible_line = 0;
+	size_t visible_line_count = 0;
+
+	for (TextLine* line = get_line_from_line_number(box, box->scroll.line_number); line != NULL; line = get_next_line(box, line)) {
 		if (pixel_offset_y > box->h) {
 			goto text_render_end;
 		}
@@ -796,7 +2267,14 @@ void text_box_render(TextBox* box) {
 			pixel_offset_y += line->size_y;
 		}
 		else {
-			if (line->str->count == 0) {
+			ensure_text_line_updated(box, line);
+
+			if (visible_line_count++ == 0) {
+				first_visible_line = line->line_number;
+			}
+
+			UTFStringView line_sv = text_line_sv(line);
+			if (line_sv.count == 0) {
 				pixel_offset_y += line->size_y;
 				continue;
 			}
@@ -817,21 +2295,23 @@ void text_box_render(TextBox* box) {
 				outside_selecton = !completely_inside_selection && !partially_inside_selection;
 			}
 
-			UTFString* copy = replace_missing_glyph_with_char(utf_sv_from_str(line->str), box->font, utf_sv_from_cstr(MISSING_GLYPH));
+			UTFString* copy = replace_missing_glyph_with_char(line_sv, box->font, utf_sv_from_cstr(MISSING_GLYPH));
+			int line_pixel_offset_y = pixel_offset_y;
 
 			if (outside_selecton || completely_inside_selection) {
 				UTFStringView sv = utf_sv_from_str(copy);
 
 				size_t char_offset = 0;
+				//rows are cut one after another, without counting from the start of the line again
+				UTFIterator row_it = utf_iter_begin(sv);
 
 				for (size_t i = 0; i < line->wrapped_line_count; i++) {
 					if (pixel_offset_y > box->h) {
-						goto text_render_end;
+						break;
 					}
-					size_t line_start = char_offset;
-					size_t line_end = line->wrapped_line_sizes[i] + char_offset;
-
-					UTFStringView line_sv = utf_sv_sub_sv(sv, line_start, line_end);
+					size_t row_start_byte = row_it.byte_offset;
+					utf_iter_skip(&row_it, line->wrapped_line_sizes[i]);
+					UTFStringView line_sv = utf_sv_sub_sv_bytes(sv, row_start_byte, row_it.byte_offset);
 					if (
 						!draw_sv(box, line_sv, 0, pixel_offset_y,
 							completely_inside_selection && box->is_selecting,
@@ -848,502 +2328,1924 @@ void text_box_render(TextBox* box) {
 			else {
 				UTFStringView sv = utf_sv_from_str(copy);
 
-				size_t char_offset = 0;
+				size_t char_offset = 0;
+				UTFIterator row_it = utf_iter_begin(sv);
+
+				for (size_t i = 0; i < line->wrapped_line_count; i++) {
+					if (pixel_offset_y > box->h) {
+						break;
+					}
+					size_t line_start = char_offset;
+					size_t line_end = line->wrapped_line_sizes[i] + char_offset;
+
+					size_t row_start_byte = row_it.byte_offset;
+					utf_iter_skip(&row_it, line->wrapped_line_sizes[i]);
+					UTFStringView line_sv = utf_sv_sub_sv_bytes(sv, row_start_byte, row_it.byte_offset);
+
+					bool left_shaded = selection.end_char <= line_end && selection.end_char >= line_start;
+					left_shaded = left_shaded && (selection.end_line_number == line->line_number);
+
+					bool right_shaded = selection.start_char <= line_end && selection.start_char >= line_start;
+					right_shaded = right_shaded && (selection.start_line_number == line->line_number);
+
+					bool un_shaded = line->line_number == selection.start_line_number && line_end < selection.start_char && line_start < selection.start_char;
+					un_shaded = un_shaded || (line->line_number == selection.end_line_number && line_start > selection.end_char && line_end > selection.end_char);
+
+
+					if (left_shaded && right_shaded) {
+						UTFStringView left = utf_sv_sub_sv(line_sv, 0, selection.start_char - char_offset);
+						UTFStringView right = utf_sv_sub_sv(line_sv, selection.end_char - char_offset, line_sv.count);
+						UTFStringView between = utf_sv_sub_sv(line_sv, selection.start_char - char_offset, selection.end_char - char_offset);
+
+						int pixel_offset_x = 0;
+						int rendered_size_x = 0;
+						if (
+							!draw_sv(box, left, 0, pixel_offset_y,
+								false,
+								box->text_color, box->selection_fg, box->selection_bg,
+								&rendered_size_x, NULL
+							))
+						{
+							goto renderexit;
+						}
+						pixel_offset_x += rendered_size_x;
+						if (
+							!draw_sv(box, between, pixel_offset_x, pixel_offset_y,
+								true,
+								box->text_color, box->selection_fg, box->selection_bg,
+								&rendered_size_x, NULL
+							))
+						{
+							goto renderexit;
+						}
+						pixel_offset_x += rendered_size_x;
+						if (
+							!draw_sv(box, right, pixel_offset_x, pixel_offset_y,
+								false,
+								box->text_color, box->selection_fg, box->selection_bg,
+								NULL, NULL
+							))
+						{
+							goto renderexit;
+						}
+					}
+					else if (left_shaded) {
+						UTFStringView left = utf_sv_sub_sv(line_sv, 0, selection.end_char - char_offset);
+						UTFStringView right = utf_sv_sub_sv(line_sv, selection.end_char - char_offset, line_sv.count);
+						int pixel_offset_x = 0;
+						int rendered_size_x = 0;
+						if (
+							!draw_sv(box, left, 0, pixel_offset_y,
+								true,
+								box->text_color, box->selection_fg, box->selection_bg,
+								&rendered_size_x, NULL
+							))
+						{
+							goto renderexit;
+						}
+						pixel_offset_x += rendered_size_x;
+						if (
+							!draw_sv(box, right, pixel_offset_x, pixel_offset_y,
+								false,
+								box->text_color, box->selection_fg, box->selection_bg,
+								NULL, NULL
+							))
+						{
+							goto renderexit;
+						}
+					}
+					else if (right_shaded) {
+						UTFStringView left = utf_sv_sub_sv(line_sv, 0, selection.start_char - char_offset);
+						UTFStringView right = utf_sv_sub_sv(line_sv, selection.start_char - char_offset, line_sv.count);
+						int pixel_offset_x = 0;
+						int rendered_size_x = 0;
+						if (
+							!draw_sv(box, left, 0, pixel_offset_y,
+								false,
+								box->text_color, box->selection_fg, box->selection_bg,
+								&rendered_size_x, NULL
+							))
+						{
+							goto renderexit;
+						}
+						pixel_offset_x += rendered_size_x;
+						if (
+							!draw_sv(box, right, pixel_offset_x, pixel_offset_y,
+								true,
+								box->text_color, box->selection_fg, box->selection_bg,
+								NULL, NULL
+							))
+						{
+							goto renderexit;
+						}
+					}
+					else {
+						if (
+							!draw_sv(box, line_sv, 0, pixel_offset_y,
+								!un_shaded,
+								box->text_color, box->selection_fg, box->selection_bg,
+								NULL, NULL
+							))
+						{
+							goto renderexit;
+						}
+					}
+					char_offset += line->wrapped_line_sizes[i];
+					pixel_offset_y += font_height;
+				}
+			}
+
+			draw_find_matches(box, line, utf_sv_from_str(copy), line_pixel_offset_y);
+
+			utf_destroy(copy);
+
+		}
+	}
+text_render_end: ;
+
+	draw_scroll_bar(box, first_visible_line, visible_line_count);
+
+	if (box->is_finding) {
+		draw_find_bar(box);
+	}
+	else if (box->is_going_to_line) {
+		draw_go_to_line_bar(box);
+	}
+	else if (box->load) {
+		draw_load_bar(box);
+	}
+	else if (box->follower) {
+		draw_follow_bar(box);
+	}
+	else if (box->is_read_only) {
+		draw_view_bar(box);
+	}
+
+	/////////////////////////////
+	// Render Cursor
+	/////////////////////////////
+	int cursor_x = 0;
+	int cursor_y = 0;
+
+	get_cursor_screen_pos(box, &cursor_x, &cursor_y);
+	SDL_Rect cursor_rect = { .x = cursor_x, .y = cursor_y + 2, .w = 2, .h = font_height - 2 };
+
+	SDL_FillRect(box->render_surface, &cursor_rect,
+        SDL_MapRGBA(box->render_surface->format, box->cursor_color.r, box->cursor_color.g, box->cursor_color.b, box->cursor_color.a));
+
+renderexit:
+
+	box->need_to_render = false;
+}
+
+TextCursor text_box_move_cursor_left(TextBox* box, TextCursor cursor)
+{
+	TextCursor new_cursor_pos = cursor;
+
+	new_cursor_pos.place_after_last_char_before_wrapping = false;
+	TextLine* cursor_line = get_line_from_line_number(box, cursor.line_number);
+
+	if (cursor.char_offset > 0) {
+		//moves over a whole cluster, like a letter with its marks or an emoji sequence
+		size_t char_count = 0;
+		new_cursor_pos.byte_offset = text_grapheme_prev(text_line_sv(cursor_line), cursor.byte_offset, &char_count);
+		new_cursor_pos.char_offset -= char_count;
+	}
+	else {
+		TextLine* prev_line = get_prev_line(box, cursor_line);
+		if (prev_line) {
+			UTFStringView prev_sv = text_line_sv(prev_line);
+			new_cursor_pos.char_offset = prev_sv.count;
+			new_cursor_pos.byte_offset = prev_sv.data_size;
+			new_cursor_pos.line_number--;
+		}
+	}
+
+	box->need_to_render = true;
+
+	return new_cursor_pos;
+}
+
+TextCursor text_box_move_cursor_right(TextBox* box, TextCursor cursor)
+{
+	TextCursor new_cursor_pos = cursor;
+
+	new_cursor_pos.place_after_last_char_before_wrapping = false;
+	TextLine* cursor_line = get_line_from_line_number(box, cursor.line_number);
+
+	UTFStringView sv = text_line_sv(cursor_line);
+	if (cursor.char_offset < sv.count) {
+		size_t char_count = 0;
+		new_cursor_pos.byte_offset = text_grapheme_next(sv, cursor.byte_offset, &char_count);
+		new_cursor_pos.char_offset += char_count;
+	}
+	else {
+		TextLine* next_line = get_next_line(box, cursor_line);
+		if (next_line) {
+			new_cursor_pos.char_offset = 0;
+			new_cursor_pos.byte_offset = 0;
+			new_cursor_pos.line_number++;
+		}
+	}
+
+	box->need_to_render = true;
+
+	return new_cursor_pos;
+}
+
+size_t get_char_offset_from_line_and_char_coord(TextLine* line, size_t char_x, size_t char_y) {
+	size_t char_offset = 0;
+	for (size_t i = 0; i < min(line->wrapped_line_count, char_y); i++) {
+		char_offset += line->wrapped_line_sizes[i];
+	}
+	size_t cursor_line_index = min(line->wrapped_line_count-1, char_y);
+	size_t cursor_line_size = min((int)char_x, line->wrapped_line_sizes[cursor_line_index]);
+	char_offset += cursor_line_size;
+	return char_offset;
+}
+
+TextCursor text_box_move_cursor_up(TextBox* box, TextCursor cursor)
+{
+	TextCursor new_cursor_pos = cursor;
+	if (cursor.char_offset == 0 && cursor.line_number == 0) {
+		return new_cursor_pos;
+	}
+	//box->cursor.place_after_last_char_before_wrapping = true;
+
+	TextLine* cursor_line = get_line_from_line_number(box, cursor.line_number);
+	size_t offset_x;
+	size_t offset_y;
+	get_char_coord_from_cursor(box, cursor, &offset_x, &offset_y);
+
+	if (offset_y == 0) {
+		TextLine* prev_line = get_prev_line(box, cursor_line);
+		if (prev_line) {
+			ensure_text_line_updated(box, prev_line);
+			new_cursor_pos = set_cursor_char_offset(prev_line, new_cursor_pos, get_char_offset_from_line_and_char_coord(
+				prev_line,
+				offset_x,
+				prev_line->wrapped_line_count - 1
+			));
+			new_cursor_pos.line_number--;
+		}
+	}
+	else {
+		if (cursor_line->wrapped_line_sizes[offset_y] == (int)offset_x) {
+			new_cursor_pos.place_after_last_char_before_wrapping = true;
+		}
+		else {
+			new_cursor_pos.place_after_last_char_before_wrapping = false;
+		}
+		new_cursor_pos = set_cursor_char_offset(cursor_line, new_cursor_pos, get_char_offset_from_line_and_char_coord(
+			cursor_line,
+			offset_x,
+			offset_y-1
+		));
+	}
+
+	box->need_to_render = true;
+
+	return new_cursor_pos;
+}
+
+TextCursor text_box_move_cursor_down(TextBox* box, TextCursor cursor)
+{
+	TextCursor new_cursor_pos = cursor;
+
+	TextLine* cursor_line = get_line_from_line_number(box, cursor.line_number);
+
+	size_t offset_x;
+	size_t offset_y;
+	get_char_coord_from_cursor(box, cursor, &offset_x, &offset_y);
+
+	if (offset_x == 0) {
+		new_cursor_pos.place_after_last_char_before_wrapping = false;
+	}
+
+	if (offset_y + 1 < cursor_line->wrapped_line_count) {
+
+		new_cursor_pos = set_cursor_char_offset(cursor_line, new_cursor_pos, get_char_offset_from_line_and_char_coord(
+			cursor_line,
+			offset_x,
+			offset_y + 1
+		));
+	}
+	else if(get_next_line(box, cursor_line) != NULL) {
+		ensure_text_line_updated(box, cursor_line->next);
+		new_cursor_pos = set_cursor_char_offset(cursor_line->next, new_cursor_pos, get_char_offset_from_line_and_char_coord(
+			cursor_line->next,
+			offset_x,
+			0
+		));
+		new_cursor_pos.line_number++;
+	}
+
+	box->need_to_render = true;
+
+	return new_cursor_pos;
+}
+
+//moves the cursor a text box height of rows up or down, keeping it where it was in its row
+//view moves by as many rows, so the cursor stays where it was on the screen
+TextCursor move_cursor_page(TextBox* box, TextCursor cursor, bool is_down)
+{
+	int font_height = TTF_FontHeight(box->font);
+	size_t page_row_count = max(box->h / font_height - 1, 1);
+
+	size_t offset_x;
+	size_t offset_y;
+	get_char_coord_from_cursor(box, cursor, &offset_x, &offset_y);
+
+	TextBoxScroll row = {.line_number = cursor.line_number, .wrapped_line = offset_y};
+	size_t moved_count = 0;
+	while (moved_count < page_row_count && (is_down ? move_row_down(box, &row) : move_row_up(box, &row))) {
+		moved_count++;
+	}
+	scroll_box_by(box, (is_down ? 1 : -1) * (int)moved_count * font_height);
+
+	TextLine* line = get_line_from_line_number(box, row.line_number);
+	ensure_text_line_updated(box, line);
+
+	TextCursor new_cursor_pos = cursor;
+	new_cursor_pos.line_number = row.line_number;
+	new_cursor_pos.place_after_last_char_before_wrapping = false;
+	new_cursor_pos = set_cursor_char_offset(line, new_cursor_pos, get_char_offset_from_line_and_char_coord(
+		line,
+		offset_x,
+		row.wrapped_line
+	));
+
+	box->need_to_render = true;
+
+	return new_cursor_pos;
+}
+
+TextCursor text_box_move_cursor_page_up(TextBox* box, TextCursor cursor)
+{
+	return move_cursor_page(box, cursor, false);
+}
+
+TextCursor text_box_move_cursor_page_down(TextBox* box, TextCursor cursor)
+{
+	return move_cursor_page(box, cursor, true);
+}
+
+TextCursor text_box_move_cursor_line_start(TextBox* box, TextCursor cursor)
+{
+	cursor.char_offset = 0;
+	cursor.byte_offset = 0;
+	cursor.place_after_last_char_before_wrapping = false;
+
+	box->need_to_render = true;
+
+	return cursor;
+}
+
+TextCursor text_box_move_cursor_line_end(TextBox* box, TextCursor cursor)
+{
+	TextLine* cursor_line = get_line_from_line_number(box, cursor.line_number);
+
+	cursor.char_offset = text_line_sv(cursor_line).count;
+	cursor.byte_offset = text_line_data_size(cursor_line);
+	cursor.place_after_last_char_before_wrapping = false;
+
+	box->need_to_render = true;
+
+	return cursor;
+}
+
+TextCursor text_box_move_cursor_document_start(TextBox* box, TextCursor cursor)
+{
+	cursor.line_number = 0;
+	return text_box_move_cursor_line_start(box, cursor);
+}
+
+TextCursor text_box_move_cursor_document_end(TextBox* box, TextCursor cursor)
+{
+	cursor.line_number = box->line_count - 1;
+	return text_box_move_cursor_line_end(box, cursor);
+}
+
+TextCursor text_box_move_cursor_left_word(TextBox* box, TextCursor cursor)
+{
+	//at the start of a line it goes to the end of the previous one
+	if (cursor.char_offset == 0) {
+		return text_box_move_cursor_left(box, cursor);
+	}
+
+	TextLine* cursor_line = get_line_from_line_number(box, cursor.line_number);
+
+	size_t char_count = 0;
+	cursor.byte_offset = text_word_prev(text_line_sv(cursor_line), cursor.byte_offset, &char_count);
+	cursor.char_offset -= char_count;
+	cursor.place_after_last_char_before_wrapping = false;
+
+	box->need_to_render = true;
+
+	return cursor;
+}
+
+TextCursor text_box_move_cursor_right_word(TextBox* box, TextCursor cursor)
+{
+	TextLine* cursor_line = get_line_from_line_number(box, cursor.line_number);
+	UTFStringView sv = text_line_sv(cursor_line);
+
+	//at the end of a line it goes to the start of the next one
+	if (cursor.byte_offset >= sv.data_size) {
+		return text_box_move_cursor_right(box, cursor);
+	}
+
+	size_t char_count = 0;
+	cursor.byte_offset = text_word_next(sv, cursor.byte_offset, &char_count);
+	cursor.char_offset += char_count;
+	cursor.place_after_last_char_before_wrapping = false;
+
+	box->need_to_render = true;
+
+	return cursor;
+}
+
+TextCursor text_box_delete_a_character(TextBox* box, TextCursor cursor)
+{
+	//matches point to lines that are about to change
+	text_find_restart(&box->find);
+
+	TextCursor new_cursor_pos = cursor;
+
+	if (cursor.line_number == 0 && cursor.char_offset == 0) {
+		return new_cursor_pos;
+	}
+
+	TextUndoText removed = {0};
+
+	size_t char_offset = cursor.char_offset;
+	if (char_offset <= 0) {
+		if (cursor.line_number == 0) {
+			return new_cursor_pos;
+		}
+		TextLine* cursor_line = get_line_from_line_number(box, cursor.line_number);
+		TextLine* prev_line = get_prev_line(box, cursor_line);
+		if (prev_line == NULL) {
+			return new_cursor_pos;
+		}
+		prepare_line_edit(box, prev_line);
+		prepare_line_edit(box, cursor_line);
+		size_t line_count = prev_line->str->count;
+		size_t line_size = prev_line->str->data_size;
+		utf_append_str(prev_line->str, cursor_line->str);
+
+		//removed character is the new line of the previous line
+		removed.str = utf_from_cstr(prev_line->ends_with_crlf ? "\r\n" : "\n");
+
+		//merged line ends the way the cursor line did
+		prev_line->ends_with_crlf = cursor_line->ends_with_crlf;
+		prev_line->ends_with_lf = cursor_line->ends_with_lf;
+
+		forget_lines(box, cursor_line->line_number, cursor_line->line_number);
+		prev_line->next = cursor_line->next;
+		if (cursor_line->next) {
+			cursor_line->next->prev = prev_line;
+		}
+		//running autosave might still read it
+		cursor_line->prev = NULL;
+		cursor_line->next = box->removed_lines;
+		box->removed_lines = cursor_line;
+		new_cursor_pos.line_number--;
+
+		number_lines_lazily_after(box, prev_line);
+		box->line_count--;
+		update_text_line(box, prev_line);
+
+		new_cursor_pos.char_offset = line_count;
+		new_cursor_pos.byte_offset = line_size;
+	}
+	else {
+		TextLine* cursor_line = get_line_from_line_number(box, cursor.line_number);
+		prepare_line_edit(box, cursor_line);
+		//whole cluster goes, so no lone marks or half of a flag are left behind
+		size_t char_count = 0;
+		size_t prev_byte = text_grapheme_prev(text_line_sv(cursor_line), cursor.byte_offset, &char_count);
+		removed.str = utf_from_sv(utf_sv_sub_str_bytes(cursor_line->str, prev_byte, cursor.byte_offset));
+		utf_erase_byte_range(cursor_line->str, prev_byte, cursor.byte_offset);
+		update_text_line(box, cursor_line);
+		new_cursor_pos.char_offset = char_offset - char_count;
+		new_cursor_pos.byte_offset = prev_byte;
+	}
+
+	journal_delete(box, undo_position_from_cursor(new_cursor_pos), undo_position_from_cursor(cursor));
+	text_undo_record_delete(&box->undo, undo_position_from_cursor(new_cursor_pos), undo_position_from_cursor(cursor), removed);
+
+	box->need_to_render = true;
+
+	return new_cursor_pos;
+}
+
+//Takes text in the selection out of the text box without recording it
+//
+//Text within a line is copied to removed.
+//Lines after the start line are detached and handed to removed as they are,
+//so removing a million lines doesn't copy them.
+//Returns cursor at the start of the selection
+TextCursor remove_text(TextBox* box, Selection selection, TextUndoText* removed)
+{
+	TextCursor new_cursor_pos = box->cursor;
+	new_cursor_pos.place_after_last_char_before_wrapping = false;
+
+	selection = normalize_selection(selection);
+
+	//nothing to take out, so nothing is journaled and the document stays as it was
+	if (selection.start_line_number == selection.end_line_number && selection.start_char == selection.end_char) {
+		memset(removed, 0, sizeof(TextUndoText));
+		removed->str = utf_from_cstr("");
+		removed->journal_delete = SIZE_MAX;
+		TextLine* start_line = get_line_from_line_number(box, selection.start_line_number);
+		new_cursor_pos.line_number = selection.start_line_number;
+		return set_cursor_char_offset(start_line, new_cursor_pos, selection.start_char);
+	}
+
+	TextUndoPosition start = {.line_number = selection.start_line_number, .char_offset = selection.start_char};
+	TextUndoPosition end = {.line_number = selection.end_line_number, .char_offset = selection.end_char};
+	size_t journal_delete_number = journal_delete(box, start, end);
+
+	TextLine* start_line = get_line_from_line_number(box, selection.start_line_number);
+	TextLine* end_line = get_line_from_line_number(box, selection.end_line_number);
+	prepare_line_edit(box, start_line);
+
+	memset(removed, 0, sizeof(TextUndoText));
+	removed->journal_delete = journal_delete_number;
+
+	if (selection.start_line_number == selection.end_line_number) {
+		removed->str = utf_sub_str(start_line->str, selection.start_char, selection.end_char);
+		utf_erase_range(start_line->str, selection.start_char, selection.end_char);
+		new_cursor_pos.line_number = start_line->line_number;
+		new_cursor_pos = set_cursor_char_offset(start_line, new_cursor_pos, selection.start_char);
+		update_text_line(box, start_line);
+	}
+	else {
+		//first get texts after selection end char
+		UTFString *start_str = start_line->str;
+		UTFStringView end_sv = text_line_sv(end_line);
+		UTFStringView after_selection_end_char = utf_sv_sub_sv(end_sv, selection.end_char, end_sv.count);
+
+		//erase start_str after selection start char
+		size_t start_byte = utf_count_to_byte(start_str, selection.start_char);
+		removed->str = utf_from_sv(utf_sv_sub_str_bytes(start_str, start_byte, start_str->data_size));
+		utf_erase_byte_range(start_str, start_byte, start_str->data_size);
+		//append after_selection_end_char
+		utf_append_sv(start_str, after_selection_end_char);
+
+		removed->ends_with_crlf = start_line->ends_with_crlf;
+		removed->ends_with_lf = start_line->ends_with_lf;
+
+		//merged line ends the way the end line did
+		start_line->ends_with_crlf = end_line->ends_with_crlf;
+		start_line->ends_with_lf = end_line->ends_with_lf;
+
+		//detach lines after start up to end in one step
+		assert(start_line->next != NULL);
+		TextLine* removed_first = start_line->next;
+		forget_lines(box, removed_first->line_number, end_line->line_number);
+
+		start_line->next = end_line->next;
+		if (end_line->next) {
+			end_line->next->prev = start_line;
+		}
+
+		removed_first->prev = NULL;
+		freeze_line(box, end_line);
+		end_line->next = NULL;
+
+		removed->first_line = removed_first;
+		removed->last_line = end_line;
+		removed->line_count = selection.end_line_number - selection.start_line_number;
+		box->line_count -= removed->line_count;
+
+		update_text_line(box, start_line);
+		new_cursor_pos.line_number = start_line->line_number;
+		new_cursor_pos = set_cursor_char_offset(start_line, new_cursor_pos, selection.start_char);
+
+		number_lines_lazily_after(box, start_line);
+	}
+	box->need_to_render = true;
+
+	return new_cursor_pos;
+}
+
+//Puts text taken by remove_text back at the position without recording it
+//
+//Detached lines are linked back in, so it costs the same no matter how many lines there are
+void reinsert_text(TextBox* box, TextUndoPosition pos, TextUndoText text)
+{
+	TextLine* line = get_line_from_line_number(box, pos.line_number);
+	prepare_line_edit(box, line);
+	TextCursor cursor = box->cursor;
+	cursor.line_number = pos.line_number;
+	cursor = set_cursor_char_offset(line, cursor, pos.char_offset);
+
+	if (text.first_line == NULL) {
+		insert_text(box, cursor, utf_sv_from_str(text.str));
+		return;
+	}
+
+	//rest of the line is what followed the removed text
+	//and last removed line still has it
+	utf_erase_byte_range(line->str, cursor.byte_offset, line->str->data_size);
+	utf_append_str(line->str, text.str);
+	line->ends_with_crlf = text.ends_with_crlf;
+	line->ends_with_lf = text.ends_with_lf;
+
+	TextLine* prev_next = line->next;
+	line->next = text.first_line;
+	text.first_line->prev = line;
+	freeze_line(box, text.last_line);
+	text.last_line->next = prev_next;
+	if (prev_next) {
+		prev_next->prev = text.last_line;
+	}
+
+	//lines keep their layout unless box was resized since they were removed
+	for (TextLine* reinserted = text.first_line; reinserted != prev_next; reinserted = reinserted->next) {
+		if (reinserted->size_x != box->w) {
+			defer_text_line_update(box, reinserted);
+		}
+	}
+	update_text_line(box, line);
+
+	number_lines_lazily_after(box, line);
+	box->line_count += text.line_count;
+
+	box->need_to_render = true;
+}
+
+TextCursor text_box_delete_range(TextBox* box, Selection selection)
+{
+	selection = normalize_selection(selection);
+
+	//empty range changes nothing, so there is nothing to restart or to undo
+	if (selection.start_line_number == selection.end_line_number && selection.start_char == selection.end_char) {
+		TextCursor cursor = box->cursor;
+		cursor.line_number = selection.start_line_number;
+		cursor.place_after_last_char_before_wrapping = false;
+		return set_cursor_char_offset(get_line_from_line_number(box, selection.start_line_number), cursor, selection.start_char);
+	}
+
+	//matches point to lines that are about to change
+	text_find_restart(&box->find);
+
+	TextUndoText removed;
+	TextCursor new_cursor_pos = remove_text(box, selection, &removed);
+
+	TextUndoPosition start = {.line_number = selection.start_line_number, .char_offset = selection.start_char};
+	TextUndoPosition end = {.line_number = selection.end_line_number, .char_offset = selection.end_char};
+
+	//removed lines are kept by the undo record and freed in text_box_free_removed_lines
+	//once the record is dropped, so deleting doesn't block
+	text_undo_seal(&box->undo);
+	text_undo_record_delete(&box->undo, start, end, removed);
+	text_undo_seal(&box->undo);
+
+	return new_cursor_pos;
+}
+
+//same as text_box_get_selection_str but lines end the way they do in the text box
+UTFString* get_text_with_line_endings(TextBox* box, Selection selection)
+{
+	//the last line is created first so no span covers it, spans in between are written as they are
+	get_line_from_line_number(box, selection.end_line_number);
+	TextLine* line = get_line_from_line_number(box, selection.start_line_number);
+	UTFStringView sv = text_line_sv(line);
+	UTFString* str = utf_from_sv(utf_sv_sub_sv(sv, selection.start_char, sv.count));
+
+	for (size_t line_number = selection.start_line_number; line_number < selection.end_line_number; ) {
+		utf_append_cstr(str, line->ends_with_crlf ? "\r\n" : "\n");
+		line = line->next;
+		line_number += line->span_count > 0 ? line->span_count : 1;
+		sv = text_line_sv(line);
+		utf_append_sv(str, line_number < selection.end_line_number ? sv : utf_sv_sub_sv(sv, 0, selection.end_char));
+	}
+
+	return str;
+}
+
+//Takes the text of the record out of the text box or puts it back
+//Returns where the cursor goes
+TextCursor toggle_undo_record(TextBox* box, TextUndoRecord* record)
+{
+	TextCursor cursor = box->cursor;
+	cursor.place_after_last_char_before_wrapping = false;
+
+	if (record->has_text) {
+		TextUndoText text = text_undo_take_text(&box->undo, record);
+		reinsert_text(box, record->start, text);
+		if (text.str) {
+			utf_destroy(text.str);
+		}
+
+		Selection selection = {
+			.start_line_number = record->start.line_number, .start_char = record->start.char_offset,
+			.end_line_number = record->end.line_number, .end_char = record->end.char_offset
+		};
+		//text within a line went through insert_text,
+		//relinked lines only refer to the delete that took them out so they aren't written again
+		if (text.first_line && box->has_journal_base) {
+			if (text.journal_delete != SIZE_MAX) {
+				text_journal_restore(box->journal, record->start, text.journal_delete);
+			}
+			//delete is in the journal from before the file was saved
+			else {
+				UTFString* reinserted = get_text_with_line_endings(box, selection);
+				journal_insert(box, record->start, utf_sv_from_str(reinserted));
+				utf_destroy(reinserted);
+			}
+		}
+
+		TextLine* end_line = get_line_from_line_number(box, record->end.line_number);
+		cursor.line_number = record->end.line_number;
+		return set_cursor_char_offset(end_line, cursor, record->end.char_offset);
+	}
+
+	Selection selection = {
+		.start_line_number = record->start.line_number, .start_char = record->start.char_offset,
+		.end_line_number = record->end.line_number, .end_char = record->end.char_offset
+	};
+	TextUndoText text;
+	cursor = remove_text(box, selection, &text);
+	text_undo_set_text(&box->undo, record, text);
+	return cursor;
+}
+
+bool undo_or_redo(TextBox* box, bool is_redo)
+{
+	//matches point to lines that are about to change
+	text_find_restart(&box->find);
+
+	TextUndoRecord* record = is_redo ? text_undo_redo(&box->undo) : text_undo_undo(&box->undo);
+	if (!record) {
+		return false;
+	}
+
+	box->cursor = toggle_undo_record(box, record);
+	box->selection = set_selection_to_cursor(box->cursor);
+	box->is_selecting = false;
+	scroll_to_cursor(box);
+	box->need_to_render = true;
+
+	return true;
+}
+
+bool text_box_undo(TextBox* box)
+{
+	return undo_or_redo(box, false);
+}
+
+bool text_box_redo(TextBox* box)
+{
+	return undo_or_redo(box, true);
+}
+
+bool is_valid_journal_position(TextBox* box, TextUndoPosition pos)
+{
+	if (pos.line_number >= box->line_count) {
+		return false;
+	}
+	TextLine* line = get_line_from_line_number(box, pos.line_number);
+	return pos.char_offset <= text_line_sv(line).count;
+}
+
+//Edits of a journal that is being replayed
+typedef struct JournalReplay {
+	//where the last edit was
+	TextCursor cursor;
+	size_t delete_count;
+
+	//text of deletes that took out lines, a restore can put it back
+	//journal_delete of each is the number of its delete, in order
+	TextUndoText* deleted;
+	size_t deleted_count;
+	size_t deleted_capacity;
+} JournalReplay;
+
+//keeps text the delete with the number took out, returns false if it couldn't
+bool keep_replayed_delete(JournalReplay* replay, TextUndoText removed, size_t number)
+{
+	if (replay->deleted_count == replay->deleted_capacity) {
+		size_t new_capacity = replay->deleted_capacity ? replay->deleted_capacity * 2 : 64;
+		TextUndoText* new_deleted = realloc(replay->deleted, new_capacity * sizeof(TextUndoText));
+		if (!new_deleted) {
+			return false;
+		}
+		replay->deleted = new_deleted;
+		replay->deleted_capacity = new_capacity;
+	}
+	removed.journal_delete = number;
+	replay->deleted[replay->deleted_count++] = removed;
+	return true;
+}
+
+//text the delete with the number took out, NULL if it didn't take out lines or they are back already
+TextUndoText* find_replayed_delete(JournalReplay* replay, size_t number)
+{
+	size_t low = 0;
+	size_t high = replay->deleted_count;
+	while (low < high) {
+		size_t mid = low + (high - low) / 2;
+		if (replay->deleted[mid].journal_delete < number) {
+			low = mid + 1;
+		}
+		else {
+			high = mid;
+		}
+	}
+	if (low == replay->deleted_count || replay->deleted[low].journal_delete != number || !replay->deleted[low].first_line) {
+		return NULL;
+	}
+	return &replay->deleted[low];
+}
+
+//does the edit of the record again without recording it
+//returns false if the record doesn't fit the text box
+bool replay_journal_record(TextBox* box, JournalReplay* replay, TextJournalRecord* record)
+{
+	TextCursor* cursor = &replay->cursor;
+	if (!is_valid_journal_position(box, record->start)) {
+		return false;
+	}
+
+	if (record->type == TEXT_JOURNAL_RESTORE) {
+		TextUndoText* deleted = find_replayed_delete(replay, record->delete_number);
+		if (!deleted) {
+			return false;
+		}
+		reinsert_text(box, record->start, *deleted);
+		utf_destroy(deleted->str);
+		memset(deleted, 0, sizeof(TextUndoText));
+		deleted->journal_delete = record->delete_number;
+
+		TextLine* line = get_line_from_line_number(box, record->start.line_number);
+		cursor->line_number = record->start.line_number;
+		*cursor = set_cursor_char_offset(line, *cursor, record->start.char_offset);
+		return true;
+	}
+
+	if (record->type == TEXT_JOURNAL_INSERT) {
+		UTFStringView sv = {.data = record->text, .data_size = record->text_size};
+		sv.count = utf_sv_count(sv);
+
+		TextLine* line = get_line_from_line_number(box, record->start.line_number);
+		cursor->line_number = record->start.line_number;
+		*cursor = set_cursor_char_offset(line, *cursor, record->start.char_offset);
+		*cursor = insert_text(box, *cursor, sv);
+		return true;
+	}
+
+	if (!is_valid_journal_position(box, record->end)) {
+		return false;
+	}
+	if (record->end.line_number < record->start.line_number ||
+		(record->end.line_number == record->start.line_number && record->end.char_offset < record->start.char_offset)) {
+		return false;
+	}
+
+	Selection selection = {
+		.start_line_number = record->start.line_number, .start_char = record->start.char_offset,
+		.end_line_number = record->end.line_number, .end_char = record->end.char_offset
+	};
+	TextUndoText removed;
+	*cursor = remove_text(box, selection, &removed);
+
+	//nothing can undo it, but a restore later in the journal can put the lines back
+	size_t number = replay->delete_count++;
+	if (removed.first_line && keep_replayed_delete(replay, removed, number)) {
+		return true;
+	}
+	utf_destroy(removed.str);
+	if (removed.first_line) {
+		removed.last_line->next = box->removed_lines;
+		box->removed_lines = removed.first_line;
+	}
+	return true;
+}
+
+//Does every edit of the journal again, stops at the first one that doesn't fit
+void replay_journal(TextBox* box, TextJournalReader* reader)
+{
+	//records can be anywhere in the file so all of it has to be split first
+	while (box->load) {
+		text_box_load_poll(box);
+	}
+
+	box->is_replaying = true;
+
+	JournalReplay replay = {.cursor = box->cursor};
+	TextJournalRecord record;
+	size_t record_start = reader->position;
+	while (text_journal_read(reader, &record)) {
+		if (!replay_journal_record(box, &replay, &record)) {
+			fprintf(stderr, "%s:%d:ERROR : Journal of %s doesn't match the file, rest of it is dropped\n", __FILE__, __LINE__, box->file_path);
+			reader->position = record_start;
+			break;
+		}
+		record_start = reader->position;
+	}
+
+	box->is_replaying = false;
+
+	//lines that were never restored are freed with the other removed lines
+	for (size_t i = 0; i < replay.deleted_count; i++) {
+		TextUndoText* deleted = &replay.deleted[i];
+		if (deleted->first_line) {
+			utf_destroy(deleted->str);
+			deleted->last_line->next = box->removed_lines;
+			box->removed_lines = deleted->first_line;
+		}
+	}
+	free(replay.deleted);
+
+	//cursor is where the last edit was
+	TextCursor cursor = replay.cursor;
+	cursor.place_after_last_char_before_wrapping = false;
+	box->cursor = cursor;
+	box->selection = set_selection_to_cursor(box->cursor);
+	scroll_to_cursor(box);
+	box->need_to_render = true;
+}
+
+//Puts back edits from the journal of the opened file and keeps journaling from there
+//
+//Journal only counts if it was written for the file as it is now,
+//otherwise the file was changed by something else and the journal is removed
+void start_journal(TextBox* box)
+{
+	TextJournalBase base = text_journal_base(os_file_mapping_data(box->mapping), os_file_mapping_size(box->mapping), box->file_stamp);
+	char* journal_path = get_path_with_suffix(box->file_path, TEXT_BOX_JOURNAL_SUFFIX);
+
+	//most files don't have one and mapping would complain about it
+	OS_FileMapping* old_journal = NULL;
+	FILE* old_journal_file = fopen(journal_path, "rb");
+	if (old_journal_file) {
+		fclose(old_journal_file);
+		old_journal = os_map_file(journal_path);
+	}
+
+	//records are copied since the old journal can't be replaced while it's mapped on every OS
+	char* records = NULL;
+	size_t records_size = 0;
+	if (old_journal) {
+		TextJournalReader reader;
+		if (text_journal_reader_init(&reader, os_file_mapping_data(old_journal), os_file_mapping_size(old_journal), base)) {
+			replay_journal(box, &reader);
+			records_size = text_journal_reader_records_size(&reader);
+			records = malloc(records_size + 1);
+			memcpy(records, text_journal_reader_records(&reader), records_size);
+		}
+		os_unmap_file(old_journal);
+
+		//journal of a different file, or without edits
+		if (records_size == 0) {
+			remove(journal_path);
+		}
+	}
+
+	//set after the replay so it doesn't create a journal while the old one is read
+	box->journal_base = base;
+	box->has_journal_base = true;
+	//replayed edits aren't in the file so they are journaled right away
+	if (records_size > 0) {
+		box->journal = text_journal_create(journal_path, base, records, records_size);
+		if (!box->journal) {
+			fprintf(stderr, "%s:%d:ERROR : Failed to create %s, edits are not journaled\n", __FILE__, __LINE__, journal_path);
+			box->has_journal_base = false;
+		}
+	}
+
+	free(records);
+	free(journal_path);
+}
+
+//edits are saved or dropped on purpose, only a crash leaves a journal behind
+void remove_journal(TextBox* box)
+{
+	if (box->journal) {
+		text_journal_destroy(box->journal);
+		box->journal = NULL;
+
+		char* journal_path = get_path_with_suffix(box->file_path, TEXT_BOX_JOURNAL_SUFFIX);
+		remove(journal_path);
+		free(journal_path);
+	}
+	box->has_journal_base = false;
+}
+
+//journal of the opened file starts over from what the file is now, with the next edit
+void restart_journal(TextBox* box)
+{
+	remove_journal(box);
+
+	//undo records can't refer to deletes of the old journal
+	for (size_t i = 0; i < box->undo.record_count; i++) {
+		box->undo.records[i].text.journal_delete = SIZE_MAX;
+	}
+
+	OS_FileMapping* saved = os_map_file(box->file_path);
+	if (!saved) {
+		return;
+	}
+
+	box->journal_base = text_journal_base(os_file_mapping_data(saved), os_file_mapping_size(saved), box->file_stamp);
+	box->has_journal_base = true;
+	os_unmap_file(saved);
+}
+
+bool text_box_journal_poll(TextBox* box)
+{
+	return box->journal && text_journal_poll(box->journal);
+}
+
+UTFString* text_box_get_selection_str(TextBox* box, Selection selection)
+{
+	selection = normalize_selection(selection);
+
+	//if selection has the same text line at beginning and at the end
+	//just create str from sub sv
+	if(selection.start_line_number == selection.end_line_number){
+		TextLine* line = get_line_from_line_number(box, selection.start_line_number);
+		UTFString* str = utf_from_sv(utf_sv_sub_sv(text_line_sv(line), selection.start_char, selection.end_char));
+		return str;
+	}
+
+	TextLine* start_line = get_line_from_line_number(box, selection.start_line_number);
+	TextLine* end_line = get_line_from_line_number(box, selection.end_line_number);
 
-				for (size_t i = 0; i < line->wrapped_line_count; i++) {
-					if (pixel_offset_y > box->h) {
-						goto text_render_end;
-					}
-					size_t line_start = char_offset;
-					size_t line_end = line->wrapped_line_sizes[i] + char_offset;
+	UTFStringView start_sv = text_line_sv(start_line);
+	UTFString* str = utf_from_sv(utf_sv_sub_sv(start_sv, selection.start_char, start_sv.count));
 
-					UTFStringView line_sv = utf_sv_sub_sv(sv, line_start, line_end);
+	//TODO : Implement some sort of mechanic to differentiate between crlf and lf
+	utf_append_cstr(str, u8"\n");
 
-					bool left_shaded = selection.end_char <= line_end && selection.end_char >= line_start;
-					left_shaded = left_shaded && (selection.end_line_number == line->line_number);
+	for(TextLine* line = start_line->next; line != NULL && line != end_line; line = line->next){
+		if(line->span_count > 0){
+			//lines of a span are read from the index so their new lines are written the same way
+			size_t first_line = text_line_index_line_at(&box->line_index, line->mapped_data);
+			for(size_t i = first_line; i < first_line + line->span_count; i++){
+				const char* data;
+				size_t size;
+				bool ends_with_lf, ends_with_crlf;
+				text_line_index_get_line(&box->line_index, i, &data, &size, &ends_with_lf, &ends_with_crlf);
+				UTFStringView sv = {.data = data, .data_size = size};
+				sv.count = utf_sv_count(sv);
+				utf_append_sv(str, sv);
+				utf_append_cstr(str, u8"\n");
+			}
+			continue;
+		}
+		utf_append_sv(str, text_line_sv(line));
+		//TODO : Implement some sort of mechanic to differentiate between crlf and lf
+		utf_append_cstr(str, u8"\n");
+	}
 
-					bool right_shaded = selection.start_char <= line_end && selection.start_char >= line_start;
-					right_shaded = right_shaded && (selection.start_line_number == line->line_number);
+	utf_append_sv(str, utf_sv_sub_sv(text_line_sv(end_line), 0, selection.end_char));
 
-					bool un_shaded = line->line_number == selection.start_line_number && line_end < selection.start_char && line_start < selection.start_char;
-					un_shaded = un_shaded || (line->line_number == selection.end_line_number && line_start > selection.end_char && line_end > selection.end_char);
+	return str;
+}
 
+void drop_clipboard_snapshot(TextBox* box)
+{
+	if (box->clipboard.snapshot) {
+		text_snapshot_destroy(box->clipboard.snapshot);
+		box->clipboard.snapshot = NULL;
+	}
+	box->clipboard.start_line = NULL;
+	box->clipboard.end_line = NULL;
+	box->clipboard.counted_removed_lines = NULL;
+	box->clipboard.removed_line_count = 0;
+}
 
-					if (left_shaded && right_shaded) {
-						UTFStringView left = utf_sv_sub_sv(line_sv, 0, selection.start_char - char_offset);
-						UTFStringView right = utf_sv_sub_sv(line_sv, selection.end_char - char_offset, line_sv.count);
-						UTFStringView between = utf_sv_sub_sv(line_sv, selection.start_char - char_offset, selection.end_char - char_offset);
+//Copying only takes a snapshot, lines are copied when they are edited
+void text_box_copy_selection(TextBox* box, Selection selection)
+{
+	if (box->clipboard.str) {
+		utf_destroy(box->clipboard.str);
+		box->clipboard.str = NULL;
+	}
+	drop_clipboard_snapshot(box);
 
-						int pixel_offset_x = 0;
-						int rendered_size_x = 0;
-						if (
-							!draw_sv(box, left, 0, pixel_offset_y,
-								false,
-								box->text_color, box->selection_fg, box->selection_bg,
-								&rendered_size_x, NULL
-							))
-						{
-							goto renderexit;
-						}
-						pixel_offset_x += rendered_size_x;
-						if (
-							!draw_sv(box, between, pixel_offset_x, pixel_offset_y,
-								true,
-								box->text_color, box->selection_fg, box->selection_bg,
-								&rendered_size_x, NULL
-							))
-						{
-							goto renderexit;
-						}
-						pixel_offset_x += rendered_size_x;
-						if (
-							!draw_sv(box, right, pixel_offset_x, pixel_offset_y,
-								false,
-								box->text_color, box->selection_fg, box->selection_bg,
-								NULL, NULL
-							))
-						{
-							goto renderexit;
-						}
-					}
-					else if (left_shaded) {
-						UTFStringView left = utf_sv_sub_sv(line_sv, 0, selection.end_char - char_offset);
-						UTFStringView right = utf_sv_sub_sv(line_sv, selection.end_char - char_offset, line_sv.count);
-						int pixel_offset_x = 0;
-						int rendered_size_x = 0;
-						if (
-							!draw_sv(box, left, 0, pixel_offset_y,
-								true,
-								box->text_color, box->selection_fg, box->selection_bg,
-								&rendered_size_x, NULL
-							))
-						{
-							goto renderexit;
-						}
-						pixel_offset_x += rendered_size_x;
-						if (
-							!draw_sv(box, right, pixel_offset_x, pixel_offset_y,
-								false,
-								box->text_color, box->selection_fg, box->selection_bg,
-								NULL, NULL
-							))
-						{
-							goto renderexit;
-						}
-					}
-					else if (right_shaded) {
-						UTFStringView left = utf_sv_sub_sv(line_sv, 0, selection.start_char - char_offset);
-						UTFStringView right = utf_sv_sub_sv(line_sv, selection.start_char - char_offset, line_sv.count);
-						int pixel_offset_x = 0;
-						int rendered_size_x = 0;
-						if (
-							!draw_sv(box, left, 0, pixel_offset_y,
-								false,
-								box->text_color, box->selection_fg, box->selection_bg,
-								&rendered_size_x, NULL
-							))
-						{
-							goto renderexit;
-						}
-						pixel_offset_x += rendered_size_x;
-						if (
-							!draw_sv(box, right, pixel_offset_x, pixel_offset_y,
-								true,
-								box->text_color, box->selection_fg, box->selection_bg,
-								NULL, NULL
-							))
-						{
-							goto renderexit;
-						}
-					}
-					else {
-						if (
-							!draw_sv(box, line_sv, 0, pixel_offset_y,
-								!un_shaded,
-								box->text_color, box->selection_fg, box->selection_bg,
-								NULL, NULL
-							))
-						{
-							goto renderexit;
-						}
-					}
-					char_offset += line->wrapped_line_sizes[i];
-					pixel_offset_y += font_height;
-				}
-			}
+	selection = normalize_selection(selection);
+	box->clipboard.has_snapshot = true;
+	box->clipboard.generation++;
 
-			utf_destroy(copy);
+	TextLine* start_line = get_line_from_line_number(box, selection.start_line_number);
+	TextLine* end_line = get_line_from_line_number(box, selection.end_line_number);
 
-		}
+	box->clipboard.snapshot = text_snapshot_create(TEXT_SNAPSHOT_CLIPBOARD, start_line, NULL, 0);
+	if (!box->clipboard.snapshot) {
+		box->clipboard.str = text_box_get_selection_str(box, selection);
+		return;
 	}
-text_render_end: ;
+	box->clipboard.start_line = start_line;
+	box->clipboard.start_byte = text_line_char_to_byte(start_line, selection.start_char);
+	box->clipboard.end_line = end_line;
+	box->clipboard.end_byte = text_line_char_to_byte(end_line, selection.end_char);
+}
 
-	/////////////////////////////
-	// Render Cursor
-	/////////////////////////////
-	int cursor_x = 0;
-	int cursor_y = 0;
+//where reader stops reading a line of the snapshot, line ending is read after the text
+size_t clipboard_line_end_byte(ClipboardSnapshot* clipboard, TextSnapshotLine version)
+{
+	if (version.line == clipboard->end_line) {
+		return clipboard->end_byte;
+	}
+	return version.data_size + (version.ends_with_crlf ? 2 : 1);
+}
 
-	get_cursor_screen_pos(box, &cursor_x, &cursor_y);
-	SDL_Rect cursor_rect = { .x = cursor_x, .y = cursor_y + 2 + box->offset_y, .w = 2, .h = font_height - 2 };
+ClipboardReader text_box_clipboard_reader(TextBox* box)
+{
+	ClipboardReader reader = {
+		.generation = box->clipboard.generation,
+		.position = 0,
+		.line = NULL, .line_byte = 0, .line_end_byte = 0
+	};
 
-	SDL_FillRect(box->render_surface, &cursor_rect,
-        SDL_MapRGBA(box->render_surface->format, box->cursor_color.r, box->cursor_color.g, box->cursor_color.b, box->cursor_color.a));
+	if (!box->clipboard.snapshot) {
+		return reader;
+	}
 
-renderexit:
+	TextSnapshotLine version = text_snapshot_line(box->clipboard.snapshot, box->clipboard.start_line);
+	reader.line = box->clipboard.start_line;
+	reader.line_byte = box->clipboard.start_byte;
+	reader.line_end_byte = clipboard_line_end_byte(&box->clipboard, version);
 
-	box->need_to_render = false;
+	return reader;
 }
 
-TextCursor text_box_move_cursor_left(TextBox* box, TextCursor cursor)
+size_t text_box_clipboard_size(TextBox* box)
 {
-	TextCursor new_cursor_pos = cursor;
-
-	new_cursor_pos.place_after_last_char_before_wrapping = false;
-	if (cursor.char_offset > 0) {
-		new_cursor_pos.char_offset--;
+	if (!box->clipboard.has_snapshot) {
+		return 0;
 	}
-	else {
-		TextLine* cursor_line = get_line_from_line_number(box, cursor.line_number);
-		TextLine* prev_line = cursor_line->prev;
-		if (prev_line) {
-			new_cursor_pos.char_offset = prev_line->str->count;
-			new_cursor_pos.line_number--;
+	if (box->clipboard.str) {
+		return box->clipboard.str->data_size;
+	}
+
+	ClipboardSnapshot* clipboard = &box->clipboard;
+	size_t size = 0;
+	size_t line_byte = clipboard->start_byte;
+
+	for (TextLine* line = clipboard->start_line; line != NULL; ) {
+		TextSnapshotLine version = text_snapshot_line(clipboard->snapshot, line);
+		size += clipboard_line_end_byte(clipboard, version) - line_byte;
+		if (line == clipboard->end_line) {
+			break;
 		}
+		line = version.next;
+		line_byte = 0;
 	}
 
-	box->need_to_render = true;
+	return size;
+}
 
-	return new_cursor_pos;
+UTFStringView text_box_clipboard_sv(TextBox* box)
+{
+	if (!box->clipboard.has_snapshot) {
+		return utf_sv_from_cstr(u8"");
+	}
+	serialize_clipboard_snapshot(box);
+	return utf_sv_from_str(box->clipboard.str);
 }
 
-TextCursor text_box_move_cursor_right(TextBox* box, TextCursor cursor)
+size_t text_box_clipboard_read(TextBox* box, ClipboardReader* reader, char* buffer, size_t buffer_size)
 {
-	TextCursor new_cursor_pos = cursor;
+	ClipboardSnapshot* clipboard = &box->clipboard;
 
-	new_cursor_pos.place_after_last_char_before_wrapping = false;
-	TextLine* cursor_line = get_line_from_line_number(box, cursor.line_number);
+	//something else was copied while reading
+	if (!clipboard->has_snapshot || reader->generation != clipboard->generation) {
+		return 0;
+	}
 
-	if (cursor.char_offset < cursor_line->str->count) {
-		new_cursor_pos.char_offset++;
+	//snapshot was serialized (maybe while we were reading it)
+	//so just continue from the position
+	if (clipboard->str) {
+		size_t data_size = clipboard->str->data_size;
+		if (reader->position >= data_size) {
+			return 0;
+		}
+		size_t to_read = min(buffer_size, data_size - reader->position);
+		memcpy(buffer, clipboard->str->data + reader->position, to_read);
+		reader->position += to_read;
+		return to_read;
 	}
-	else {
-		TextLine* next_line = cursor_line->next;
-		if (next_line) {
-			new_cursor_pos.char_offset = 0;
-			new_cursor_pos.line_number++;
+
+	size_t written = 0;
+
+	while (written < buffer_size && reader->line != NULL) {
+		TextSnapshotLine version = text_snapshot_line(clipboard->snapshot, reader->line);
+
+		if (reader->line_byte < reader->line_end_byte) {
+			size_t to_read = min(buffer_size - written, reader->line_end_byte - reader->line_byte);
+			if (reader->line_byte < version.data_size) {
+				to_read = min(to_read, version.data_size - reader->line_byte);
+				memcpy(buffer + written, version.data + reader->line_byte, to_read);
+			}
+			else {
+				const char* ending = version.ends_with_crlf ? "\r\n" : "\n";
+				memcpy(buffer + written, ending + (reader->line_byte - version.data_size), to_read);
+			}
+			reader->line_byte += to_read;
+			written += to_read;
+			continue;
+		}
+
+		if (reader->line == clipboard->end_line) {
+			reader->line = NULL;
+			break;
 		}
+
+		reader->line = version.next;
+		reader->line_byte = 0;
+		reader->line_end_byte = clipboard_line_end_byte(clipboard, text_snapshot_line(clipboard->snapshot, reader->line));
 	}
 
-	box->need_to_render = true;
+	reader->position += written;
 
-	return new_cursor_pos;
+	return written;
 }
 
-size_t get_char_offset_from_line_and_char_coord(TextLine* line, size_t char_x, size_t char_y) {
-	size_t char_offset = 0;
-	for (size_t i = 0; i < min(line->wrapped_line_count, char_y); i++) {
-		char_offset += line->wrapped_line_sizes[i];
+//Frees at most max_lines of removed lines.
+//Meant to be called when there is nothing else to do.
+//Returns true if there are lines left to free
+bool text_box_free_removed_lines(TextBox* box, size_t max_lines)
+{
+	//running autosave, find or reload workers might still read them
+	if (box->autosave_snapshot || text_find_is_reading(&box->find) || box->reload_snapshot) {
+		return box->removed_lines != NULL;
 	}
-	size_t cursor_line_index = min(line->wrapped_line_count-1, char_y);
-	size_t cursor_line_size = min((int)char_x, line->wrapped_line_sizes[cursor_line_index]);
-	char_offset += cursor_line_size;
-	return char_offset;
+
+	//so might the copied text, they are kept until there are too many of them
+	//and then the copied text is serialized instead
+	if (box->clipboard.snapshot) {
+		ClipboardSnapshot* clipboard = &box->clipboard;
+		//lines are pushed to the front, so only the new ones are counted
+		for (TextLine* line = box->removed_lines; line != clipboard->counted_removed_lines; line = line->next) {
+			clipboard->removed_line_count++;
+		}
+		clipboard->counted_removed_lines = box->removed_lines;
+
+		if (clipboard->removed_line_count <= TEXT_BOX_CLIPBOARD_KEPT_LINES) {
+			return box->removed_lines != NULL;
+		}
+		serialize_clipboard_snapshot(box);
+	}
+
+	for (size_t i = 0; i < max_lines && box->removed_lines != NULL; i++) {
+		TextLine* next = box->removed_lines->next;
+		text_line_destroy(box->removed_lines);
+		box->removed_lines = next;
+	}
+	return box->removed_lines != NULL;
 }
 
-TextCursor text_box_move_cursor_up(TextBox* box, TextCursor cursor)
+void text_box_resize(TextBox* box, int w, int h)
 {
-	TextCursor new_cursor_pos = cursor;
-	if (cursor.char_offset == 0 && cursor.line_number == 0) {
-		return new_cursor_pos;
+	SDL_Surface *new_render_surface = SDL_CreateRGBSurfaceWithFormat(0, w, h, 32, box->render_surface->format->format);
+
+	if (!new_render_surface) {
+		fprintf(stderr, "%s:%d:ERROR : Failed to resize text box!!! : %s", __FILE__, __LINE__, SDL_GetError());
+		return;
 	}
-	//box->cursor.place_after_last_char_before_wrapping = true;
+	SDL_FreeSurface(box->render_surface);
+	box->render_surface = new_render_surface;
 
-	TextLine* cursor_line = get_line_from_line_number(box, cursor.line_number);
-	size_t offset_x;
-	size_t offset_y;
-	get_char_coord_from_cursor(box, cursor, &offset_x, &offset_y);
+	box->w = w;
+	box->h = h;
 
-	if (offset_y == 0) {
-		TextLine* prev_line = cursor_line->prev;
-		if (prev_line) {
-			new_cursor_pos.char_offset = get_char_offset_from_line_and_char_coord(
-				prev_line,
-				offset_x,
-				prev_line->wrapped_line_count - 1
-			);
-			new_cursor_pos.line_number--;
-		}
+	//lines are laid out for the new width when they are reached, view stays on the same line
+	for (TextLine* line = box->first_line; line != NULL; line = line->next) {
+		defer_text_line_update(box, line);
 	}
-	else {
-		if (cursor_line->wrapped_line_sizes[offset_y] == (int)offset_x) {
-			new_cursor_pos.place_after_last_char_before_wrapping = true;
-		}
-		else {
-			new_cursor_pos.place_after_last_char_before_wrapping = false;
-		}
-		new_cursor_pos.char_offset = get_char_offset_from_line_and_char_coord(
-			cursor_line,
-			offset_x,
-			offset_y-1
-		);
+	box->scroll.wrapped_line = 0;
+	box->scroll.pixel_offset = 0;
+
+	scroll_to_cursor(box);
+	box->need_to_render = true;
+}
+
+void text_box_go_to_line(TextBox* box, size_t line_number)
+{
+	if (line_number >= box->line_count) {
+		line_number = box->line_count - 1;
 	}
 
-	box->need_to_render = true;
+	box->cursor.line_number = line_number;
+	box->cursor = set_cursor_char_offset(get_line_from_line_number(box, line_number), box->cursor, 0);
+	box->selection = set_selection_to_cursor(box->cursor);
 
-	return new_cursor_pos;
+	scroll_to_cursor(box);
+	box->need_to_render = true;
 }
 
-TextCursor text_box_move_cursor_down(TextBox* box, TextCursor cursor)
+void text_box_start_find(TextBox* box)
 {
-	TextCursor new_cursor_pos = cursor;
+	box->is_finding = true;
 
-	TextLine* cursor_line = get_line_from_line_number(box, cursor.line_number);
+	//selected text becomes the query
+	Selection selection = normalize_selection(box->selection);
+	if (has_selection(box, selection) && selection.start_line_number == selection.end_line_number) {
+		UTFString* selected = text_box_get_selection_str(box, selection);
+		text_box_set_find_query(box, utf_sv_from_str(selected));
+		utf_destroy(selected);
+	}
 
-	size_t offset_x;
-	size_t offset_y;
-	get_char_coord_from_cursor(box, cursor, &offset_x, &offset_y);
+	box->need_to_render = true;
+}
 
-	if (offset_x == 0) {
-		new_cursor_pos.place_after_last_char_before_wrapping = false;
-	}
+void text_box_set_find_query(TextBox* box, UTFStringView query)
+{
+	text_find_set_query(&box->find, query);
+	box->need_to_render = true;
+}
 
-	if (offset_y + 1 < cursor_line->wrapped_line_count) {
+void text_box_set_find_regex(TextBox* box, bool is_regex)
+{
+	text_find_set_regex(&box->find, is_regex);
+	box->need_to_render = true;
+}
 
-		new_cursor_pos.char_offset = get_char_offset_from_line_and_char_coord(
-			cursor_line,
-			offset_x,
-			offset_y + 1
-		);
+bool text_box_start_follow(TextBox* box)
+{
+	if (!box->file_path || !box->mapping || box->follower || box->is_read_only) {
+		return false;
 	}
-	else if(cursor_line->next != NULL) {
-		new_cursor_pos.char_offset = get_char_offset_from_line_and_char_coord(
-			cursor_line->next,
-			offset_x,
-			0
-		);
-		new_cursor_pos.line_number++;
+	//lines read from the file would be appended to the index the reload worker reads
+	stop_reload_job(box);
+
+	//file goes on right after what was mapped
+	box->follower = os_file_follower_create(box->file_path, os_file_mapping_size(box->mapping));
+	if (!box->follower) {
+		return false;
+	}
+	box->follow_buffer = malloc(TEXT_BOX_FOLLOW_READ_SIZE);
+	box->follow_carry_size = 0;
+
+	//cursor goes to the end so the view follows the file from the start (like tail -f),
+	//every line of the file has to be there for that
+	while (box->load) {
+		text_box_load_poll(box);
 	}
+	text_find_restart(&box->find);
 
+	TextLine* last_line = get_line_from_line_number(box, box->line_count - 1);
+	box->cursor.line_number = box->line_count - 1;
+	box->cursor = set_cursor_char_offset(last_line, box->cursor, text_line_sv(last_line).count);
+	box->cursor.place_after_last_char_before_wrapping = false;
+	box->selection = set_selection_to_cursor(box->cursor);
+	box->is_selecting = false;
+	scroll_to_cursor(box);
 	box->need_to_render = true;
 
-	return new_cursor_pos;
+	return true;
 }
 
-TextCursor text_box_move_cursor_left_word(TextBox* box, TextCursor cursor)
+void text_box_stop_follow(TextBox* box)
 {
-    //first check if we can go left
-    if(cursor.line_number <= 0 && cursor.char_offset <= 0){
-        return cursor;
-    }
+	if (!box->follower) {
+		return;
+	}
+	os_file_follower_destroy(box->follower);
+	box->follower = NULL;
+	free(box->follow_buffer);
+	box->follow_buffer = NULL;
+	box->follow_carry_size = 0;
+}
 
-    box->need_to_render = true;
+//how many bytes at the end have to wait for the rest of them
+size_t get_follow_carry_size(const char* data, size_t size)
+{
+	//\r might be half of \r\n
+	if (size > 0 && data[size - 1] == '\r') {
+		return 1;
+	}
 
-    while(true){
-        cursor = text_box_move_cursor_left(box, cursor);
-        //if we reached the beginnig of the string return
-        if(cursor.char_offset <= 0){
-            return cursor;
-        }
+	//character that doesn't have all of its bytes yet
+	for (size_t back = 1; back <= 3 && back <= size; back++) {
+		unsigned char byte = data[size - back];
+		if ((byte & 0xC0) == 0x80) {
+			continue;
+		}
+		size_t char_size = byte >= 0xF0 ? 4 : byte >= 0xE0 ? 3 : byte >= 0xC0 ? 2 : 1;
+		return char_size > back ? back : 0;
+	}
+	return 0;
+}
+
+//Puts text at the end of the document as a part of the file, it's not an edit
+//
+//Only the last line changes (it's the one the text continues),
+//new lines are laid out when they are shown
+void append_followed_text(TextBox* box, UTFStringView sv)
+{
+	TextLine* last_line = get_line_from_line_number(box, box->line_count - 1);
+	assert(last_line->next == NULL);
 
-        TextLine* cursor_line = get_line_from_line_number(box, cursor.line_number);
+	freeze_line(box, last_line);
+	text_line_materialize(last_line);
 
-        //if we reached the end of the string return
-        if(cursor.char_offset == cursor_line->str->count){
-            return cursor;
-        }
+	TextLine* new_lines = create_lines_from_sv(sv);
 
-        //if there is a space at left return
-        UTFStringView sv = utf_sv_from_str(cursor_line->str);
-        UTFStringView at_left = utf_sv_sub_sv(sv, cursor.char_offset - 1 , cursor.char_offset);
-        UTFStringView at_right = utf_sv_sub_sv(sv, cursor.char_offset, cursor.char_offset+1);
-        if( utf_sv_cmp(at_left, utf_sv_from_cstr(u8" ")) && !utf_sv_cmp(at_right, utf_sv_from_cstr(u8" ")) )
-        {
-            return cursor;
-        }
-    }
+	utf_append_str(last_line->str, new_lines->str);
+	last_line->ends_with_crlf = new_lines->ends_with_crlf;
+	last_line->ends_with_lf = new_lines->ends_with_lf;
+	defer_text_line_update(box, last_line);
+
+	TextLine* first_to_append = new_lines->next;
+	text_line_destroy(new_lines);
+
+	last_line->next = first_to_append;
+	if (first_to_append) {
+		first_to_append->prev = last_line;
+	}
+
+	size_t line_number = last_line->line_number;
+	TextLine* new_last = last_line;
+	for (TextLine* line = first_to_append; line != NULL; line = line->next) {
+		line->line_number = ++line_number;
+		defer_text_line_update(box, line);
+		new_last = line;
+	}
+
+	box->line_count = line_number + 1;
+	box->line_hint = new_last;
 }
-TextCursor text_box_move_cursor_right_word(TextBox* box, TextCursor cursor)
+
+bool text_box_follow_poll(TextBox* box)
 {
-    TextLine* cursor_line = get_line_from_line_number(box, cursor.line_number);
+	if (!box->follower) {
+		return false;
+	}
 
-    //first check if we can go right
-    if(cursor.char_offset >= cursor_line->str->count && cursor_line->next == NULL){
-        return cursor;
-    }
+	//lines of the file have to be there before anything goes after them,
+	//and find workers follow next pointers, so it waits for both
+	if (box->load || box->find.job) {
+		return false;
+	}
 
-    box->need_to_render = true;
+	size_t carry_size = box->follow_carry_size;
+	size_t read_size = os_file_follower_read(box->follower, box->follow_buffer + carry_size, TEXT_BOX_FOLLOW_READ_SIZE - carry_size);
+	if (read_size == 0) {
+		return false;
+	}
 
-    while(true){
-        cursor = text_box_move_cursor_right(box, cursor);
+	size_t size = carry_size + read_size;
+	box->follow_carry_size = get_follow_carry_size(box->follow_buffer, size);
+	size -= box->follow_carry_size;
 
-        //if we reached the beginnig of the string return
-        if(cursor.char_offset <= 0){
-            return cursor;
-        }
+	if (size > 0) {
+		TextLine* last_line = get_line_from_line_number(box, box->line_count - 1);
+		bool cursor_at_end = box->cursor.line_number == box->line_count - 1 &&
+			box->cursor.byte_offset == text_line_data_size(last_line);
 
-        TextLine* cursor_line = get_line_from_line_number(box, cursor.line_number);
+		UTFStringView sv = {.data = box->follow_buffer, .data_size = size};
+		sv.count = utf_sv_count(sv);
+		append_followed_text(box, sv);
 
-        //if we reached the end of the string return
-        if(cursor.char_offset == cursor_line->str->count){
-            return cursor;
-        }
+		//view keeps up with the file only if the cursor was following it
+		if (cursor_at_end && !box->is_selecting) {
+			TextLine* new_last = get_line_from_line_number(box, box->line_count - 1);
 
-        //if there is a space at left return
-        UTFStringView sv = utf_sv_from_str(cursor_line->str);
-        UTFStringView at_left = utf_sv_sub_sv(sv, cursor.char_offset - 1 , cursor.char_offset);
-        UTFStringView at_right = utf_sv_sub_sv(sv, cursor.char_offset, cursor.char_offset+1);
-        if( utf_sv_cmp(at_left, utf_sv_from_cstr(u8" ")) && !utf_sv_cmp(at_right, utf_sv_from_cstr(u8" ")) )
-        {
-            return cursor;
-        }
-    }
+			box->cursor.line_number = box->line_count - 1;
+			box->cursor = set_cursor_char_offset(new_last, box->cursor, new_last->str->count);
+			box->cursor.place_after_last_char_before_wrapping = false;
+			box->selection = set_selection_to_cursor(box->cursor);
+			scroll_to_cursor(box);
+		}
+	}
+
+	memmove(box->follow_buffer, box->follow_buffer + size, box->follow_carry_size);
+
+	box->need_to_render = true;
+	return true;
 }
 
-TextCursor text_box_delete_a_character(TextBox* box, TextCursor cursor)
+//line the diff kept points to its text in the reloaded file, its layout stays
+void repoint_reloaded_line(TextBox* box, TextLine* line, TextLineIndex* index, size_t line_number)
 {
-	TextCursor new_cursor_pos = cursor;
+	const char* data = NULL;
+	size_t size = 0;
+	bool ends_with_lf = false;
+	bool ends_with_crlf = false;
+	text_line_index_get_line(index, line_number, &data, &size, &ends_with_lf, &ends_with_crlf);
+
+	//hashes matched, text is compared anyway so a collision can't keep the old text
+	bool is_same = text_line_data_size(line) == size && memcmp(text_line_data(line), data, size) == 0;
+
+	if (line->str) {
+		utf_destroy(line->str);
+		line->str = NULL;
+	}
+	line->mapped_data = data;
+	line->mapped_size = size;
+	line->mapped_count = SIZE_MAX;
+	line->ends_with_lf = ends_with_lf;
+	line->ends_with_crlf = ends_with_crlf;
+	line->line_number = line_number;
+
+	if (!is_same) {
+		defer_text_line_update(box, line);
+	}
+}
 
-	if (cursor.line_number == 0 && cursor.char_offset == 0) {
-		return new_cursor_pos;
+//Puts lines of the reloaded file in place of the ones the diff replaced
+//
+//TextLines are created where each hunk starts and ends first, so a span is either kept or replaced whole
+//and old lines without a TextLine are all after the last hunk.
+//They stay without one and are created from the new index when something reaches them
+void apply_reload_diff(TextBox* box, TextLineIndex* index, TextDiff* diff)
+{
+	for (size_t i = 0; i < diff->hunk_count; i++) {
+		TextDiffHunk hunk = diff->hunks[i];
+		if (hunk.old_start < box->line_count) {
+			get_line_from_line_number(box, hunk.old_start);
+		}
+		if (hunk.old_count > 0) {
+			get_line_from_line_number(box, hunk.old_start + hunk.old_count - 1);
+		}
 	}
+	forget_all_lines(box);
 
-	size_t char_offset = cursor.char_offset;
-	if (char_offset <= 0) {
-		if (cursor.line_number == 0) {
-			return new_cursor_pos;
+	TextLine* line = box->first_line;
+	TextLine* prev = NULL;
+	size_t old_line_number = 0;
+	size_t new_line_number = 0;
+
+	for (size_t i = 0; i <= diff->hunk_count; i++) {
+		//lines before the hunk stay, after the last hunk every line that is left does
+		size_t keep_until = i < diff->hunk_count ? diff->hunks[i].old_start : SIZE_MAX;
+		while (line && old_line_number < keep_until) {
+			if (line->span_count > 0) {
+				size_t count = line->span_count;
+				text_line_index_set_span(index, line, new_line_number, new_line_number + count);
+				line->line_number = new_line_number;
+				new_line_number += count;
+				old_line_number += count;
+			}
+			else {
+				repoint_reloaded_line(box, line, index, new_line_number++);
+				old_line_number++;
+			}
+			prev = line;
+			line = line->next;
 		}
-		TextLine* cursor_line = get_line_from_line_number(box, cursor.line_number);
-		if (cursor_line->prev == NULL) {
-			return new_cursor_pos;
+		if (i == diff->hunk_count) {
+			break;
 		}
-		TextLine* prev_line = cursor_line->prev;
-		size_t line_count = prev_line->str->count;
-		utf_append_str(prev_line->str, cursor_line->str);
 
-		prev_line->next = cursor_line->next;
-		if (cursor_line->next) {
-			cursor_line->next->prev = prev_line;
+		TextDiffHunk hunk = diff->hunks[i];
+		for (size_t j = 0; j < hunk.old_count; ) {
+			TextLine* next = line->next;
+			j += line->span_count > 0 ? line->span_count : 1;
+			text_line_destroy(line);
+			line = next;
 		}
-		text_line_destroy(cursor_line);
-		new_cursor_pos.line_number--;
+		old_line_number += hunk.old_count;
 
-		text_line_set_number_right(prev_line, prev_line->line_number);
-		update_text_line(box, prev_line);
+		for (size_t j = 0; j < hunk.new_count; j++) {
+			const char* data = NULL;
+			size_t size = 0;
+			bool ends_with_lf = false;
+			bool ends_with_crlf = false;
+			text_line_index_get_line(index, new_line_number, &data, &size, &ends_with_lf, &ends_with_crlf);
 
-		new_cursor_pos.char_offset = line_count;
+			TextLine* new_line = text_line_create_mapped(data, size, new_line_number++, ends_with_lf, ends_with_crlf);
+			defer_text_line_update(box, new_line);
+
+			new_line->prev = prev;
+			if (prev) {
+				prev->next = new_line;
+			}
+			else {
+				box->first_line = new_line;
+			}
+			prev = new_line;
+		}
+
+		if (prev) {
+			prev->next = line;
+		}
+		else {
+			box->first_line = line;
+		}
+		if (line) {
+			line->prev = prev;
+		}
 	}
-	else {
-		TextLine* cursor_line = get_line_from_line_number(box, cursor.line_number);
-		utf_erase_range(cursor_line->str, char_offset - 1, char_offset);
-		update_text_line(box, cursor_line);
-		new_cursor_pos.char_offset = char_offset - 1;
+
+	index->next_line = new_line_number;
+}
+
+//where a line of the old document is after the diff
+//lines that were replaced go to the line that replaced them(or the one after)
+size_t get_reloaded_line_number(TextDiff* diff, size_t line_number, size_t new_line_count, bool* was_replaced)
+{
+	*was_replaced = false;
+
+	size_t new_line_number = line_number;
+	for (size_t i = 0; i < diff->hunk_count; i++) {
+		TextDiffHunk hunk = diff->hunks[i];
+		if (line_number < hunk.old_start) {
+			break;
+		}
+		if (line_number < hunk.old_start + hunk.old_count) {
+			*was_replaced = true;
+			size_t in_hunk = min(line_number - hunk.old_start, hunk.new_count > 0 ? hunk.new_count - 1 : 0);
+			new_line_number = hunk.new_start + in_hunk;
+			break;
+		}
+		new_line_number = line_number - (hunk.old_start + hunk.old_count) + (hunk.new_start + hunk.new_count);
 	}
+	return min(new_line_number, new_line_count - 1);
+}
 
-	box->need_to_render = true;
+//moves a position of the old document to the new one, column stays if the line was replaced
+void reload_position(TextBox* box, TextDiff* diff, size_t* line_number, size_t* char_offset)
+{
+	bool was_replaced = false;
+	*line_number = get_reloaded_line_number(diff, *line_number, box->line_count, &was_replaced);
+	if (was_replaced) {
+		TextLine* line = get_line_from_line_number(box, *line_number);
+		*char_offset = min(*char_offset, text_line_sv(line).count);
+	}
+}
 
-	return new_cursor_pos;
+//worker reads the document and the old index, so it's stopped before they change
+void stop_reload_job(TextBox* box)
+{
+	if (box->reload_job) {
+		text_reload_job_destroy(box->reload_job);
+		box->reload_job = NULL;
+	}
+	if (box->reload_snapshot) {
+		text_snapshot_destroy(box->reload_snapshot);
+		box->reload_snapshot = NULL;
+	}
+	if (box->reload_mapping) {
+		os_unmap_file(box->reload_mapping);
+		box->reload_mapping = NULL;
+	}
 }
 
-TextCursor text_box_delete_range(TextBox* box, Selection selection)
+//Starts reloading the opened file after someone else changed it
+//
+//Changed file is split and both versions are hashed line by line and diffed on a worker thread,
+//text_box_load_poll replaces only lines in the hunks once it's done.
+//Unsaved edits are dropped, and so is the undo history since it points to the old lines
+bool text_box_reload_file(TextBox* box)
 {
-	TextCursor new_cursor_pos = box->cursor;
+	//index of a viewed file might be in its cache, viewing it again builds a new one
+	if (!box->file_path || box->is_read_only) {
+		return false;
+	}
+	stop_reload_job(box);
 
-	selection = normalize_selection(selection);
+	//file is checked again when the diff is done, it's diffed again if it changed in between
+	if (!os_get_file_stamp(box->file_path, &box->reload_stamp)) {
+		memset(&box->reload_stamp, 0, sizeof(OS_FileStamp));
+	}
+	OS_FileMapping* mapping = os_map_file(box->file_path);
+	if (!mapping) {
+		return false;
+	}
 
-	TextLine* start_line = get_line_from_line_number(box, selection.start_line_number);
-	TextLine* end_line = get_line_from_line_number(box, selection.end_line_number);
+	//lines without a TextLine are hashed from the index so all of it has to be split,
+	//and nothing can be appended to it while the worker reads it
+	while (box->load) {
+		text_box_load_poll(box);
+	}
+	text_box_stop_follow(box);
+
+	box->reload_snapshot = text_snapshot_create(TEXT_SNAPSHOT_RELOAD, box->first_line, NULL, 0);
+	if (box->reload_snapshot) {
+		box->reload_job = text_reload_job_start(
+			os_file_mapping_data(mapping), os_file_mapping_size(mapping),
+			box->reload_snapshot, box->first_line,
+			&box->line_index, box->line_index.next_line, box->line_count
+		);
+	}
+	box->reload_mapping = mapping;
+	if (!box->reload_job) {
+		stop_reload_job(box);
+		return false;
+	}
+	box->reload_change_count = box->change_count;
+	return true;
+}
 
-	if (selection.start_line_number == selection.end_line_number) {
-		utf_erase_range(start_line->str, selection.start_char, selection.end_char);
-		new_cursor_pos.char_offset = selection.start_char;
-		update_text_line(box, start_line);
-		box->need_to_render = true;
+//puts the reloaded file in place of the old one with the diff the worker made
+void apply_reloaded_file(TextBox* box, OS_FileMapping* mapping, TextLineIndex* index, TextDiff* diff)
+{
+	serialize_clipboard_snapshot(box);
+	//matches, autosave and follower point to lines that are about to change
+	text_find_restart(&box->find);
+	text_find_wait(&box->find);
+	stop_autosave(box);
+	text_box_stop_follow(box);
+
+	apply_reload_diff(box, index, diff);
+
+	//undo records and removed lines might point to the old mapping
+	text_undo_destroy(&box->undo);
+	text_box_free_removed_lines(box, SIZE_MAX);
+	text_undo_init(&box->undo, &box->removed_lines);
+
+	if (box->mapping) {
+		os_unmap_file(box->mapping);
+		text_line_index_destroy(&box->line_index);
+	}
+	box->mapping = mapping;
+	box->line_index = *index;
+	box->line_count = index->line_count;
+	forget_all_lines(box);
+
+	reload_position(box, diff, &box->cursor.line_number, &box->cursor.char_offset);
+	box->cursor = set_cursor_char_offset(get_line_from_line_number(box, box->cursor.line_number), box->cursor, box->cursor.char_offset);
+	reload_position(box, diff, &box->selection.start_line_number, &box->selection.start_char);
+	reload_position(box, diff, &box->selection.end_line_number, &box->selection.end_char);
+
+	//line at the top of the view stays there, kept lines are laid out as they were
+	bool was_replaced = false;
+	box->scroll.line_number = get_reloaded_line_number(diff, box->scroll.line_number, box->line_count, &was_replaced);
+	if (was_replaced) {
+		box->scroll.wrapped_line = 0;
+		box->scroll.pixel_offset = 0;
 	}
-	else {
-		//first get texts after selection end char
-		UTFString *start_str = start_line->str;
-		UTFString *end_str = end_line->str;
-		UTFStringView after_selection_end_char = utf_sv_sub_str(end_str, selection.end_char, end_str->count);
 
-		//erase start_str after selection start char
-		utf_erase_range(start_str, selection.start_char, start_str->count);
-		//append after_selection_end_char
-		utf_append_sv(start_str, after_selection_end_char);
+	box->change_count++;
+	mark_document_as_file(box);
+	box->need_to_render = true;
+}
 
-		//free lines between start and end
-		assert(start_line->next != NULL);
-		for (TextLine* line = start_line->next; line != end_line;) {
-			TextLine* tmp = line->next;
-			text_line_destroy(line);
-			line = tmp;
+//applies the diff once the worker is done, returns true if the document changed
+bool poll_reload_job(TextBox* box)
+{
+	bool success = false;
+	if (!box->reload_job || !text_reload_job_poll(box->reload_job, &success)) {
+		return false;
+	}
+
+	TextLineIndex index;
+	TextDiff diff;
+	if (success) {
+		text_reload_job_take(box->reload_job, &index, &diff);
+	}
+	OS_FileMapping* mapping = box->reload_mapping;
+	box->reload_mapping = NULL;
+	OS_FileStamp stamp = box->reload_stamp;
+	stop_reload_job(box);
+
+	if (!success) {
+		fprintf(stderr, "%s:%d:ERROR : Failed to diff %s\n", __FILE__, __LINE__, box->file_path);
+		os_unmap_file(mapping);
+		return false;
+	}
+
+	//diff is for the document as it was, edits made since then are not dropped without asking
+	bool is_edited = box->change_count != box->reload_change_count;
+	OS_FileStamp now;
+	bool is_file_changed = os_get_file_stamp(box->file_path, &now) &&
+		(now.modified_time != stamp.modified_time || now.size != stamp.size);
+	if (is_edited || is_file_changed) {
+		text_line_index_destroy(&index);
+		text_diff_destroy(&diff);
+		os_unmap_file(mapping);
+
+		if (is_edited) {
+			fprintf(stderr, "%s:%d:ERROR : %s was edited while it was reloaded, Ctrl+R reloads it without the edits\n", __FILE__, __LINE__, box->file_path);
+			box->file_stamp = stamp;
 		}
-		start_line->next = end_line->next;
-		if (end_line->next) {
-			end_line->next->prev = start_line;
+		//file was written again while it was diffed
+		else if (!text_box_reload_file(box)) {
+			fprintf(stderr, "%s:%d:ERROR : Failed to reload %s\n", __FILE__, __LINE__, box->file_path);
 		}
-		text_line_destroy(end_line);
+		return false;
+	}
 
-		update_text_line(box, start_line);
-		new_cursor_pos.line_number = start_line->line_number;
-		new_cursor_pos.char_offset = selection.start_char;
+	apply_reloaded_file(box, mapping, &index, &diff);
+	text_diff_destroy(&diff);
+	return true;
+}
+
+bool text_box_reload_poll(TextBox* box)
+{
+	//followed file is read as it grows instead
+	if (!box->file_path || box->follower || box->is_read_only || box->reload_job) {
+		return false;
+	}
 
-		text_line_set_number_right(start_line, start_line->line_number);
+	double now = os_get_time();
+	if (now - box->last_reload_check_time < TEXT_BOX_RELOAD_CHECK_INTERVAL) {
+		return false;
 	}
-	box->need_to_render = true;
+	box->last_reload_check_time = now;
 
-	return new_cursor_pos;
+	OS_FileStamp stamp;
+	if (!os_get_file_stamp(box->file_path, &stamp)) {
+		return false;
+	}
+	if (stamp.modified_time == box->file_stamp.modified_time && stamp.size == box->file_stamp.size) {
+		return false;
+	}
+
+	//edits are never dropped without asking, Ctrl+R reloads anyway
+	if (box->change_count != box->file_change_count) {
+		fprintf(stderr, "%s:%d:ERROR : %s changed on the disk, Ctrl+R reloads it without the edits\n", __FILE__, __LINE__, box->file_path);
+		box->file_stamp = stamp;
+		return false;
+	}
+	return text_box_reload_file(box);
 }
 
-UTFString* text_box_get_selection_str(TextBox* box, Selection selection)
+bool text_box_load_poll(TextBox* box)
 {
-	selection = normalize_selection(selection);
+	poll_index_cache_job(box);
+	bool is_reloaded = poll_reload_job(box);
 
-	//if selection has the same text line at beginning and at the end
-	//just create str from sub sv
-	if(selection.start_line_number == selection.end_line_number){
-		TextLine* line = get_line_from_line_number(box, selection.start_line_number);
-		UTFString* str = utf_from_sv(utf_sv_sub_str(line->str, selection.start_char, selection.end_char));
-		return str;
+	if (!box->load) {
+		return is_reloaded;
 	}
 
-	TextLine* start_line = get_line_from_line_number(box, selection.start_line_number);
-	TextLine* end_line = get_line_from_line_number(box, selection.end_line_number);
+	size_t prev_line_count = text_line_index_ended_count(&box->line_index);
+	bool changed = text_load_poll(box->load, &box->line_index);
+	box->line_count += text_line_index_ended_count(&box->line_index) - prev_line_count;
 
-	UTFString* str = utf_from_sv(utf_sv_sub_str(start_line->str, selection.start_char, start_line->str->count));
+	//it could have finished while the file was being opened
+	if (text_load_is_done(box->load)) {
+		changed = true;
 
-	//TODO : Implement some sort of mechanic to differentiate between crlf and lf
-	utf_append_cstr(str, u8"\n");
+		text_load_destroy(box->load);
+		box->load = NULL;
 
-	for(TextLine* line = start_line->next; line != NULL && line != end_line; line = line->next){
-		utf_append_str(str, line->str);
-		//TODO : Implement some sort of mechanic to differentiate between crlf and lf
-		utf_append_cstr(str, u8"\n");
+		start_index_cache_job(box);
+
+		//search only went through lines that were loaded back then
+		if (box->find.query->count > 0) {
+			text_find_restart(&box->find);
+		}
 	}
 
-	utf_append_sv(str, utf_sv_sub_str(end_line->str, 0, selection.end_char));
+	if (!changed) {
+		return false;
+	}
 
-	return str;
+	//lines are created when render reaches them, but scroll bar and status still change
+	box->need_to_render = true;
+	return true;
 }
 
-void text_box_resize(TextBox* box, int w, int h)
+bool text_box_find_poll(TextBox* box)
 {
-	SDL_Surface *new_render_surface = SDL_CreateRGBSurfaceWithFormat(0, w, h, 32, box->render_surface->format->format);
+	//lines without a TextLine are searched from the index, a match doesn't create its line
+	//until render or the cursor gets there
+	if (text_find_poll(&box->find, box->first_line, &box->line_index)) {
+		box->need_to_render = true;
+		return true;
+	}
+	return false;
+}
 
-	if (!new_render_surface) {
-		fprintf(stderr, "%s:%d:ERROR : Failed to resize text box!!! : %s", __FILE__, __LINE__, SDL_GetError());
+//selects next(or previous) match from the cursor
+void text_box_find_next(TextBox* box, bool backwards)
+{
+	TextFind* find = &box->find;
+	if (find->match_count == 0) {
 		return;
 	}
-	SDL_FreeSurface(box->render_surface);
-	box->render_surface = new_render_surface;
 
-	box->w = w;
-	box->h = h;
+	//if current match is selected, move from its start
+	size_t from_line = box->cursor.line_number;
+	size_t from_char = box->cursor.char_offset;
+	Selection selection = normalize_selection(box->selection);
+	if (has_selection(box, selection)) {
+		from_line = selection.start_line_number;
+		from_char = backwards ? selection.start_char : selection.start_char + 1;
+	}
 
-	for (TextLine* line = box->first_line; line != NULL; line = line->next) {
-		update_text_line(box, line);
+	size_t index = text_find_match_after(find, from_line, from_char);
+	if (backwards) {
+		index = index == 0 ? find->match_count - 1 : index - 1;
+	}
+	else if (index >= find->match_count) {
+		index = 0;
 	}
 
-	box->offset_y = calculate_new_box_offset_y(box, box->cursor);
+	FindMatch match = find->matches[index];
+
+	box->cursor.line_number = match.line_number;
+	box->cursor.char_offset = match.end_char;
+	box->cursor.byte_offset = match.end_byte;
+	box->cursor.place_after_last_char_before_wrapping = false;
+
+	box->selection.start_line_number = match.line_number;
+	box->selection.start_char = match.start_char;
+	box->selection.end_line_number = match.line_number;
+	box->selection.end_char = match.end_char;
+	box->is_selecting = true;
+
+	scroll_to_cursor(box);
 	box->need_to_render = true;
 }
@@ -3,15 +3,35 @@
 
 #include "UTFString.h"
 #include "TextLine.h"
+#include "TextFind.h"
+#include "TextUndo.h"
+#include "TextLoad.h"
+#include "TextSnapshot.h"
+#include "TextJournal.h"
+#include "TextDiff.h"
+#include "TextIndexCache.h"
+#include "TextWord.h"
+#include "TextGrapheme.h"
 #include <SDL2/SDL_ttf.h>
 #include <SDL2/SDL.h>
 #include "OS.h"
 
+//edits since the last save are kept next to the file
+#define TEXT_BOX_JOURNAL_SUFFIX ".journal"
+
+//line index of a viewed file is kept next to it
+#define TEXT_BOX_INDEX_CACHE_SUFFIX ".lineindex"
+
 
 typedef struct TextCursor {
     size_t line_number;
     size_t char_offset;
 
+    // byte offset of char_offset in the line
+    // kept alongside char_offset so we don't have to scan the line
+    // from the beginning every time we need it
+    size_t byte_offset;
+
     // This is for the special case when cursor has to be
     // at the end of the line wrapped character
     //
@@ -48,20 +68,85 @@ typedef struct Selection {
     size_t end_char;
 } Selection;
 
+// Text that was copied to the clipboard
+//
+// Copying doesn't build a string, it takes a snapshot of the document(see TextSnapshot.h)
+// and remembers where the selection starts and ends in it.
+// Lines that are edited after that are copied on write, so the copied text stays as it was
+// and it's read in pieces when someone pastes it.
+// Text is serialized only when someone reads it as a whole or the lines go away(another file is opened)
+typedef struct ClipboardSnapshot {
+    bool has_snapshot;
+
+    //NULL once the text is serialized
+    TextSnapshot* snapshot;
+    TextLine* start_line;
+    size_t start_byte;
+    TextLine* end_line;
+    size_t end_byte;
+
+    //snapshot might read removed lines so they are kept while it's alive,
+    //these count them so they don't pile up
+    TextLine* counted_removed_lines;
+    size_t removed_line_count;
+
+    //NULL until snapshot is serialized
+    UTFString* str;
+
+    //changes every time something new is copied
+    size_t generation;
+} ClipboardSnapshot;
+
+// Reads clipboard snapshot in pieces without building the whole string
+typedef struct ClipboardReader {
+    size_t generation;
+    //how many bytes are read
+    size_t position;
+
+    //these are only used while snapshot is not serialized
+    TextLine* line;
+    size_t line_byte;
+    //line ending is read after the line's text, it's part of this
+    size_t line_end_byte;
+} ClipboardReader;
+
 typedef void (*PreeditPosSetter)(int x, int y);
 
+// Row of the document at the top of the text box
+//
+// Rows are wrapped lines, and they are all as tall as the font.
+// Scrolling only walks rows from here, so it doesn't matter how far down the document it is
+typedef struct TextBoxScroll {
+    size_t line_number;
+    size_t wrapped_line;
+    //pixels of the row that are above the text box, less than the font height
+    int pixel_offset;
+} TextBoxScroll;
+
 typedef struct TextBox{
     int w;
     int h;
 
     TextLine* first_line;
+    //line that was looked up last, lookups walk from it when it's closer
+    //(NULL when it might not be in the text box anymore)
+    TextLine* line_hint;
+    //lines that lookups walked over, at least TEXT_BOX_LINE_JUMP_DISTANCE lines apart and in the order of the lines
+    //lookups walk from the closest one before the line, so a jump costs a binary search and a short walk
+    //(they are all before unnumbered_line)
+    TextLine** line_jumps;
+    size_t line_jump_count;
+    size_t line_jump_capacity;
+    //an edit doesn't renumber the rest of the document, lines after it are numbered when something walks to them
+    //lines before this one have the right line_number, NULL when every line does
+    TextLine* unnumbered_line;
 
     TextCursor cursor;
 
     TTF_Font* font;
     SDL_Surface* render_surface;
 
-    int offset_y;
+    TextBoxScroll scroll;
 
     Selection selection;
     bool is_selecting;
@@ -76,6 +161,92 @@ typedef struct TextBox{
 
     UTFString* composite_str;
 
+    ClipboardSnapshot clipboard;
+
+    //paste that comes in pieces is inserted a piece per frame, each piece right after the last one,
+    //and nothing else edits the document until its last piece is in
+    bool is_pasting;
+    //first piece went to the document and not to the find bar(or nowhere)
+    bool is_pasting_to_document;
+    //where the next piece goes
+    TextCursor paste_end;
+
+    //lines that were removed from the text box but not freed yet
+    //(linked with next pointer)
+    TextLine* removed_lines;
+
+    TextUndo undo;
+
+    //file the lines point to, NULL if nothing is opened
+    OS_FileMapping* mapping;
+    //lines of the file after the last line don't have TextLines until something reaches them
+    TextLineIndex line_index;
+    //NULL when file is done loading
+    TextLoad* load;
+
+    //every line of the document, including the ones without TextLines
+    size_t line_count;
+
+    //file that was opened, NULL if there is none
+    char* file_path;
+    //change_count when the document was the same as the file(it was opened, saved or reloaded)
+    size_t file_change_count;
+    //how the file was back then, it's reloaded when it changes while the document has no edits
+    OS_FileStamp file_stamp;
+    double last_reload_check_time;
+
+    //running reload diffs the snapshot with the mapped file, all three are NULL when it's not running
+    TextReloadJob* reload_job;
+    TextSnapshot* reload_snapshot;
+    OS_FileMapping* reload_mapping;
+    //how the file was when the reload started, and change_count back then
+    OS_FileStamp reload_stamp;
+    size_t reload_change_count;
+
+    //goes up every time a line changes
+    size_t change_count;
+    //change_count of the last autosave(or save)
+    size_t autosaved_change_count;
+    //change_count when the running autosave started
+    size_t autosave_change_count;
+    double last_autosave_time;
+
+    //running autosave writes the snapshot, both are NULL when it's not running
+    TextSnapshot* autosave_snapshot;
+    TextSnapshotJob* autosave_job;
+
+    //edits since the opened file was saved, NULL until the first edit,
+    //or if there is no file or it couldn't be written
+    TextJournal* journal;
+    //file the edits are made to, as it was when it was opened or saved
+    TextJournalBase journal_base;
+    //edits of the opened file are journaled
+    bool has_journal_base;
+    //journal is being replayed, lines are laid out when they are shown
+    bool is_replaying;
+
+    //reads what is written to the end of the opened file, NULL when it's not followed
+    OS_FileFollower* follower;
+    char* follow_buffer;
+    //bytes at the end of the buffer that wait for the next read
+    //(character or \r\n that was cut in half)
+    size_t follow_carry_size;
+
+    //find bar is open and typed text goes to the find query
+    bool is_finding;
+    TextFind find;
+
+    //go to line bar is open and typed digits go to the line number(0 when nothing is typed)
+    bool is_going_to_line;
+    size_t go_to_line_number;
+
+    //file is only viewed, nothing edits it
+    bool is_read_only;
+    //line index of the viewed file that was kept next to it, NULL if there wasn't one
+    TextIndexCache* index_cache;
+    //writes the index of the viewed file next to it once it's split, NULL when it's not running
+    TextIndexCacheJob* index_cache_job;
+
     PreeditPosSetter preedit_pos_setter;
 }TextBox;
 
@@ -89,9 +260,27 @@ TextBox* text_box_create(
 
 void text_box_destroy(TextBox* box);
 
+//replaces text with the file, returns false if the file couldn't be opened
+bool text_box_open_file(TextBox* box, const char* path);
+//opens the file only to look at it(scrolling, going to a line, finding and copying)
+//its line index is kept next to it, so opening it again doesn't split it again
+bool text_box_view_file(TextBox* box, const char* path);
+//writes every line with the line ending it has, returns false if the file couldn't be written
+//file is replaced only after the whole text is written
+bool text_box_save_file(TextBox* box, const char* path);
+
+//writes the document next to the opened file on a worker thread every now and then
+//typing goes on while it's written, returns true while it's running
+bool text_box_autosave_poll(TextBox* box);
+
+//every edit is put in a journal next to the opened file and written to the disk on a worker thread,
+//opening the file again replays it, returns true while some edits are not on the disk yet
+bool text_box_journal_poll(TextBox* box);
+
 void text_box_handle_event(TextBox* box, OS_Event* event);
 
 TextCursor text_box_type(TextBox* box, TextCursor cursor, UTFStringView sv);
+TextCursor text_box_insert_lines(TextBox* box, TextCursor cursor, UTFStringView sv);
 
 void text_box_render(TextBox* box);
 
@@ -99,6 +288,13 @@ TextCursor text_box_move_cursor_left(TextBox* box, TextCursor cursor);
 TextCursor text_box_move_cursor_right(TextBox* box, TextCursor cursor);
 TextCursor text_box_move_cursor_up(TextBox* box, TextCursor cursor);
 TextCursor text_box_move_cursor_down(TextBox* box, TextCursor cursor);
+//moves a text box height of rows and scrolls the view with the cursor
+TextCursor text_box_move_cursor_page_up(TextBox* box, TextCursor cursor);
+TextCursor text_box_move_cursor_page_down(TextBox* box, TextCursor cursor);
+TextCursor text_box_move_cursor_line_start(TextBox* box, TextCursor cursor);
+TextCursor text_box_move_cursor_line_end(TextBox* box, TextCursor cursor);
+TextCursor text_box_move_cursor_document_start(TextBox* box, TextCursor cursor);
+TextCursor text_box_move_cursor_document_end(TextBox* box, TextCursor cursor);
 
 TextCursor text_box_move_cursor_left_word(TextBox* box, TextCursor cursor);
 TextCursor text_box_move_cursor_right_word(TextBox* box, TextCursor cursor);
@@ -106,8 +302,66 @@ TextCursor text_box_move_cursor_right_word(TextBox* box, TextCursor cursor);
 TextCursor text_box_delete_a_character(TextBox* box, TextCursor cursor);
 TextCursor text_box_delete_range(TextBox* box, Selection selection);
 
+//returns false if there is nothing to undo(or redo)
+bool text_box_undo(TextBox* box);
+bool text_box_redo(TextBox* box);
+
 UTFString* text_box_get_selection_str(TextBox* box, Selection selection);
 
+void text_box_copy_selection(TextBox* box, Selection selection);
+size_t text_box_clipboard_size(TextBox* box);
+UTFStringView text_box_clipboard_sv(TextBox* box);
+ClipboardReader text_box_clipboard_reader(TextBox* box);
+size_t text_box_clipboard_read(TextBox* box, ClipboardReader* reader, char* buffer, size_t buffer_size);
+
 void text_box_resize(TextBox* box, int w, int h);
 
+bool text_box_free_removed_lines(TextBox* box, size_t max_lines);
+
+//appends what is written to the end of the opened file as new lines (tail -f)
+//returns false if there is no file or it can't be followed
+bool text_box_start_follow(TextBox* box);
+void text_box_stop_follow(TextBox* box);
+//reads what was added since the last poll, view follows it if the cursor is at the end
+//returns true if lines were added
+bool text_box_follow_poll(TextBox* box);
+
+//replaces only the lines that changed since the file was opened(or saved),
+//cursor, selection and view stay where they were and unchanged lines keep their layout
+//edits that were not saved are dropped, returns false if the file couldn't be read
+//file is diffed on a worker thread, text_box_load_poll replaces the lines once it's done
+bool text_box_reload_file(TextBox* box);
+//checks every now and then if someone else changed the opened file and reloads it
+//if the document has no edits, returns true if a reload was started
+bool text_box_reload_poll(TextBox* box);
+
+//moves lines of the loading file to the text box, and the lines of a finished reload
+//returns true if something changed
+bool text_box_load_poll(TextBox* box);
+
+void text_box_start_find(TextBox* box);
+void text_box_set_find_query(TextBox* box, UTFStringView query);
+void text_box_set_find_regex(TextBox* box, bool is_regex);
+//starts search if needed and shows matches found so far
+//returns true if matches changed
+bool text_box_find_poll(TextBox* box);
+void text_box_find_next(TextBox* box, bool backwards);
+
+//line_number starts from 0, lines past the last one go to the last one
+void text_box_go_to_line(TextBox* box, size_t line_number);
+
+//below are for the benchmarks(TextBoxBenchmark.c), the main loop doesn't need them
+
+//creates the line if it's in a span or not created yet
+TextLine* get_line_from_line_number(TextBox* box, size_t line_number);
+TextLine* get_next_line(TextBox* box, TextLine* line);
+void ensure_text_line_updated(TextBox* box, TextLine* line);
+TextCursor set_cursor_char_offset(TextLine* line, TextCursor cursor, size_t char_offset);
+Selection set_selection_to_cursor(TextCursor cursor);
+void scroll_to_cursor(TextBox* box);
+TextUndoPosition undo_position_from_cursor(TextCursor cursor);
+//inserts text without recording it
+TextCursor insert_text(TextBox* box, TextCursor cursor, UTFStringView sv);
+char* get_path_with_suffix(const char* path, const char* suffix);
+
 #endif
@@ -0,0 +1,544 @@
+#include "TextBoxBenchmark.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+//benchmarks leave nothing behind, the journal is there if the benchmark edited the file
+static void benchmark_remove_file(TextBox* box, const char* path)
+{
+    if (box->journal) {
+        text_journal_destroy(box->journal);
+        box->journal = NULL;
+    }
+    char* journal_path = get_path_with_suffix(path, TEXT_BOX_JOURNAL_SUFFIX);
+    remove(journal_path);
+    free(journal_path);
+
+    remove(path);
+}
+
+//same as text_box_type without scrolling to the cursor
+static TextCursor journal_benchmark_type(TextBox* box, TextCursor cursor, UTFStringView sv)
+{
+    TextCursor new_cursor_pos = insert_text(box, cursor, sv);
+    text_undo_record_insert(&box->undo, undo_position_from_cursor(cursor), undo_position_from_cursor(new_cursor_pos), sv);
+    return new_cursor_pos;
+}
+
+//Journals a million edits of a typing session, then opens the file again and times the replay
+void text_box_journal_benchmark(TextBox* box)
+{
+    const size_t line_count = 10000;
+    const size_t edit_count = 1000 * 1000;
+    char path[1024];
+    char expected_path[1024];
+    char replayed_path[1024];
+    if (!os_create_temp_file("text_box_journal_benchmark", path, sizeof(path))) {
+        return;
+    }
+    if (!os_create_temp_file("text_box_journal_benchmark_expected", expected_path, sizeof(expected_path))) {
+        remove(path);
+        return;
+    }
+    if (!os_create_temp_file("text_box_journal_benchmark_replayed", replayed_path, sizeof(replayed_path))) {
+        remove(path);
+        remove(expected_path);
+        return;
+    }
+
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "%s:%d:ERROR : Failed to create %s\n", __FILE__, __LINE__, path);
+        remove(path);
+        remove(expected_path);
+        remove(replayed_path);
+        return;
+    }
+    for (size_t i = 0; i < line_count; i++) {
+        fprintf(file, i % 4 ? "line %zu of the file that is being edited\n" : "line %zu of the file that is being edited\r\n", i);
+    }
+    fclose(file);
+
+    if (!text_box_open_file(box, path)) {
+        remove(path);
+        remove(expected_path);
+        remove(replayed_path);
+        return;
+    }
+
+    //only the journal matters here, so lines are not laid out while typing
+    box->is_replaying = true;
+
+    //typing goes on around one place and jumps somewhere else every now and then
+    uint32_t random = 12345;
+    TextCursor cursor = box->cursor;
+    double start = os_get_time();
+    for (size_t i = 0; i < edit_count; i++) {
+        random = random * 1103515245u + 12345u;
+        uint32_t roll = (random >> 8) % 1000;
+
+        if (i % 500 == 0) {
+            cursor.line_number = (random >> 4) % box->line_count;
+            TextLine* line = get_line_from_line_number(box, cursor.line_number);
+            cursor = set_cursor_char_offset(line, cursor, text_line_sv(line).count / 2);
+        }
+
+        if (roll < 100) {
+            cursor = text_box_delete_a_character(box, cursor);
+        }
+        else if (roll < 110) {
+            cursor = journal_benchmark_type(box, cursor, utf_sv_from_cstr("\r\n"));
+        }
+        else if (roll < 112 && cursor.line_number + 3 < box->line_count) {
+            Selection selection = {
+                .start_line_number = cursor.line_number, .start_char = 0,
+                .end_line_number = cursor.line_number + 2, .end_char = 0
+            };
+            cursor = text_box_delete_range(box, selection);
+        }
+        else if (roll < 114) {
+            text_box_undo(box);
+            cursor = box->cursor;
+        }
+        else {
+            cursor = journal_benchmark_type(box, cursor, utf_sv_from_cstr(roll % 2 ? "a" : u8"가"));
+        }
+
+        text_box_journal_poll(box);
+    }
+    double edit_time = os_get_time() - start;
+    box->is_replaying = false;
+
+    text_box_save_file(box, expected_path);
+
+    //journal is left behind like after a crash, so opening the file again replays it
+    if (box->journal) {
+        text_journal_destroy(box->journal);
+        box->journal = NULL;
+    }
+
+    start = os_get_time();
+    text_box_open_file(box, path);
+    double replay_time = os_get_time() - start;
+
+    text_box_save_file(box, replayed_path);
+
+    OS_FileMapping* expected = os_map_file(expected_path);
+    OS_FileMapping* replayed = os_map_file(replayed_path);
+    bool matches = expected && replayed &&
+        os_file_mapping_size(expected) == os_file_mapping_size(replayed) &&
+        memcmp(os_file_mapping_data(expected), os_file_mapping_data(replayed), os_file_mapping_size(expected)) == 0;
+    if (expected) {
+        os_unmap_file(expected);
+    }
+    if (replayed) {
+        os_unmap_file(replayed);
+    }
+
+    printf("journal benchmark, %zu lines, %zu edits\n", line_count, edit_count);
+    printf("editing with the journal : %.3f s\n", edit_time);
+    printf("opening and replaying    : %.3f s, %s\n", replay_time, matches ? "same text as before" : "TEXT DIFFERS");
+
+    benchmark_remove_file(box, path);
+    remove(expected_path);
+    remove(replayed_path);
+}
+
+typedef struct FollowBenchmarkWriter {
+    const char* path;
+    size_t lines_per_second;
+    double seconds;
+} FollowBenchmarkWriter;
+
+//appends log lines at a steady rate, a millisecond worth of them at a time
+static void follow_benchmark_writer(void* data)
+{
+    FollowBenchmarkWriter* writer = data;
+    FILE* file = fopen(writer->path, "ab");
+    if (!file) {
+        return;
+    }
+
+    size_t lines_per_burst = writer->lines_per_second / 1000;
+    size_t line_number = 0;
+    double start = os_get_time();
+    for (size_t burst = 0; burst < (size_t)(writer->seconds * 1000); burst++) {
+        double wait = start + burst / 1000.0 - os_get_time();
+        if (wait > 0) {
+            os_sleep(wait);
+        }
+        for (size_t i = 0; i < lines_per_burst; i++) {
+            fprintf(file, "2026-10-19 12:00:00.%06zu INFO request %zu handled in %zu ms\n", line_number % 1000000, line_number, line_number % 997);
+            line_number++;
+        }
+        fflush(file);
+    }
+    fclose(file);
+}
+
+//Follows a file that gets 100k lines a second and measures how much of a core it takes
+void text_box_follow_benchmark(TextBox* box)
+{
+    char path[1024];
+    if (!os_create_temp_file("text_box_follow_benchmark", path, sizeof(path))) {
+        return;
+    }
+    FollowBenchmarkWriter writer = {.path = path, .lines_per_second = 100000, .seconds = 5.0};
+
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "%s:%d:ERROR : Failed to create %s\n", __FILE__, __LINE__, path);
+        remove(path);
+        return;
+    }
+    fputs("first line\n", file);
+    fclose(file);
+
+    if (!text_box_open_file(box, path) || !text_box_start_follow(box)) {
+        benchmark_remove_file(box, path);
+        return;
+    }
+    size_t first_line_count = box->line_count;
+
+    OS_Thread* thread = os_thread_create(follow_benchmark_writer, &writer);
+    if (!thread) {
+        text_box_stop_follow(box);
+        benchmark_remove_file(box, path);
+        return;
+    }
+
+    size_t expected_line_count = first_line_count + writer.lines_per_second * (size_t)(writer.seconds * 1000) / 1000;
+
+    //same as the main loop, but rendering is kept to 60 frames a second
+    double start = os_get_time();
+    double busy_time = 0;
+    double max_poll_time = 0;
+    double last_render_time = 0;
+    while (box->line_count < expected_line_count && os_get_time() - start < writer.seconds * 4) {
+        double poll_start = os_get_time();
+        bool appended = text_box_follow_poll(box);
+        double poll_end = os_get_time();
+        if (appended) {
+            busy_time += poll_end - poll_start;
+            if (poll_end - poll_start > max_poll_time) {
+                max_poll_time = poll_end - poll_start;
+            }
+        }
+
+        if (box->need_to_render && poll_end - last_render_time > 1.0 / 60) {
+            text_box_render(box);
+            last_render_time = os_get_time();
+            busy_time += last_render_time - poll_end;
+        }
+    }
+    double total_time = os_get_time() - start;
+
+    os_thread_join(thread);
+
+    printf("follow benchmark, %zu lines a second for %.0f s\n", writer.lines_per_second, writer.seconds);
+    printf("followed %zu of %zu lines in %.3f s, cursor %s at the end\n",
+        box->line_count - first_line_count, expected_line_count - first_line_count, total_time,
+        box->cursor.line_number == box->line_count - 1 ? "stayed" : "is not");
+    printf("busy %.1f%% of the time, slowest poll %.3f ms\n", busy_time / total_time * 100, max_poll_time * 1000);
+
+    text_box_stop_follow(box);
+    benchmark_remove_file(box, path);
+}
+
+//hashes of every line of the document, with or without a TextLine
+static void hash_document_lines(TextBox* box, uint64_t* hashes)
+{
+    size_t i = 0;
+    TextLineIndex* index = &box->line_index;
+    for (TextLine* line = box->first_line; line != NULL; line = line->next) {
+        if (line->span_count > 0) {
+            size_t first_line = text_line_index_line_at(index, line->mapped_data);
+            text_load_hash_lines(index, first_line, first_line + line->span_count, hashes + i);
+            i += line->span_count;
+            continue;
+        }
+        hashes[i++] = text_diff_hash_line(text_line_data(line), text_line_data_size(line), line->ends_with_lf, line->ends_with_crlf);
+    }
+
+    text_load_hash_lines(index, index->next_line, index->line_count, hashes + i);
+    i += index->line_count - index->next_line;
+    assert(i == box->line_count);
+}
+
+//every changed_every lines one of them is changed and a line is added after it, 0 changes nothing
+//file is replaced the way editors save, the mapping of the old one stays as it was
+static bool reload_benchmark_write(const char* path, size_t line_count, size_t changed_every)
+{
+    OS_FileWriter* writer = os_file_writer_create(path);
+    if (!writer) {
+        return false;
+    }
+
+    char buffer[64 * 1024];
+    size_t size = 0;
+    for (size_t i = 0; i < line_count; i++) {
+        if (changed_every > 0 && i % changed_every == changed_every / 2) {
+            size += snprintf(buffer + size, sizeof(buffer) - size, "line %zu was changed\nand a line was added after it\n", i);
+        }
+        else {
+            size += snprintf(buffer + size, sizeof(buffer) - size, "line %zu of the reload benchmark, with some more text after it\n", i);
+        }
+
+        if (size > sizeof(buffer) - 256 || i == line_count - 1) {
+            OS_WriteBuffer write_buffer = {.data = buffer, .size = size};
+            if (!os_file_writer_write(writer, &write_buffer, 1)) {
+                os_file_writer_abort(writer);
+                return false;
+            }
+            size = 0;
+        }
+    }
+    return os_file_writer_commit(writer);
+}
+
+//creates every line on the way
+static void reload_benchmark_lay_out(TextBox* box)
+{
+    for (TextLine* line = box->first_line; line != NULL; line = get_next_line(box, line)) {
+        ensure_text_line_updated(box, line);
+    }
+}
+
+static size_t reload_benchmark_laid_out_count(TextBox* box)
+{
+    size_t count = 0;
+    for (TextLine* line = box->first_line; line != NULL; line = line->next) {
+        count += !line->needs_update;
+    }
+    return count;
+}
+
+//Reloads a laid out file of a million lines after a hundred places in it changed,
+//and compares it to opening the file again
+void text_box_reload_benchmark(TextBox* box)
+{
+    char path[1024];
+    if (!os_create_temp_file("text_box_reload_benchmark", path, sizeof(path))) {
+        return;
+    }
+    size_t line_count = 1000000;
+    size_t changed_every = 10000;
+    size_t cursor_line = 900000;
+
+    if (!reload_benchmark_write(path, line_count, 0) || !text_box_open_file(box, path)) {
+        benchmark_remove_file(box, path);
+        return;
+    }
+
+    //every line is laid out, as if the whole file was scrolled through
+    while (box->load) {
+        text_box_load_poll(box);
+    }
+    reload_benchmark_lay_out(box);
+
+    box->cursor.line_number = cursor_line;
+    box->cursor = set_cursor_char_offset(get_line_from_line_number(box, cursor_line), box->cursor, 3);
+    box->selection = set_selection_to_cursor(box->cursor);
+    scroll_to_cursor(box);
+    text_box_render(box);
+    size_t laid_out_count = reload_benchmark_laid_out_count(box);
+
+    if (!reload_benchmark_write(path, line_count, changed_every)) {
+        benchmark_remove_file(box, path);
+        return;
+    }
+
+    //main thread only starts the reload and applies the diff, the rest is on the worker
+    double start = os_get_time();
+    bool reloaded = text_box_reload_file(box);
+    double main_thread_time = os_get_time() - start;
+    if (!reloaded) {
+        benchmark_remove_file(box, path);
+        return;
+    }
+    //polled once a frame, like the main loop does
+    while (box->reload_job) {
+        os_sleep(0.016);
+        double poll_start = os_get_time();
+        text_box_load_poll(box);
+        main_thread_time += os_get_time() - poll_start;
+    }
+    double reload_time = os_get_time() - start;
+
+    size_t kept_count = reload_benchmark_laid_out_count(box);
+
+    //document has to be the same as the file
+    uint64_t* document_hashes = malloc(box->line_count * sizeof(uint64_t));
+    uint64_t* file_hashes = malloc(box->line_index.line_count * sizeof(uint64_t));
+    hash_document_lines(box, document_hashes);
+    text_load_hash_lines(&box->line_index, 0, box->line_index.line_count, file_hashes);
+    bool is_same = box->line_count == box->line_index.line_count &&
+        memcmp(document_hashes, file_hashes, box->line_count * sizeof(uint64_t)) == 0;
+    free(document_hashes);
+    free(file_hashes);
+
+    size_t expected_cursor_line = cursor_line + (cursor_line + changed_every / 2) / changed_every;
+    bool cursor_stayed = box->cursor.line_number == expected_cursor_line && box->cursor.char_offset == 3;
+
+    text_box_render(box);
+
+    //same file opened again has to lay everything out again
+    start = os_get_time();
+    text_box_open_file(box, path);
+    while (box->load) {
+        text_box_load_poll(box);
+    }
+    reload_benchmark_lay_out(box);
+    double reopen_time = os_get_time() - start;
+
+    printf("reload benchmark, %zu lines with %zu places changed\n", line_count, line_count / changed_every);
+    printf("reloading            : %.3f s, %s, cursor %s\n", reload_time, is_same ? "text matches" : "TEXT DIFFERS", cursor_stayed ? "stayed on its line" : "MOVED");
+    printf("on the main thread   : %.3f s\n", main_thread_time);
+    printf("layouts kept         : %zu of %zu\n", kept_count, laid_out_count);
+    printf("opening and laying out again : %.3f s\n", reopen_time);
+
+    benchmark_remove_file(box, path);
+}
+
+//Views a file of two million lines twice, the first time it's split into lines
+//and its cache is written, the second time the cache is used
+void text_box_view_benchmark(TextBox* box)
+{
+    char path[1024];
+    if (!os_create_temp_file("text_box_view_benchmark", path, sizeof(path))) {
+        return;
+    }
+    size_t line_count = 2000000;
+
+    char* cache_path = get_path_with_suffix(path, TEXT_BOX_INDEX_CACHE_SUFFIX);
+
+    if (!reload_benchmark_write(path, line_count, 0)) {
+        free(cache_path);
+        remove(path);
+        return;
+    }
+
+    double start = os_get_time();
+    if (!text_box_view_file(box, path)) {
+        free(cache_path);
+        remove(path);
+        return;
+    }
+    double first_open_time = os_get_time() - start;
+    while (box->load) {
+        text_box_load_poll(box);
+    }
+    double first_load_time = os_get_time() - start;
+    while (box->index_cache_job) {
+        text_box_load_poll(box);
+        os_sleep(0.001);
+    }
+    double cache_time = os_get_time() - start;
+
+    start = os_get_time();
+    bool viewed = text_box_view_file(box, path);
+    double second_open_time = os_get_time() - start;
+    bool used_cache = viewed && box->index_cache && !box->load;
+
+    start = os_get_time();
+    text_box_go_to_line(box, box->line_count - 1);
+    text_box_render(box);
+    double go_to_time = os_get_time() - start;
+
+    printf("view benchmark, %zu lines\n", line_count);
+    printf("first view, opened   : %.3f s, split into lines %.3f s, cache written %.3f s\n", first_open_time, first_load_time, cache_time);
+    printf("second view, opened  : %.3f s, %s\n", second_open_time, used_cache ? "from the cache" : "CACHE NOT USED");
+    printf("going to the last line : %.3f s\n", go_to_time);
+
+    remove(path);
+    remove(cache_path);
+    free(cache_path);
+}
+
+static double navigation_benchmark_jumps(TextBox* box, size_t jump_count, bool keeps_jumps)
+{
+    srand(1234);
+    double start = os_get_time();
+    for (size_t i = 0; i < jump_count; i++) {
+        //without kept jumps a lookup walks from the first line or the last line it looked up
+        if (!keeps_jumps) {
+            box->line_jump_count = 0;
+        }
+        size_t line_number = ((size_t)rand() * ((size_t)RAND_MAX + 1) + (size_t)rand()) % box->line_count;
+        text_box_go_to_line(box, line_number);
+    }
+    return os_get_time() - start;
+}
+
+static size_t navigation_benchmark_created_count(TextBox* box)
+{
+    size_t count = 0;
+    for (TextLine* line = box->first_line; line != NULL; line = line->next) {
+        count += line->span_count == 0;
+    }
+    return count;
+}
+
+//Opens the file and jumps to a line of it right away
+static bool navigation_benchmark_cold_jump(TextBox* box, const char* path, size_t line_number, double* time, size_t* created_count)
+{
+    if (!text_box_open_file(box, path)) {
+        return false;
+    }
+    while (box->load) {
+        text_box_load_poll(box);
+    }
+
+    double start = os_get_time();
+    text_box_go_to_line(box, line_number);
+    *time = os_get_time() - start;
+    *created_count = navigation_benchmark_created_count(box);
+    return true;
+}
+
+//Jumps to random lines of a file of a million lines, with and without the kept jumps,
+//and pages through a part of it
+//
+//Cold jumps are the first ones after the file is opened, only lines around them are created
+void text_box_navigation_benchmark(TextBox* box)
+{
+    char path[1024];
+    if (!os_create_temp_file("text_box_navigation_benchmark", path, sizeof(path))) {
+        return;
+    }
+    size_t line_count = 1000000;
+    size_t jump_count = 10000;
+    size_t page_count = 10000;
+
+    double middle_time = 0;
+    double end_time = 0;
+    size_t middle_created_count = 0;
+    size_t end_created_count = 0;
+    if (!reload_benchmark_write(path, line_count, 0) ||
+        !navigation_benchmark_cold_jump(box, path, line_count / 2 + 1234, &middle_time, &middle_created_count) ||
+        !navigation_benchmark_cold_jump(box, path, line_count - 1, &end_time, &end_created_count)) {
+        benchmark_remove_file(box, path);
+        return;
+    }
+
+    double walk_time = navigation_benchmark_jumps(box, jump_count / 100, false);
+    double jump_time = navigation_benchmark_jumps(box, jump_count, true);
+
+    text_box_go_to_line(box, 0);
+    double start = os_get_time();
+    for (size_t i = 0; i < page_count; i++) {
+        box->cursor = text_box_move_cursor_page_down(box, box->cursor);
+    }
+    double page_time = os_get_time() - start;
+
+    printf("navigation benchmark, %zu lines\n", line_count);
+    printf("cold jump to the middle : %.3f ms, %zu lines created\n", middle_time * 1000, middle_created_count);
+    printf("cold jump to the end    : %.3f ms, %zu lines created\n", end_time * 1000, end_created_count);
+    printf("jump walking from the first line or the last one : %.3f ms\n", walk_time / (jump_count / 100) * 1000);
+    printf("jump from the closest kept line               : %.3f ms\n", jump_time / jump_count * 1000);
+    printf("page down : %.3f ms, cursor on line %zu\n", page_time / page_count * 1000, box->cursor.line_number);
+
+    benchmark_remove_file(box, path);
+}
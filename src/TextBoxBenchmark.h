@@ -0,0 +1,14 @@
+#ifndef TextBoxBenchmark_HEADER_GUARD
+#define TextBoxBenchmark_HEADER_GUARD
+
+#include "TextBox.h"
+
+// Benchmarks of the text box that run with a file they write next to the executable
+// and remove when they are done, each prints what it measured
+void text_box_journal_benchmark(TextBox* box);
+void text_box_follow_benchmark(TextBox* box);
+void text_box_reload_benchmark(TextBox* box);
+void text_box_view_benchmark(TextBox* box);
+void text_box_navigation_benchmark(TextBox* box);
+
+#endif
@@ -0,0 +1,356 @@
+#include "TextDiff.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+//FNV-1a
+#define DIFF_HASH_OFFSET 0xcbf29ce484222325ULL
+#define DIFF_HASH_PRIME 0x100000001b3ULL
+
+uint64_t text_diff_hash_line(const char* data, size_t size, bool ends_with_lf, bool ends_with_crlf)
+{
+    uint64_t hash = DIFF_HASH_OFFSET;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= DIFF_HASH_PRIME;
+    }
+
+    //line ending goes in as one more byte that text of a line can't have
+    hash ^= ends_with_crlf ? '\r' : ends_with_lf ? '\n' : 0;
+    hash *= DIFF_HASH_PRIME;
+    return hash;
+}
+
+static bool diff_push_hunk(TextDiff* diff, size_t old_start, size_t old_count, size_t new_start, size_t new_count)
+{
+    if (old_count == 0 && new_count == 0) {
+        return true;
+    }
+
+    if (diff->hunk_count == diff->hunk_capacity) {
+        size_t new_capacity = diff->hunk_capacity ? diff->hunk_capacity * 2 : 16;
+        TextDiffHunk* new_hunks = realloc(diff->hunks, new_capacity * sizeof(TextDiffHunk));
+        if (!new_hunks) {
+            return false;
+        }
+        diff->hunks = new_hunks;
+        diff->hunk_capacity = new_capacity;
+    }
+
+    TextDiffHunk hunk = {
+        .old_start = old_start, .old_count = old_count,
+        .new_start = new_start, .new_count = new_count,
+    };
+    diff->hunks[diff->hunk_count++] = hunk;
+    return true;
+}
+
+// Furthest x each diagonal k(= x - y) reached with d edits, for every d so far
+//
+// Row d has diagonals -d to d, and it starts after rows 0 to d - 1,
+// which is d * d values
+typedef struct DiffTrace {
+    ptrdiff_t* values;
+    size_t capacity;
+} DiffTrace;
+
+static ptrdiff_t* diff_trace_row(DiffTrace* trace, ptrdiff_t d)
+{
+    return trace->values + d * d + d;
+}
+
+static bool diff_trace_reserve(DiffTrace* trace, ptrdiff_t d)
+{
+    size_t needed = (size_t)(d + 1) * (size_t)(d + 1);
+    if (needed <= trace->capacity) {
+        return true;
+    }
+
+    size_t new_capacity = trace->capacity ? trace->capacity * 2 : 1024;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+    ptrdiff_t* new_values = realloc(trace->values, new_capacity * sizeof(ptrdiff_t));
+    if (!new_values) {
+        return false;
+    }
+    trace->values = new_values;
+    trace->capacity = new_capacity;
+    return true;
+}
+
+//finds the fewest edits that turn a into b and pushes them as hunks
+//returns false if it couldn't allocate or it takes more than max_edits
+static bool diff_myers(
+    TextDiff* diff,
+    const uint64_t* a, ptrdiff_t n,
+    const uint64_t* b, ptrdiff_t m,
+    size_t offset, ptrdiff_t max_edits
+)
+{
+    DiffTrace trace = {0};
+
+    //going forward, every diagonal goes as far as it can
+    ptrdiff_t edit_count = -1;
+    for (ptrdiff_t d = 0; d <= max_edits && edit_count < 0; d++) {
+        if (!diff_trace_reserve(&trace, d)) {
+            free(trace.values);
+            return false;
+        }
+        ptrdiff_t* prev = d > 0 ? diff_trace_row(&trace, d - 1) : NULL;
+        ptrdiff_t* row = diff_trace_row(&trace, d);
+
+        for (ptrdiff_t k = -d; k <= d; k += 2) {
+            ptrdiff_t x = 0;
+            if (d == 0) {
+                x = 0;
+            }
+            else if (k == -d || (k != d && prev[k - 1] < prev[k + 1])) {
+                //down, line of b is added
+                x = prev[k + 1];
+            }
+            else {
+                //right, line of a is removed
+                x = prev[k - 1] + 1;
+            }
+            ptrdiff_t y = x - k;
+
+            while (x < n && y < m && a[x] == b[y]) {
+                x++;
+                y++;
+            }
+            row[k] = x;
+
+            if (x >= n && y >= m) {
+                edit_count = d;
+                break;
+            }
+        }
+    }
+
+    if (edit_count < 0) {
+        free(trace.values);
+        return false;
+    }
+
+    //going back from the end, runs of edits between matching lines are hunks
+    //they come out last one first
+    size_t first_hunk = diff->hunk_count;
+
+    ptrdiff_t x = n;
+    ptrdiff_t y = m;
+    bool in_hunk = false;
+    ptrdiff_t hunk_end_x = 0;
+    ptrdiff_t hunk_end_y = 0;
+
+    for (ptrdiff_t d = edit_count; d >= 0; d--) {
+        ptrdiff_t k = x - y;
+
+        ptrdiff_t start_x = 0;
+        bool is_down = false;
+        if (d > 0) {
+            ptrdiff_t* prev = diff_trace_row(&trace, d - 1);
+            is_down = k == -d || (k != d && prev[k - 1] < prev[k + 1]);
+            start_x = is_down ? prev[k + 1] : prev[k - 1] + 1;
+        }
+
+        //lines that match after the edit
+        while (x > start_x) {
+            if (in_hunk && !diff_push_hunk(diff, offset + x, hunk_end_x - x, offset + y, hunk_end_y - y)) {
+                free(trace.values);
+                return false;
+            }
+            in_hunk = false;
+            x--;
+            y--;
+        }
+
+        if (d == 0) {
+            break;
+        }
+
+        if (!in_hunk) {
+            in_hunk = true;
+            hunk_end_x = x;
+            hunk_end_y = y;
+        }
+        if (is_down) {
+            y--;
+        }
+        else {
+            x--;
+        }
+    }
+    if (in_hunk && !diff_push_hunk(diff, offset + x, hunk_end_x - x, offset + y, hunk_end_y - y)) {
+        free(trace.values);
+        return false;
+    }
+
+    free(trace.values);
+
+    size_t pushed_count = diff->hunk_count - first_hunk;
+    for (size_t i = 0; i < pushed_count / 2; i++) {
+        TextDiffHunk* first = &diff->hunks[first_hunk + i];
+        TextDiffHunk* last = &diff->hunks[diff->hunk_count - 1 - i];
+        TextDiffHunk tmp = *first;
+        *first = *last;
+        *last = tmp;
+    }
+    return true;
+}
+
+bool text_diff_lines(
+    TextDiff* diff,
+    const uint64_t* old_hashes, size_t old_count,
+    const uint64_t* new_hashes, size_t new_count
+)
+{
+    memset(diff, 0, sizeof(TextDiff));
+
+    size_t prefix = 0;
+    while (prefix < old_count && prefix < new_count && old_hashes[prefix] == new_hashes[prefix]) {
+        prefix++;
+    }
+    size_t suffix = 0;
+    while (
+        suffix < old_count - prefix && suffix < new_count - prefix &&
+        old_hashes[old_count - 1 - suffix] == new_hashes[new_count - 1 - suffix]
+    ) {
+        suffix++;
+    }
+
+    size_t n = old_count - prefix - suffix;
+    size_t m = new_count - prefix - suffix;
+    if (n == 0 || m == 0) {
+        if (!diff_push_hunk(diff, prefix, n, prefix, m)) {
+            text_diff_destroy(diff);
+            return false;
+        }
+        return true;
+    }
+
+    ptrdiff_t max_edits = n + m < TEXT_DIFF_MAX_EDITS ? (ptrdiff_t)(n + m) : TEXT_DIFF_MAX_EDITS;
+    if (diff_myers(diff, old_hashes + prefix, n, new_hashes + prefix, m, prefix, max_edits)) {
+        return true;
+    }
+
+    //too many changes(or no memory for them), lines between are replaced as a whole
+    diff->hunk_count = 0;
+    if (!diff_push_hunk(diff, prefix, n, prefix, m)) {
+        text_diff_destroy(diff);
+        return false;
+    }
+    return true;
+}
+
+void text_diff_destroy(TextDiff* diff)
+{
+    free(diff->hunks);
+    memset(diff, 0, sizeof(TextDiff));
+}
+
+//applies the diff to a and checks that it's b and that hunks are in order
+static void diff_test_check(const uint64_t* a, size_t a_count, const uint64_t* b, size_t b_count, size_t max_hunk_count)
+{
+    TextDiff diff;
+    assert(text_diff_lines(&diff, a, a_count, b, b_count));
+    assert(diff.hunk_count <= max_hunk_count);
+
+    uint64_t* result = malloc((b_count + 1) * sizeof(uint64_t));
+    size_t result_count = 0;
+    size_t old_line = 0;
+    for (size_t i = 0; i < diff.hunk_count; i++) {
+        TextDiffHunk hunk = diff.hunks[i];
+        assert(hunk.old_start >= old_line);
+        assert(hunk.old_count > 0 || hunk.new_count > 0);
+        while (old_line < hunk.old_start) {
+            result[result_count++] = a[old_line++];
+        }
+        //lines that were kept end up where the hunk says
+        assert(result_count == hunk.new_start);
+        for (size_t j = 0; j < hunk.new_count; j++) {
+            result[result_count++] = b[hunk.new_start + j];
+        }
+        old_line += hunk.old_count;
+    }
+    while (old_line < a_count) {
+        result[result_count++] = a[old_line++];
+    }
+
+    assert(result_count == b_count);
+    assert(b_count == 0 || memcmp(result, b, b_count * sizeof(uint64_t)) == 0);
+
+    free(result);
+    text_diff_destroy(&diff);
+}
+
+void text_diff_test()
+{
+    {
+        const char* line = "hello";
+        assert(text_diff_hash_line(line, 5, false, false) != text_diff_hash_line(line, 5, true, false));
+        assert(text_diff_hash_line(line, 5, true, false) != text_diff_hash_line(line, 5, false, true));
+        assert(text_diff_hash_line(line, 5, true, false) == text_diff_hash_line("hello", 5, true, false));
+    }
+    {
+        uint64_t a[] = {1, 2, 3, 4, 5};
+        uint64_t same[] = {1, 2, 3, 4, 5};
+        uint64_t changed[] = {1, 2, 9, 4, 5};
+        uint64_t added[] = {1, 2, 3, 7, 8, 4, 5};
+        uint64_t removed[] = {1, 4, 5};
+        uint64_t two_places[] = {0, 1, 2, 3, 4, 6};
+
+        diff_test_check(a, 5, same, 5, 0);
+        diff_test_check(a, 5, changed, 5, 1);
+        diff_test_check(a, 5, added, 7, 1);
+        diff_test_check(a, 5, removed, 3, 1);
+        diff_test_check(a, 5, two_places, 6, 2);
+        diff_test_check(a, 5, NULL, 0, 1);
+        diff_test_check(NULL, 0, a, 5, 1);
+
+        TextDiff diff;
+        assert(text_diff_lines(&diff, a, 5, changed, 5));
+        assert(diff.hunk_count == 1);
+        assert(diff.hunks[0].old_start == 2 && diff.hunks[0].old_count == 1);
+        assert(diff.hunks[0].new_start == 2 && diff.hunks[0].new_count == 1);
+        text_diff_destroy(&diff);
+    }
+    {
+        //random edits on a few different lines, so lines repeat a lot
+        srand(1234);
+        uint64_t a[200];
+        uint64_t b[260];
+        for (int round = 0; round < 200; round++) {
+            size_t a_count = rand() % 200;
+            for (size_t i = 0; i < a_count; i++) {
+                a[i] = rand() % 8;
+            }
+            size_t b_count = 0;
+            for (size_t i = 0; i < a_count && b_count < 250; i++) {
+                int edit = rand() % 10;
+                if (edit == 0) {
+                    continue;
+                }
+                if (edit == 1) {
+                    b[b_count++] = rand() % 8;
+                }
+                b[b_count++] = edit == 2 ? (uint64_t)(rand() % 8) : a[i];
+            }
+            diff_test_check(a, a_count, b, b_count, b_count + a_count + 1);
+        }
+    }
+    {
+        //more changes than Myers is let to find still gives a correct diff
+        size_t count = TEXT_DIFF_MAX_EDITS * 2;
+        uint64_t* a = malloc(count * sizeof(uint64_t));
+        uint64_t* b = malloc(count * sizeof(uint64_t));
+        for (size_t i = 0; i < count; i++) {
+            a[i] = i;
+            b[i] = i % 2 == 0 ? i : i + count;
+        }
+        diff_test_check(a, count, b, count, 1);
+        free(a);
+        free(b);
+    }
+}
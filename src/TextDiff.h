@@ -0,0 +1,47 @@
+#ifndef TextDiff_HEADER_GUARD
+#define TextDiff_HEADER_GUARD
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Old lines that were replaced by new lines
+//
+// Either count can be 0, so a hunk can only remove or only add lines
+typedef struct TextDiffHunk {
+    size_t old_start;
+    size_t old_count;
+
+    size_t new_start;
+    size_t new_count;
+} TextDiffHunk;
+
+// What changed between two versions of a document, in the order of the lines
+//
+// Lines are compared by their hashes. Lines that are the same at the start
+// and at the end are skipped first (an edit usually touches a small part of a file),
+// and the lines between are diffed with Myers' algorithm.
+// Myers takes time and memory that grow with the number of changes,
+// so past TEXT_DIFF_MAX_EDITS the lines between are one big hunk instead
+typedef struct TextDiff {
+    TextDiffHunk* hunks;
+    size_t hunk_count;
+    size_t hunk_capacity;
+} TextDiff;
+
+#define TEXT_DIFF_MAX_EDITS 1024
+
+//hash of the line with its line ending, so a line that only changed its ending is different
+uint64_t text_diff_hash_line(const char* data, size_t size, bool ends_with_lf, bool ends_with_crlf);
+
+//returns false if it couldn't allocate, diff is empty then
+bool text_diff_lines(
+    TextDiff* diff,
+    const uint64_t* old_hashes, size_t old_count,
+    const uint64_t* new_hashes, size_t new_count
+);
+void text_diff_destroy(TextDiff* diff);
+
+void text_diff_test();
+
+#endif
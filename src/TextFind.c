@@ -0,0 +1,861 @@
+#include "TextFind.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <stdatomic.h>
+
+//stop searching after this many matches
+//nobody is going to look at them all anyway
+#define FIND_MAX_MATCHES (1024 * 1024)
+
+#define FIND_DEFAULT_MATCH_CAPACITY 64
+
+#ifndef FIND_MAX_THREADS
+#define FIND_MAX_THREADS 16
+#endif
+
+//how many lines a worker takes at a time
+//chunk is split by line count, not by size, so that taking a chunk
+//only has to follow next pointers while holding the lock
+#define FIND_CHUNK_LINES 4096
+
+typedef struct FindChunk {
+    //lines are counted as they are handed out, line_number of a TextLine might be out of date
+    size_t first_line_number;
+    size_t line_count;
+    //lines are read from the index instead of the snapshot
+    bool is_from_index;
+    size_t first_index_line;
+    //where search goes on after the chunk
+    FindPosition end;
+
+    FindMatch* matches;
+    size_t match_count;
+    size_t match_capacity;
+
+    bool is_truncated;
+    bool is_done;
+} FindChunk;
+
+struct FindJob {
+    OS_Mutex* mutex;
+
+    OS_Thread* threads[FIND_MAX_THREADS];
+    size_t thread_count;
+
+    //lines as they were when the search started, document can change while workers read it
+    TextSnapshot* snapshot;
+
+    //workers only read their own copy of the query
+    UTFString* query;
+
+    //NULL if query is not a regex, job keeps a reference to it
+    Regex* regex;
+
+    //workers check it before every line
+    atomic_bool is_cancelled;
+
+    //below are guarded by the mutex
+    //workers that haven't returned yet
+    size_t running_count;
+
+    //next line to give to a worker
+    FindPosition next;
+
+    //lines of the index from tail_start up to tail_end are after the last TextLine when the job starts
+    //only a finished index is searched(spans are only made of one) so it doesn't change while workers read it
+    TextLineIndex* index;
+    size_t tail_start;
+    size_t tail_end;
+
+    //chunks in document order
+    FindChunk** chunks;
+    size_t chunk_count;
+    size_t chunk_capacity;
+
+    //only used by the main thread
+    size_t merged_count;
+};
+
+static bool find_push_match(FindMatch** matches, size_t* match_count, size_t* match_capacity, FindMatch match)
+{
+    if (*match_count >= FIND_MAX_MATCHES) {
+        return false;
+    }
+
+    if (*match_count >= *match_capacity) {
+        size_t new_capacity = *match_capacity ? *match_capacity * 2 : FIND_DEFAULT_MATCH_CAPACITY;
+        FindMatch* new_matches = realloc(*matches, new_capacity * sizeof(FindMatch));
+        if (!new_matches) {
+            fprintf(stderr, "%s:%d:ERROR : failed to grow find matches!!!\n", __FILE__, __LINE__);
+            return false;
+        }
+        *matches = new_matches;
+        *match_capacity = new_capacity;
+    }
+
+    (*matches)[(*match_count)++] = match;
+    return true;
+}
+
+typedef struct FindLineSearch {
+    FindChunk* chunk;
+    TextLine* line;
+    size_t index_line;
+    size_t line_number;
+    UTFStringView sv;
+
+    //characters are counted only up to the last match
+    size_t counted_byte;
+    size_t char_offset;
+
+    bool is_truncated;
+} FindLineSearch;
+
+//matches have to come from left to right
+static bool find_add_line_match(void* data, RegexMatch found)
+{
+    FindLineSearch* search = data;
+
+    UTFStringView skipped = {.data = search->sv.data + search->counted_byte, .data_size = found.start_byte - search->counted_byte};
+    search->char_offset += utf_sv_count(skipped);
+    search->counted_byte = found.start_byte;
+
+    UTFStringView matched = {.data = search->sv.data + found.start_byte, .data_size = found.end_byte - found.start_byte};
+
+    FindMatch match = {
+        .line = search->line,
+        .index_line = search->index_line,
+        .line_number = search->line_number,
+        .start_byte = found.start_byte,
+        .end_byte = found.end_byte,
+        .start_char = search->char_offset,
+        .end_char = search->char_offset + utf_sv_count(matched)
+    };
+    if (!find_push_match(&search->chunk->matches, &search->chunk->match_count, &search->chunk->match_capacity, match)) {
+        search->is_truncated = true;
+        return false;
+    }
+    return true;
+}
+
+//line is NULL if the data is from index_line of the index
+//returns false if matches couldn't be stored
+static bool find_search_line(FindChunk* chunk, TextLine* line, size_t index_line, size_t line_number,
+                             const char* data, size_t data_size, UTFStringView query, RegexMatcher* matcher)
+{
+    FindLineSearch search = {
+        .chunk = chunk,
+        .line = line,
+        .index_line = index_line,
+        .line_number = line_number,
+        //only bytes are searched so mapped lines are not counted
+        .sv = {.data = data, .data_size = data_size},
+        .counted_byte = 0,
+        .char_offset = 0,
+        .is_truncated = false
+    };
+
+    if (matcher) {
+        regex_find_all(matcher, search.sv, find_add_line_match, &search);
+        return !search.is_truncated;
+    }
+
+    size_t search_from = 0;
+    while (true) {
+        size_t found = utf_sv_find_right_from_bytes(search.sv, query, search_from);
+        if (found == UTF_NOT_FOUND) {
+            return true;
+        }
+
+        RegexMatch match = { .start_byte = found, .end_byte = found + query.data_size };
+        if (!find_add_line_match(&search, match)) {
+            return false;
+        }
+
+        //matches can overlap so next search starts from the next character
+        search_from = utf_sv_next(search.sv, found);
+    }
+}
+
+//must be called with the job mutex locked
+//lines of the chunk are read to the worker's lines unless they are from the index
+static FindChunk* find_job_take_chunk(FindJob* job, TextSnapshotLine* lines)
+{
+    if (atomic_load_explicit(&job->is_cancelled, memory_order_relaxed)) {
+        return NULL;
+    }
+
+    if (job->chunk_count >= job->chunk_capacity) {
+        size_t new_capacity = job->chunk_capacity ? job->chunk_capacity * 2 : 64;
+        FindChunk** new_chunks = realloc(job->chunks, new_capacity * sizeof(FindChunk*));
+        if (!new_chunks) {
+            fprintf(stderr, "%s:%d:ERROR : failed to grow find chunks!!!\n", __FILE__, __LINE__);
+            return NULL;
+        }
+        job->chunks = new_chunks;
+        job->chunk_capacity = new_capacity;
+    }
+
+    FindPosition* next = &job->next;
+    size_t line_count = 0;
+
+    if (next->index_line >= next->index_end && next->line) {
+        size_t read_count = text_snapshot_read_lines(job->snapshot, next->line, lines, FIND_CHUNK_LINES);
+
+        //lines of a span are searched from the index, it doesn't change once there is a span
+        if (lines[0].span_count > 0) {
+            next->index_line = text_line_index_line_at(job->index, lines[0].data);
+            next->index_end = next->index_line + lines[0].span_count;
+            next->line = lines[0].next;
+        }
+        //chunk ends before the next span
+        else {
+            while (line_count < read_count && lines[line_count].span_count == 0) {
+                line_count++;
+            }
+            next->line = lines[line_count - 1].next;
+        }
+    }
+
+    //lines after the last TextLine go after every TextLine
+    if (line_count == 0 && next->index_line >= next->index_end && !next->line && !next->is_past_lines) {
+        next->is_past_lines = true;
+        next->index_line = job->tail_start;
+        next->index_end = job->tail_end;
+    }
+
+    bool is_from_index = false;
+    size_t first_index_line = 0;
+    if (line_count == 0) {
+        if (next->index_line >= next->index_end) {
+            return NULL;
+        }
+        is_from_index = true;
+        first_index_line = next->index_line;
+        line_count = next->index_end - next->index_line;
+        if (line_count > FIND_CHUNK_LINES) {
+            line_count = FIND_CHUNK_LINES;
+        }
+        next->index_line += line_count;
+    }
+
+    FindChunk* chunk = calloc(1, sizeof(FindChunk));
+    chunk->first_line_number = next->line_number;
+    chunk->line_count = line_count;
+    chunk->is_from_index = is_from_index;
+    chunk->first_index_line = first_index_line;
+
+    next->line_number += line_count;
+    chunk->end = *next;
+    job->chunks[job->chunk_count++] = chunk;
+
+    return chunk;
+}
+
+static void find_worker(void* data)
+{
+    FindJob* job = data;
+    UTFStringView query = utf_sv_from_str(job->query);
+
+    //DFA cache of the regex can't be shared between threads
+    RegexMatcher* matcher = job->regex ? regex_matcher_create(job->regex) : NULL;
+    TextSnapshotLine* lines = malloc(FIND_CHUNK_LINES * sizeof(TextSnapshotLine));
+
+    while (lines) {
+        os_mutex_lock(job->mutex);
+        FindChunk* chunk = find_job_take_chunk(job, lines);
+        os_mutex_unlock(job->mutex);
+
+        if (!chunk) {
+            break;
+        }
+
+        for (size_t i = 0; i < chunk->line_count; i++) {
+            //document changed, nobody is going to merge this chunk
+            if (atomic_load_explicit(&job->is_cancelled, memory_order_relaxed)) {
+                break;
+            }
+
+            size_t line_number = chunk->first_line_number + i;
+            bool is_stored;
+            if (chunk->is_from_index) {
+                size_t index_line = chunk->first_index_line + i;
+                const char* line_data;
+                size_t line_size;
+                bool ends_with_lf, ends_with_crlf;
+                text_line_index_get_line(job->index, index_line, &line_data, &line_size, &ends_with_lf, &ends_with_crlf);
+                is_stored = find_search_line(chunk, NULL, index_line, line_number, line_data, line_size, query, matcher);
+            }
+            else {
+                is_stored = find_search_line(chunk, lines[i].line, 0, line_number, lines[i].data, lines[i].data_size, query, matcher);
+            }
+            if (!is_stored) {
+                chunk->is_truncated = true;
+                break;
+            }
+        }
+
+        os_mutex_lock(job->mutex);
+        chunk->is_done = true;
+        os_mutex_unlock(job->mutex);
+    }
+
+    free(lines);
+    if (matcher) {
+        regex_matcher_destroy(matcher);
+    }
+
+    os_mutex_lock(job->mutex);
+    job->running_count--;
+    os_mutex_unlock(job->mutex);
+}
+
+static void find_chunk_destroy(FindChunk* chunk)
+{
+    free(chunk->matches);
+    free(chunk);
+}
+
+//starts from find->next
+static void find_job_start(TextFind* find, TextLineIndex* index)
+{
+    //lines of the index don't change, only TextLines need a snapshot
+    TextSnapshot* snapshot = NULL;
+    if (find->next.line) {
+        snapshot = text_snapshot_create(TEXT_SNAPSHOT_FIND, find->next.line, NULL, 0);
+        if (!snapshot) {
+            fprintf(stderr, "%s:%d:ERROR : failed to take a snapshot to search!!!\n", __FILE__, __LINE__);
+            return;
+        }
+    }
+
+    FindJob* job = calloc(1, sizeof(FindJob));
+    job->mutex = os_mutex_create();
+    job->snapshot = snapshot;
+    job->query = utf_copy(find->query);
+    job->regex = find->is_regex ? find->regex : NULL;
+    if (job->regex) {
+        regex_retain(job->regex);
+    }
+    atomic_init(&job->is_cancelled, false);
+    job->next = find->next;
+
+    //snapshot ends at the last TextLine, lines created while the job runs are searched from the index
+    job->index = index;
+    job->tail_start = index ? index->next_line : 0;
+    job->tail_end = index && index->is_finished ? index->line_count : 0;
+
+    find->job = job;
+
+    size_t thread_count = os_get_processor_count();
+    if (thread_count > FIND_MAX_THREADS) {
+        thread_count = FIND_MAX_THREADS;
+    }
+
+    //workers can start before every thread is created
+    job->running_count = thread_count;
+    for (size_t i = 0; i < thread_count; i++) {
+        OS_Thread* thread = os_thread_create(find_worker, job);
+        if (thread) {
+            job->threads[job->thread_count++] = thread;
+        }
+        else {
+            os_mutex_lock(job->mutex);
+            job->running_count--;
+            os_mutex_unlock(job->mutex);
+        }
+    }
+
+    //couldn't create any thread, just search here
+    if (job->thread_count == 0) {
+        job->running_count = 1;
+        find_worker(job);
+    }
+}
+
+//waits for the workers(they stop at the next line once the job is cancelled) and frees the job
+static void find_job_destroy(FindJob* job)
+{
+    for (size_t i = 0; i < job->thread_count; i++) {
+        os_thread_join(job->threads[i]);
+    }
+
+    for (size_t i = job->merged_count; i < job->chunk_count; i++) {
+        find_chunk_destroy(job->chunks[i]);
+    }
+
+    if (job->snapshot) {
+        text_snapshot_destroy(job->snapshot);
+    }
+    if (job->regex) {
+        regex_release(job->regex);
+    }
+    utf_destroy(job->query);
+    os_mutex_destroy(job->mutex);
+    free(job->chunks);
+    free(job);
+}
+
+static bool find_job_is_running(FindJob* job)
+{
+    os_mutex_lock(job->mutex);
+    bool is_running = job->running_count > 0;
+    os_mutex_unlock(job->mutex);
+    return is_running;
+}
+
+//cancels the job without waiting for the workers
+//it's freed by a later poll once they return
+static void find_job_stop(TextFind* find)
+{
+    FindJob* job = find->job;
+    if (!job) {
+        return;
+    }
+
+    atomic_store_explicit(&job->is_cancelled, true, memory_order_relaxed);
+
+    //next job waits until this one is freed, so there is only one at a time
+    assert(!find->stopping_job);
+    find->stopping_job = job;
+    find->job = NULL;
+}
+
+//frees the stopped job if its workers returned
+//returns false if they are still running
+static bool find_job_reap(TextFind* find)
+{
+    if (!find->stopping_job) {
+        return true;
+    }
+    if (find_job_is_running(find->stopping_job)) {
+        return false;
+    }
+    find_job_destroy(find->stopping_job);
+    find->stopping_job = NULL;
+    return true;
+}
+
+//moves finished chunks to find matches in document order
+//returns true if anything was merged
+static bool find_job_merge(TextFind* find)
+{
+    FindJob* job = find->job;
+    bool merged = false;
+
+    while (!find->is_truncated) {
+        FindChunk* chunk = NULL;
+
+        os_mutex_lock(job->mutex);
+        if (job->merged_count < job->chunk_count && job->chunks[job->merged_count]->is_done) {
+            chunk = job->chunks[job->merged_count];
+            job->chunks[job->merged_count] = NULL;
+            job->merged_count++;
+        }
+        os_mutex_unlock(job->mutex);
+
+        if (!chunk) {
+            break;
+        }
+
+        for (size_t i = 0; i < chunk->match_count; i++) {
+            if (!find_push_match(&find->matches, &find->match_count, &find->match_capacity, chunk->matches[i])) {
+                find->is_truncated = true;
+                break;
+            }
+        }
+        if (chunk->is_truncated) {
+            find->is_truncated = true;
+        }
+
+        find->next = chunk->end;
+        find_chunk_destroy(chunk);
+        merged = true;
+    }
+
+    return merged;
+}
+
+void text_find_init(TextFind* find)
+{
+    find->query = utf_from_cstr(u8"");
+
+    find->is_regex = false;
+    find->regex = NULL;
+    find->regex_error = NULL;
+
+    find->matches = NULL;
+    find->match_count = 0;
+    find->match_capacity = 0;
+
+    find->is_truncated = false;
+    find->needs_restart = false;
+    memset(&find->next, 0, sizeof(FindPosition));
+    find->is_finished = true;
+    find->index = NULL;
+
+    find->job = NULL;
+    find->stopping_job = NULL;
+}
+
+void text_find_destroy(TextFind* find)
+{
+    text_find_wait(find);
+
+    if (find->query) {
+        utf_destroy(find->query);
+    }
+    if (find->regex) {
+        regex_release(find->regex);
+    }
+    free(find->matches);
+}
+
+void text_find_restart(TextFind* find)
+{
+    find_job_stop(find);
+
+    find->match_count = 0;
+    find->is_truncated = false;
+    //poll starts it over, until then there is nothing to search
+    find->is_finished = true;
+    //nothing to search with invalid pattern
+    find->needs_restart = find->query->count > 0 && (!find->is_regex || find->regex);
+}
+
+//keeps only the matches that still match after the query got longer
+static void text_find_refine(TextFind* find)
+{
+    UTFStringView query = utf_sv_from_str(find->query);
+    size_t kept = 0;
+
+    for (size_t i = 0; i < find->match_count; i++) {
+        FindMatch match = find->matches[i];
+        const char* data;
+        size_t data_size;
+        if (match.line) {
+            data = text_line_data(match.line);
+            data_size = text_line_data_size(match.line);
+        }
+        else {
+            bool ends_with_lf, ends_with_crlf;
+            text_line_index_get_line(find->index, match.index_line, &data, &data_size, &ends_with_lf, &ends_with_crlf);
+        }
+
+        if (data_size - match.start_byte < query.data_size) {
+            continue;
+        }
+        if (memcmp(data + match.start_byte, query.data, query.data_size) != 0) {
+            continue;
+        }
+
+        match.end_byte = match.start_byte + query.data_size;
+        match.end_char = match.start_char + query.count;
+        find->matches[kept++] = match;
+    }
+
+    find->match_count = kept;
+}
+
+static void text_find_compile_regex(TextFind* find)
+{
+    if (find->regex) {
+        regex_release(find->regex);
+        find->regex = NULL;
+    }
+    find->regex_error = NULL;
+
+    if (find->query->count > 0) {
+        find->regex = regex_cache_get(utf_sv_from_str(find->query), &find->regex_error);
+    }
+}
+
+void text_find_set_regex(TextFind* find, bool is_regex)
+{
+    if (find->is_regex == is_regex) {
+        return;
+    }
+
+    find_job_stop(find);
+
+    find->is_regex = is_regex;
+    if (is_regex) {
+        text_find_compile_regex(find);
+    }
+    else if (find->regex) {
+        regex_release(find->regex);
+        find->regex = NULL;
+        find->regex_error = NULL;
+    }
+
+    text_find_restart(find);
+}
+
+void text_find_set_query(TextFind* find, UTFStringView query)
+{
+    //stop searching with the old query
+    //next is kept at the first line that is not merged yet
+    find_job_stop(find);
+
+    UTFStringView prev_query = utf_sv_from_str(find->query);
+
+    //new matches are subset of previous matches if query just got longer
+    //but if search stopped early we don't know about matches that are not stored
+    bool can_refine = !find->is_regex &&
+                      prev_query.count > 0 &&
+                      query.data_size > prev_query.data_size &&
+                      utf_sv_starts_with(query, prev_query) &&
+                      !find->needs_restart &&
+                      !find->is_truncated;
+
+    utf_set_sv(find->query, query);
+    if (find->is_regex) {
+        text_find_compile_regex(find);
+    }
+
+    if (can_refine) {
+        //lines that are not searched yet will be searched with the new query
+        text_find_refine(find);
+    }
+    else {
+        text_find_restart(find);
+    }
+}
+
+void text_find_freeze_line(TextFind* find, TextLine* line)
+{
+    //only one of them is alive at a time
+    if (find->job && find->job->snapshot) {
+        text_snapshot_freeze_line(find->job->snapshot, line);
+    }
+    if (find->stopping_job && find->stopping_job->snapshot) {
+        text_snapshot_freeze_line(find->stopping_job->snapshot, line);
+    }
+}
+
+bool text_find_is_reading(TextFind* find)
+{
+    return find->job || find->stopping_job;
+}
+
+void text_find_wait(TextFind* find)
+{
+    find_job_stop(find);
+    if (find->stopping_job) {
+        find_job_destroy(find->stopping_job);
+        find->stopping_job = NULL;
+    }
+}
+
+bool text_find_poll(TextFind* find, TextLine* first_line, TextLineIndex* index)
+{
+    find->index = index;
+
+    //previous search has to let go of the lines before the next one takes a snapshot
+    if (!find_job_reap(find)) {
+        return false;
+    }
+
+    if (find->needs_restart) {
+        find->needs_restart = false;
+        memset(&find->next, 0, sizeof(FindPosition));
+        find->next.line = first_line;
+        find->is_finished = false;
+    }
+
+    if (!find->job) {
+        if (find->is_finished) {
+            return false;
+        }
+        find_job_start(find, index);
+        if (!find->job) {
+            return false;
+        }
+    }
+
+    bool changed = find_job_merge(find);
+
+    FindJob* job = find->job;
+    os_mutex_lock(job->mutex);
+    FindPosition next = job->next;
+    bool finished = !next.line && next.is_past_lines && next.index_line >= next.index_end && job->merged_count == job->chunk_count;
+    os_mutex_unlock(job->mutex);
+
+    if (finished || find->is_truncated) {
+        find->is_finished = true;
+        find_job_stop(find);
+        //workers are out of lines, so they are about to return anyway
+        if (finished) {
+            find_job_reap(find);
+        }
+        changed = true;
+    }
+
+    return changed;
+}
+
+bool text_find_is_done(TextFind* find)
+{
+    return !find->needs_restart && !find->job && find->is_finished;
+}
+
+size_t text_find_match_after(TextFind* find, size_t line_number, size_t char_offset)
+{
+    size_t low = 0;
+    size_t high = find->match_count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        FindMatch match = find->matches[mid];
+        bool is_before = match.line_number < line_number ||
+                         (match.line_number == line_number && match.start_char < char_offset);
+        if (is_before) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+void text_find_test()
+{
+    {
+        TextLine* first = create_lines_from_cstr(u8"고양이 cat\naaaa\n\ncat 고양이 cats");
+        TextFind find;
+        text_find_init(&find);
+
+        text_find_set_query(&find, utf_sv_from_cstr(u8"cat"));
+        assert(!text_find_is_done(&find));
+        while (!text_find_is_done(&find)) { text_find_poll(&find, first, NULL); }
+        assert(text_find_is_done(&find));
+        assert(find.match_count == 3);
+        assert(find.matches[0].line_number == 0 && find.matches[0].start_char == 4);
+        assert(find.matches[0].start_byte == 10 && find.matches[0].end_char == 7);
+        assert(find.matches[1].line_number == 3 && find.matches[1].start_char == 0);
+        assert(find.matches[2].line_number == 3 && find.matches[2].start_char == 8);
+
+        //matches can overlap
+        text_find_set_query(&find, utf_sv_from_cstr(u8"aa"));
+        while (!text_find_is_done(&find)) { text_find_poll(&find, first, NULL); }
+        assert(find.match_count == 3);
+
+        //longer query filters previous matches
+        text_find_set_query(&find, utf_sv_from_cstr(u8"c"));
+        while (!text_find_is_done(&find)) { text_find_poll(&find, first, NULL); }
+        assert(find.match_count == 3);
+        text_find_set_query(&find, utf_sv_from_cstr(u8"ca"));
+        assert(text_find_is_done(&find));
+        assert(find.match_count == 3);
+        text_find_set_query(&find, utf_sv_from_cstr(u8"cats"));
+        assert(find.match_count == 1);
+        assert(find.matches[0].line_number == 3 && find.matches[0].start_char == 8);
+        assert(find.matches[0].end_char == 12);
+        assert(text_find_match_after(&find, 3, 8) == 0);
+        assert(text_find_match_after(&find, 3, 9) == 1);
+
+        //extending query in the middle of search
+        text_find_set_query(&find, utf_sv_from_cstr(u8"고"));
+        text_find_poll(&find, first, NULL);
+        text_find_set_query(&find, utf_sv_from_cstr(u8"고양이"));
+        while (!text_find_is_done(&find)) { text_find_poll(&find, first, NULL); }
+        assert(find.match_count == 2);
+        assert(find.matches[1].line_number == 3 && find.matches[1].start_char == 4);
+
+        text_find_set_query(&find, utf_sv_from_cstr(u8""));
+        assert(!text_find_poll(&find, first, NULL));
+        assert(text_find_is_done(&find));
+        assert(find.match_count == 0);
+
+        text_find_set_regex(&find, true);
+        text_find_set_query(&find, utf_sv_from_cstr(u8"ca?t?s?"));
+        while (!text_find_is_done(&find)) { text_find_poll(&find, first, NULL); }
+        assert(find.match_count == 3);
+        assert(find.matches[2].line_number == 3 && find.matches[2].start_char == 8);
+        assert(find.matches[2].start_byte == 14 && find.matches[2].end_byte == 18);
+        assert(find.matches[2].end_char == 12);
+
+        text_find_set_query(&find, utf_sv_from_cstr(u8"[가-힣]+$"));
+        while (!text_find_is_done(&find)) { text_find_poll(&find, first, NULL); }
+        assert(find.match_count == 0);
+        text_find_set_query(&find, utf_sv_from_cstr(u8"[가-힣]+"));
+        while (!text_find_is_done(&find)) { text_find_poll(&find, first, NULL); }
+        assert(find.match_count == 2);
+        assert(find.matches[1].start_char == 4 && find.matches[1].end_char == 7);
+
+        //invalid pattern finds nothing
+        text_find_set_query(&find, utf_sv_from_cstr(u8"(cat"));
+        assert(find.regex == NULL && find.regex_error != NULL);
+        assert(text_find_is_done(&find));
+        assert(find.match_count == 0);
+
+        text_find_set_regex(&find, false);
+        while (!text_find_is_done(&find)) { text_find_poll(&find, first, NULL); }
+        assert(find.match_count == 0);
+
+        text_find_destroy(&find);
+        for (TextLine* line = first; line != NULL; ) {
+            TextLine* next = line->next;
+            text_line_destroy(line);
+            line = next;
+        }
+    }
+    {
+        //document can change while workers search a snapshot of it
+        TextLine* first = create_lines_from_cstr(u8"cat\ncat\ncat");
+        TextFind find;
+        text_find_init(&find);
+
+        text_find_set_query(&find, utf_sv_from_cstr(u8"cat"));
+        text_find_poll(&find, first, NULL);
+
+        //restarting doesn't wait for the workers
+        text_find_restart(&find);
+        text_find_freeze_line(&find, first->next);
+        utf_set_cstr(first->next->str, u8"dog");
+
+        while (!text_find_is_done(&find)) { text_find_poll(&find, first, NULL); }
+        assert(find.match_count == 2);
+        assert(find.matches[0].line_number == 0 && find.matches[1].line_number == 2);
+        assert(!text_find_is_reading(&find));
+
+        text_find_destroy(&find);
+        for (TextLine* line = first; line != NULL; ) {
+            TextLine* next = line->next;
+            text_line_destroy(line);
+            line = next;
+        }
+    }
+    {
+        //lines without a TextLine are searched from the index
+        const char* data = u8"cat\ndog\ncat cat\r\n고양이 cat";
+        TextLineIndex index;
+        text_line_index_build(&index, data, strlen(data));
+        TextLine* first = text_line_index_create_lines(&index, 2, 0, NULL);
+        TextFind find;
+        text_find_init(&find);
+
+        text_find_set_query(&find, utf_sv_from_cstr(u8"cat"));
+        while (!text_find_is_done(&find)) { text_find_poll(&find, first, &index); }
+        assert(find.match_count == 4);
+        assert(find.matches[0].line == first && find.matches[0].line_number == 0);
+        assert(find.matches[1].line == NULL && find.matches[1].index_line == 2 && find.matches[1].line_number == 2);
+        assert(find.matches[2].start_char == 4 && find.matches[2].end_byte == 7);
+        assert(find.matches[3].line_number == 3 && find.matches[3].start_char == 4 && find.matches[3].start_byte == 10);
+        assert(index.next_line == 2);
+
+        text_find_set_query(&find, utf_sv_from_cstr(u8"cat "));
+        assert(find.match_count == 1);
+        assert(find.matches[0].line_number == 2 && find.matches[0].start_char == 0);
+
+        text_find_destroy(&find);
+        for (TextLine* line = first; line != NULL; ) {
+            TextLine* next = line->next;
+            text_line_destroy(line);
+            line = next;
+        }
+        text_line_index_destroy(&index);
+    }
+}
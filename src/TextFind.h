@@ -0,0 +1,129 @@
+#ifndef TextFind_HEADER_GUARD
+#define TextFind_HEADER_GUARD
+
+#include "UTFString.h"
+#include "TextLine.h"
+#include "TextSnapshot.h"
+#include "OS.h"
+#include "Regex.h"
+#include <stdbool.h>
+
+// A match of the find query
+//
+// line is only valid until the document changes,
+// find has to be restarted when that happens
+typedef struct FindMatch {
+    //NULL if the line didn't have a TextLine when it was searched, its text is in the index then
+    TextLine* line;
+    size_t index_line;
+    size_t line_number;
+
+    size_t start_byte;
+    size_t end_byte;
+    size_t start_char;
+    size_t end_char;
+} FindMatch;
+
+// Where search goes on
+//
+// Lines of the index from index_line up to index_end are searched before line and the lines after it.
+// They are the lines of a span(see TextLine.span_count) that is being searched,
+// or the lines after the last TextLine once every TextLine is searched
+typedef struct FindPosition {
+    TextLine* line;
+    size_t index_line;
+    size_t index_end;
+    //lines after the last TextLine are searched already or being searched
+    bool is_past_lines;
+
+    size_t line_number;
+} FindPosition;
+
+typedef struct FindJob FindJob;
+
+// Finds every match of the query in the document
+//
+// Search runs on worker threads. Each worker takes a chunk of lines at a time,
+// and finished chunks are merged in document order on the main thread
+// so matches can be shown while the rest of the document is being searched.
+//
+// Lines of the opened file that don't have a TextLine yet(the ones after the last TextLine and the ones in spans)
+// are searched straight from the line index, so search doesn't create them.
+// Only the index of a fully loaded file is searched, search has to be restarted once loading finishes.
+//
+// Workers read a snapshot of the lines(see TextSnapshot.h), so the document can change
+// while they run as long as text_find_freeze_line is called before a line changes.
+// text_find_restart cancels the job without waiting for it, workers check it before every line
+// and the job is freed by a later poll once they return.
+//
+// Matches are kept in document order and they can overlap,
+// so when the query is extended (user typed one more character)
+// previous matches are filtered instead of searching the whole document again
+//
+// In regex mode the query is a pattern (see Regex.h) and matches don't overlap.
+// A longer pattern doesn't always match less, so it is searched again every time.
+typedef struct TextFind {
+    UTFString* query;
+
+    bool is_regex;
+    //compiled query, NULL if it is not a valid pattern
+    Regex* regex;
+    //why the query is not a valid pattern
+    const char* regex_error;
+
+    FindMatch* matches;
+    size_t match_count;
+    size_t match_capacity;
+
+    //there were too many matches and search stopped
+    bool is_truncated;
+
+    //search has to start over from the first line
+    bool needs_restart;
+
+    //first line that is not searched yet
+    FindPosition next;
+    //every line is searched, or search stopped because there were too many matches
+    bool is_finished;
+
+    //index of the opened file given to the last poll, NULL if there is none
+    TextLineIndex* index;
+
+    //NULL when nothing is running
+    FindJob* job;
+    //cancelled job whose workers haven't returned yet
+    //next job starts after it's freed, so there is only one snapshot at a time
+    FindJob* stopping_job;
+} TextFind;
+
+void text_find_init(TextFind* find);
+void text_find_destroy(TextFind* find);
+
+void text_find_set_query(TextFind* find, UTFStringView query);
+void text_find_set_regex(TextFind* find, bool is_regex);
+
+//call this before document changes
+//it cancels the running search without waiting for it
+void text_find_restart(TextFind* find);
+
+//call it before the line(or its next pointer) changes
+void text_find_freeze_line(TextFind* find, TextLine* line);
+//returns true while workers might read the lines, lines can't be freed until then
+bool text_find_is_reading(TextFind* find);
+//cancels the search and waits for the workers to return
+//call it before lines are freed
+void text_find_wait(TextFind* find);
+
+//starts search if needed and merges matches found so far
+//index has the lines that don't have a TextLine yet, it can be NULL
+//returns true if matches changed
+bool text_find_poll(TextFind* find, TextLine* first_line, TextLineIndex* index);
+bool text_find_is_done(TextFind* find);
+
+//returns index of the first match that starts at or after the position
+//or match_count if there is none
+size_t text_find_match_after(TextFind* find, size_t line_number, size_t char_offset);
+
+void text_find_test();
+
+#endif
@@ -0,0 +1,541 @@
+#include "TextGrapheme.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <time.h>
+
+typedef struct GraphemeRange {
+    uint32_t first;
+    uint32_t last;
+    TextGraphemeProperty property;
+} GraphemeRange;
+
+//Hangul syllables are LV or LVT depending on where they are in the block,
+//they are one range here and told apart when they are looked up
+#define GRAPHEME_HANGUL_SYLLABLE_FIRST 0xAC00
+#define GRAPHEME_HANGUL_SYLLABLE_LAST 0xD7A3
+#define GRAPHEME_HANGUL_T_COUNT 28
+
+// Code points that are not TEXT_GRAPHEME_OTHER, in order
+//
+// This covers controls, the Hangul jamo, regional indicators, emoji, and the combining
+// marks of the scripts the editor is used with (Latin, Greek, Cyrillic, Hebrew, Arabic,
+// Devanagari, Thai and CJK), not every Extend and SpacingMark of Unicode
+static const GraphemeRange GRAPHEME_RANGES[] = {
+    {0x0000, 0x0009, TEXT_GRAPHEME_CONTROL},
+    {0x000A, 0x000A, TEXT_GRAPHEME_LF},
+    {0x000B, 0x000C, TEXT_GRAPHEME_CONTROL},
+    {0x000D, 0x000D, TEXT_GRAPHEME_CR},
+    {0x000E, 0x001F, TEXT_GRAPHEME_CONTROL},
+    {0x007F, 0x009F, TEXT_GRAPHEME_CONTROL},
+    {0x00A9, 0x00A9, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x00AD, 0x00AD, TEXT_GRAPHEME_CONTROL},
+    {0x00AE, 0x00AE, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x0300, 0x036F, TEXT_GRAPHEME_EXTEND},
+    {0x0483, 0x0489, TEXT_GRAPHEME_EXTEND},
+    {0x0591, 0x05BD, TEXT_GRAPHEME_EXTEND},
+    {0x05BF, 0x05BF, TEXT_GRAPHEME_EXTEND},
+    {0x05C1, 0x05C2, TEXT_GRAPHEME_EXTEND},
+    {0x05C4, 0x05C5, TEXT_GRAPHEME_EXTEND},
+    {0x05C7, 0x05C7, TEXT_GRAPHEME_EXTEND},
+    {0x0600, 0x0605, TEXT_GRAPHEME_PREPEND},
+    {0x0610, 0x061A, TEXT_GRAPHEME_EXTEND},
+    {0x061C, 0x061C, TEXT_GRAPHEME_CONTROL},
+    {0x064B, 0x065F, TEXT_GRAPHEME_EXTEND},
+    {0x0670, 0x0670, TEXT_GRAPHEME_EXTEND},
+    {0x06D6, 0x06DC, TEXT_GRAPHEME_EXTEND},
+    {0x06DD, 0x06DD, TEXT_GRAPHEME_PREPEND},
+    {0x06DF, 0x06E4, TEXT_GRAPHEME_EXTEND},
+    {0x06E7, 0x06E8, TEXT_GRAPHEME_EXTEND},
+    {0x06EA, 0x06ED, TEXT_GRAPHEME_EXTEND},
+    {0x070F, 0x070F, TEXT_GRAPHEME_PREPEND},
+    {0x0900, 0x0902, TEXT_GRAPHEME_EXTEND},
+    {0x0903, 0x0903, TEXT_GRAPHEME_SPACING_MARK},
+    {0x093A, 0x093A, TEXT_GRAPHEME_EXTEND},
+    {0x093B, 0x093B, TEXT_GRAPHEME_SPACING_MARK},
+    {0x093C, 0x093C, TEXT_GRAPHEME_EXTEND},
+    {0x093E, 0x0940, TEXT_GRAPHEME_SPACING_MARK},
+    {0x0941, 0x0948, TEXT_GRAPHEME_EXTEND},
+    {0x0949, 0x094C, TEXT_GRAPHEME_SPACING_MARK},
+    {0x094D, 0x094D, TEXT_GRAPHEME_EXTEND},
+    {0x094E, 0x094F, TEXT_GRAPHEME_SPACING_MARK},
+    {0x0951, 0x0957, TEXT_GRAPHEME_EXTEND},
+    {0x0962, 0x0963, TEXT_GRAPHEME_EXTEND},
+    {0x0E31, 0x0E31, TEXT_GRAPHEME_EXTEND},
+    {0x0E33, 0x0E33, TEXT_GRAPHEME_SPACING_MARK},
+    {0x0E34, 0x0E3A, TEXT_GRAPHEME_EXTEND},
+    {0x0E47, 0x0E4E, TEXT_GRAPHEME_EXTEND},
+    {0x1100, 0x115F, TEXT_GRAPHEME_L},
+    {0x1160, 0x11A7, TEXT_GRAPHEME_V},
+    {0x11A8, 0x11FF, TEXT_GRAPHEME_T},
+    {0x1AB0, 0x1AFF, TEXT_GRAPHEME_EXTEND},
+    {0x1DC0, 0x1DFF, TEXT_GRAPHEME_EXTEND},
+    {0x200B, 0x200B, TEXT_GRAPHEME_CONTROL},
+    {0x200C, 0x200C, TEXT_GRAPHEME_EXTEND},
+    {0x200D, 0x200D, TEXT_GRAPHEME_ZWJ},
+    {0x200E, 0x200F, TEXT_GRAPHEME_CONTROL},
+    {0x2028, 0x202E, TEXT_GRAPHEME_CONTROL},
+    {0x203C, 0x203C, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x2049, 0x2049, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x2060, 0x206F, TEXT_GRAPHEME_CONTROL},
+    {0x20D0, 0x20FF, TEXT_GRAPHEME_EXTEND},
+    {0x2122, 0x2122, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x2139, 0x2139, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x2194, 0x2199, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x21A9, 0x21AA, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x231A, 0x231B, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x2328, 0x2328, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x23CF, 0x23CF, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x23E9, 0x23F3, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x23F8, 0x23FA, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x24C2, 0x24C2, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x25AA, 0x25AB, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x25B6, 0x25B6, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x25C0, 0x25C0, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x25FB, 0x25FE, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x2600, 0x27BF, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x2934, 0x2935, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x2B05, 0x2B07, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x2B1B, 0x2B1C, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x2B50, 0x2B50, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x2B55, 0x2B55, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x302A, 0x302F, TEXT_GRAPHEME_EXTEND},
+    {0x3030, 0x3030, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x303D, 0x303D, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x3099, 0x309A, TEXT_GRAPHEME_EXTEND},
+    {0x3297, 0x3297, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x3299, 0x3299, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0xA960, 0xA97C, TEXT_GRAPHEME_L},
+    {GRAPHEME_HANGUL_SYLLABLE_FIRST, GRAPHEME_HANGUL_SYLLABLE_LAST, TEXT_GRAPHEME_LV},
+    {0xD7B0, 0xD7C6, TEXT_GRAPHEME_V},
+    {0xD7CB, 0xD7FB, TEXT_GRAPHEME_T},
+    {0xFE00, 0xFE0F, TEXT_GRAPHEME_EXTEND},
+    {0xFE20, 0xFE2F, TEXT_GRAPHEME_EXTEND},
+    {0xFEFF, 0xFEFF, TEXT_GRAPHEME_CONTROL},
+    {0xFF9E, 0xFF9F, TEXT_GRAPHEME_EXTEND},
+    {0xFFF0, 0xFFFB, TEXT_GRAPHEME_CONTROL},
+    {0x1F000, 0x1F0FF, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x1F10D, 0x1F10F, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x1F12F, 0x1F12F, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x1F16C, 0x1F171, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x1F17E, 0x1F17F, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x1F18E, 0x1F18E, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x1F191, 0x1F19A, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x1F1AD, 0x1F1E5, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x1F1E6, 0x1F1FF, TEXT_GRAPHEME_REGIONAL_INDICATOR},
+    {0x1F201, 0x1F20F, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x1F21A, 0x1F21A, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x1F22F, 0x1F22F, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x1F232, 0x1F23A, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x1F23C, 0x1F23F, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x1F249, 0x1F3FA, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x1F3FB, 0x1F3FF, TEXT_GRAPHEME_EXTEND},
+    {0x1F400, 0x1F53D, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x1F546, 0x1F64F, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x1F680, 0x1F6FF, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x1F774, 0x1F77F, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x1F7D5, 0x1F7FF, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x1F80C, 0x1F80F, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x1F848, 0x1F84F, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x1F85A, 0x1F85F, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x1F888, 0x1F88F, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x1F8AE, 0x1F8FF, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x1F90C, 0x1F93A, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x1F93C, 0x1F945, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x1F947, 0x1FAFF, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0x1FC00, 0x1FFFD, TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC},
+    {0xE0000, 0xE001F, TEXT_GRAPHEME_CONTROL},
+    {0xE0020, 0xE007F, TEXT_GRAPHEME_EXTEND},
+    {0xE0080, 0xE00FF, TEXT_GRAPHEME_CONTROL},
+    {0xE0100, 0xE01EF, TEXT_GRAPHEME_EXTEND},
+    {0xE01F0, 0xE0FFF, TEXT_GRAPHEME_CONTROL},
+};
+
+#define GRAPHEME_RANGE_COUNT (sizeof(GRAPHEME_RANGES) / sizeof(GRAPHEME_RANGES[0]))
+
+// Two-stage table
+//
+// First stage says which block a code point is in, second stage has the property
+// of every code point of a block. Most blocks are the same(all OTHER), so they are kept once
+#define GRAPHEME_BLOCK_SHIFT 7
+#define GRAPHEME_BLOCK_SIZE (1 << GRAPHEME_BLOCK_SHIFT)
+#define GRAPHEME_CODEPOINT_COUNT 0x110000
+#define GRAPHEME_STAGE1_SIZE (GRAPHEME_CODEPOINT_COUNT >> GRAPHEME_BLOCK_SHIFT)
+#define GRAPHEME_MAX_BLOCK_COUNT 256
+
+static uint8_t GRAPHEME_STAGE1[GRAPHEME_STAGE1_SIZE];
+static uint8_t GRAPHEME_STAGE2[GRAPHEME_MAX_BLOCK_COUNT][GRAPHEME_BLOCK_SIZE];
+static bool GRAPHEME_TABLE_IS_BUILT = false;
+
+//table is only built and read by the thread that moves the cursor
+static void grapheme_build_table()
+{
+    size_t block_count = 0;
+    size_t range_index = 0;
+
+    for (size_t block = 0; block < GRAPHEME_STAGE1_SIZE; block++) {
+        uint32_t block_first = (uint32_t)(block << GRAPHEME_BLOCK_SHIFT);
+        uint32_t block_last = block_first + GRAPHEME_BLOCK_SIZE - 1;
+
+        uint8_t properties[GRAPHEME_BLOCK_SIZE] = {0};
+        while (range_index < GRAPHEME_RANGE_COUNT && GRAPHEME_RANGES[range_index].last < block_first) {
+            range_index++;
+        }
+        for (size_t i = range_index; i < GRAPHEME_RANGE_COUNT && GRAPHEME_RANGES[i].first <= block_last; i++) {
+            GraphemeRange range = GRAPHEME_RANGES[i];
+            uint32_t first = range.first > block_first ? range.first : block_first;
+            uint32_t last = range.last < block_last ? range.last : block_last;
+            for (uint32_t codepoint = first; codepoint <= last; codepoint++) {
+                properties[codepoint - block_first] = (uint8_t)range.property;
+            }
+        }
+
+        //neighbouring blocks are usually the same, so the last one is checked first
+        size_t found = block_count;
+        if (block_count > 0 && memcmp(GRAPHEME_STAGE2[block_count - 1], properties, GRAPHEME_BLOCK_SIZE) == 0) {
+            found = block_count - 1;
+        }
+        for (size_t i = 0; i < block_count && found == block_count; i++) {
+            if (memcmp(GRAPHEME_STAGE2[i], properties, GRAPHEME_BLOCK_SIZE) == 0) {
+                found = i;
+            }
+        }
+        if (found == block_count) {
+            assert(block_count < GRAPHEME_MAX_BLOCK_COUNT);
+            memcpy(GRAPHEME_STAGE2[block_count], properties, GRAPHEME_BLOCK_SIZE);
+            block_count++;
+        }
+        GRAPHEME_STAGE1[block] = (uint8_t)found;
+    }
+
+    GRAPHEME_TABLE_IS_BUILT = true;
+}
+
+TextGraphemeProperty text_grapheme_property(uint32_t codepoint)
+{
+    if (codepoint >= GRAPHEME_CODEPOINT_COUNT) {
+        return TEXT_GRAPHEME_OTHER;
+    }
+    if (!GRAPHEME_TABLE_IS_BUILT) {
+        grapheme_build_table();
+    }
+
+    TextGraphemeProperty property = (TextGraphemeProperty)
+        GRAPHEME_STAGE2[GRAPHEME_STAGE1[codepoint >> GRAPHEME_BLOCK_SHIFT]][codepoint & (GRAPHEME_BLOCK_SIZE - 1)];
+
+    //syllables without a final consonant are every 28th one
+    if (property == TEXT_GRAPHEME_LV && codepoint >= GRAPHEME_HANGUL_SYLLABLE_FIRST &&
+        (codepoint - GRAPHEME_HANGUL_SYLLABLE_FIRST) % GRAPHEME_HANGUL_T_COUNT != 0) {
+        property = TEXT_GRAPHEME_LVT;
+    }
+    return property;
+}
+
+static bool grapheme_is_control(TextGraphemeProperty property)
+{
+    return property == TEXT_GRAPHEME_CONTROL || property == TEXT_GRAPHEME_CR || property == TEXT_GRAPHEME_LF;
+}
+
+//whether clusters break between before and after
+//after_pictographic : before is a ZWJ that follows a pictograph and its extends
+//odd_regional_indicators : before ends an odd run of regional indicators
+static bool grapheme_is_break(
+    TextGraphemeProperty before, TextGraphemeProperty after,
+    bool after_pictographic, bool odd_regional_indicators
+)
+{
+    //GB3 - GB5
+    if (before == TEXT_GRAPHEME_CR && after == TEXT_GRAPHEME_LF) {
+        return false;
+    }
+    if (grapheme_is_control(before) || grapheme_is_control(after)) {
+        return true;
+    }
+
+    //GB6 - GB8, jamo join into syllables
+    if (before == TEXT_GRAPHEME_L && (after == TEXT_GRAPHEME_L || after == TEXT_GRAPHEME_V ||
+        after == TEXT_GRAPHEME_LV || after == TEXT_GRAPHEME_LVT)) {
+        return false;
+    }
+    if ((before == TEXT_GRAPHEME_LV || before == TEXT_GRAPHEME_V) && (after == TEXT_GRAPHEME_V || after == TEXT_GRAPHEME_T)) {
+        return false;
+    }
+    if ((before == TEXT_GRAPHEME_LVT || before == TEXT_GRAPHEME_T) && after == TEXT_GRAPHEME_T) {
+        return false;
+    }
+
+    //GB9 - GB9b
+    if (after == TEXT_GRAPHEME_EXTEND || after == TEXT_GRAPHEME_ZWJ || after == TEXT_GRAPHEME_SPACING_MARK) {
+        return false;
+    }
+    if (before == TEXT_GRAPHEME_PREPEND) {
+        return false;
+    }
+
+    //GB11, emoji joined with ZWJ
+    if (before == TEXT_GRAPHEME_ZWJ && after == TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC && after_pictographic) {
+        return false;
+    }
+
+    //GB12 - GB13, regional indicators pair up into flags
+    if (before == TEXT_GRAPHEME_REGIONAL_INDICATOR && after == TEXT_GRAPHEME_REGIONAL_INDICATOR) {
+        return !odd_regional_indicators;
+    }
+
+    return true;
+}
+
+void text_grapheme_iterator_init(TextGraphemeIterator* it, UTFStringView sv, size_t byte_offset, size_t char_offset)
+{
+    it->sv = sv;
+    it->byte_offset = byte_offset;
+    it->char_offset = char_offset;
+}
+
+bool text_grapheme_iterator_next(TextGraphemeIterator* it)
+{
+    UTFIterator next = utf_iter_at(it->sv, it->byte_offset, it->char_offset);
+    UTFChar c;
+    if (!utf_iter_next(&next, &c)) {
+        return false;
+    }
+
+    //state only goes back to the start of the cluster, which is a boundary
+    TextGraphemeProperty before = text_grapheme_property(c.codepoint);
+    bool in_pictographic = before == TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC;
+    bool odd_regional_indicators = before == TEXT_GRAPHEME_REGIONAL_INDICATOR;
+    UTFIterator end = next;
+
+    while (utf_iter_next(&next, &c)) {
+        TextGraphemeProperty after = text_grapheme_property(c.codepoint);
+        bool after_pictographic = before == TEXT_GRAPHEME_ZWJ && in_pictographic;
+        if (grapheme_is_break(before, after, after_pictographic, odd_regional_indicators)) {
+            break;
+        }
+
+        if (after == TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC) {
+            in_pictographic = true;
+        }
+        else if (after != TEXT_GRAPHEME_EXTEND && !(after == TEXT_GRAPHEME_ZWJ && before != TEXT_GRAPHEME_ZWJ)) {
+            in_pictographic = false;
+        }
+        odd_regional_indicators = after == TEXT_GRAPHEME_REGIONAL_INDICATOR && !odd_regional_indicators;
+
+        before = after;
+        end = next;
+    }
+
+    it->byte_offset = end.byte_offset;
+    it->char_offset = end.index;
+    return true;
+}
+
+size_t text_grapheme_next(UTFStringView sv, size_t byte_offset, size_t* char_count)
+{
+    TextGraphemeIterator it;
+    text_grapheme_iterator_init(&it, sv, byte_offset, 0);
+    text_grapheme_iterator_next(&it);
+    if (char_count) {
+        *char_count = it.char_offset;
+    }
+    return it.byte_offset;
+}
+
+//whether there is a boundary between before and after, before_it is where before starts
+//looks further back only for emoji sequences and regional indicators
+static bool grapheme_is_break_between(UTFIterator before_it, TextGraphemeProperty before, TextGraphemeProperty after)
+{
+    UTFChar c;
+
+    bool after_pictographic = false;
+    if (before == TEXT_GRAPHEME_ZWJ && after == TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC) {
+        while (utf_iter_prev(&before_it, &c)) {
+            TextGraphemeProperty property = text_grapheme_property(c.codepoint);
+            if (property != TEXT_GRAPHEME_EXTEND) {
+                after_pictographic = property == TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC;
+                break;
+            }
+        }
+    }
+
+    bool odd_regional_indicators = false;
+    if (before == TEXT_GRAPHEME_REGIONAL_INDICATOR && after == TEXT_GRAPHEME_REGIONAL_INDICATOR) {
+        odd_regional_indicators = true;
+        while (utf_iter_prev(&before_it, &c) && text_grapheme_property(c.codepoint) == TEXT_GRAPHEME_REGIONAL_INDICATOR) {
+            odd_regional_indicators = !odd_regional_indicators;
+        }
+    }
+
+    return grapheme_is_break(before, after, after_pictographic, odd_regional_indicators);
+}
+
+size_t text_grapheme_prev(UTFStringView sv, size_t byte_offset, size_t* char_count)
+{
+    size_t pos = byte_offset < sv.data_size ? byte_offset : sv.data_size;
+    //index only tells how far it went, there are never more characters than bytes before pos
+    UTFIterator it = utf_iter_at(sv, pos, pos);
+    UTFChar c;
+
+    if (utf_iter_prev(&it, &c)) {
+        TextGraphemeProperty after = text_grapheme_property(c.codepoint);
+        UTFIterator before_it = it;
+        while (utf_iter_prev(&before_it, &c)) {
+            TextGraphemeProperty before = text_grapheme_property(c.codepoint);
+            if (grapheme_is_break_between(before_it, before, after)) {
+                break;
+            }
+            it = before_it;
+            after = before;
+        }
+    }
+
+    if (char_count) {
+        *char_count = pos - it.index;
+    }
+    return it.byte_offset;
+}
+
+//clusters of the string, as byte offsets where they end, end with SIZE_MAX
+static void grapheme_test_clusters(const char* str, const size_t* ends)
+{
+    UTFStringView sv = utf_sv_from_cstr(str);
+
+    TextGraphemeIterator it;
+    text_grapheme_iterator_init(&it, sv, 0, 0);
+    size_t i = 0;
+    while (text_grapheme_iterator_next(&it)) {
+        assert(it.byte_offset == ends[i]);
+        assert(it.char_offset == utf_sv_count(utf_sv_sub_sv_bytes(sv, 0, it.byte_offset)));
+        i++;
+    }
+    assert(ends[i] == SIZE_MAX);
+
+    //going back stops at the same places
+    size_t pos = sv.data_size;
+    while (i > 0) {
+        size_t count = 0;
+        size_t prev = text_grapheme_prev(sv, pos, &count);
+        i--;
+        assert(prev == (i > 0 ? ends[i - 1] : 0));
+        assert(count == utf_sv_count(utf_sv_sub_sv_bytes(sv, prev, pos)));
+        pos = prev;
+    }
+}
+
+void text_grapheme_test()
+{
+    assert(text_grapheme_property('a') == TEXT_GRAPHEME_OTHER);
+    assert(text_grapheme_property('\r') == TEXT_GRAPHEME_CR);
+    assert(text_grapheme_property(0x0301) == TEXT_GRAPHEME_EXTEND);
+    assert(text_grapheme_property(0xAC00) == TEXT_GRAPHEME_LV);
+    assert(text_grapheme_property(0xAC01) == TEXT_GRAPHEME_LVT);
+    assert(text_grapheme_property(0xD7A3) == TEXT_GRAPHEME_LVT);
+    assert(text_grapheme_property(0x1F600) == TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC);
+    assert(text_grapheme_property(0x1F1F0) == TEXT_GRAPHEME_REGIONAL_INDICATOR);
+    assert(text_grapheme_property(0x10FFFF) == TEXT_GRAPHEME_OTHER);
+
+    //ranges have to be in order to be put in the table
+    for (size_t i = 1; i < GRAPHEME_RANGE_COUNT; i++) {
+        assert(GRAPHEME_RANGES[i - 1].last < GRAPHEME_RANGES[i].first);
+    }
+    {
+        //every code point
+        size_t ends[] = {1, 2, 3, SIZE_MAX};
+        grapheme_test_clusters("abc", ends);
+    }
+    {
+        //e with a combining acute, then \r\n as one
+        size_t ends[] = {3, 5, 6, SIZE_MAX};
+        grapheme_test_clusters("e\xcc\x81\r\nx", ends);
+    }
+    {
+        //"한" as jamo(L V T) and as a syllable with a T after it
+        size_t ends[] = {9, 15, SIZE_MAX};
+        grapheme_test_clusters("\xe1\x84\x92\xe1\x85\xa1\xe1\x86\xab" "\xed\x95\x98\xe1\x86\xab", ends);
+    }
+    {
+        //family emoji(man ZWJ woman ZWJ girl), then a thumbs up with a skin tone
+        size_t ends[] = {18, 26, SIZE_MAX};
+        grapheme_test_clusters(
+            "\xf0\x9f\x91\xa8\xe2\x80\x8d\xf0\x9f\x91\xa9\xe2\x80\x8d\xf0\x9f\x91\xa7"
+            "\xf0\x9f\x91\x8d\xf0\x9f\x8f\xbd", ends);
+    }
+    {
+        //three regional indicators are a flag and a lone one
+        size_t ends[] = {8, 12, SIZE_MAX};
+        grapheme_test_clusters("\xf0\x9f\x87\xb0\xf0\x9f\x87\xb7\xf0\x9f\x87\xaf", ends);
+    }
+    {
+        //ZWJ after a letter doesn't join the emoji after it
+        size_t ends[] = {4, 8, SIZE_MAX};
+        grapheme_test_clusters("a\xe2\x80\x8d\xf0\x9f\x98\x80", ends);
+    }
+}
+
+//Steps through lines of decomposed Hangul, accented Latin and emoji
+//cluster by cluster and code point by code point
+void text_grapheme_benchmark()
+{
+    const char* pieces[] = {
+        "plain ascii text ",
+        "cafe\xcc\x81 ",
+        "\xe1\x84\x92\xe1\x85\xa1\xe1\x86\xab\xe1\x84\x80\xe1\x85\xb3\xe1\x86\xaf ",
+        "\xed\x95\x9c\xea\xb8\x80 ",
+        "\xf0\x9f\x91\xa8\xe2\x80\x8d\xf0\x9f\x91\xa9\xe2\x80\x8d\xf0\x9f\x91\xa7 ",
+        "\xf0\x9f\x87\xb0\xf0\x9f\x87\xb7 ",
+    };
+    size_t piece_count = sizeof(pieces) / sizeof(pieces[0]);
+
+    size_t line_size = 4 * 1024;
+    size_t line_count = 4 * 1024;
+    size_t total_size = line_size * line_count;
+    char* data = malloc(total_size + 64);
+    size_t size = 0;
+    for (size_t i = 0; size < total_size; i++) {
+        const char* piece = pieces[i % piece_count];
+        size_t piece_size = strlen(piece);
+        memcpy(data + size, piece, piece_size);
+        size += piece_size;
+    }
+
+    clock_t start = clock();
+    size_t code_point_count = 0;
+    for (size_t line = 0; line < line_count; line++) {
+        UTFStringView sv = {.data = data + line * line_size, .data_size = line_size};
+        for (size_t pos = 0; pos < sv.data_size; pos = utf_sv_next(sv, pos)) {
+            code_point_count++;
+        }
+    }
+    double code_point_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    start = clock();
+    size_t cluster_count = 0;
+    for (size_t line = 0; line < line_count; line++) {
+        UTFStringView sv = {.data = data + line * line_size, .data_size = line_size};
+        TextGraphemeIterator it;
+        text_grapheme_iterator_init(&it, sv, 0, 0);
+        while (text_grapheme_iterator_next(&it)) {
+            cluster_count++;
+        }
+    }
+    double cluster_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    start = clock();
+    size_t back_count = 0;
+    for (size_t line = 0; line < line_count; line++) {
+        UTFStringView sv = {.data = data + line * line_size, .data_size = line_size};
+        for (size_t pos = sv.data_size; pos > 0; pos = text_grapheme_prev(sv, pos, NULL)) {
+            back_count++;
+        }
+    }
+    double back_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    double mb = (double)total_size / (1024 * 1024);
+    printf("grapheme benchmark, %zu lines of %zu bytes\n", line_count, line_size);
+    printf("code point steps      : %.3f s, %.0f MB/s, %zu steps\n", code_point_time, mb / code_point_time, code_point_count);
+    printf("cluster steps forward : %.3f s, %.0f MB/s, %zu steps\n", cluster_time, mb / cluster_time, cluster_count);
+    printf("cluster steps back    : %.3f s, %.0f MB/s, %zu steps\n", back_time, mb / back_time, back_count);
+
+    free(data);
+}
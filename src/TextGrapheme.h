@@ -0,0 +1,56 @@
+#ifndef TextGrapheme_HEADER_GUARD
+#define TextGrapheme_HEADER_GUARD
+
+#include "UTFString.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Grapheme clusters, what a user sees as one character (UAX #29 extended grapheme clusters)
+//
+// A base character with its combining marks, a Hangul syllable written as jamo,
+// an emoji sequence joined with ZWJ or a pair of regional indicators(a flag)
+// is one cluster, so the cursor moves over it and backspace deletes it as a whole.
+// Properties of code points are looked up in a two-stage table generated from
+// a list of ranges the first time it's needed
+typedef enum TextGraphemeProperty {
+    TEXT_GRAPHEME_OTHER,
+    TEXT_GRAPHEME_CR,
+    TEXT_GRAPHEME_LF,
+    TEXT_GRAPHEME_CONTROL,
+    TEXT_GRAPHEME_EXTEND,
+    TEXT_GRAPHEME_ZWJ,
+    TEXT_GRAPHEME_REGIONAL_INDICATOR,
+    TEXT_GRAPHEME_PREPEND,
+    TEXT_GRAPHEME_SPACING_MARK,
+    TEXT_GRAPHEME_L,
+    TEXT_GRAPHEME_V,
+    TEXT_GRAPHEME_T,
+    TEXT_GRAPHEME_LV,
+    TEXT_GRAPHEME_LVT,
+    TEXT_GRAPHEME_EXTENDED_PICTOGRAPHIC,
+} TextGraphemeProperty;
+
+TextGraphemeProperty text_grapheme_property(uint32_t codepoint);
+
+// Goes over the clusters of a string from a cluster boundary, decoding only the cluster it's on
+typedef struct TextGraphemeIterator {
+    UTFStringView sv;
+    //where the next cluster starts
+    size_t byte_offset;
+    size_t char_offset;
+} TextGraphemeIterator;
+
+void text_grapheme_iterator_init(TextGraphemeIterator* it, UTFStringView sv, size_t byte_offset, size_t char_offset);
+//moves over the next cluster, returns false at the end of the string
+bool text_grapheme_iterator_next(TextGraphemeIterator* it);
+
+//byte offset of where the cluster after byte_offset ends, char_count is set to its characters
+size_t text_grapheme_next(UTFStringView sv, size_t byte_offset, size_t* char_count);
+//byte offset of where the cluster before byte_offset starts, char_count is set to its characters
+size_t text_grapheme_prev(UTFStringView sv, size_t byte_offset, size_t* char_count);
+
+void text_grapheme_test();
+void text_grapheme_benchmark();
+
+#endif
@@ -0,0 +1,333 @@
+#include "TextIndexCache.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <stdint.h>
+
+#define INDEX_CACHE_MAGIC "TXLIDX01"
+#define INDEX_CACHE_MAGIC_SIZE 8
+//magic, file size, modified time, file hash and line count
+#define INDEX_CACHE_HEADER_SIZE (INDEX_CACHE_MAGIC_SIZE + 8 * 4)
+
+//file is hashed only at its start and end, size and time catch the rest
+#define INDEX_CACHE_HASH_SPAN (64 * 1024)
+
+//characters are counted and written this many lines at a time
+#define INDEX_CACHE_COUNT_CHUNK (64 * 1024)
+
+struct TextIndexCache {
+    OS_FileMapping* mapping;
+
+    const size_t* line_starts;
+    const uint32_t* char_counts;
+    size_t line_count;
+};
+
+static uint64_t index_cache_hash_bytes(uint64_t hash, const char* data, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static uint64_t index_cache_file_hash(const char* data, size_t size)
+{
+    uint64_t hash = 14695981039346656037ull;
+    if (size <= INDEX_CACHE_HASH_SPAN * 2) {
+        return index_cache_hash_bytes(hash, data, size);
+    }
+    hash = index_cache_hash_bytes(hash, data, INDEX_CACHE_HASH_SPAN);
+    return index_cache_hash_bytes(hash, data + size - INDEX_CACHE_HASH_SPAN, INDEX_CACHE_HASH_SPAN);
+}
+
+static uint64_t index_cache_get_u64(const char* from)
+{
+    uint64_t value;
+    memcpy(&value, from, sizeof(value));
+    return value;
+}
+
+static void index_cache_write_header(char* header, const char* data, size_t size, OS_FileStamp stamp, size_t line_count)
+{
+    uint64_t values[] = {size, stamp.modified_time, index_cache_file_hash(data, size), line_count};
+    memcpy(header, INDEX_CACHE_MAGIC, INDEX_CACHE_MAGIC_SIZE);
+    memcpy(header + INDEX_CACHE_MAGIC_SIZE, values, sizeof(values));
+}
+
+TextIndexCache* text_index_cache_open(const char* path, const char* data, size_t size, OS_FileStamp stamp)
+{
+    //line starts are used as size_t without copying them
+    if (sizeof(size_t) != sizeof(uint64_t)) {
+        return NULL;
+    }
+
+    //most files don't have one and mapping would complain about it
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    fclose(file);
+
+    OS_FileMapping* mapping = os_map_file(path);
+    if (!mapping) {
+        return NULL;
+    }
+
+    const char* cache_data = os_file_mapping_data(mapping);
+    size_t cache_size = os_file_mapping_size(mapping);
+
+    if (cache_size < INDEX_CACHE_HEADER_SIZE || memcmp(cache_data, INDEX_CACHE_MAGIC, INDEX_CACHE_MAGIC_SIZE) != 0) {
+        os_unmap_file(mapping);
+        return NULL;
+    }
+
+    const char* values = cache_data + INDEX_CACHE_MAGIC_SIZE;
+    uint64_t line_count = index_cache_get_u64(values + 24);
+    bool is_valid =
+        index_cache_get_u64(values) == size &&
+        index_cache_get_u64(values + 8) == stamp.modified_time &&
+        line_count > 0 &&
+        line_count <= (cache_size - INDEX_CACHE_HEADER_SIZE) / 12 &&
+        cache_size == INDEX_CACHE_HEADER_SIZE + line_count * 12 &&
+        index_cache_get_u64(values + 16) == index_cache_file_hash(data, size);
+
+    if (!is_valid) {
+        os_unmap_file(mapping);
+        return NULL;
+    }
+
+    //lines are only checked at the ends, checking all of them would read the whole cache
+    const size_t* line_starts = (const size_t*)(cache_data + INDEX_CACHE_HEADER_SIZE);
+    if (line_starts[0] != 0 || line_starts[line_count - 1] > size) {
+        os_unmap_file(mapping);
+        return NULL;
+    }
+
+    TextIndexCache* cache = malloc(sizeof(TextIndexCache));
+    cache->mapping = mapping;
+    cache->line_starts = line_starts;
+    cache->char_counts = (const uint32_t*)(cache_data + INDEX_CACHE_HEADER_SIZE + line_count * 8);
+    cache->line_count = line_count;
+    return cache;
+}
+
+void text_index_cache_close(TextIndexCache* cache)
+{
+    os_unmap_file(cache->mapping);
+    free(cache);
+}
+
+void text_index_cache_get_index(TextIndexCache* cache, TextLineIndex* index, const char* data, size_t size)
+{
+    text_line_index_init_borrowed(index, data, size, cache->line_starts, cache->char_counts, cache->line_count);
+}
+
+struct TextIndexCacheJob {
+    char* path;
+    const TextLineIndex* index;
+    OS_FileStamp stamp;
+
+    OS_Thread* thread;
+    OS_Mutex* mutex;
+
+    //below are guarded by the mutex
+    bool is_cancelled;
+    bool is_done;
+    bool success;
+};
+
+static bool index_cache_job_is_cancelled(TextIndexCacheJob* job)
+{
+    os_mutex_lock(job->mutex);
+    bool is_cancelled = job->is_cancelled;
+    os_mutex_unlock(job->mutex);
+    return is_cancelled;
+}
+
+static bool index_cache_job_write(TextIndexCacheJob* job, OS_FileWriter* writer)
+{
+    //index only reads the data, so it's fine to go through it from here
+    TextLineIndex* index = (TextLineIndex*)job->index;
+
+    char header[INDEX_CACHE_HEADER_SIZE];
+    index_cache_write_header(header, index->data, index->size, job->stamp, index->line_count);
+    OS_WriteBuffer buffers[] = {
+        {.data = header, .size = sizeof(header)},
+        {.data = index->line_starts, .size = index->line_count * sizeof(size_t)},
+    };
+    if (!os_file_writer_write(writer, buffers, 2)) {
+        return false;
+    }
+
+    uint32_t* counts = malloc(INDEX_CACHE_COUNT_CHUNK * sizeof(uint32_t));
+    if (!counts) {
+        return false;
+    }
+
+    bool success = true;
+    for (size_t chunk_start = 0; chunk_start < index->line_count && success; chunk_start += INDEX_CACHE_COUNT_CHUNK) {
+        if (index_cache_job_is_cancelled(job)) {
+            success = false;
+            break;
+        }
+
+        size_t chunk_size = index->line_count - chunk_start;
+        if (chunk_size > INDEX_CACHE_COUNT_CHUNK) {
+            chunk_size = INDEX_CACHE_COUNT_CHUNK;
+        }
+        for (size_t i = 0; i < chunk_size; i++) {
+            UTFStringView sv = {0};
+            bool ends_with_lf = false;
+            bool ends_with_crlf = false;
+            text_line_index_get_line(index, chunk_start + i, &sv.data, &sv.data_size, &ends_with_lf, &ends_with_crlf);
+            size_t count = utf_sv_count(sv);
+            counts[i] = count < UINT32_MAX ? (uint32_t)count : UINT32_MAX;
+        }
+
+        OS_WriteBuffer buffer = {.data = counts, .size = chunk_size * sizeof(uint32_t)};
+        success = os_file_writer_write(writer, &buffer, 1);
+    }
+
+    free(counts);
+    return success;
+}
+
+static void index_cache_job_worker(void* data)
+{
+    TextIndexCacheJob* job = data;
+
+    bool success = false;
+    OS_FileWriter* writer = os_file_writer_create(job->path);
+    if (writer) {
+        if (index_cache_job_write(job, writer)) {
+            success = os_file_writer_commit(writer);
+        }
+        else {
+            os_file_writer_abort(writer);
+        }
+    }
+
+    os_mutex_lock(job->mutex);
+    job->is_done = true;
+    job->success = success;
+    os_mutex_unlock(job->mutex);
+}
+
+TextIndexCacheJob* text_index_cache_job_start(const char* path, const TextLineIndex* index, OS_FileStamp stamp)
+{
+    assert(index->is_finished);
+    if (sizeof(size_t) != sizeof(uint64_t)) {
+        return NULL;
+    }
+
+    TextIndexCacheJob* job = calloc(1, sizeof(TextIndexCacheJob));
+    if (!job) {
+        return NULL;
+    }
+
+    job->path = malloc(strlen(path) + 1);
+    strcpy(job->path, path);
+    job->index = index;
+    job->stamp = stamp;
+
+    job->mutex = os_mutex_create();
+    if (!job->mutex) {
+        free(job->path);
+        free(job);
+        return NULL;
+    }
+
+    job->thread = os_thread_create(index_cache_job_worker, job);
+    if (!job->thread) {
+        os_mutex_destroy(job->mutex);
+        free(job->path);
+        free(job);
+        return NULL;
+    }
+
+    return job;
+}
+
+bool text_index_cache_job_poll(TextIndexCacheJob* job, bool* success)
+{
+    os_mutex_lock(job->mutex);
+    bool is_done = job->is_done;
+    if (success) {
+        *success = job->success;
+    }
+    os_mutex_unlock(job->mutex);
+    return is_done;
+}
+
+void text_index_cache_job_destroy(TextIndexCacheJob* job)
+{
+    os_mutex_lock(job->mutex);
+    job->is_cancelled = true;
+    os_mutex_unlock(job->mutex);
+
+    os_thread_join(job->thread);
+    os_mutex_destroy(job->mutex);
+
+    free(job->path);
+    free(job);
+}
+
+bool text_index_cache_test()
+{
+    char path[1024];
+    if (!os_create_temp_file("text_index_cache_test", path, sizeof(path))) {
+        return false;
+    }
+    const char* data = u8"first\r\n둘째 줄\n\nlast";
+    size_t size = strlen(data);
+    OS_FileStamp stamp = {.modified_time = 1234, .size = size};
+
+    //empty file is not a cache
+    assert(text_index_cache_open(path, data, size, stamp) == NULL);
+
+    TextLineIndex built;
+    assert(text_line_index_build(&built, data, size));
+
+    bool success = false;
+    TextIndexCacheJob* job = text_index_cache_job_start(path, &built, stamp);
+    if (job) {
+        while (!text_index_cache_job_poll(job, &success)) {
+            os_sleep(0.001);
+        }
+        text_index_cache_job_destroy(job);
+    }
+    if (!success) {
+        text_line_index_destroy(&built);
+        remove(path);
+        return false;
+    }
+
+    {
+        TextIndexCache* cache = text_index_cache_open(path, data, size, stamp);
+        assert(cache);
+
+        TextLineIndex index;
+        text_index_cache_get_index(cache, &index, data, size);
+        assert(index.is_finished && index.line_count == 4);
+        assert(memcmp(index.line_starts, built.line_starts, 4 * sizeof(size_t)) == 0);
+        assert(index.char_counts[0] == 5 && index.char_counts[1] == 4);
+        assert(index.char_counts[2] == 0 && index.char_counts[3] == 4);
+
+        text_line_index_destroy(&index);
+        text_index_cache_close(cache);
+    }
+
+    //cache of the file as it was before is not used
+    OS_FileStamp newer = stamp;
+    newer.modified_time++;
+    assert(text_index_cache_open(path, data, size, newer) == NULL);
+    assert(text_index_cache_open(path, u8"first\r\n둘째 줄\n\nLAST", size, stamp) == NULL);
+    assert(text_index_cache_open(path, data, size - 1, stamp) == NULL);
+
+    text_line_index_destroy(&built);
+    remove(path);
+    return true;
+}
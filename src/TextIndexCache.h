@@ -0,0 +1,39 @@
+#ifndef TextIndexCache_HEADER_GUARD
+#define TextIndexCache_HEADER_GUARD
+
+#include "TextLine.h"
+#include "OS.h"
+#include <stdbool.h>
+
+// Line index of a file kept in a file next to it, so a big file isn't split again every time it's opened
+//
+// Cache is a header, where every line starts(u64) and how many characters every line has(u32).
+// It's mapped and the index uses its arrays as they are, so opening with it costs
+// the same no matter how big the file is.
+// Header has the size and the modified time of the file and a hash of its start and end,
+// cache that doesn't match the file is ignored(and written again)
+typedef struct TextIndexCache TextIndexCache;
+
+//returns NULL if there is no cache for the file as it is now
+TextIndexCache* text_index_cache_open(const char* path, const char* data, size_t size, OS_FileStamp stamp);
+//index that uses the cache has to be destroyed first
+void text_index_cache_close(TextIndexCache* cache);
+
+//finished index of the file that points into the cache
+void text_index_cache_get_index(TextIndexCache* cache, TextLineIndex* index, const char* data, size_t size);
+
+// Counts characters of every line and writes the cache on a worker thread
+typedef struct TextIndexCacheJob TextIndexCacheJob;
+
+//index has to be finished and stay as it is until the job is destroyed
+//returns NULL if worker couldn't be started
+TextIndexCacheJob* text_index_cache_job_start(const char* path, const TextLineIndex* index, OS_FileStamp stamp);
+//returns true when worker is done and sets success to whether the cache was written
+bool text_index_cache_job_poll(TextIndexCacheJob* job, bool* success);
+//stops writing if it's not done and frees the job
+void text_index_cache_job_destroy(TextIndexCacheJob* job);
+
+//writes to a temporary file, returns false if it couldn't
+bool text_index_cache_test();
+
+#endif
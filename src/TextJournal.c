@@ -0,0 +1,580 @@
+#include "TextJournal.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <stdint.h>
+
+#define JOURNAL_MAGIC "TXJRNL02"
+#define JOURNAL_MAGIC_SIZE 8
+//magic, base size, when the base was written and base hash
+#define JOURNAL_HEADER_SIZE (JOURNAL_MAGIC_SIZE + 8 + 8 + 8)
+
+//payload size and checksum
+#define JOURNAL_RECORD_HEADER_SIZE (4 + 4)
+//type and start position
+#define JOURNAL_RECORD_FIXED_SIZE (1 + 8 + 8)
+
+//base is hashed only at its start and end, so opening a big file doesn't read all of it,
+//a change in the middle is caught by the time the base was written
+#define JOURNAL_BASE_HASH_SPAN (64 * 1024)
+
+#define JOURNAL_DEFAULT_CAPACITY (64 * 1024)
+
+struct TextJournal {
+    OS_AppendFile* file;
+
+    //records that are not handed to the worker yet, only used by the main thread
+    char* pending;
+    size_t pending_size;
+    size_t pending_capacity;
+
+    //records the worker is writing, main thread doesn't touch them while it runs
+    char* committing;
+    size_t committing_size;
+    size_t committing_capacity;
+
+    double last_commit_time;
+
+    //deletes in the journal, including the ones in records it was created with
+    size_t delete_count;
+
+    //records after a failed write would be replayed at wrong places,
+    //so nothing is written after one
+    bool has_failed;
+
+    //NULL while the worker is not running
+    OS_Thread* thread;
+    OS_Mutex* mutex;
+
+    //below are guarded by the mutex
+    bool is_worker_done;
+    bool success;
+};
+
+//numbers are written the way this machine has them,
+//journal is only read back by the same machine
+static void journal_put_u32(char* to, uint32_t value)
+{
+    memcpy(to, &value, sizeof(value));
+}
+
+static void journal_put_u64(char* to, uint64_t value)
+{
+    memcpy(to, &value, sizeof(value));
+}
+
+static uint32_t journal_get_u32(const char* from)
+{
+    uint32_t value;
+    memcpy(&value, from, sizeof(value));
+    return value;
+}
+
+static uint64_t journal_get_u64(const char* from)
+{
+    uint64_t value;
+    memcpy(&value, from, sizeof(value));
+    return value;
+}
+
+//FNV-1a
+static uint32_t journal_checksum(const char* data, size_t size)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static uint64_t journal_hash_bytes(uint64_t hash, const char* data, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static uint64_t journal_base_hash(const char* base, size_t base_size)
+{
+    uint64_t hash = 14695981039346656037ull;
+    if (base_size <= JOURNAL_BASE_HASH_SPAN * 2) {
+        return journal_hash_bytes(hash, base, base_size);
+    }
+    hash = journal_hash_bytes(hash, base, JOURNAL_BASE_HASH_SPAN);
+    return journal_hash_bytes(hash, base + base_size - JOURNAL_BASE_HASH_SPAN, JOURNAL_BASE_HASH_SPAN);
+}
+
+TextJournalBase text_journal_base(const char* data, size_t size, OS_FileStamp stamp)
+{
+    TextJournalBase base = {
+        .size = size,
+        .modified_time = stamp.modified_time,
+        .hash = journal_base_hash(data, size)
+    };
+    return base;
+}
+
+static void journal_write_header(char* header, TextJournalBase base)
+{
+    memcpy(header, JOURNAL_MAGIC, JOURNAL_MAGIC_SIZE);
+    journal_put_u64(header + JOURNAL_MAGIC_SIZE, base.size);
+    journal_put_u64(header + JOURNAL_MAGIC_SIZE + 8, base.modified_time);
+    journal_put_u64(header + JOURNAL_MAGIC_SIZE + 16, base.hash);
+}
+
+TextJournal* text_journal_create(const char* path, TextJournalBase base, const char* records, size_t records_size)
+{
+    //header and the records that are kept replace the old journal at once,
+    //so a crash here leaves either the old journal or the new one
+    char header[JOURNAL_HEADER_SIZE];
+    journal_write_header(header, base);
+
+    OS_FileWriter* writer = os_file_writer_create(path);
+    if (!writer) {
+        return NULL;
+    }
+    OS_WriteBuffer buffers[] = {
+        {.data = header, .size = JOURNAL_HEADER_SIZE},
+        {.data = records, .size = records_size},
+    };
+    if (!os_file_writer_write(writer, buffers, sizeof(buffers) / sizeof(buffers[0]))) {
+        os_file_writer_abort(writer);
+        return NULL;
+    }
+    if (!os_file_writer_commit(writer)) {
+        return NULL;
+    }
+
+    TextJournal* journal = calloc(1, sizeof(TextJournal));
+    if (!journal) {
+        return NULL;
+    }
+
+    journal->file = os_append_file_open(path);
+    if (!journal->file) {
+        free(journal);
+        return NULL;
+    }
+
+    journal->mutex = os_mutex_create();
+    if (!journal->mutex) {
+        os_append_file_close(journal->file);
+        free(journal);
+        return NULL;
+    }
+
+    journal->last_commit_time = os_get_time();
+
+    //restores of new records count deletes from the start of the journal
+    TextJournalReader reader = {.data = records, .size = records_size, .position = 0};
+    TextJournalRecord record;
+    while (records_size > 0 && text_journal_read(&reader, &record)) {
+        journal->delete_count += record.type == TEXT_JOURNAL_DELETE;
+    }
+
+    return journal;
+}
+
+static bool journal_write(TextJournal* journal, const char* data, size_t size)
+{
+    return os_append_file_write(journal->file, data, size) && os_append_file_sync(journal->file);
+}
+
+static void journal_worker(void* data)
+{
+    TextJournal* journal = data;
+
+    //every record since the last commit goes to the disk with one flush
+    bool success = journal_write(journal, journal->committing, journal->committing_size);
+
+    os_mutex_lock(journal->mutex);
+    journal->is_worker_done = true;
+    journal->success = success;
+    os_mutex_unlock(journal->mutex);
+}
+
+//waits for the worker if it's running
+static void journal_join_worker(TextJournal* journal)
+{
+    if (!journal->thread) {
+        return;
+    }
+
+    os_thread_join(journal->thread);
+    journal->thread = NULL;
+
+    if (!journal->success) {
+        journal->has_failed = true;
+    }
+    journal->committing_size = 0;
+}
+
+void text_journal_destroy(TextJournal* journal)
+{
+    journal_join_worker(journal);
+
+    if (!journal->has_failed && journal->pending_size > 0) {
+        if (!journal_write(journal, journal->pending, journal->pending_size)) {
+            journal->has_failed = true;
+        }
+    }
+    if (journal->has_failed) {
+        fprintf(stderr, "%s:%d:ERROR : Failed to write the journal, edits after the failure are not in it\n", __FILE__, __LINE__);
+    }
+
+    os_append_file_close(journal->file);
+    os_mutex_destroy(journal->mutex);
+
+    free(journal->pending);
+    free(journal->committing);
+    free(journal);
+}
+
+//returns where the record goes in the pending records, NULL if it can't be stored
+static char* journal_reserve(TextJournal* journal, size_t size)
+{
+    if (journal->has_failed) {
+        return NULL;
+    }
+
+    if (journal->pending_size + size > journal->pending_capacity) {
+        size_t new_capacity = journal->pending_capacity ? journal->pending_capacity * 2 : JOURNAL_DEFAULT_CAPACITY;
+        while (new_capacity < journal->pending_size + size) {
+            new_capacity *= 2;
+        }
+        char* new_pending = realloc(journal->pending, new_capacity);
+        if (!new_pending) {
+            journal->has_failed = true;
+            return NULL;
+        }
+        journal->pending = new_pending;
+        journal->pending_capacity = new_capacity;
+    }
+
+    char* record = journal->pending + journal->pending_size;
+    journal->pending_size += size;
+    return record;
+}
+
+//fills in the record header once the payload is written
+static void journal_seal_record(char* record, size_t payload_size)
+{
+    char* payload = record + JOURNAL_RECORD_HEADER_SIZE;
+    journal_put_u32(record, (uint32_t)payload_size);
+    journal_put_u32(record + 4, journal_checksum(payload, payload_size));
+}
+
+static char* journal_put_position(char* to, TextUndoPosition position)
+{
+    journal_put_u64(to, position.line_number);
+    journal_put_u64(to + 8, position.char_offset);
+    return to + 16;
+}
+
+void text_journal_insert(TextJournal* journal, TextUndoPosition start, UTFStringView text)
+{
+    //size of the payload is only 32 bits, journal can't go on without the insert
+    if (text.data_size > UINT32_MAX - JOURNAL_RECORD_FIXED_SIZE) {
+        journal->has_failed = true;
+        return;
+    }
+
+    size_t payload_size = JOURNAL_RECORD_FIXED_SIZE + text.data_size;
+    char* record = journal_reserve(journal, JOURNAL_RECORD_HEADER_SIZE + payload_size);
+    if (!record) {
+        return;
+    }
+
+    char* payload = record + JOURNAL_RECORD_HEADER_SIZE;
+    payload[0] = TEXT_JOURNAL_INSERT;
+    char* text_start = journal_put_position(payload + 1, start);
+    memcpy(text_start, text.data, text.data_size);
+
+    journal_seal_record(record, payload_size);
+}
+
+size_t text_journal_delete(TextJournal* journal, TextUndoPosition start, TextUndoPosition end)
+{
+    size_t payload_size = JOURNAL_RECORD_FIXED_SIZE + 16;
+    char* record = journal_reserve(journal, JOURNAL_RECORD_HEADER_SIZE + payload_size);
+    if (!record) {
+        return SIZE_MAX;
+    }
+
+    char* payload = record + JOURNAL_RECORD_HEADER_SIZE;
+    payload[0] = TEXT_JOURNAL_DELETE;
+    journal_put_position(journal_put_position(payload + 1, start), end);
+
+    journal_seal_record(record, payload_size);
+    return journal->delete_count++;
+}
+
+void text_journal_restore(TextJournal* journal, TextUndoPosition start, size_t delete_number)
+{
+    size_t payload_size = JOURNAL_RECORD_FIXED_SIZE + 8;
+    char* record = journal_reserve(journal, JOURNAL_RECORD_HEADER_SIZE + payload_size);
+    if (!record) {
+        return;
+    }
+
+    char* payload = record + JOURNAL_RECORD_HEADER_SIZE;
+    payload[0] = TEXT_JOURNAL_RESTORE;
+    journal_put_u64(journal_put_position(payload + 1, start), delete_number);
+
+    journal_seal_record(record, payload_size);
+}
+
+bool text_journal_poll(TextJournal* journal)
+{
+    if (journal->thread) {
+        os_mutex_lock(journal->mutex);
+        bool is_worker_done = journal->is_worker_done;
+        os_mutex_unlock(journal->mutex);
+        if (!is_worker_done) {
+            return true;
+        }
+
+        journal_join_worker(journal);
+        if (journal->has_failed) {
+            fprintf(stderr, "%s:%d:ERROR : Failed to write the journal, edits after this are not in it\n", __FILE__, __LINE__);
+        }
+    }
+
+    if (journal->has_failed || journal->pending_size == 0) {
+        return false;
+    }
+
+    double now = os_get_time();
+    if (now - journal->last_commit_time < TEXT_JOURNAL_COMMIT_INTERVAL) {
+        return true;
+    }
+    journal->last_commit_time = now;
+
+    //pending records go to the worker and typing goes on in the other buffer
+    char* tmp = journal->committing;
+    size_t tmp_capacity = journal->committing_capacity;
+    journal->committing = journal->pending;
+    journal->committing_size = journal->pending_size;
+    journal->committing_capacity = journal->pending_capacity;
+    journal->pending = tmp;
+    journal->pending_size = 0;
+    journal->pending_capacity = tmp_capacity;
+
+    journal->is_worker_done = false;
+    journal->success = false;
+    journal->thread = os_thread_create(journal_worker, journal);
+    if (!journal->thread) {
+        //without a worker the records are written right here
+        if (!journal_write(journal, journal->committing, journal->committing_size)) {
+            journal->has_failed = true;
+        }
+        journal->committing_size = 0;
+        return false;
+    }
+
+    return true;
+}
+
+bool text_journal_reader_init(TextJournalReader* reader, const char* data, size_t size, TextJournalBase base)
+{
+    reader->data = data;
+    reader->size = size;
+    reader->position = JOURNAL_HEADER_SIZE;
+
+    if (size < JOURNAL_HEADER_SIZE || memcmp(data, JOURNAL_MAGIC, JOURNAL_MAGIC_SIZE) != 0) {
+        return false;
+    }
+    return journal_get_u64(data + JOURNAL_MAGIC_SIZE) == base.size &&
+        journal_get_u64(data + JOURNAL_MAGIC_SIZE + 8) == base.modified_time &&
+        journal_get_u64(data + JOURNAL_MAGIC_SIZE + 16) == base.hash;
+}
+
+static TextUndoPosition journal_get_position(const char* from)
+{
+    TextUndoPosition position = {.line_number = journal_get_u64(from), .char_offset = journal_get_u64(from + 8)};
+    return position;
+}
+
+bool text_journal_read(TextJournalReader* reader, TextJournalRecord* record)
+{
+    size_t left = reader->size - reader->position;
+    if (left < JOURNAL_RECORD_HEADER_SIZE) {
+        return false;
+    }
+
+    const char* header = reader->data + reader->position;
+    size_t payload_size = journal_get_u32(header);
+    if (payload_size < JOURNAL_RECORD_FIXED_SIZE || payload_size > left - JOURNAL_RECORD_HEADER_SIZE) {
+        return false;
+    }
+
+    const char* payload = header + JOURNAL_RECORD_HEADER_SIZE;
+    if (journal_get_u32(header + 4) != journal_checksum(payload, payload_size)) {
+        return false;
+    }
+
+    memset(record, 0, sizeof(TextJournalRecord));
+    record->type = (unsigned char)payload[0];
+    record->start = journal_get_position(payload + 1);
+
+    if (record->type == TEXT_JOURNAL_INSERT) {
+        record->text = payload + JOURNAL_RECORD_FIXED_SIZE;
+        record->text_size = payload_size - JOURNAL_RECORD_FIXED_SIZE;
+    }
+    else if (record->type == TEXT_JOURNAL_DELETE) {
+        if (payload_size != JOURNAL_RECORD_FIXED_SIZE + 16) {
+            return false;
+        }
+        record->end = journal_get_position(payload + JOURNAL_RECORD_FIXED_SIZE);
+    }
+    else if (record->type == TEXT_JOURNAL_RESTORE) {
+        if (payload_size != JOURNAL_RECORD_FIXED_SIZE + 8) {
+            return false;
+        }
+        record->delete_number = journal_get_u64(payload + JOURNAL_RECORD_FIXED_SIZE);
+    }
+    else {
+        return false;
+    }
+
+    reader->position += JOURNAL_RECORD_HEADER_SIZE + payload_size;
+    return true;
+}
+
+const char* text_journal_reader_records(TextJournalReader* reader)
+{
+    return reader->data + JOURNAL_HEADER_SIZE;
+}
+
+size_t text_journal_reader_records_size(TextJournalReader* reader)
+{
+    return reader->position - JOURNAL_HEADER_SIZE;
+}
+
+bool text_journal_test()
+{
+    char path[1024];
+    if (!os_create_temp_file("text_journal_test", path, sizeof(path))) {
+        return false;
+    }
+    const char* base_text = "first\nsecond\n";
+    OS_FileStamp stamp = {.modified_time = 1234, .size = strlen(base_text)};
+    TextJournalBase base = text_journal_base(base_text, stamp.size, stamp);
+
+    TextUndoPosition start = {.line_number = 1, .char_offset = 2};
+    TextUndoPosition end = {.line_number = 3, .char_offset = 0};
+
+    {
+        TextJournal* journal = text_journal_create(path, base, NULL, 0);
+        if (!journal) {
+            remove(path);
+            return false;
+        }
+        text_journal_insert(journal, start, utf_sv_from_cstr(u8"ab\n사과"));
+        assert(text_journal_delete(journal, start, end) == 0);
+        //nothing is written until the interval passes, destroy writes the rest
+        text_journal_destroy(journal);
+    }
+    {
+        OS_FileMapping* mapping = os_map_file(path);
+        if (!mapping) {
+            remove(path);
+            return false;
+        }
+        const char* data = os_file_mapping_data(mapping);
+        size_t size = os_file_mapping_size(mapping);
+
+        TextJournalReader reader;
+        OS_FileStamp other_stamp = {.modified_time = stamp.modified_time, .size = 6};
+        assert(!text_journal_reader_init(&reader, data, size, text_journal_base("other\n", 6, other_stamp)));
+        //base of the same size changed where it isn't hashed, or written again with the same text
+        OS_FileStamp later = {.modified_time = stamp.modified_time + 1, .size = stamp.size};
+        assert(!text_journal_reader_init(&reader, data, size, text_journal_base(base_text, stamp.size, later)));
+        assert(text_journal_reader_init(&reader, data, size, base));
+
+        TextJournalRecord record;
+        assert(text_journal_read(&reader, &record));
+        assert(record.type == TEXT_JOURNAL_INSERT);
+        assert(record.start.line_number == 1 && record.start.char_offset == 2);
+        assert(record.text_size == strlen(u8"ab\n사과") && memcmp(record.text, u8"ab\n사과", record.text_size) == 0);
+
+        assert(text_journal_read(&reader, &record));
+        assert(record.type == TEXT_JOURNAL_DELETE);
+        assert(record.end.line_number == 3 && record.end.char_offset == 0);
+
+        assert(!text_journal_read(&reader, &record));
+        assert(reader.position == size);
+
+        //record cut in half by a crash ends the journal
+        for (size_t cut = 1; cut < 8; cut++) {
+            assert(text_journal_reader_init(&reader, data, size - cut, base));
+            assert(text_journal_read(&reader, &record));
+            assert(!text_journal_read(&reader, &record));
+        }
+
+        //so does a corrupted one, mapping is read only so it's corrupted in a copy
+        //which also lets the journal be replaced below, it can't be while it's mapped on every OS
+        char* corrupted = malloc(size);
+        memcpy(corrupted, data, size);
+        corrupted[size - 1] ^= 1;
+        os_unmap_file(mapping);
+        assert(text_journal_reader_init(&reader, corrupted, size, base));
+        assert(text_journal_read(&reader, &record));
+        assert(!text_journal_read(&reader, &record));
+
+        //records that were read are kept in the new journal, then it goes on from there
+        TextJournal* journal = text_journal_create(path, base,
+            text_journal_reader_records(&reader), text_journal_reader_records_size(&reader));
+        free(corrupted);
+        if (!journal) {
+            remove(path);
+            return false;
+        }
+        //kept insert is not a delete, so this is the first one
+        assert(text_journal_delete(journal, start, end) == 0);
+        text_journal_restore(journal, start, 0);
+        while (text_journal_poll(journal)) {
+        }
+        text_journal_destroy(journal);
+    }
+    {
+        OS_FileMapping* mapping = os_map_file(path);
+        if (!mapping) {
+            remove(path);
+            return false;
+        }
+        size_t size = os_file_mapping_size(mapping);
+        //copied so the journal can be replaced below
+        char* data = malloc(size);
+        memcpy(data, os_file_mapping_data(mapping), size);
+        os_unmap_file(mapping);
+
+        TextJournalReader reader;
+        assert(text_journal_reader_init(&reader, data, size, base));
+        TextJournalRecord record;
+        assert(text_journal_read(&reader, &record) && record.type == TEXT_JOURNAL_INSERT);
+        assert(text_journal_read(&reader, &record) && record.type == TEXT_JOURNAL_DELETE);
+        assert(text_journal_read(&reader, &record) && record.type == TEXT_JOURNAL_RESTORE);
+        assert(record.start.line_number == 1 && record.start.char_offset == 2 && record.delete_number == 0);
+        assert(!text_journal_read(&reader, &record));
+        assert(reader.position == size);
+
+        //deletes in the kept records are counted
+        TextJournal* journal = text_journal_create(path, base,
+            text_journal_reader_records(&reader), text_journal_reader_records_size(&reader));
+        free(data);
+        if (!journal) {
+            remove(path);
+            return false;
+        }
+        assert(text_journal_delete(journal, start, end) == 1);
+        text_journal_destroy(journal);
+    }
+
+    remove(path);
+    return true;
+}
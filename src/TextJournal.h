@@ -0,0 +1,97 @@
+#ifndef TextJournal_HEADER_GUARD
+#define TextJournal_HEADER_GUARD
+
+#include "UTFString.h"
+#include "TextUndo.h"
+#include "OS.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum TextJournalType {
+    TEXT_JOURNAL_INSERT = 1,
+    TEXT_JOURNAL_DELETE = 2,
+    //puts back the text a delete took out, like undo does, so the text isn't written again
+    TEXT_JOURNAL_RESTORE = 3,
+} TextJournalType;
+
+// An edit as it was done to the document
+typedef struct TextJournalRecord {
+    TextJournalType type;
+
+    TextUndoPosition start;
+    //only for deletes
+    TextUndoPosition end;
+
+    //only for inserts, points into the journal data
+    const char* text;
+    size_t text_size;
+
+    //only for restores, which delete of the journal took the text out, counted from 0
+    size_t delete_number;
+} TextJournalRecord;
+
+// Edits since the file was last saved, kept on the disk so they survive a crash
+//
+// File starts with a header that tells which file the edits are for(its size, when it was written and a hash),
+// and every edit is appended after it as a record with its own checksum.
+// Records are only put in memory while typing, a worker thread writes them
+// and flushes the file to the disk at most every TEXT_JOURNAL_COMMIT_INTERVAL,
+// so a keystroke never waits for the disk and a crash loses at most that much.
+// Record that was cut in half by a crash fails its checksum and ends the journal
+typedef struct TextJournal TextJournal;
+
+//seconds records can wait in memory before they are written
+#define TEXT_JOURNAL_COMMIT_INTERVAL 0.1
+
+// Which file the edits of a journal are for
+typedef struct TextJournalBase {
+    uint64_t size;
+    //when it was written
+    uint64_t modified_time;
+    //of its start and end only, so opening a big file doesn't read all of it
+    uint64_t hash;
+} TextJournalBase;
+
+TextJournalBase text_journal_base(const char* data, size_t size, OS_FileStamp stamp);
+
+//replaces the journal at path with one for the base file, that already has records in it
+//records are bytes that a reader went through, they can be empty
+//returns NULL if the file couldn't be written
+TextJournal* text_journal_create(const char* path, TextJournalBase base, const char* records, size_t records_size);
+//writes what's left, flushes it and frees the journal
+void text_journal_destroy(TextJournal* journal);
+
+void text_journal_insert(TextJournal* journal, TextUndoPosition start, UTFStringView text);
+//returns the number of the delete, to restore its text later
+//SIZE_MAX if it couldn't be stored
+size_t text_journal_delete(TextJournal* journal, TextUndoPosition start, TextUndoPosition end);
+//text taken out by the delete with delete_number goes back at start
+void text_journal_restore(TextJournal* journal, TextUndoPosition start, size_t delete_number);
+
+//hands records to the worker once the interval passes
+//returns true while some of them are not on the disk yet
+bool text_journal_poll(TextJournal* journal);
+
+// Goes through the records of a journal file
+typedef struct TextJournalReader {
+    const char* data;
+    size_t size;
+
+    //where the next record starts
+    size_t position;
+} TextJournalReader;
+
+//returns false if it's not a journal or it's for a different base file,
+//or the base file was written again since the journal was created
+bool text_journal_reader_init(TextJournalReader* reader, const char* data, size_t size, TextJournalBase base);
+//returns false at the end of the journal or at a broken record
+bool text_journal_read(TextJournalReader* reader, TextJournalRecord* record);
+
+//records the reader went through, to keep them in a new journal
+const char* text_journal_reader_records(TextJournalReader* reader);
+size_t text_journal_reader_records_size(TextJournalReader* reader);
+
+//writes to a temporary file, returns false if it couldn't
+bool text_journal_test();
+
+#endif
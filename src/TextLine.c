@@ -2,8 +2,9 @@
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <stdio.h>
 
-TextLine* text_line_create(UTFString *str, size_t line_number, bool ends_with_lf, bool ends_with_crlf)
+static TextLine* text_line_alloc(size_t line_number, bool ends_with_lf, bool ends_with_crlf)
 {
     TextLine *line = malloc(sizeof(TextLine));
     line->prev = NULL;
@@ -12,6 +13,35 @@ TextLine* text_line_create(UTFString *str, size_t line_number, bool ends_with_lf
     line->ends_with_crlf = ends_with_crlf;
     line->ends_with_lf = ends_with_lf;
 
+    line->str = NULL;
+    line->mapped_data = NULL;
+    line->mapped_size = 0;
+    line->mapped_count = SIZE_MAX;
+    line->span_count = 0;
+
+    for (size_t i = 0; i < TEXT_LINE_SNAPSHOT_SLOTS; i++) {
+        line->snapshot_lines[i] = NULL;
+    }
+
+    line->wrapped_line_count = 1;
+    line->wrapped_line_sizes = &line->first_wrapped_line_size;
+    line->wrapped_line_capacity = 1;
+    line->first_wrapped_line_size = 0;
+
+    line->size_x = 0;
+    line->size_y = 0;
+
+    line->line_number = line_number;
+
+    line->needs_update = true;
+
+    return line;
+}
+
+TextLine* text_line_create(UTFString *str, size_t line_number, bool ends_with_lf, bool ends_with_crlf)
+{
+    TextLine *line = text_line_alloc(line_number, ends_with_lf, ends_with_crlf);
+
     if (str == NULL) {
         line->str = utf_from_cstr(u8"");
     }
@@ -19,13 +49,21 @@ TextLine* text_line_create(UTFString *str, size_t line_number, bool ends_with_lf
         line->str = str;
     }
 
-    line->wrapped_line_count = 1;
     line->wrapped_line_sizes[0] = line->str->count;
 
-    line->size_x = 0;
-    line->size_y = 0;
+    return line;
+}
 
-    line->line_number = line_number;
+TextLine* text_line_create_mapped(const char* data, size_t size, size_t line_number, bool ends_with_lf, bool ends_with_crlf)
+{
+    TextLine *line = text_line_alloc(line_number, ends_with_lf, ends_with_crlf);
+
+    line->mapped_data = data;
+    line->mapped_size = size;
+
+    //character count is not known until the line is read
+    //byte count is an upper bound of it
+    line->wrapped_line_sizes[0] = size;
 
     return line;
 }
@@ -36,9 +74,84 @@ void text_line_destroy(TextLine* line)
         utf_destroy(line->str);
     }
 
+    if (line->wrapped_line_sizes != &line->first_wrapped_line_size) {
+        free(line->wrapped_line_sizes);
+    }
+
     free(line);
 }
 
+UTFStringView text_line_sv(TextLine* line)
+{
+    if (line->str) {
+        return utf_sv_from_str(line->str);
+    }
+
+    UTFStringView sv = {.data = line->mapped_data, .data_size = line->mapped_size};
+    sv.count = line->mapped_count != SIZE_MAX ? line->mapped_count : utf_sv_count(sv);
+    return sv;
+}
+
+UTFString* text_line_materialize(TextLine* line)
+{
+    if (!line->str) {
+        line->str = utf_from_sv(text_line_sv(line));
+        line->mapped_data = NULL;
+        line->mapped_size = 0;
+        line->mapped_count = SIZE_MAX;
+    }
+    return line->str;
+}
+
+const char* text_line_data(TextLine* line)
+{
+    return line->str ? line->str->data : line->mapped_data;
+}
+
+size_t text_line_data_size(TextLine* line)
+{
+    return line->str ? line->str->data_size : line->mapped_size;
+}
+
+size_t text_line_char_to_byte(TextLine* line, size_t char_offset)
+{
+    if (line->str) {
+        return utf_count_to_byte(line->str, char_offset);
+    }
+    UTFStringView sv = {.data = line->mapped_data, .data_size = line->mapped_size};
+    return utf_sv_count_to_byte(sv, char_offset);
+}
+
+void text_line_clear_wrapped_line_sizes(TextLine* line)
+{
+    line->wrapped_line_count = 0;
+}
+
+void text_line_push_wrapped_line_size(TextLine* line, int size)
+{
+    if (line->wrapped_line_count >= line->wrapped_line_capacity) {
+        size_t new_capacity = line->wrapped_line_capacity * 2;
+        int* new_sizes = NULL;
+        if (line->wrapped_line_sizes == &line->first_wrapped_line_size) {
+            new_sizes = malloc(new_capacity * sizeof(int));
+            if (new_sizes) {
+                new_sizes[0] = line->first_wrapped_line_size;
+            }
+        }
+        else {
+            new_sizes = realloc(line->wrapped_line_sizes, new_capacity * sizeof(int));
+        }
+        if (!new_sizes) {
+            fprintf(stderr, "%s:%d:ERROR : failed to grow wrapped line sizes!!!\n", __FILE__, __LINE__);
+            return;
+        }
+        line->wrapped_line_sizes = new_sizes;
+        line->wrapped_line_capacity = new_capacity;
+    }
+
+    line->wrapped_line_sizes[line->wrapped_line_count++] = size;
+}
+
 TextLine* text_line_first(TextLine* line)
 {
     TextLine* current_line = line;
@@ -129,6 +242,248 @@ void text_line_insert_right(TextLine* line, TextLine* to_insert)
     }
 }
 
+#define TEXT_LINE_INDEX_DEFAULT_CAPACITY 1024
+
+bool text_line_index_init(TextLineIndex* index, const char* data, size_t size)
+{
+    memset(index, 0, sizeof(TextLineIndex));
+
+    //empty files are not mapped, lines still need something to point to
+    if (data == NULL) {
+        data = "";
+        size = 0;
+    }
+
+    index->line_starts = malloc(TEXT_LINE_INDEX_DEFAULT_CAPACITY * sizeof(size_t));
+    if (!index->line_starts) {
+        return false;
+    }
+    index->line_capacity = TEXT_LINE_INDEX_DEFAULT_CAPACITY;
+
+    index->data = data;
+    index->size = size;
+    index->line_starts[index->line_count++] = 0;
+
+    return true;
+}
+
+bool text_line_index_append(TextLineIndex* index, const size_t* line_starts, size_t count)
+{
+    assert(!index->is_finished);
+
+    if (index->line_count + count > index->line_capacity) {
+        //new lines are not counted first, file is read once and offsets array grows instead
+        size_t new_capacity = index->line_capacity * 2;
+        while (new_capacity < index->line_count + count) {
+            new_capacity *= 2;
+        }
+        size_t* new_line_starts = realloc(index->line_starts, new_capacity * sizeof(size_t));
+        if (!new_line_starts) {
+            return false;
+        }
+        index->line_starts = new_line_starts;
+        index->line_capacity = new_capacity;
+    }
+
+    memcpy(index->line_starts + index->line_count, line_starts, count * sizeof(size_t));
+    index->line_count += count;
+
+    return true;
+}
+
+void text_line_index_finish(TextLineIndex* index)
+{
+    index->is_finished = true;
+}
+
+bool text_line_index_build(TextLineIndex* index, const char* data, size_t size)
+{
+    if (!text_line_index_init(index, data, size)) {
+        return false;
+    }
+
+    const char* end = index->data + index->size;
+    for (const char* lf = index->data; lf < end; lf++) {
+        lf = memchr(lf, '\n', end - lf);
+        if (lf == NULL) {
+            break;
+        }
+
+        //line after the last new line is an empty line, same as create_lines_from_sv
+        size_t line_start = lf - index->data + 1;
+        if (!text_line_index_append(index, &line_start, 1)) {
+            text_line_index_destroy(index);
+            return false;
+        }
+    }
+
+    text_line_index_finish(index);
+
+    return true;
+}
+
+void text_line_index_init_borrowed(
+    TextLineIndex* index, const char* data, size_t size,
+    const size_t* line_starts, const uint32_t* char_counts, size_t line_count
+)
+{
+    memset(index, 0, sizeof(TextLineIndex));
+    index->data = data;
+    index->size = size;
+    //nothing is appended to a finished index, so they are never written
+    index->line_starts = (size_t*)line_starts;
+    index->line_count = line_count;
+    index->line_capacity = line_count;
+    index->char_counts = char_counts;
+    index->is_borrowed = true;
+    index->is_finished = true;
+}
+
+void text_line_index_destroy(TextLineIndex* index)
+{
+    if (!index->is_borrowed) {
+        free(index->line_starts);
+    }
+    memset(index, 0, sizeof(TextLineIndex));
+}
+
+size_t text_line_index_ended_count(TextLineIndex* index)
+{
+    if (index->is_finished || index->line_count == 0) {
+        return index->line_count;
+    }
+    return index->line_count - 1;
+}
+
+size_t text_line_index_pending_count(TextLineIndex* index)
+{
+    size_t ended_count = text_line_index_ended_count(index);
+    if (ended_count < index->next_line) {
+        return 0;
+    }
+    return ended_count - index->next_line;
+}
+
+void text_line_index_get_line(TextLineIndex* index, size_t line_index, const char** data, size_t* size, bool* ends_with_lf, bool* ends_with_crlf)
+{
+    size_t start = index->line_starts[line_index];
+    size_t end = line_index + 1 < index->line_count ? index->line_starts[line_index + 1] : index->size;
+
+    *ends_with_lf = false;
+    *ends_with_crlf = false;
+
+    //every line but the last ends with a new line
+    if (line_index + 1 < index->line_count) {
+        end--;
+        if (end > start && index->data[end - 1] == '\r') {
+            end--;
+            *ends_with_crlf = true;
+        }
+        else {
+            *ends_with_lf = true;
+        }
+    }
+
+    *data = index->data + start;
+    *size = end - start;
+}
+
+TextLine* text_line_index_create_lines(TextLineIndex* index, size_t count, size_t first_line_number, TextLine** last)
+{
+    size_t pending_count = text_line_index_pending_count(index);
+    if (count > pending_count) {
+        count = pending_count;
+    }
+
+    TextLine* first = text_line_index_create_lines_at(index, index->next_line, count, first_line_number, last);
+    index->next_line += count;
+    return first;
+}
+
+TextLine* text_line_index_create_lines_at(TextLineIndex* index, size_t first_line, size_t count, size_t first_line_number, TextLine** last)
+{
+    TextLine* first = NULL;
+    TextLine* prev = NULL;
+
+    for (size_t i = 0; i < count; i++) {
+        TextLine* line = text_line_alloc(first_line_number + i, false, false);
+        text_line_index_set_line(index, line, first_line + i);
+
+        if (prev) {
+            prev->next = line;
+            line->prev = prev;
+        }
+        else {
+            first = line;
+        }
+        prev = line;
+    }
+
+    if (last) {
+        *last = prev;
+    }
+
+    return first;
+}
+
+TextLine* text_line_index_create_span(TextLineIndex* index, size_t first_line, size_t end_line, size_t line_number)
+{
+    TextLine* span = text_line_alloc(line_number, false, false);
+    text_line_index_set_span(index, span, first_line, end_line);
+    return span;
+}
+
+size_t text_line_index_line_at(TextLineIndex* index, const char* data)
+{
+    size_t start = (size_t)(data - index->data);
+
+    //first line that starts after data does
+    size_t low = 0;
+    size_t high = index->line_count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (index->line_starts[mid] <= start) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+    assert(low > 0 && index->line_starts[low - 1] == start);
+    return low - 1;
+}
+
+void text_line_index_set_line(TextLineIndex* index, TextLine* line, size_t line_index)
+{
+    text_line_index_get_line(index, line_index, &line->mapped_data, &line->mapped_size, &line->ends_with_lf, &line->ends_with_crlf);
+    line->span_count = 0;
+    line->mapped_count = SIZE_MAX;
+    if (index->char_counts && index->char_counts[line_index] != UINT32_MAX) {
+        line->mapped_count = index->char_counts[line_index];
+    }
+
+    //character count is not known until the line is read
+    //byte count is an upper bound of it
+    line->wrapped_line_count = 1;
+    line->wrapped_line_sizes[0] = line->mapped_count != SIZE_MAX ? line->mapped_count : line->mapped_size;
+    line->needs_update = true;
+}
+
+void text_line_index_set_span(TextLineIndex* index, TextLine* line, size_t first_line, size_t end_line)
+{
+    assert(first_line < end_line);
+
+    const char* last_data = NULL;
+    size_t last_size = 0;
+    text_line_index_get_line(index, end_line - 1, &last_data, &last_size, &line->ends_with_lf, &line->ends_with_crlf);
+
+    line->mapped_data = index->data + index->line_starts[first_line];
+    line->mapped_size = (size_t)(last_data + last_size - line->mapped_data);
+    line->mapped_count = SIZE_MAX;
+    line->span_count = end_line - first_line;
+    line->needs_update = true;
+}
+
 TextLine* create_lines_from_cstr(const char *str)
 {
     if (str == NULL) {
@@ -156,52 +511,48 @@ TextLine* create_lines_from_sv(UTFStringView sv)
 
     size_t line_number = 0;
 
-    while (sv.count != 0) {
-        int lf_at = utf_sv_find(sv, utf_sv_from_cstr(u8"\n"));
-        int crlf_at = utf_sv_find(sv, utf_sv_from_cstr(u8"\r\n"));
+    //split in a single pass over bytes
+    const char* data = sv.data;
+    size_t remaining = sv.data_size;
+
+    while (remaining != 0) {
+        const char* lf = memchr(data, '\n', remaining);
 
         bool ends_with_crlf = false;
         bool ends_with_lf = false;
 
-        bool found_new_line = lf_at >= 0 || crlf_at >= 0;
-
-        size_t new_line_at = 0;
+        size_t line_size = remaining;
+        size_t new_line_size = 0;
 
-        if (!found_new_line) {
-            new_line_at = sv.count;
-        }
-        else {
-            if(lf_at < 0 || (crlf_at < lf_at && crlf_at >= 0)){
-                new_line_at = crlf_at;
+        if (lf) {
+            line_size = lf - data;
+            if (line_size > 0 && data[line_size - 1] == '\r') {
+                line_size--;
+                new_line_size = 2;
                 ends_with_crlf = true;
             }
-            else{
-                new_line_at = lf_at;
+            else {
+                new_line_size = 1;
                 ends_with_lf = true;
             }
         }
 
-        UTFStringView line = utf_sv_sub_sv(sv, 0, new_line_at);
-        sv = utf_sv_trim_left(sv, new_line_at);
+        UTFStringView line = {.data = data, .data_size = line_size};
+        line.count = utf_sv_count(line);
 
-        if (found_new_line) {
-            if (ends_with_crlf) {
-                sv = utf_sv_trim_left(sv, 2);
-            }
-            else if(ends_with_lf) {
-                sv = utf_sv_trim_left(sv, 1);
-            }
-        }
+        TextLine* to_push = text_line_create(utf_from_sv(line), line_number++, ends_with_lf, ends_with_crlf);
 
         if (first == NULL) {
-            first = text_line_create(utf_from_sv(line), line_number++, ends_with_lf, ends_with_crlf);
-            last = first;
+            first = to_push;
         }
         else {
-            TextLine* to_push = text_line_create(utf_from_sv(line), line_number++, ends_with_lf, ends_with_crlf);
-            text_line_push_back(last, to_push);
-            last = to_push;
+            last->next = to_push;
+            to_push->prev = last;
         }
+        last = to_push;
+
+        data += line_size + new_line_size;
+        remaining -= line_size + new_line_size;
     }
     if (last->ends_with_crlf || last->ends_with_lf) {
         TextLine* end = text_line_create(utf_from_cstr(""), line_number++, false, false);
@@ -282,4 +633,222 @@ void text_line_test()
             tmp = next;
         }
     }
+    {
+        //lone cr is not a new line
+        TextLine* first = create_lines_from_cstr(
+            u8"a\rb\r\n"
+            u8"\r\n"
+            u8"\n"
+            u8"c"
+        );
+
+        TextLine* tmp = first;
+
+        assert(utf_sv_cmp(utf_sv_from_str(tmp->str), utf_sv_from_cstr(u8"a\rb")));
+        assert(tmp->ends_with_crlf == true);
+        tmp = tmp->next;
+
+        assert(tmp->str->count == 0);
+        assert(tmp->ends_with_crlf == true);
+        tmp = tmp->next;
+
+        assert(tmp->str->count == 0);
+        assert(tmp->ends_with_lf == true);
+        tmp = tmp->next;
+
+        assert(utf_sv_cmp(utf_sv_from_str(tmp->str), utf_sv_from_cstr(u8"c")));
+        assert(tmp->line_number == 3);
+        assert(tmp->next == NULL);
+
+        tmp = first;
+
+        while (tmp != NULL) {
+            TextLine* next = tmp->next;
+            text_line_destroy(tmp);
+            tmp = next;
+        }
+    }
+    {
+        //lines are created from the index when they are needed
+        const char data[] = u8"고양이\r\n\nabc\r\n";
+        TextLineIndex index;
+        assert(text_line_index_build(&index, data, sizeof(data) - 1));
+        assert(index.line_count == 4);
+        assert(text_line_index_pending_count(&index) == 4);
+
+        TextLine* last = NULL;
+        TextLine* first = text_line_index_create_lines(&index, 2, 0, &last);
+        assert(text_line_index_pending_count(&index) == 2);
+        assert(first->next == last && last->prev == first);
+
+        TextLine* tmp = first;
+
+        assert(tmp->str == NULL);
+        assert(tmp->mapped_data == data && tmp->mapped_size == 9);
+        assert(tmp->ends_with_crlf == true);
+        UTFStringView sv = text_line_sv(tmp);
+        assert(sv.data == data && sv.count == 3);
+        assert(text_line_char_to_byte(tmp, 2) == 6);
+        assert(tmp->str == NULL);
+
+        UTFString* str = text_line_materialize(tmp);
+        assert(tmp->str == str && tmp->mapped_data == NULL);
+        assert(utf_sv_cmp(utf_sv_from_str(str), utf_sv_from_cstr(u8"고양이")));
+        assert(str->count == 3);
+        tmp = tmp->next;
+
+        assert(text_line_sv(tmp).count == 0);
+        assert(tmp->ends_with_lf == true);
+        assert(tmp->line_number == 1);
+
+        TextLine* rest = text_line_index_create_lines(&index, 100, 2, &last);
+        assert(text_line_index_pending_count(&index) == 0);
+        assert(text_line_index_create_lines(&index, 100, 4, NULL) == NULL);
+        text_line_push_back(first, rest);
+        tmp = tmp->next;
+
+        assert(utf_sv_cmp(text_line_sv(tmp), utf_sv_from_cstr(u8"abc")));
+        assert(tmp->ends_with_crlf == true);
+        assert(text_line_data_size(tmp) == 3);
+        assert(tmp->line_number == 2);
+        tmp = tmp->next;
+
+        //same as create_lines_from_sv, text ending with a new line has an empty last line
+        assert(tmp == last);
+        assert(text_line_data_size(tmp) == 0);
+        assert(!tmp->ends_with_lf && !tmp->ends_with_crlf);
+        assert(tmp->next == NULL);
+
+        text_line_index_destroy(&index);
+
+        tmp = first;
+
+        while (tmp != NULL) {
+            TextLine* next = tmp->next;
+            text_line_destroy(tmp);
+            tmp = next;
+        }
+    }
+    {
+        //index filled a piece at a time, last line is pending only after it's finished
+        const char data[] = u8"ab\r\ncd\nef";
+        TextLineIndex index;
+        assert(text_line_index_init(&index, data, sizeof(data) - 1));
+        assert(text_line_index_pending_count(&index) == 0);
+        assert(text_line_index_ended_count(&index) == 0);
+        assert(text_line_index_create_lines(&index, 100, 0, NULL) == NULL);
+
+        size_t second_start = 4;
+        assert(text_line_index_append(&index, &second_start, 1));
+        assert(text_line_index_pending_count(&index) == 1);
+        assert(text_line_index_ended_count(&index) == 1);
+
+        TextLine* last = NULL;
+        TextLine* first = text_line_index_create_lines(&index, 100, 0, &last);
+        assert(first == last);
+        assert(utf_sv_cmp(text_line_sv(first), utf_sv_from_cstr(u8"ab")));
+        assert(first->ends_with_crlf == true);
+
+        size_t third_start = 7;
+        assert(text_line_index_append(&index, &third_start, 1));
+        text_line_index_finish(&index);
+        assert(text_line_index_pending_count(&index) == 2);
+        assert(text_line_index_ended_count(&index) == 3);
+
+        TextLine* rest = text_line_index_create_lines(&index, 100, 1, &last);
+        text_line_push_back(first, rest);
+        assert(utf_sv_cmp(text_line_sv(rest), utf_sv_from_cstr(u8"cd")));
+        assert(rest->ends_with_lf == true);
+        assert(utf_sv_cmp(text_line_sv(last), utf_sv_from_cstr(u8"ef")));
+        assert(!last->ends_with_lf && !last->ends_with_crlf);
+        assert(last->line_number == 2);
+
+        text_line_index_destroy(&index);
+
+        TextLine* tmp = first;
+        while (tmp != NULL) {
+            TextLine* next = tmp->next;
+            text_line_destroy(tmp);
+            tmp = next;
+        }
+    }
+    {
+        //borrowed index with known character counts, lines don't count them again
+        const char data[] = u8"가나\r\nab\n";
+        const size_t line_starts[] = {0, 8, 11};
+        const uint32_t char_counts[] = {2, 2, 0};
+
+        TextLineIndex index;
+        text_line_index_init_borrowed(&index, data, sizeof(data) - 1, line_starts, char_counts, 3);
+        assert(text_line_index_pending_count(&index) == 3);
+
+        TextLine* last = NULL;
+        TextLine* first = text_line_index_create_lines(&index, 100, 0, &last);
+        assert(first->mapped_count == 2 && first->wrapped_line_sizes[0] == 2);
+        assert(first->ends_with_crlf);
+        assert(utf_sv_cmp(text_line_sv(first), utf_sv_from_cstr(u8"가나")));
+        assert(text_line_sv(first).count == 2);
+        assert(last->line_number == 2 && last->mapped_size == 0);
+
+        //materialized line counts its own characters
+        text_line_materialize(first);
+        assert(first->mapped_count == SIZE_MAX && first->str->count == 2);
+
+        //arrays are not freed with the index
+        text_line_index_destroy(&index);
+
+        TextLine* tmp = first;
+        while (tmp != NULL) {
+            TextLine* next = tmp->next;
+            text_line_destroy(tmp);
+            tmp = next;
+        }
+    }
+    {
+        //span stands for lines that are skipped over, it's written out as they are
+        const char data[] = u8"a\nbc\r\nd\ne";
+        TextLineIndex index;
+        assert(text_line_index_build(&index, data, sizeof(data) - 1));
+
+        TextLine* first = text_line_index_create_lines(&index, 1, 0, NULL);
+        TextLine* span = text_line_index_create_span(&index, 1, 3, 1);
+        assert(span->span_count == 2 && span->line_number == 1);
+        assert(span->mapped_data == data + 2 && span->mapped_size == 5);
+        assert(span->ends_with_lf && !span->ends_with_crlf);
+        assert(text_line_index_line_at(&index, span->mapped_data) == 1);
+
+        //span shrinks to its first line, and the line after it gets a TextLine of its own
+        TextLine* line = text_line_index_create_lines_at(&index, 2, 1, 2, NULL);
+        text_line_index_set_span(&index, span, 1, 2);
+        assert(span->span_count == 1 && span->mapped_size == 2 && span->ends_with_crlf);
+        assert(line->span_count == 0 && utf_sv_cmp(text_line_sv(line), utf_sv_from_cstr(u8"d")));
+        assert(line->ends_with_lf && line->wrapped_line_sizes[0] == 1);
+
+        //span can turn into a line too
+        text_line_index_set_line(&index, span, 1);
+        assert(span->span_count == 0 && utf_sv_cmp(text_line_sv(span), utf_sv_from_cstr(u8"bc")));
+
+        //last line doesn't end with a new line, neither does its span
+        TextLine* last_span = text_line_index_create_span(&index, 3, 4, 3);
+        assert(last_span->span_count == 1 && last_span->mapped_size == 1);
+        assert(!last_span->ends_with_lf && !last_span->ends_with_crlf);
+        assert(text_line_index_pending_count(&index) == 3);
+
+        text_line_index_destroy(&index);
+        text_line_destroy(first);
+        text_line_destroy(span);
+        text_line_destroy(line);
+        text_line_destroy(last_span);
+    }
+    {
+        //wrapped line sizes grow past the first one
+        TextLine* line = text_line_create(NULL, 0, false, false);
+        text_line_clear_wrapped_line_sizes(line);
+        for (int i = 0; i < 300; i++) {
+            text_line_push_wrapped_line_size(line, i);
+        }
+        assert(line->wrapped_line_count == 300);
+        assert(line->wrapped_line_sizes[0] == 0 && line->wrapped_line_sizes[299] == 299);
+        text_line_destroy(line);
+    }
 }
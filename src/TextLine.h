@@ -3,6 +3,10 @@
 
 #include "UTFString.h"
 #include <stdbool.h>
+#include <stdint.h>
+
+//how many snapshots a line can be in at once, one of each kind(see TextSnapshotSlot)
+#define TEXT_LINE_SNAPSHOT_SLOTS 4
 
 typedef struct TextLine{
     struct TextLine* prev;
@@ -17,8 +21,11 @@ typedef struct TextLine{
     //then it might be displayed in multiple lines
     //these values are here to handle that situation
     size_t wrapped_line_count;
-    //TODO perhaps make vector for ints
-    int wrapped_line_sizes[128];
+    //points to first_wrapped_line_size until line wraps
+    //so lines that don't wrap don't need another allocation
+    int* wrapped_line_sizes;
+    size_t wrapped_line_capacity;
+    int first_wrapped_line_size;
 
     /////////////////////////////
     // !!!!!!!IMPORTANT!!!!!!!!!
@@ -29,11 +36,48 @@ typedef struct TextLine{
     bool ends_with_lf;
 
     size_t line_number;
+
+    //line is not laid out yet
+    //size_y and wrapped_line_sizes are just an estimate until the text box updates it
+    bool needs_update;
+
+    //lines of an opened file point to the file mapping until they are edited
+    //str is NULL until then
+    const char* mapped_data;
+    size_t mapped_size;
+    //characters in mapped_data, SIZE_MAX until something counts them
+    size_t mapped_count;
+
+    //0 for a line, otherwise the TextLine is a span that stands for this many lines of an opened file
+    //that were skipped over without creating TextLines for them(see TextLineIndex)
+    //mapped_data goes from the first of them to the end of the last one with new lines in between,
+    //so a span is written out like a line, but it's never laid out or edited
+    size_t span_count;
+
+    //how the line was when the snapshot in each slot was taken
+    //NULL if it hasn't changed since then(see TextSnapshot.h)
+    struct TextSnapshotLine* snapshot_lines[TEXT_LINE_SNAPSHOT_SLOTS];
 } TextLine;
 
 TextLine* text_line_create(UTFString* str, size_t line_number, bool ends_with_lf, bool ends_with_crlf);
+//line points to data instead of copying it, data has to outlive the line
+TextLine* text_line_create_mapped(const char* data, size_t size, size_t line_number, bool ends_with_lf, bool ends_with_crlf);
 void text_line_destroy(TextLine* line);
 
+//text of the line without copying it
+//safe to call while other threads read the line, as long as nobody edits it
+UTFStringView text_line_sv(TextLine* line);
+//copies text from the mapping if it's not copied yet
+//call it before editing the line
+UTFString* text_line_materialize(TextLine* line);
+//these don't copy the line either
+const char* text_line_data(TextLine* line);
+size_t text_line_data_size(TextLine* line);
+size_t text_line_char_to_byte(TextLine* line, size_t char_offset);
+
+void text_line_clear_wrapped_line_sizes(TextLine* line);
+void text_line_push_wrapped_line_size(TextLine* line, int size);
+
 TextLine* text_line_first(TextLine* line);
 TextLine* text_line_last(TextLine* line);
 
@@ -46,6 +90,78 @@ void text_line_push_front(TextLine* line, TextLine* to_push);
 void text_line_insert_left(TextLine* line, TextLine* to_insert);
 void text_line_insert_right(TextLine* line, TextLine* to_insert);
 
+// Where each line of a mapped file starts
+//
+// It's built in one pass over the file and TextLines are created from it
+// only when something needs them, so opening a file doesn't
+// allocate anything per line other than its offset
+//
+// Index can also be filled a piece at a time while the file is being split(see TextLoad.h),
+// then the last line is not known to end until the index is finished
+typedef struct TextLineIndex {
+    const char* data;
+    size_t size;
+
+    //line i is from line_starts[i] up to the new line before line_starts[i + 1]
+    size_t* line_starts;
+    size_t line_count;
+    size_t line_capacity;
+
+    //every new line of the data is in line_starts
+    bool is_finished;
+
+    //lines before this have TextLines
+    size_t next_line;
+
+    //characters of every line when they are known(see TextIndexCache.h), NULL otherwise
+    //a line with too many of them for 32 bits has UINT32_MAX
+    const uint32_t* char_counts;
+    //line_starts belong to someone else and are not freed with the index
+    bool is_borrowed;
+} TextLineIndex;
+
+//index only has the first line, returns false if it couldn't be allocated
+bool text_line_index_init(TextLineIndex* index, const char* data, size_t size);
+//adds lines that start at the offsets, returns false if they couldn't be added
+bool text_line_index_append(TextLineIndex* index, const size_t* line_starts, size_t count);
+//no more lines will be added so the last line ends at the end of the data
+void text_line_index_finish(TextLineIndex* index);
+
+//whole data at once, returns false if index couldn't be allocated
+bool text_line_index_build(TextLineIndex* index, const char* data, size_t size);
+//finished index that uses arrays someone else keeps alive instead of copying them
+//char_counts can be NULL
+void text_line_index_init_borrowed(
+    TextLineIndex* index, const char* data, size_t size,
+    const size_t* line_starts, const uint32_t* char_counts, size_t line_count
+);
+void text_line_index_destroy(TextLineIndex* index);
+
+//lines that are known to end, last line may still be going on while the index is filled
+size_t text_line_index_ended_count(TextLineIndex* index);
+//how many lines that are known to end don't have TextLines yet
+size_t text_line_index_pending_count(TextLineIndex* index);
+
+//text of a line that is known to end, without its new line
+void text_line_index_get_line(TextLineIndex* index, size_t line_index, const char** data, size_t* size, bool* ends_with_lf, bool* ends_with_crlf);
+
+//creates TextLines for up to count lines that don't have one yet
+//they point to the data and are linked to each other, last is set to the last one
+//returns NULL if every line has one
+TextLine* text_line_index_create_lines(TextLineIndex* index, size_t count, size_t first_line_number, TextLine** last);
+//same as text_line_index_create_lines but for count lines from first_line on, like the lines of a span
+//next_line doesn't change
+TextLine* text_line_index_create_lines_at(TextLineIndex* index, size_t first_line, size_t count, size_t first_line_number, TextLine** last);
+//one TextLine that stands for lines first_line up to end_line(see TextLine.span_count), next_line doesn't change
+TextLine* text_line_index_create_span(TextLineIndex* index, size_t first_line, size_t end_line, size_t line_number);
+
+//line of the index that starts at data, like the first line of a span
+size_t text_line_index_line_at(TextLineIndex* index, const char* data);
+//points the line(or the span) to a line of the index, it's laid out again before it's shown
+void text_line_index_set_line(TextLineIndex* index, TextLine* line, size_t line_index);
+//points the line(or the span) to lines first_line up to end_line of the index, it's a span from then on
+void text_line_index_set_span(TextLineIndex* index, TextLine* line, size_t first_line, size_t end_line);
+
 TextLine* create_lines_from_cstr(const char *str);
 TextLine* create_lines_from_str(UTFString* str);
 TextLine* create_lines_from_sv(UTFStringView sv);
@@ -0,0 +1,495 @@
+#include "TextLoad.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+//first screen only needs a few lines, so first chunk is small
+#define LOAD_FIRST_CHUNK_SIZE (64 * 1024)
+#define LOAD_CHUNK_SIZE (4 * 1024 * 1024)
+
+#define LOAD_DEFAULT_CAPACITY 1024
+
+//lines of the snapshot that are read at once when it's hashed
+#define RELOAD_READ_LINES 256
+
+struct TextLoad {
+    const char* data;
+    size_t size;
+
+    OS_Thread* thread;
+    OS_Mutex* mutex;
+
+    //below are guarded by the mutex
+    bool is_cancelled;
+    bool is_worker_done;
+
+    //line starts that are not moved to the index yet
+    size_t* found;
+    size_t found_count;
+    size_t found_capacity;
+
+    size_t progress;
+
+    //only used by the main thread
+    bool is_done;
+};
+
+static bool load_push_starts(size_t** starts, size_t* count, size_t* capacity, const size_t* to_push, size_t push_count)
+{
+    if (*count + push_count > *capacity) {
+        size_t new_capacity = *capacity ? *capacity * 2 : LOAD_DEFAULT_CAPACITY;
+        while (new_capacity < *count + push_count) {
+            new_capacity *= 2;
+        }
+        size_t* new_starts = realloc(*starts, new_capacity * sizeof(size_t));
+        if (!new_starts) {
+            return false;
+        }
+        *starts = new_starts;
+        *capacity = new_capacity;
+    }
+
+    memcpy(*starts + *count, to_push, push_count * sizeof(size_t));
+    *count += push_count;
+    return true;
+}
+
+static void load_worker(void* data)
+{
+    TextLoad* load = data;
+
+    //chunk is split without holding the lock, then handed over at once
+    size_t* starts = NULL;
+    size_t start_count = 0;
+    size_t start_capacity = 0;
+
+    size_t position = 0;
+    size_t chunk_size = LOAD_FIRST_CHUNK_SIZE;
+
+    while (position < load->size) {
+        os_mutex_lock(load->mutex);
+        bool is_cancelled = load->is_cancelled;
+        os_mutex_unlock(load->mutex);
+        if (is_cancelled) {
+            break;
+        }
+
+        size_t chunk_end = load->size - position > chunk_size ? position + chunk_size : load->size;
+        start_count = 0;
+
+        bool failed = false;
+        const char* end = load->data + chunk_end;
+        for (const char* lf = load->data + position; lf < end; lf++) {
+            lf = memchr(lf, '\n', end - lf);
+            if (lf == NULL) {
+                break;
+            }
+
+            size_t line_start = lf - load->data + 1;
+            if (!load_push_starts(&starts, &start_count, &start_capacity, &line_start, 1)) {
+                failed = true;
+                break;
+            }
+        }
+
+        os_mutex_lock(load->mutex);
+        if (!failed) {
+            failed = !load_push_starts(&load->found, &load->found_count, &load->found_capacity, starts, start_count);
+        }
+        if (!failed) {
+            load->progress = chunk_end;
+        }
+        os_mutex_unlock(load->mutex);
+
+        if (failed) {
+            fprintf(stderr, "%s:%d:ERROR : Failed to store line starts, rest of the file is not loaded\n", __FILE__, __LINE__);
+            break;
+        }
+
+        position = chunk_end;
+        chunk_size = LOAD_CHUNK_SIZE;
+    }
+
+    free(starts);
+
+    os_mutex_lock(load->mutex);
+    load->is_worker_done = true;
+    os_mutex_unlock(load->mutex);
+}
+
+TextLoad* text_load_start(const char* data, size_t size)
+{
+    TextLoad* load = calloc(1, sizeof(TextLoad));
+    if (!load) {
+        return NULL;
+    }
+
+    load->data = data;
+    load->size = data ? size : 0;
+
+    load->mutex = os_mutex_create();
+    if (!load->mutex) {
+        free(load);
+        return NULL;
+    }
+
+    load->thread = os_thread_create(load_worker, load);
+    if (!load->thread) {
+        os_mutex_destroy(load->mutex);
+        free(load);
+        return NULL;
+    }
+
+    return load;
+}
+
+void text_load_destroy(TextLoad* load)
+{
+    os_mutex_lock(load->mutex);
+    load->is_cancelled = true;
+    os_mutex_unlock(load->mutex);
+
+    os_thread_join(load->thread);
+    os_mutex_destroy(load->mutex);
+
+    free(load->found);
+    free(load);
+}
+
+bool text_load_poll(TextLoad* load, TextLineIndex* index)
+{
+    if (load->is_done) {
+        return false;
+    }
+
+    bool changed = false;
+
+    os_mutex_lock(load->mutex);
+    if (load->found_count > 0) {
+        if (!text_line_index_append(index, load->found, load->found_count)) {
+            fprintf(stderr, "%s:%d:ERROR : Failed to grow line index, rest of the file is not loaded\n", __FILE__, __LINE__);
+            load->is_cancelled = true;
+        }
+        load->found_count = 0;
+        changed = true;
+    }
+    bool is_worker_done = load->is_worker_done;
+    os_mutex_unlock(load->mutex);
+
+    if (is_worker_done) {
+        text_line_index_finish(index);
+        load->is_done = true;
+        changed = true;
+    }
+
+    return changed;
+}
+
+bool text_load_is_done(TextLoad* load)
+{
+    return load->is_done;
+}
+
+size_t text_load_progress(TextLoad* load)
+{
+    os_mutex_lock(load->mutex);
+    size_t progress = load->progress;
+    os_mutex_unlock(load->mutex);
+    return progress;
+}
+
+struct TextReloadJob {
+    const char* data;
+    size_t size;
+
+    TextSnapshot* snapshot;
+    TextLine* first_line;
+    TextLineIndex* old_index;
+    size_t tail_start;
+    size_t old_line_count;
+
+    //only read by the main thread once the worker is done
+    TextLineIndex index;
+    TextDiff diff;
+
+    OS_Thread* thread;
+    OS_Mutex* mutex;
+
+    //below are guarded by the mutex
+    bool is_cancelled;
+    bool is_done;
+    bool success;
+};
+
+static bool reload_job_is_cancelled(TextReloadJob* job)
+{
+    os_mutex_lock(job->mutex);
+    bool is_cancelled = job->is_cancelled;
+    os_mutex_unlock(job->mutex);
+    return is_cancelled;
+}
+
+void text_load_hash_lines(TextLineIndex* index, size_t first_line, size_t end_line, uint64_t* hashes)
+{
+    for (size_t line_index = first_line; line_index < end_line; line_index++) {
+        const char* data = NULL;
+        size_t size = 0;
+        bool ends_with_lf = false;
+        bool ends_with_crlf = false;
+        text_line_index_get_line(index, line_index, &data, &size, &ends_with_lf, &ends_with_crlf);
+        hashes[line_index - first_line] = text_diff_hash_line(data, size, ends_with_lf, ends_with_crlf);
+    }
+}
+
+//hashes of every line of the document as it was when the snapshot was taken
+//returns false if it was cancelled
+static bool reload_job_hash_document(TextReloadJob* job, uint64_t* hashes)
+{
+    TextSnapshotLine lines[RELOAD_READ_LINES];
+    size_t hash_count = 0;
+
+    TextLine* line = job->first_line;
+    while (line) {
+        if (reload_job_is_cancelled(job)) {
+            return false;
+        }
+
+        size_t read_count = text_snapshot_read_lines(job->snapshot, line, lines, RELOAD_READ_LINES);
+        for (size_t i = 0; i < read_count; i++) {
+            //lines of a span are in the old index, it doesn't change once there is a span
+            size_t count = lines[i].span_count > 0 ? lines[i].span_count : 1;
+            if (hash_count + count > job->old_line_count) {
+                return false;
+            }
+            if (lines[i].span_count > 0) {
+                size_t first_line = text_line_index_line_at(job->old_index, lines[i].data);
+                text_load_hash_lines(job->old_index, first_line, first_line + count, hashes + hash_count);
+            }
+            else {
+                hashes[hash_count] = text_diff_hash_line(lines[i].data, lines[i].data_size, lines[i].ends_with_lf, lines[i].ends_with_crlf);
+            }
+            hash_count += count;
+        }
+        line = lines[read_count - 1].next;
+    }
+
+    size_t tail_count = job->old_index->line_count - job->tail_start;
+    if (hash_count + tail_count != job->old_line_count) {
+        return false;
+    }
+    text_load_hash_lines(job->old_index, job->tail_start, job->old_index->line_count, hashes + hash_count);
+    return true;
+}
+
+static void reload_job_worker(void* data)
+{
+    TextReloadJob* job = data;
+
+    bool success = text_line_index_build(&job->index, job->data, job->size);
+    bool is_built = success;
+
+    uint64_t* old_hashes = NULL;
+    uint64_t* new_hashes = NULL;
+    if (success) {
+        old_hashes = malloc(job->old_line_count * sizeof(uint64_t));
+        new_hashes = malloc(job->index.line_count * sizeof(uint64_t));
+        success = old_hashes && new_hashes && reload_job_hash_document(job, old_hashes);
+    }
+    if (success) {
+        text_load_hash_lines(&job->index, 0, job->index.line_count, new_hashes);
+        success = text_diff_lines(&job->diff, old_hashes, job->old_line_count, new_hashes, job->index.line_count);
+    }
+    free(old_hashes);
+    free(new_hashes);
+
+    if (!success && is_built) {
+        text_line_index_destroy(&job->index);
+    }
+
+    os_mutex_lock(job->mutex);
+    job->is_done = true;
+    job->success = success;
+    os_mutex_unlock(job->mutex);
+}
+
+TextReloadJob* text_reload_job_start(
+    const char* data, size_t size,
+    TextSnapshot* snapshot, TextLine* first_line,
+    TextLineIndex* old_index, size_t tail_start, size_t old_line_count
+)
+{
+    assert(old_index->is_finished);
+
+    TextReloadJob* job = calloc(1, sizeof(TextReloadJob));
+    if (!job) {
+        return NULL;
+    }
+
+    job->data = data;
+    job->size = data ? size : 0;
+    job->snapshot = snapshot;
+    job->first_line = first_line;
+    job->old_index = old_index;
+    job->tail_start = tail_start;
+    job->old_line_count = old_line_count;
+
+    job->mutex = os_mutex_create();
+    if (!job->mutex) {
+        free(job);
+        return NULL;
+    }
+
+    job->thread = os_thread_create(reload_job_worker, job);
+    if (!job->thread) {
+        os_mutex_destroy(job->mutex);
+        free(job);
+        return NULL;
+    }
+
+    return job;
+}
+
+bool text_reload_job_poll(TextReloadJob* job, bool* success)
+{
+    os_mutex_lock(job->mutex);
+    bool is_done = job->is_done;
+    if (success) {
+        *success = job->success;
+    }
+    os_mutex_unlock(job->mutex);
+    return is_done;
+}
+
+void text_reload_job_take(TextReloadJob* job, TextLineIndex* index, TextDiff* diff)
+{
+    assert(job->success);
+
+    *index = job->index;
+    *diff = job->diff;
+    job->success = false;
+}
+
+void text_reload_job_destroy(TextReloadJob* job)
+{
+    os_mutex_lock(job->mutex);
+    job->is_cancelled = true;
+    os_mutex_unlock(job->mutex);
+
+    os_thread_join(job->thread);
+    os_mutex_destroy(job->mutex);
+
+    //results nobody took
+    if (job->success) {
+        text_line_index_destroy(&job->index);
+        text_diff_destroy(&job->diff);
+    }
+    free(job);
+}
+
+void text_load_test()
+{
+    {
+        //same lines as building the index at once
+        size_t line_total = 100000;
+        size_t size = 0;
+        char* data = malloc(line_total * 16);
+        for (size_t i = 0; i < line_total; i++) {
+            size += sprintf(data + size, i % 3 ? "line %zu\n" : "line %zu\r\n", i);
+        }
+
+        TextLineIndex expected;
+        assert(text_line_index_build(&expected, data, size));
+
+        TextLineIndex index;
+        assert(text_line_index_init(&index, data, size));
+
+        TextLoad* load = text_load_start(data, size);
+        assert(load);
+        while (!text_load_is_done(load)) {
+            text_load_poll(load, &index);
+        }
+        assert(!text_load_poll(load, &index));
+        assert(text_load_progress(load) == size);
+
+        assert(index.is_finished);
+        assert(index.line_count == expected.line_count);
+        assert(memcmp(index.line_starts, expected.line_starts, index.line_count * sizeof(size_t)) == 0);
+
+        text_load_destroy(load);
+        text_line_index_destroy(&index);
+        text_line_index_destroy(&expected);
+
+        //stopping in the middle
+        load = text_load_start(data, size);
+        assert(load);
+        text_load_destroy(load);
+
+        free(data);
+    }
+    {
+        //empty file is not mapped
+        TextLineIndex index;
+        assert(text_line_index_init(&index, NULL, 0));
+
+        TextLoad* load = text_load_start(NULL, 0);
+        assert(load);
+        while (!text_load_is_done(load)) {
+            text_load_poll(load, &index);
+        }
+        assert(index.line_count == 1);
+        assert(text_line_index_pending_count(&index) == 1);
+
+        text_load_destroy(load);
+        text_line_index_destroy(&index);
+    }
+    {
+        //lines with TextLines, a span and lines without TextLines are all diffed
+        const char* old_data = "l0\nl1\nl2\nl3\nl4\nl5\nl6\nl7\nl8\nl9\n";
+        const char* new_data = "l0\nY\nl2\nl3\nl4\nX\nl6\nl7\nl8\nl9\nl10\n";
+
+        TextLineIndex old_index;
+        assert(text_line_index_build(&old_index, old_data, strlen(old_data)));
+        TextLine* last = NULL;
+        TextLine* first_line = text_line_index_create_lines(&old_index, 3, 0, &last);
+        TextLine* span = text_line_index_create_span(&old_index, 3, 7, 3);
+        old_index.next_line = 7;
+        last->next = span;
+        span->prev = last;
+
+        TextSnapshot* snapshot = text_snapshot_create(TEXT_SNAPSHOT_RELOAD, first_line, NULL, 0);
+        assert(snapshot);
+        TextReloadJob* job = text_reload_job_start(new_data, strlen(new_data), snapshot, first_line, &old_index, old_index.next_line, old_index.line_count);
+        assert(job);
+        bool success = false;
+        while (!text_reload_job_poll(job, &success)) {
+        }
+        assert(success);
+
+        TextLineIndex index;
+        TextDiff diff;
+        text_reload_job_take(job, &index, &diff);
+        text_reload_job_destroy(job);
+
+        assert(index.line_count == 12);
+        assert(diff.hunk_count == 3);
+        assert(diff.hunks[0].old_start == 1 && diff.hunks[0].old_count == 1 && diff.hunks[0].new_count == 1);
+        assert(diff.hunks[1].old_start == 5 && diff.hunks[1].old_count == 1 && diff.hunks[1].new_count == 1);
+        assert(diff.hunks[2].old_start == 10 && diff.hunks[2].old_count == 0 && diff.hunks[2].new_count == 1);
+
+        //stopping in the middle
+        job = text_reload_job_start(new_data, strlen(new_data), snapshot, first_line, &old_index, old_index.next_line, old_index.line_count);
+        assert(job);
+        text_reload_job_destroy(job);
+
+        text_diff_destroy(&diff);
+        text_line_index_destroy(&index);
+        text_snapshot_destroy(snapshot);
+        for (TextLine* line = first_line; line != NULL; ) {
+            TextLine* next = line->next;
+            text_line_destroy(line);
+            line = next;
+        }
+        text_line_index_destroy(&old_index);
+    }
+}
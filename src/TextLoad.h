@@ -0,0 +1,64 @@
+#ifndef TextLoad_HEADER_GUARD
+#define TextLoad_HEADER_GUARD
+
+#include "TextLine.h"
+#include "TextSnapshot.h"
+#include "TextDiff.h"
+#include "OS.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Splits a file into lines on a worker thread
+//
+// Worker finds where lines start a chunk at a time and hands the offsets over,
+// then the main thread moves them to the index with text_load_poll.
+// First chunk is small so the first screen can be shown
+// before the rest of the file is even read.
+//
+// Data has to stay mapped until the load is destroyed
+typedef struct TextLoad TextLoad;
+
+//returns NULL if worker couldn't be started
+TextLoad* text_load_start(const char* data, size_t size);
+//stops the worker if it's still running and frees the load
+void text_load_destroy(TextLoad* load);
+
+//moves lines found so far to the index and finishes the index when the whole data is split
+//returns true if index changed
+bool text_load_poll(TextLoad* load, TextLineIndex* index);
+//every line is in the index
+bool text_load_is_done(TextLoad* load);
+
+//how many bytes are split so far
+size_t text_load_progress(TextLoad* load);
+
+// Splits a file that changed on the disk into lines and diffs it with the document on a worker thread
+//
+// Document is read from a snapshot(see TextSnapshot.h). Its lines without a TextLine
+// (lines of spans and the ones after the last TextLine) are hashed from the index of the old file,
+// so the main thread only applies the diff once the job is done.
+//
+// Data of the changed file, the snapshot and the old index have to stay as they are until the job is destroyed
+typedef struct TextReloadJob TextReloadJob;
+
+//old_index has to be finished, its lines from tail_start on are after the last TextLine
+//and the document has old_line_count lines
+//returns NULL if worker couldn't be started
+TextReloadJob* text_reload_job_start(
+    const char* data, size_t size,
+    TextSnapshot* snapshot, TextLine* first_line,
+    TextLineIndex* old_index, size_t tail_start, size_t old_line_count
+);
+//returns true when worker is done and sets success to whether the file was split and diffed
+bool text_reload_job_poll(TextReloadJob* job, bool* success);
+//hands the index of the changed file and the diff to the caller, only after it succeeded
+void text_reload_job_take(TextReloadJob* job, TextLineIndex* index, TextDiff* diff);
+//stops the worker if it's not done and frees the job, snapshot is not freed
+void text_reload_job_destroy(TextReloadJob* job);
+
+//hashes of lines first_line up to end_line of the index, the first one goes to hashes[0]
+void text_load_hash_lines(TextLineIndex* index, size_t first_line, size_t end_line, uint64_t* hashes);
+
+void text_load_test();
+
+#endif
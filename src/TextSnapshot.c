@@ -0,0 +1,629 @@
+#include "TextSnapshot.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <stdint.h>
+
+//how many pieces of the document are handed to the writer at once
+#define SNAPSHOT_WRITE_BATCH 1024
+//how many lines writer reads while holding the lock
+#define SNAPSHOT_LOCK_LINES 32
+
+#define SNAPSHOT_DEFAULT_CAPACITY 64
+
+_Static_assert(TEXT_SNAPSHOT_SLOT_COUNT == TEXT_LINE_SNAPSHOT_SLOTS, "every slot needs a version in TextLine");
+
+typedef struct SnapshotLineVersion {
+    const char* data;
+    size_t data_size;
+    //data is in a file mapping and the line ending follows it
+    bool is_mapped;
+
+    bool ends_with_lf;
+    bool ends_with_crlf;
+
+    TextLine* next;
+} SnapshotLineVersion;
+
+struct TextSnapshot {
+    TextSnapshotSlot slot;
+    TextLine* first_line;
+
+    const char* tail;
+    size_t tail_size;
+
+    //held by the writer while it reads lines,
+    //and by the main thread while it freezes one
+    OS_Mutex* mutex;
+
+    //below are guarded by the mutex
+    bool is_cancelled;
+
+    //only used by the main thread
+    TextSnapshotLine** frozen_lines;
+    size_t frozen_count;
+    size_t frozen_capacity;
+
+    //texts lines had when they were frozen
+    UTFString** retired_strs;
+    size_t retired_count;
+    size_t retired_capacity;
+};
+
+static bool snapshot_push_pointer(void*** array, size_t* count, size_t* capacity, void* pointer)
+{
+    if (*count >= *capacity) {
+        size_t new_capacity = *capacity ? *capacity * 2 : SNAPSHOT_DEFAULT_CAPACITY;
+        void** new_array = realloc(*array, new_capacity * sizeof(void*));
+        if (!new_array) {
+            return false;
+        }
+        *array = new_array;
+        *capacity = new_capacity;
+    }
+    (*array)[(*count)++] = pointer;
+    return true;
+}
+
+TextSnapshot* text_snapshot_create(TextSnapshotSlot slot, TextLine* first_line, const char* tail, size_t tail_size)
+{
+    TextSnapshot* snapshot = calloc(1, sizeof(TextSnapshot));
+    if (!snapshot) {
+        return NULL;
+    }
+
+    snapshot->mutex = os_mutex_create();
+    if (!snapshot->mutex) {
+        free(snapshot);
+        return NULL;
+    }
+
+    snapshot->slot = slot;
+    snapshot->first_line = first_line;
+    snapshot->tail = tail;
+    snapshot->tail_size = tail ? tail_size : 0;
+
+    return snapshot;
+}
+
+void text_snapshot_destroy(TextSnapshot* snapshot)
+{
+    for (size_t i = 0; i < snapshot->frozen_count; i++) {
+        snapshot->frozen_lines[i]->line->snapshot_lines[snapshot->slot] = NULL;
+        free(snapshot->frozen_lines[i]);
+    }
+    free(snapshot->frozen_lines);
+
+    for (size_t i = 0; i < snapshot->retired_count; i++) {
+        utf_destroy(snapshot->retired_strs[i]);
+    }
+    free(snapshot->retired_strs);
+
+    os_mutex_destroy(snapshot->mutex);
+    free(snapshot);
+}
+
+void text_snapshot_freeze_line(TextSnapshot* snapshot, TextLine* line)
+{
+    if (line->snapshot_lines[snapshot->slot]) {
+        return;
+    }
+
+    TextSnapshotLine* frozen = malloc(sizeof(TextSnapshotLine));
+    frozen->line = line;
+    frozen->data = line->str ? line->str->data : line->mapped_data;
+    frozen->data_size = line->str ? line->str->data_size : line->mapped_size;
+    frozen->ends_with_lf = line->ends_with_lf;
+    frozen->ends_with_crlf = line->ends_with_crlf;
+    frozen->span_count = line->span_count;
+    frozen->next = line->next;
+
+    //snapshot keeps the text it points to, line goes on with a copy
+    UTFString* copy = NULL;
+    if (line->str) {
+        copy = utf_from_sv(utf_sv_from_str(line->str));
+        snapshot_push_pointer((void***)&snapshot->retired_strs, &snapshot->retired_count, &snapshot->retired_capacity, line->str);
+    }
+    snapshot_push_pointer((void***)&snapshot->frozen_lines, &snapshot->frozen_count, &snapshot->frozen_capacity, frozen);
+
+    //writer reads either the frozen line or the line before it changes
+    os_mutex_lock(snapshot->mutex);
+    line->snapshot_lines[snapshot->slot] = frozen;
+    os_mutex_unlock(snapshot->mutex);
+
+    if (copy) {
+        line->str = copy;
+    }
+}
+
+TextSnapshotLine text_snapshot_line(TextSnapshot* snapshot, TextLine* line)
+{
+    TextSnapshotLine* frozen = line->snapshot_lines[snapshot->slot];
+    if (frozen) {
+        return *frozen;
+    }
+
+    TextSnapshotLine version = {
+        .line = line,
+        .data = text_line_data(line),
+        .data_size = text_line_data_size(line),
+        .ends_with_lf = line->ends_with_lf,
+        .ends_with_crlf = line->ends_with_crlf,
+        .span_count = line->span_count,
+        .next = line->next,
+    };
+    return version;
+}
+
+size_t text_snapshot_read_lines(TextSnapshot* snapshot, TextLine* line, TextSnapshotLine* lines, size_t max_count)
+{
+    size_t count = 0;
+    while (line != NULL && count < max_count) {
+        //lock isn't held for long so the main thread can freeze lines in between
+        os_mutex_lock(snapshot->mutex);
+        for (size_t i = 0; i < SNAPSHOT_LOCK_LINES && line != NULL && count < max_count; i++) {
+            lines[count] = text_snapshot_line(snapshot, line);
+            line = lines[count].next;
+            count++;
+        }
+        os_mutex_unlock(snapshot->mutex);
+    }
+    return count;
+}
+
+//caller holds the mutex
+static SnapshotLineVersion snapshot_line_version(TextSnapshot* snapshot, TextLine* line)
+{
+    SnapshotLineVersion version;
+
+    TextSnapshotLine* frozen = line->snapshot_lines[snapshot->slot];
+    if (frozen) {
+        version.data = frozen->data;
+        version.data_size = frozen->data_size;
+        version.is_mapped = false;
+        version.ends_with_lf = frozen->ends_with_lf;
+        version.ends_with_crlf = frozen->ends_with_crlf;
+        version.next = frozen->next;
+    }
+    else {
+        version.data = line->str ? line->str->data : line->mapped_data;
+        version.data_size = line->str ? line->str->data_size : line->mapped_size;
+        version.is_mapped = line->str == NULL;
+        version.ends_with_lf = line->ends_with_lf;
+        version.ends_with_crlf = line->ends_with_crlf;
+        version.next = line->next;
+    }
+
+    return version;
+}
+
+//piece that continues the last one is merged to it, so unedited lines of a file become one piece
+static void snapshot_push_buffer(OS_WriteBuffer* buffers, size_t* count, const char* data, size_t size)
+{
+    if (size == 0) {
+        return;
+    }
+    if (*count > 0) {
+        OS_WriteBuffer* last = &buffers[*count - 1];
+        if ((const char*)last->data + last->size == data) {
+            last->size += size;
+            return;
+        }
+    }
+    buffers[(*count)++] = (OS_WriteBuffer){ .data = data, .size = size };
+}
+
+bool text_snapshot_write(TextSnapshot* snapshot, OS_FileWriter* writer)
+{
+    OS_WriteBuffer buffers[SNAPSHOT_WRITE_BATCH];
+    size_t buffer_count = 0;
+
+    TextLine* line = snapshot->first_line;
+    while (line != NULL) {
+        //lines are only read under the lock, text they point to doesn't change after that
+        os_mutex_lock(snapshot->mutex);
+        bool is_cancelled = snapshot->is_cancelled;
+        for (size_t i = 0; i < SNAPSHOT_LOCK_LINES && line != NULL && !is_cancelled; i++) {
+            //a line takes at most two pieces
+            if (buffer_count + 2 > SNAPSHOT_WRITE_BATCH) {
+                break;
+            }
+
+            SnapshotLineVersion version = snapshot_line_version(snapshot, line);
+            size_t ending_size = version.ends_with_crlf ? 2 : version.ends_with_lf ? 1 : 0;
+
+            if (version.is_mapped) {
+                //line ending is right after the line in the file
+                snapshot_push_buffer(buffers, &buffer_count, version.data, version.data_size + ending_size);
+            }
+            else {
+                snapshot_push_buffer(buffers, &buffer_count, version.data, version.data_size);
+                snapshot_push_buffer(buffers, &buffer_count, version.ends_with_crlf ? "\r\n" : "\n", ending_size);
+            }
+
+            line = version.next;
+        }
+        os_mutex_unlock(snapshot->mutex);
+
+        if (is_cancelled) {
+            return false;
+        }
+
+        if (buffer_count + 2 > SNAPSHOT_WRITE_BATCH) {
+            if (!os_file_writer_write(writer, buffers, buffer_count)) {
+                return false;
+            }
+            buffer_count = 0;
+        }
+    }
+
+    snapshot_push_buffer(buffers, &buffer_count, snapshot->tail, snapshot->tail_size);
+
+    return os_file_writer_write(writer, buffers, buffer_count);
+}
+
+struct TextSnapshotJob {
+    TextSnapshot* snapshot;
+    char* path;
+
+    OS_Thread* thread;
+    OS_Mutex* mutex;
+
+    //below are guarded by the mutex
+    bool is_done;
+    bool success;
+};
+
+static void snapshot_job_worker(void* data)
+{
+    TextSnapshotJob* job = data;
+
+    bool success = false;
+    OS_FileWriter* writer = os_file_writer_create(job->path);
+    if (writer) {
+        if (text_snapshot_write(job->snapshot, writer)) {
+            success = os_file_writer_commit(writer);
+        }
+        else {
+            os_file_writer_abort(writer);
+        }
+    }
+
+    os_mutex_lock(job->mutex);
+    job->is_done = true;
+    job->success = success;
+    os_mutex_unlock(job->mutex);
+}
+
+TextSnapshotJob* text_snapshot_job_start(TextSnapshot* snapshot, const char* path)
+{
+    TextSnapshotJob* job = calloc(1, sizeof(TextSnapshotJob));
+    if (!job) {
+        return NULL;
+    }
+
+    job->snapshot = snapshot;
+    job->path = malloc(strlen(path) + 1);
+    strcpy(job->path, path);
+
+    job->mutex = os_mutex_create();
+    if (!job->mutex) {
+        free(job->path);
+        free(job);
+        return NULL;
+    }
+
+    job->thread = os_thread_create(snapshot_job_worker, job);
+    if (!job->thread) {
+        os_mutex_destroy(job->mutex);
+        free(job->path);
+        free(job);
+        return NULL;
+    }
+
+    return job;
+}
+
+bool text_snapshot_job_poll(TextSnapshotJob* job, bool* success)
+{
+    os_mutex_lock(job->mutex);
+    bool is_done = job->is_done;
+    if (success) {
+        *success = job->success;
+    }
+    os_mutex_unlock(job->mutex);
+    return is_done;
+}
+
+void text_snapshot_job_destroy(TextSnapshotJob* job)
+{
+    os_mutex_lock(job->snapshot->mutex);
+    job->snapshot->is_cancelled = true;
+    os_mutex_unlock(job->snapshot->mutex);
+
+    os_thread_join(job->thread);
+    os_mutex_destroy(job->mutex);
+
+    free(job->path);
+    free(job);
+}
+
+static char* snapshot_test_read_file(const char* path, size_t* size)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    *size = (size_t)ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char* data = malloc(*size + 1);
+    *size = fread(data, 1, *size, file);
+    data[*size] = 0;
+    fclose(file);
+
+    return data;
+}
+
+//writes the snapshot through a file writer and reads the file back, NULL if it couldn't
+static char* snapshot_test_write_and_read(TextSnapshot* snapshot, const char* path, size_t* size)
+{
+    OS_FileWriter* writer = os_file_writer_create(path);
+    if (!writer) {
+        return NULL;
+    }
+    if (!text_snapshot_write(snapshot, writer)) {
+        os_file_writer_abort(writer);
+        return NULL;
+    }
+    if (!os_file_writer_commit(writer)) {
+        return NULL;
+    }
+    return snapshot_test_read_file(path, size);
+}
+
+bool text_snapshot_test()
+{
+    char path[1024];
+    if (!os_create_temp_file("text_snapshot_test", path, sizeof(path))) {
+        return false;
+    }
+    bool success = true;
+
+    {
+        //edits after the snapshot don't show up in it
+        TextLine* lines = create_lines_from_cstr(u8"a\r\n고양이\nccc\r\n");
+        TextLine* second = lines->next;
+        TextLine* third = second->next;
+
+        const char tail[] = "tail\nend";
+        TextSnapshot* snapshot = text_snapshot_create(TEXT_SNAPSHOT_AUTOSAVE, lines, tail, sizeof(tail) - 1);
+
+        //edit a line
+        UTFString* old_str = second->str;
+        text_snapshot_freeze_line(snapshot, second);
+        assert(second->str != old_str);
+        utf_insert_sv(second->str, 1, utf_sv_from_cstr(u8"x"));
+        second->ends_with_lf = false;
+        second->ends_with_crlf = true;
+
+        //freezing twice keeps the first version
+        text_snapshot_freeze_line(snapshot, second);
+        utf_append_cstr(second->str, "y");
+
+        //remove a line(it is kept alive)
+        second->next = third->next;
+        third->next->prev = second;
+
+        //insert a line
+        TextLine* inserted = text_line_create(utf_from_cstr("new"), 0, true, false);
+        text_snapshot_freeze_line(snapshot, lines);
+        inserted->next = second;
+        second->prev = inserted;
+        lines->next = inserted;
+        inserted->prev = lines;
+
+        size_t size = 0;
+        char* data = snapshot_test_write_and_read(snapshot, path, &size);
+        success = success && data;
+        assert(!data || strcmp(data, u8"a\r\n고양이\nccc\r\ntail\nend") == 0);
+        free(data);
+
+        text_snapshot_destroy(snapshot);
+        assert(second->snapshot_lines[TEXT_SNAPSHOT_AUTOSAVE] == NULL && lines->snapshot_lines[TEXT_SNAPSHOT_AUTOSAVE] == NULL);
+        assert(utf_sv_cmp(utf_sv_from_str(second->str), utf_sv_from_cstr(u8"고x양이y")));
+
+        //without a snapshot edits are written
+        snapshot = text_snapshot_create(TEXT_SNAPSHOT_AUTOSAVE, lines, NULL, 0);
+        data = snapshot_test_write_and_read(snapshot, path, &size);
+        success = success && data;
+        assert(!data || strcmp(data, u8"a\r\nnew\n고x양이y\r\n") == 0);
+        free(data);
+        text_snapshot_destroy(snapshot);
+
+        text_line_destroy(third);
+        for (TextLine* line = lines; line != NULL; ) {
+            TextLine* next = line->next;
+            text_line_destroy(line);
+            line = next;
+        }
+    }
+    {
+        //snapshots in different slots keep their own versions of a line
+        TextLine* lines = create_lines_from_cstr(u8"one\ntwo");
+        TextSnapshot* autosave = text_snapshot_create(TEXT_SNAPSHOT_AUTOSAVE, lines, NULL, 0);
+        text_snapshot_freeze_line(autosave, lines);
+        utf_append_cstr(lines->str, "1");
+
+        TextSnapshot* clipboard = text_snapshot_create(TEXT_SNAPSHOT_CLIPBOARD, lines, NULL, 0);
+        text_snapshot_freeze_line(clipboard, lines);
+        text_snapshot_freeze_line(autosave, lines);
+        utf_append_cstr(lines->str, "2");
+
+        TextSnapshotLine version = text_snapshot_line(autosave, lines);
+        assert(version.data_size == 3 && memcmp(version.data, "one", 3) == 0);
+        version = text_snapshot_line(clipboard, lines);
+        assert(version.data_size == 4 && memcmp(version.data, "one1", 4) == 0);
+        assert(version.next == lines->next && version.ends_with_lf);
+        assert(utf_sv_cmp(utf_sv_from_str(lines->str), utf_sv_from_cstr("one12")));
+
+        //lines that didn't change are read as they are
+        version = text_snapshot_line(clipboard, lines->next);
+        assert(version.data_size == 3 && memcmp(version.data, "two", 3) == 0 && version.next == NULL);
+
+        //other threads read the same versions
+        TextSnapshotLine read_lines[4];
+        assert(text_snapshot_read_lines(clipboard, lines, read_lines, 4) == 2);
+        assert(read_lines[0].data_size == 4 && read_lines[1].line == lines->next);
+        assert(text_snapshot_read_lines(clipboard, lines, read_lines, 1) == 1);
+
+        text_snapshot_destroy(autosave);
+        text_snapshot_destroy(clipboard);
+        assert(lines->snapshot_lines[TEXT_SNAPSHOT_CLIPBOARD] == NULL);
+
+        for (TextLine* line = lines; line != NULL; ) {
+            TextLine* next = line->next;
+            text_line_destroy(line);
+            line = next;
+        }
+    }
+    {
+        //mapped lines are written from the data they point to
+        const char data[] = "one\r\ntwo\nthree";
+        TextLineIndex index;
+        assert(text_line_index_build(&index, data, sizeof(data) - 1));
+        TextLine* lines = text_line_index_create_lines(&index, 2, 0, NULL);
+        size_t tail_start = index.line_starts[index.next_line];
+
+        TextSnapshot* snapshot = text_snapshot_create(TEXT_SNAPSHOT_AUTOSAVE, lines, data + tail_start, index.size - tail_start);
+        text_snapshot_freeze_line(snapshot, lines);
+        text_line_materialize(lines);
+        utf_append_cstr(lines->str, "!");
+
+        TextSnapshotJob* job = text_snapshot_job_start(snapshot, path);
+        bool job_success = false;
+        if (job) {
+            while (!text_snapshot_job_poll(job, &job_success)) {
+            }
+            text_snapshot_job_destroy(job);
+        }
+        text_snapshot_destroy(snapshot);
+
+        size_t size = 0;
+        char* written = job_success ? snapshot_test_read_file(path, &size) : NULL;
+        success = success && written;
+        assert(!written || (size == sizeof(data) - 1 && memcmp(written, data, size) == 0));
+        free(written);
+
+        for (TextLine* line = lines; line != NULL; ) {
+            TextLine* next = line->next;
+            text_line_destroy(line);
+            line = next;
+        }
+        text_line_index_destroy(&index);
+    }
+
+    remove(path);
+    return success;
+}
+
+void text_snapshot_benchmark()
+{
+    const size_t line_count = 5 * 1000 * 1000;
+    const size_t keystroke_count = 20000;
+    const char* path = "text_snapshot_benchmark.tmp";
+
+    //document is built as edited lines, the worst case for a snapshot
+    TextLine** lines = malloc(line_count * sizeof(TextLine*));
+    size_t total_bytes = 0;
+    uint32_t random = 12345;
+    for (size_t i = 0; i < line_count; i++) {
+        random = random * 1103515245u + 12345u;
+        char buffer[256];
+        int size = snprintf(buffer, sizeof(buffer),
+            "2026-10-19 12:%02u:%02u INFO worker[%u] request handled id=%u status=200 took %ums and some more text",
+            (unsigned)(i / 60 % 60), (unsigned)(i % 60), (random >> 8) % 16, (random >> 4) % 100000, (random >> 12) % 2000);
+        lines[i] = text_line_create(utf_from_cstr(buffer), i, true, false);
+        if (i > 0) {
+            lines[i - 1]->next = lines[i];
+            lines[i]->prev = lines[i - 1];
+        }
+        total_bytes += (size_t)size + 1;
+    }
+
+    printf("snapshot benchmark, %zu lines, %zu MB\n", line_count, total_bytes / (1024 * 1024));
+
+    //a keystroke is an edit of a random line
+    //main thread freezes the line first when a snapshot is alive
+    double* latencies = malloc(keystroke_count * sizeof(double));
+
+    for (int with_autosave = 0; with_autosave <= 1; with_autosave++) {
+        TextSnapshot* snapshot = NULL;
+        TextSnapshotJob* job = NULL;
+
+        double start = os_get_time();
+        if (with_autosave) {
+            snapshot = text_snapshot_create(TEXT_SNAPSHOT_AUTOSAVE, lines[0], NULL, 0);
+            job = text_snapshot_job_start(snapshot, path);
+        }
+        double snapshot_time = os_get_time() - start;
+
+        size_t typed = 0;
+        for (; typed < keystroke_count; typed++) {
+            if (job && text_snapshot_job_poll(job, NULL)) {
+                break;
+            }
+
+            random = random * 1103515245u + 12345u;
+            TextLine* line = lines[(random >> 4) % line_count];
+
+            double keystroke_start = os_get_time();
+            if (snapshot) {
+                text_snapshot_freeze_line(snapshot, line);
+            }
+            utf_insert_sv(line->str, 0, utf_sv_from_cstr("k"));
+            latencies[typed] = os_get_time() - keystroke_start;
+
+            //about how often a key is pressed while typing fast
+            double wait_until = os_get_time() + 0.0002;
+            while (os_get_time() < wait_until) {
+            }
+        }
+
+        bool success = true;
+        if (job) {
+            while (!text_snapshot_job_poll(job, &success)) {
+            }
+        }
+        double total_time = os_get_time() - start;
+
+        double max_latency = 0;
+        double sum = 0;
+        for (size_t i = 0; i < typed; i++) {
+            sum += latencies[i];
+            if (latencies[i] > max_latency) {
+                max_latency = latencies[i];
+            }
+        }
+
+        printf("%-16s : snapshot taken in %.3f ms, %zu keystrokes, average %.2f us, max %.2f us, total %.0f ms%s\n",
+            with_autosave ? "during autosave" : "no autosave",
+            snapshot_time * 1000.0, typed, typed ? sum / typed * 1e6 : 0.0, max_latency * 1e6, total_time * 1000.0,
+            success ? "" : " (autosave failed)");
+
+        if (job) {
+            text_snapshot_job_destroy(job);
+            text_snapshot_destroy(snapshot);
+        }
+    }
+
+    remove(path);
+
+    for (size_t i = 0; i < line_count; i++) {
+        text_line_destroy(lines[i]);
+    }
+    free(lines);
+    free(latencies);
+}
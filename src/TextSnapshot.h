@@ -0,0 +1,83 @@
+#ifndef TextSnapshot_HEADER_GUARD
+#define TextSnapshot_HEADER_GUARD
+
+#include "UTFString.h"
+#include "TextLine.h"
+#include "OS.h"
+#include <stdbool.h>
+
+// How a line was when the snapshot was taken
+typedef struct TextSnapshotLine {
+    TextLine* line;
+
+    const char* data;
+    size_t data_size;
+
+    bool ends_with_lf;
+    bool ends_with_crlf;
+
+    //lines the TextLine stood for if it was a span(see TextLine.h), 0 otherwise
+    size_t span_count;
+
+    TextLine* next;
+} TextSnapshotLine;
+
+// Document as it was at one moment, written out on another thread while it keeps changing
+//
+// Taking a snapshot doesn't copy anything, it only remembers the first line.
+// Instead, the main thread calls text_snapshot_freeze_line before it changes a line
+// or where the line links to. Snapshot then keeps how the line was,
+// and the line gets a copy of its text so the old text stays as it is (copy on write).
+// So only lines that are edited while the snapshot is alive are copied.
+//
+// Lines that are in the snapshot can't be freed until it's destroyed
+typedef struct TextSnapshot TextSnapshot;
+
+// A line keeps a version for each slot, so snapshots in different slots can be alive at once.
+// There can be only one snapshot in a slot
+typedef enum TextSnapshotSlot {
+    //document that is being written out
+    TEXT_SNAPSHOT_AUTOSAVE,
+    //copied text that is read when someone pastes it
+    TEXT_SNAPSHOT_CLIPBOARD,
+    //document that is being searched
+    TEXT_SNAPSHOT_FIND,
+    //document that is being diffed with the file it's reloaded from
+    TEXT_SNAPSHOT_RELOAD,
+    TEXT_SNAPSHOT_SLOT_COUNT,
+} TextSnapshotSlot;
+
+//tail is the rest of the document after the last line, it's written as it is
+TextSnapshot* text_snapshot_create(TextSnapshotSlot slot, TextLine* first_line, const char* tail, size_t tail_size);
+//only the main thread can call this, after nothing is writing the snapshot
+void text_snapshot_destroy(TextSnapshot* snapshot);
+
+//call it before the line(or its next pointer) changes
+void text_snapshot_freeze_line(TextSnapshot* snapshot, TextLine* line);
+
+//how the line was when the snapshot was taken, only the main thread can call this
+TextSnapshotLine text_snapshot_line(TextSnapshot* snapshot, TextLine* line);
+//reads at most max_count lines from line on, safe to call from another thread
+//returns how many were read, it stops after the last line
+size_t text_snapshot_read_lines(TextSnapshot* snapshot, TextLine* line, TextSnapshotLine* lines, size_t max_count);
+
+//writes every line with the line ending it had, safe to call from another thread
+//returns false if writing failed or it was cancelled
+bool text_snapshot_write(TextSnapshot* snapshot, OS_FileWriter* writer);
+
+// Writes a snapshot to a file on a worker thread
+typedef struct TextSnapshotJob TextSnapshotJob;
+
+//returns NULL if worker couldn't be started
+//file is replaced only when the whole snapshot is written
+TextSnapshotJob* text_snapshot_job_start(TextSnapshot* snapshot, const char* path);
+//returns true when worker is done and sets success to whether the file was written
+bool text_snapshot_job_poll(TextSnapshotJob* job, bool* success);
+//stops writing if it's not done and frees the job, snapshot is not freed
+void text_snapshot_job_destroy(TextSnapshotJob* job);
+
+//writes to a temporary file, returns false if it couldn't
+bool text_snapshot_test();
+void text_snapshot_benchmark();
+
+#endif
@@ -0,0 +1,429 @@
+#include "TextUndo.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+//oldest records are dropped past these limits
+#define TEXT_UNDO_MAX_RECORDS (64 * 1024)
+#define TEXT_UNDO_MAX_COPIED_BYTES (16 * 1024 * 1024)
+
+//records are dropped in batches so dropping doesn't happen on every edit
+#define TEXT_UNDO_DROP_BATCH 1024
+
+#define TEXT_UNDO_DEFAULT_CAPACITY 64
+
+static bool position_equal(TextUndoPosition a, TextUndoPosition b)
+{
+    return a.line_number == b.line_number && a.char_offset == b.char_offset;
+}
+
+static bool is_space_byte(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static void free_text(TextUndo* undo, TextUndoText* text)
+{
+    if (text->str) {
+        undo->copied_bytes -= text->str->data_size;
+        utf_destroy(text->str);
+    }
+
+    //there can be a lot of lines so they are freed later with the other removed lines
+    if (text->first_line) {
+        text->last_line->next = *undo->removed_lines;
+        *undo->removed_lines = text->first_line;
+    }
+
+    memset(text, 0, sizeof(TextUndoText));
+}
+
+static void drop_redo(TextUndo* undo)
+{
+    for (size_t i = undo->undo_count; i < undo->record_count; i++) {
+        if (undo->records[i].has_text) {
+            free_text(undo, &undo->records[i].text);
+        }
+    }
+    undo->record_count = undo->undo_count;
+}
+
+static void drop_oldest(TextUndo* undo, size_t count)
+{
+    assert(count <= undo->undo_count);
+
+    for (size_t i = 0; i < count; i++) {
+        if (undo->records[i].has_text) {
+            free_text(undo, &undo->records[i].text);
+        }
+    }
+
+    memmove(undo->records, undo->records + count, (undo->record_count - count) * sizeof(TextUndoRecord));
+    undo->record_count -= count;
+    undo->undo_count -= count;
+}
+
+//never drops the last record
+static void enforce_limits(TextUndo* undo)
+{
+    size_t drop_count = 0;
+
+    if (undo->record_count > TEXT_UNDO_MAX_RECORDS) {
+        drop_count = undo->record_count - TEXT_UNDO_MAX_RECORDS + TEXT_UNDO_DROP_BATCH;
+    }
+
+    size_t copied_bytes = undo->copied_bytes;
+    for (size_t i = 0; i < drop_count; i++) {
+        if (undo->records[i].has_text && undo->records[i].text.str) {
+            copied_bytes -= undo->records[i].text.str->data_size;
+        }
+    }
+    while (copied_bytes > TEXT_UNDO_MAX_COPIED_BYTES && drop_count + 1 < undo->undo_count) {
+        if (undo->records[drop_count].has_text && undo->records[drop_count].text.str) {
+            copied_bytes -= undo->records[drop_count].text.str->data_size;
+        }
+        drop_count++;
+    }
+
+    if (drop_count > undo->undo_count - 1) {
+        drop_count = undo->undo_count - 1;
+    }
+    if (drop_count > 0) {
+        drop_oldest(undo, drop_count);
+    }
+}
+
+static void push_record(TextUndo* undo, TextUndoRecord record)
+{
+    drop_redo(undo);
+
+    if (record.has_text && record.text.str) {
+        undo->copied_bytes += record.text.str->data_size;
+    }
+
+    if (undo->record_count >= undo->record_capacity) {
+        size_t new_capacity = undo->record_capacity ? undo->record_capacity * 2 : TEXT_UNDO_DEFAULT_CAPACITY;
+        TextUndoRecord* new_records = realloc(undo->records, new_capacity * sizeof(TextUndoRecord));
+        if (!new_records) {
+            fprintf(stderr, "%s:%d:ERROR : failed to grow undo records!!!\n", __FILE__, __LINE__);
+            //forget the history rather than the edit
+            drop_oldest(undo, undo->undo_count);
+            if (record.has_text) {
+                free_text(undo, &record.text);
+            }
+            return;
+        }
+        undo->records = new_records;
+        undo->record_capacity = new_capacity;
+    }
+
+    undo->records[undo->record_count++] = record;
+    undo->undo_count = undo->record_count;
+
+    enforce_limits(undo);
+}
+
+void text_undo_init(TextUndo* undo, TextLine** removed_lines)
+{
+    memset(undo, 0, sizeof(TextUndo));
+    undo->removed_lines = removed_lines;
+    undo->is_sealed = true;
+}
+
+void text_undo_destroy(TextUndo* undo)
+{
+    undo->undo_count = 0;
+    drop_redo(undo);
+    free(undo->records);
+    undo->records = NULL;
+    undo->record_capacity = 0;
+}
+
+void text_undo_record_insert(TextUndo* undo, TextUndoPosition start, TextUndoPosition end, UTFStringView inserted)
+{
+    if (inserted.data_size == 0) {
+        return;
+    }
+
+    bool starts_with_space = is_space_byte(inserted.data[0]);
+    bool ends_with_space = is_space_byte(inserted.data[inserted.data_size - 1]);
+
+    drop_redo(undo);
+
+    //keystrokes are merged until a word ends
+    if (!undo->is_sealed && inserted.count == 1 && undo->undo_count > 0) {
+        TextUndoRecord* last = &undo->records[undo->undo_count - 1];
+        bool word_ended = starts_with_space && !last->ends_with_space;
+        if (last->type == TEXT_UNDO_INSERT && !last->has_text && position_equal(last->end, start) && !word_ended) {
+            last->end = end;
+            last->ends_with_space = ends_with_space;
+            return;
+        }
+    }
+
+    TextUndoRecord record = {
+        .type = TEXT_UNDO_INSERT,
+        .start = start,
+        .end = end,
+        .has_text = false,
+        .ends_with_space = ends_with_space
+    };
+    push_record(undo, record);
+
+    //pasted text is undone on its own
+    undo->is_sealed = inserted.count != 1;
+}
+
+void text_undo_record_insert_piece(TextUndo* undo, TextUndoPosition start, TextUndoPosition end, UTFStringView inserted)
+{
+    if (inserted.data_size == 0) {
+        return;
+    }
+
+    drop_redo(undo);
+
+    if (undo->undo_count > 0) {
+        TextUndoRecord* last = &undo->records[undo->undo_count - 1];
+        if (last->type == TEXT_UNDO_INSERT && !last->has_text && position_equal(last->end, start)) {
+            last->end = end;
+            last->ends_with_space = is_space_byte(inserted.data[inserted.data_size - 1]);
+            return;
+        }
+    }
+
+    //record of the first piece was dropped, rest of the paste is undone on its own
+    text_undo_record_insert(undo, start, end, inserted);
+    undo->is_sealed = true;
+}
+
+void text_undo_record_delete(TextUndo* undo, TextUndoPosition start, TextUndoPosition end, TextUndoText removed)
+{
+    drop_redo(undo);
+
+    //backspacing prepends to the last delete
+    if (!undo->is_sealed && removed.first_line == NULL && undo->undo_count > 0) {
+        TextUndoRecord* last = &undo->records[undo->undo_count - 1];
+        if (last->type == TEXT_UNDO_DELETE && last->has_text && last->text.first_line == NULL &&
+            position_equal(last->start, end)) {
+            utf_insert_str(last->text.str, 0, removed.str);
+            undo->copied_bytes += removed.str->data_size;
+            utf_destroy(removed.str);
+            last->start = start;
+            return;
+        }
+    }
+
+    TextUndoRecord record = {
+        .type = TEXT_UNDO_DELETE,
+        .start = start,
+        .end = end,
+        .has_text = true,
+        .text = removed
+    };
+    push_record(undo, record);
+
+    undo->is_sealed = false;
+}
+
+void text_undo_seal(TextUndo* undo)
+{
+    undo->is_sealed = true;
+}
+
+TextUndoRecord* text_undo_undo(TextUndo* undo)
+{
+    undo->is_sealed = true;
+    if (undo->undo_count == 0) {
+        return NULL;
+    }
+    return &undo->records[--undo->undo_count];
+}
+
+TextUndoRecord* text_undo_redo(TextUndo* undo)
+{
+    undo->is_sealed = true;
+    if (undo->undo_count == undo->record_count) {
+        return NULL;
+    }
+    return &undo->records[undo->undo_count++];
+}
+
+TextUndoText text_undo_take_text(TextUndo* undo, TextUndoRecord* record)
+{
+    assert(record->has_text);
+
+    TextUndoText text = record->text;
+    if (text.str) {
+        undo->copied_bytes -= text.str->data_size;
+    }
+
+    record->has_text = false;
+    memset(&record->text, 0, sizeof(TextUndoText));
+
+    return text;
+}
+
+void text_undo_set_text(TextUndo* undo, TextUndoRecord* record, TextUndoText text)
+{
+    assert(!record->has_text);
+
+    if (text.str) {
+        undo->copied_bytes += text.str->data_size;
+    }
+
+    record->has_text = true;
+    record->text = text;
+}
+
+size_t text_undo_memory_usage(TextUndo* undo)
+{
+    return sizeof(TextUndo) + undo->record_capacity * sizeof(TextUndoRecord) + undo->copied_bytes;
+}
+
+static TextUndoPosition test_pos(size_t line_number, size_t char_offset)
+{
+    TextUndoPosition pos = {.line_number = line_number, .char_offset = char_offset};
+    return pos;
+}
+
+static TextUndoText test_text(const char* cstr)
+{
+    TextUndoText text = {0};
+    text.str = utf_from_cstr(cstr);
+    return text;
+}
+
+void text_undo_test()
+{
+    TextLine* removed_lines = NULL;
+
+    //typing is merged by words
+    {
+        TextUndo undo;
+        text_undo_init(&undo, &removed_lines);
+
+        const char* typed = "ab cd\r\n";
+        size_t typed_size = strlen(typed);
+        for (size_t i = 0; i < typed_size; i++) {
+            UTFStringView sv = {.data = typed + i, .data_size = 1, .count = 1};
+            text_undo_record_insert(&undo, test_pos(0, i), test_pos(0, i + 1), sv);
+        }
+        assert(undo.record_count == 3);
+        assert(position_equal(undo.records[0].end, test_pos(0, 2)));
+        assert(position_equal(undo.records[1].start, test_pos(0, 2)));
+        assert(position_equal(undo.records[1].end, test_pos(0, 5)));
+        assert(position_equal(undo.records[2].end, test_pos(0, typed_size)));
+        assert(undo.copied_bytes == 0);
+
+        //paste is not merged
+        text_undo_record_insert(&undo, test_pos(0, 7), test_pos(1, 3), utf_sv_from_cstr("x\nyyy"));
+        text_undo_record_insert(&undo, test_pos(1, 3), test_pos(1, 4), utf_sv_from_cstr("z"));
+        assert(undo.record_count == 5);
+
+        //moving the cursor seals
+        text_undo_seal(&undo);
+        text_undo_record_insert(&undo, test_pos(1, 4), test_pos(1, 5), utf_sv_from_cstr("z"));
+        assert(undo.record_count == 6);
+
+        //pieces of a paste are added to its record
+        text_undo_record_insert(&undo, test_pos(1, 5), test_pos(1, 8), utf_sv_from_cstr("abc"));
+        text_undo_record_insert_piece(&undo, test_pos(1, 8), test_pos(3, 1), utf_sv_from_cstr("d\ne\nf"));
+        text_undo_record_insert_piece(&undo, test_pos(3, 1), test_pos(3, 2), utf_sv_from_cstr("g"));
+        assert(undo.record_count == 7);
+        assert(position_equal(undo.records[6].start, test_pos(1, 5)));
+        assert(position_equal(undo.records[6].end, test_pos(3, 2)));
+        text_undo_record_insert(&undo, test_pos(3, 2), test_pos(3, 3), utf_sv_from_cstr("h"));
+        assert(undo.record_count == 8);
+
+        text_undo_destroy(&undo);
+    }
+
+    //backspacing is merged into one delete
+    {
+        TextUndo undo;
+        text_undo_init(&undo, &removed_lines);
+
+        text_undo_record_delete(&undo, test_pos(1, 2), test_pos(1, 3), test_text("c"));
+        text_undo_record_delete(&undo, test_pos(1, 1), test_pos(1, 2), test_text("b"));
+        text_undo_record_delete(&undo, test_pos(1, 0), test_pos(1, 1), test_text("a"));
+        text_undo_record_delete(&undo, test_pos(0, 5), test_pos(1, 0), test_text("\r\n"));
+        assert(undo.record_count == 1);
+        assert(utf_sv_cmp(utf_sv_from_str(undo.records[0].text.str), utf_sv_from_cstr("\r\nabc")));
+        assert(position_equal(undo.records[0].start, test_pos(0, 5)));
+        assert(position_equal(undo.records[0].end, test_pos(1, 3)));
+        assert(undo.copied_bytes == 5);
+
+        //undo and redo toggle the record
+        TextUndoRecord* record = text_undo_undo(&undo);
+        assert(record == &undo.records[0]);
+        assert(text_undo_undo(&undo) == NULL);
+        TextUndoText text = text_undo_take_text(&undo, record);
+        assert(undo.copied_bytes == 0);
+        utf_destroy(text.str);
+
+        record = text_undo_redo(&undo);
+        assert(record == &undo.records[0]);
+        assert(text_undo_redo(&undo) == NULL);
+        text_undo_set_text(&undo, record, test_text("\r\nabc"));
+        assert(undo.copied_bytes == 5);
+
+        //new edit after undo drops redo
+        text_undo_undo(&undo);
+        text = text_undo_take_text(&undo, record);
+        utf_destroy(text.str);
+        text_undo_record_insert(&undo, test_pos(0, 0), test_pos(0, 1), utf_sv_from_cstr("q"));
+        assert(undo.record_count == 1 && undo.undo_count == 1);
+        assert(undo.records[0].type == TEXT_UNDO_INSERT);
+
+        text_undo_destroy(&undo);
+    }
+
+    //removed lines are kept and given back when the record is dropped
+    {
+        TextUndo undo;
+        text_undo_init(&undo, &removed_lines);
+
+        TextLine* lines = create_lines_from_cstr("a\nb\nc");
+        TextUndoText removed = test_text("tail");
+        removed.first_line = lines;
+        removed.last_line = text_line_last(lines);
+        removed.line_count = 3;
+        removed.ends_with_lf = true;
+        text_undo_record_delete(&undo, test_pos(0, 1), test_pos(3, 0), removed);
+
+        //lines are never merged
+        text_undo_record_delete(&undo, test_pos(0, 0), test_pos(0, 1), test_text("x"));
+        assert(undo.record_count == 2);
+
+        text_undo_undo(&undo);
+        text_undo_undo(&undo);
+        text_undo_record_insert(&undo, test_pos(0, 0), test_pos(0, 1), utf_sv_from_cstr("q"));
+        assert(undo.record_count == 1);
+        assert(removed_lines == lines);
+        assert(undo.copied_bytes == 0);
+
+        text_undo_destroy(&undo);
+    }
+
+    //oldest records are dropped
+    {
+        TextUndo undo;
+        text_undo_init(&undo, &removed_lines);
+
+        for (size_t i = 0; i < TEXT_UNDO_MAX_RECORDS + 10; i++) {
+            text_undo_seal(&undo);
+            text_undo_record_insert(&undo, test_pos(i, 0), test_pos(i, 1), utf_sv_from_cstr("a"));
+        }
+        assert(undo.record_count <= TEXT_UNDO_MAX_RECORDS);
+        assert(undo.records[undo.record_count - 1].start.line_number == TEXT_UNDO_MAX_RECORDS + 9);
+
+        text_undo_destroy(&undo);
+    }
+
+    for (TextLine* line = removed_lines; line != NULL; ) {
+        TextLine* next = line->next;
+        text_line_destroy(line);
+        line = next;
+    }
+}
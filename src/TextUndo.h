@@ -0,0 +1,108 @@
+#ifndef TextUndo_HEADER_GUARD
+#define TextUndo_HEADER_GUARD
+
+#include "UTFString.h"
+#include "TextLine.h"
+#include <stdbool.h>
+
+typedef struct TextUndoPosition {
+    size_t line_number;
+    size_t char_offset;
+} TextUndoPosition;
+
+// Text of an edit that is not in the document right now
+//
+// Text within a line is copied to str.
+// When text spans lines, removed lines are kept as they are instead of being copied.
+// Then str is the text that was after the position on the first line,
+// and lines hold the rest (last line still has what followed the text)
+typedef struct TextUndoText {
+    UTFString* str;
+
+    TextLine* first_line;
+    TextLine* last_line;
+    size_t line_count;
+
+    //line ending of the first line
+    bool ends_with_lf;
+    bool ends_with_crlf;
+
+    //which delete of the journal took the lines out, so putting them back refers to it
+    //SIZE_MAX if it isn't in the current journal
+    size_t journal_delete;
+} TextUndoText;
+
+typedef enum TextUndoType {
+    TEXT_UNDO_INSERT,
+    TEXT_UNDO_DELETE,
+} TextUndoType;
+
+// An edit that can be undone and redone
+//
+// Record only holds text while the text is not in the document,
+// so inserts don't copy anything until they are undone.
+// Undo and redo both just take the text out of the document, or put it back
+typedef struct TextUndoRecord {
+    TextUndoType type;
+
+    //where the text is when it is in the document
+    TextUndoPosition start;
+    TextUndoPosition end;
+
+    bool has_text;
+    TextUndoText text;
+
+    //inserted text ended with a space or a new line, typing is grouped by words
+    bool ends_with_space;
+} TextUndoRecord;
+
+// Undo and redo history
+//
+// records[0, undo_count) can be undone and records[undo_count, record_count) can be redone.
+// Consecutive typing and backspacing are merged into one record.
+// Oldest records are dropped when there are too many of them or they hold too much copied text
+typedef struct TextUndo {
+    TextUndoRecord* records;
+    size_t record_count;
+    size_t undo_count;
+    size_t record_capacity;
+
+    //bytes copied into str of records
+    size_t copied_bytes;
+
+    //next edit starts a new record even if it continues the last one
+    bool is_sealed;
+
+    //lines of dropped records are moved here to be freed later
+    TextLine** removed_lines;
+} TextUndo;
+
+void text_undo_init(TextUndo* undo, TextLine** removed_lines);
+void text_undo_destroy(TextUndo* undo);
+
+void text_undo_record_insert(TextUndo* undo, TextUndoPosition start, TextUndoPosition end, UTFStringView inserted);
+//next piece of a paste that came in pieces, it goes to the record of the paste
+void text_undo_record_insert_piece(TextUndo* undo, TextUndoPosition start, TextUndoPosition end, UTFStringView inserted);
+//undo takes the removed text
+void text_undo_record_delete(TextUndo* undo, TextUndoPosition start, TextUndoPosition end, TextUndoText removed);
+
+//stops next edit from being merged to the last record
+//call it when the cursor jumps
+void text_undo_seal(TextUndo* undo);
+
+//returns record to undo(or redo) and moves it to the other side
+//NULL if there is nothing to do
+TextUndoRecord* text_undo_undo(TextUndo* undo);
+TextUndoRecord* text_undo_redo(TextUndo* undo);
+
+//record gives its text back to the document
+TextUndoText text_undo_take_text(TextUndo* undo, TextUndoRecord* record);
+//text was taken out of the document
+void text_undo_set_text(TextUndo* undo, TextUndoRecord* record, TextUndoText text);
+
+//bytes used by the history itself, not counting lines that are kept by reference
+size_t text_undo_memory_usage(TextUndo* undo);
+
+void text_undo_test();
+
+#endif
@@ -0,0 +1,319 @@
+#include "TextWord.h"
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+#include <stdbool.h>
+
+// Classes of the code points, as ranges
+//
+// Every entry is where a range starts(shifted left by 8) and its class(low 8 bits),
+// a range goes on until the next one starts. Code points that are not listed
+// are in a range of letters, so only what breaks words has to be here
+#define WORD_RANGE(first, word_class) (((uint32_t)(first) << 8) | (word_class))
+
+static const uint32_t WORD_CLASS_RANGES[] = {
+    WORD_RANGE(0x0000, TEXT_WORD_SPACE),          //controls, tab, new lines and space
+    WORD_RANGE(0x0021, TEXT_WORD_PUNCTUATION),
+    WORD_RANGE(0x0030, TEXT_WORD_LETTER),         //digits
+    WORD_RANGE(0x003A, TEXT_WORD_PUNCTUATION),
+    WORD_RANGE(0x0041, TEXT_WORD_LETTER),
+    WORD_RANGE(0x005B, TEXT_WORD_PUNCTUATION),
+    WORD_RANGE(0x005F, TEXT_WORD_LETTER),         //underscore is a part of identifiers
+    WORD_RANGE(0x0060, TEXT_WORD_PUNCTUATION),
+    WORD_RANGE(0x0061, TEXT_WORD_LETTER),
+    WORD_RANGE(0x007B, TEXT_WORD_PUNCTUATION),
+    WORD_RANGE(0x007F, TEXT_WORD_SPACE),          //delete and C1 controls
+    WORD_RANGE(0x00A0, TEXT_WORD_SPACE),          //no-break space
+    WORD_RANGE(0x00A1, TEXT_WORD_PUNCTUATION),
+    WORD_RANGE(0x00AA, TEXT_WORD_LETTER),
+    WORD_RANGE(0x00AB, TEXT_WORD_PUNCTUATION),
+    WORD_RANGE(0x00B5, TEXT_WORD_LETTER),
+    WORD_RANGE(0x00B6, TEXT_WORD_PUNCTUATION),
+    WORD_RANGE(0x00BA, TEXT_WORD_LETTER),
+    WORD_RANGE(0x00BB, TEXT_WORD_PUNCTUATION),
+    WORD_RANGE(0x00C0, TEXT_WORD_LETTER),
+    WORD_RANGE(0x00D7, TEXT_WORD_PUNCTUATION),
+    WORD_RANGE(0x00D8, TEXT_WORD_LETTER),
+    WORD_RANGE(0x00F7, TEXT_WORD_PUNCTUATION),
+    WORD_RANGE(0x00F8, TEXT_WORD_LETTER),
+    WORD_RANGE(0x0300, TEXT_WORD_MARK),           //combining diacritical marks
+    WORD_RANGE(0x0370, TEXT_WORD_LETTER),
+    WORD_RANGE(0x1100, TEXT_WORD_HANGUL),         //hangul jamo
+    WORD_RANGE(0x1200, TEXT_WORD_LETTER),
+    WORD_RANGE(0x1680, TEXT_WORD_SPACE),
+    WORD_RANGE(0x1681, TEXT_WORD_LETTER),
+    WORD_RANGE(0x1AB0, TEXT_WORD_MARK),
+    WORD_RANGE(0x1B00, TEXT_WORD_LETTER),
+    WORD_RANGE(0x1DC0, TEXT_WORD_MARK),
+    WORD_RANGE(0x1E00, TEXT_WORD_LETTER),
+    WORD_RANGE(0x2000, TEXT_WORD_SPACE),          //spaces and zero width space
+    WORD_RANGE(0x200C, TEXT_WORD_MARK),           //joiners
+    WORD_RANGE(0x200E, TEXT_WORD_SPACE),
+    WORD_RANGE(0x2010, TEXT_WORD_PUNCTUATION),    //general punctuation
+    WORD_RANGE(0x2028, TEXT_WORD_SPACE),
+    WORD_RANGE(0x2030, TEXT_WORD_PUNCTUATION),
+    WORD_RANGE(0x205F, TEXT_WORD_SPACE),
+    WORD_RANGE(0x2070, TEXT_WORD_LETTER),
+    WORD_RANGE(0x20A0, TEXT_WORD_PUNCTUATION),    //currencies
+    WORD_RANGE(0x20D0, TEXT_WORD_MARK),
+    WORD_RANGE(0x2100, TEXT_WORD_LETTER),
+    WORD_RANGE(0x2190, TEXT_WORD_PUNCTUATION),    //arrows, math, boxes and other symbols
+    WORD_RANGE(0x2C00, TEXT_WORD_LETTER),
+    WORD_RANGE(0x2E00, TEXT_WORD_PUNCTUATION),
+    WORD_RANGE(0x2E80, TEXT_WORD_HAN),            //radicals
+    WORD_RANGE(0x2FE0, TEXT_WORD_LETTER),
+    WORD_RANGE(0x3000, TEXT_WORD_SPACE),          //ideographic space
+    WORD_RANGE(0x3001, TEXT_WORD_PUNCTUATION),    //CJK punctuation
+    WORD_RANGE(0x3005, TEXT_WORD_HAN),            //iteration mark, closing mark and zero
+    WORD_RANGE(0x3008, TEXT_WORD_PUNCTUATION),
+    WORD_RANGE(0x3021, TEXT_WORD_HAN),            //hangzhou numerals
+    WORD_RANGE(0x302A, TEXT_WORD_MARK),
+    WORD_RANGE(0x3030, TEXT_WORD_PUNCTUATION),
+    WORD_RANGE(0x3031, TEXT_WORD_KATAKANA),       //kana repeat marks
+    WORD_RANGE(0x3036, TEXT_WORD_PUNCTUATION),
+    WORD_RANGE(0x3041, TEXT_WORD_HIRAGANA),
+    WORD_RANGE(0x3099, TEXT_WORD_MARK),           //voiced sound marks
+    WORD_RANGE(0x309D, TEXT_WORD_HIRAGANA),
+    WORD_RANGE(0x30A0, TEXT_WORD_PUNCTUATION),
+    WORD_RANGE(0x30A1, TEXT_WORD_KATAKANA),
+    WORD_RANGE(0x30FB, TEXT_WORD_PUNCTUATION),    //middle dot
+    WORD_RANGE(0x30FC, TEXT_WORD_KATAKANA),       //prolonged sound mark
+    WORD_RANGE(0x3100, TEXT_WORD_LETTER),
+    WORD_RANGE(0x3130, TEXT_WORD_HANGUL),         //compatibility jamo
+    WORD_RANGE(0x3190, TEXT_WORD_LETTER),
+    WORD_RANGE(0x31F0, TEXT_WORD_KATAKANA),
+    WORD_RANGE(0x3200, TEXT_WORD_PUNCTUATION),    //enclosed letters and months
+    WORD_RANGE(0x3400, TEXT_WORD_HAN),            //extension A and unified ideographs
+    WORD_RANGE(0xA000, TEXT_WORD_LETTER),
+    WORD_RANGE(0xA960, TEXT_WORD_HANGUL),         //jamo extended A
+    WORD_RANGE(0xA980, TEXT_WORD_LETTER),
+    WORD_RANGE(0xAC00, TEXT_WORD_HANGUL),         //syllables and jamo extended B
+    WORD_RANGE(0xD800, TEXT_WORD_LETTER),
+    WORD_RANGE(0xF900, TEXT_WORD_HAN),            //compatibility ideographs
+    WORD_RANGE(0xFB00, TEXT_WORD_LETTER),
+    WORD_RANGE(0xFE00, TEXT_WORD_MARK),           //variation selectors
+    WORD_RANGE(0xFE10, TEXT_WORD_PUNCTUATION),
+    WORD_RANGE(0xFE20, TEXT_WORD_MARK),
+    WORD_RANGE(0xFE30, TEXT_WORD_PUNCTUATION),    //vertical and small forms
+    WORD_RANGE(0xFE70, TEXT_WORD_LETTER),
+    WORD_RANGE(0xFEFF, TEXT_WORD_SPACE),          //byte order mark
+    WORD_RANGE(0xFF00, TEXT_WORD_PUNCTUATION),    //fullwidth forms, as ASCII
+    WORD_RANGE(0xFF10, TEXT_WORD_LETTER),
+    WORD_RANGE(0xFF1A, TEXT_WORD_PUNCTUATION),
+    WORD_RANGE(0xFF21, TEXT_WORD_LETTER),
+    WORD_RANGE(0xFF3B, TEXT_WORD_PUNCTUATION),
+    WORD_RANGE(0xFF3F, TEXT_WORD_LETTER),
+    WORD_RANGE(0xFF40, TEXT_WORD_PUNCTUATION),
+    WORD_RANGE(0xFF41, TEXT_WORD_LETTER),
+    WORD_RANGE(0xFF5B, TEXT_WORD_PUNCTUATION),
+    WORD_RANGE(0xFF66, TEXT_WORD_KATAKANA),       //halfwidth katakana
+    WORD_RANGE(0xFFA0, TEXT_WORD_HANGUL),         //halfwidth jamo
+    WORD_RANGE(0xFFE0, TEXT_WORD_PUNCTUATION),
+    WORD_RANGE(0x10000, TEXT_WORD_LETTER),
+    WORD_RANGE(0x1F000, TEXT_WORD_PUNCTUATION),   //emoji and pictographs
+    WORD_RANGE(0x1F3FB, TEXT_WORD_MARK),          //skin tones
+    WORD_RANGE(0x1F400, TEXT_WORD_PUNCTUATION),
+    WORD_RANGE(0x1FC00, TEXT_WORD_LETTER),
+    WORD_RANGE(0x20000, TEXT_WORD_HAN),           //supplementary ideographic planes
+    WORD_RANGE(0x40000, TEXT_WORD_LETTER),
+    WORD_RANGE(0xE0000, TEXT_WORD_MARK),          //tags and variation selectors supplement
+    WORD_RANGE(0xE0200, TEXT_WORD_LETTER),
+};
+
+#define WORD_RANGE_COUNT (sizeof(WORD_CLASS_RANGES) / sizeof(WORD_CLASS_RANGES[0]))
+
+static uint32_t word_range_first(size_t index)
+{
+    return WORD_CLASS_RANGES[index] >> 8;
+}
+
+//hint is the range that was found last, neighbouring characters are usually in it
+static TextWordClass word_class_lookup(uint32_t codepoint, size_t* hint)
+{
+    size_t index = *hint;
+    bool is_in_hint =
+        word_range_first(index) <= codepoint &&
+        (index + 1 == WORD_RANGE_COUNT || codepoint < word_range_first(index + 1));
+
+    if (!is_in_hint) {
+        //last range that starts at or before the code point
+        size_t low = 0;
+        size_t high = WORD_RANGE_COUNT;
+        while (high - low > 1) {
+            size_t mid = low + (high - low) / 2;
+            if (word_range_first(mid) <= codepoint) {
+                low = mid;
+            }
+            else {
+                high = mid;
+            }
+        }
+        index = low;
+        *hint = index;
+    }
+
+    return (TextWordClass)(WORD_CLASS_RANGES[index] & 0xFF);
+}
+
+TextWordClass text_word_class(uint32_t codepoint)
+{
+    size_t hint = 0;
+    return word_class_lookup(codepoint, &hint);
+}
+
+size_t text_word_next(UTFStringView sv, size_t byte_offset, size_t* char_count)
+{
+    size_t hint = 0;
+    UTFIterator it = utf_iter_at(sv, byte_offset, 0);
+    UTFIterator next = it;
+    UTFChar c;
+
+    //rest of the word the offset is in, marks go with it
+    TextWordClass word_class = TEXT_WORD_SPACE;
+    while (utf_iter_next(&next, &c)) {
+        TextWordClass char_class = word_class_lookup(c.codepoint, &hint);
+        if (it.index == 0) {
+            word_class = char_class == TEXT_WORD_MARK ? TEXT_WORD_LETTER : char_class;
+        }
+        else if (char_class != word_class && char_class != TEXT_WORD_MARK) {
+            break;
+        }
+        if (word_class == TEXT_WORD_SPACE) {
+            break;
+        }
+        it = next;
+    }
+
+    //and spaces after it
+    next = it;
+    while (utf_iter_next(&next, &c)) {
+        if (word_class_lookup(c.codepoint, &hint) != TEXT_WORD_SPACE) {
+            break;
+        }
+        it = next;
+    }
+
+    if (char_count) {
+        *char_count = it.index;
+    }
+    return it.byte_offset;
+}
+
+size_t text_word_prev(UTFStringView sv, size_t byte_offset, size_t* char_count)
+{
+    size_t hint = 0;
+    size_t pos = byte_offset < sv.data_size ? byte_offset : sv.data_size;
+    //index only tells how far it went, there are never more characters than bytes before pos
+    UTFIterator it = utf_iter_at(sv, pos, pos);
+    UTFIterator prev = it;
+    UTFChar c;
+
+    //spaces before the offset
+    while (utf_iter_prev(&prev, &c)) {
+        if (word_class_lookup(c.codepoint, &hint) != TEXT_WORD_SPACE) {
+            break;
+        }
+        it = prev;
+    }
+
+    //and the word before them, a character goes with the marks after it
+    bool has_word_class = false;
+    TextWordClass word_class = TEXT_WORD_LETTER;
+    while (it.byte_offset > 0) {
+        UTFIterator start = it;
+        TextWordClass char_class = TEXT_WORD_MARK;
+        while (char_class == TEXT_WORD_MARK && utf_iter_prev(&start, &c)) {
+            char_class = word_class_lookup(c.codepoint, &hint);
+        }
+        //marks at the start of the line
+        if (char_class == TEXT_WORD_MARK) {
+            char_class = TEXT_WORD_LETTER;
+        }
+
+        if (!has_word_class) {
+            has_word_class = true;
+            word_class = char_class;
+        }
+        else if (char_class != word_class) {
+            break;
+        }
+        it = start;
+    }
+
+    if (char_count) {
+        *char_count = pos - it.index;
+    }
+    return it.byte_offset;
+}
+
+//next and prev stops of the whole string, as byte offsets, end with SIZE_MAX
+static void word_test_stops(const char* str, const size_t* next_stops, const size_t* prev_stops)
+{
+    UTFStringView sv = utf_sv_from_cstr(str);
+
+    size_t pos = 0;
+    size_t chars = 0;
+    for (size_t i = 0; next_stops[i] != SIZE_MAX; i++) {
+        size_t count = 0;
+        pos = text_word_next(sv, pos, &count);
+        chars += count;
+        assert(pos == next_stops[i]);
+        assert(chars == utf_sv_count(utf_sv_sub_sv_bytes(sv, 0, pos)));
+    }
+    assert(pos == sv.data_size);
+
+    for (size_t i = 0; prev_stops[i] != SIZE_MAX; i++) {
+        size_t count = 0;
+        size_t prev = text_word_prev(sv, pos, &count);
+        assert(prev == prev_stops[i]);
+        assert(count == utf_sv_count(utf_sv_sub_sv_bytes(sv, prev, pos)));
+        pos = prev;
+    }
+    assert(pos == 0);
+}
+
+void text_word_test()
+{
+    assert(text_word_class(' ') == TEXT_WORD_SPACE);
+    assert(text_word_class('a') == TEXT_WORD_LETTER);
+    assert(text_word_class('_') == TEXT_WORD_LETTER);
+    assert(text_word_class('.') == TEXT_WORD_PUNCTUATION);
+    assert(text_word_class(0xAC00) == TEXT_WORD_HANGUL);
+    assert(text_word_class(0xD7A3) == TEXT_WORD_HANGUL);
+    assert(text_word_class(0x4E00) == TEXT_WORD_HAN);
+    assert(text_word_class(0x3042) == TEXT_WORD_HIRAGANA);
+    assert(text_word_class(0x30AB) == TEXT_WORD_KATAKANA);
+    assert(text_word_class(0x3000) == TEXT_WORD_SPACE);
+    assert(text_word_class(0x0301) == TEXT_WORD_MARK);
+    assert(text_word_class(0x10FFFF) == TEXT_WORD_LETTER);
+
+    //ranges have to be in order for the binary search
+    for (size_t i = 1; i < WORD_RANGE_COUNT; i++) {
+        assert(word_range_first(i - 1) < word_range_first(i));
+    }
+    {
+        size_t next[] = {7, 8, 9, 12, 13, SIZE_MAX};
+        size_t prev[] = {12, 9, 8, 7, 0, SIZE_MAX};
+        word_test_stops("hello  x.y  z", next, prev);
+    }
+    {
+        //"안녕하세요 世界です" : hangul, space, han, then hiragana
+        size_t next[] = {16, 22, 28, SIZE_MAX};
+        size_t prev[] = {22, 16, 0, SIZE_MAX};
+        word_test_stops(u8"안녕하세요 世界です", next, prev);
+    }
+    {
+        //"cafe" with a combining acute stays one word, hangul right after it is another
+        size_t next[] = {6, 9, SIZE_MAX};
+        size_t prev[] = {6, 0, SIZE_MAX};
+        word_test_stops("cafe\xcc\x81\xed\x95\x9c", next, prev);
+    }
+    {
+        UTFStringView sv = utf_sv_from_cstr("  ab");
+        size_t count = 0;
+        assert(text_word_next(sv, 0, &count) == 2 && count == 2);
+        assert(text_word_prev(sv, 2, &count) == 0 && count == 2);
+        assert(text_word_next(sv, 4, &count) == 4 && count == 0);
+        assert(text_word_prev(sv, 0, &count) == 0 && count == 0);
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef TextWord_HEADER_GUARD
+#define TextWord_HEADER_GUARD
+
+#include "UTFString.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// What kind of character a code point is, for finding where words start
+//
+// A word is a run of characters of the same class, so Korean, Chinese and
+// Japanese next to each other or next to Latin letters are different words.
+// Combining marks (and joiners, variation selectors and skin tones) go with
+// the character before them
+typedef enum TextWordClass {
+    TEXT_WORD_SPACE,
+    TEXT_WORD_PUNCTUATION,
+    TEXT_WORD_LETTER,
+    TEXT_WORD_HAN,
+    TEXT_WORD_HIRAGANA,
+    TEXT_WORD_KATAKANA,
+    TEXT_WORD_HANGUL,
+    TEXT_WORD_MARK,
+} TextWordClass;
+
+TextWordClass text_word_class(uint32_t codepoint);
+
+//byte offset of where the next word starts after byte_offset(spaces before it are skipped),
+//or the end of sv, char_count is set to how many characters it moved over
+size_t text_word_next(UTFStringView sv, size_t byte_offset, size_t* char_count);
+//byte offset of where the word before byte_offset starts(spaces after it are skipped),
+//or 0, char_count is set to how many characters it moved over
+size_t text_word_prev(UTFStringView sv, size_t byte_offset, size_t* char_count);
+
+void text_word_test();
+
+#endif
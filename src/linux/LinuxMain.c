@@ -8,6 +8,18 @@
 #include <stdbool.h>
 #include <assert.h>
 #include <locale.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <limits.h>
+#include <libgen.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/inotify.h>
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
@@ -18,6 +30,19 @@
 #include "../TextBox.h"
 #include "../TextLine.h"
 
+//max number of windows we can send copied text to at the same time with INCR
+#define CLIPBOARD_MAX_TRANSFERS 8
+
+//INCR transfer of copied text to another window
+typedef struct ClipboardTransfer
+{
+    bool active;
+    Window requestor;
+    Atom property;
+    bool from_text_box;
+    ClipboardReader reader;
+} ClipboardTransfer;
+
 typedef struct OS
 {
     Display* display;
@@ -28,8 +53,30 @@ typedef struct OS
     OS_Keymod key_mod;
     int window_width;
     int window_height;
+
+    //text that came from the clipboard but is not inserted to the text box yet
+    //it is filtered and always valid utf8
     UTFString* clipboard_paste_text;
+    //how many bytes of clipboard_paste_text are already inserted
+    size_t clipboard_paste_offset;
+    //text box got pieces of the paste and waits for the rest of it
+    bool clipboard_paste_is_inserting;
+    //property chunks can cut a utf8 character in half
+    //so we keep the incomplete bytes until next chunk arrives
+    unsigned char clipboard_paste_carry[4];
+    size_t clipboard_paste_carry_size;
+    //true while clipboard owner is sending us text with INCR protocol
+    bool clipboard_paste_incr;
+    Atom clipboard_paste_property;
+    //when the last piece came, owner that stops sending is given up on
+    double clipboard_paste_time;
+
+    //copied text is either clipboard_copy_text or text box's clipboard snapshot
+    //which is serialized only when someone asks for it
     UTFString* clipboard_copy_text;
+    bool clipboard_from_text_box;
+    ClipboardTransfer clipboard_transfers[CLIPBOARD_MAX_TRANSFERS];
+    char* clipboard_send_buffer;
 } OS;
 
 OS* GLOBAL_OS;
@@ -43,6 +90,27 @@ Atom WM_QUIT_ATOM = None;
 Atom CLIPBOARD_ATOM = None;
 Atom UTF8_ATOM = None;
 Atom TARGETS_ATOM = None;
+Atom INCR_ATOM = None;
+
+///////////////////
+//Clipboard settings
+///////////////////
+
+//how many bytes we ask for in a single XGetWindowProperty call
+//(must be multiple of 4 since offset is in 32 bit units)
+#define CLIPBOARD_READ_SIZE (64 * 1024)
+
+//how many bytes of pasted text we insert to the text box per frame
+#define CLIPBOARD_INSERT_SIZE (64 * 1024)
+
+//seconds we wait for the next piece of INCR transfer before we give up on it
+#define CLIPBOARD_PASTE_TIMEOUT 5.0
+
+//copied text bigger than this is sent with INCR protocol in pieces of this size
+#define CLIPBOARD_SEND_SIZE (64 * 1024)
+
+//how many removed lines we free per frame
+#define FREE_REMOVED_LINES_PER_FRAME 4096
 
 
 ///////////////////
@@ -58,7 +126,8 @@ OS_Keymod os_get_mod_state()
 
 void os_set_ime_preedit_pos(int x, int y)
 {
-    if(!GLOBAL_OS){
+    //clipboard test has no input context
+    if(!GLOBAL_OS || !GLOBAL_OS->xic){
         return;
     }
     XPoint spot = {.x = x, .y = y};
@@ -86,6 +155,462 @@ void os_set_clipboard_text(UTFStringView sv)
     }
 	XSetSelectionOwner(GLOBAL_OS->display, CLIPBOARD_ATOM, GLOBAL_OS->window, CurrentTime);
 	utf_set_sv(GLOBAL_OS->clipboard_copy_text, sv);
+    GLOBAL_OS->clipboard_from_text_box = false;
+}
+
+void os_claim_clipboard()
+{
+    if(!GLOBAL_OS){
+        return;
+    }
+    XSetSelectionOwner(GLOBAL_OS->display, CLIPBOARD_ATOM, GLOBAL_OS->window, CurrentTime);
+    GLOBAL_OS->clipboard_from_text_box = true;
+}
+
+struct OS_Thread
+{
+    pthread_t thread;
+    OS_ThreadFunction function;
+    void* data;
+};
+
+struct OS_Mutex
+{
+    pthread_mutex_t mutex;
+};
+
+static void* os_thread_start(void* data)
+{
+    OS_Thread* thread = data;
+    thread->function(thread->data);
+    return NULL;
+}
+
+OS_Thread* os_thread_create(OS_ThreadFunction function, void* data)
+{
+    OS_Thread* thread = malloc(sizeof(OS_Thread));
+    thread->function = function;
+    thread->data = data;
+    if(pthread_create(&thread->thread, NULL, os_thread_start, thread) != 0){
+        fprintf(stderr, "%s:%d:ERROR : Failed to create a thread\n", __FILE__, __LINE__);
+        free(thread);
+        return NULL;
+    }
+    return thread;
+}
+
+void os_thread_join(OS_Thread* thread)
+{
+    pthread_join(thread->thread, NULL);
+    free(thread);
+}
+
+OS_Mutex* os_mutex_create()
+{
+    OS_Mutex* mutex = malloc(sizeof(OS_Mutex));
+    pthread_mutex_init(&mutex->mutex, NULL);
+    return mutex;
+}
+
+void os_mutex_destroy(OS_Mutex* mutex)
+{
+    pthread_mutex_destroy(&mutex->mutex);
+    free(mutex);
+}
+
+void os_mutex_lock(OS_Mutex* mutex)
+{
+    pthread_mutex_lock(&mutex->mutex);
+}
+
+void os_mutex_unlock(OS_Mutex* mutex)
+{
+    pthread_mutex_unlock(&mutex->mutex);
+}
+
+size_t os_get_processor_count()
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (size_t)count : 1;
+}
+
+double os_get_time()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+void os_sleep(double seconds)
+{
+    struct timespec time;
+    time.tv_sec = (time_t)seconds;
+    time.tv_nsec = (long)((seconds - (double)time.tv_sec) * 1e9);
+    nanosleep(&time, NULL);
+}
+
+struct OS_FileMapping
+{
+    char* data;
+    size_t size;
+};
+
+OS_FileMapping* os_map_file(const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "%s:%d:ERROR : Failed to open %s\n", __FILE__, __LINE__, path);
+        return NULL;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+        fprintf(stderr, "%s:%d:ERROR : %s is not a regular file\n", __FILE__, __LINE__, path);
+        close(fd);
+        return NULL;
+    }
+
+    OS_FileMapping* mapping = malloc(sizeof(OS_FileMapping));
+    mapping->data = NULL;
+    mapping->size = file_stat.st_size;
+
+    //mmap fails on an empty file
+    if (mapping->size > 0) {
+        void* data = mmap(NULL, mapping->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            fprintf(stderr, "%s:%d:ERROR : Failed to map %s\n", __FILE__, __LINE__, path);
+            free(mapping);
+            close(fd);
+            return NULL;
+        }
+        mapping->data = data;
+    }
+
+    //mapping stays valid after the file is closed
+    close(fd);
+
+    return mapping;
+}
+
+void os_unmap_file(OS_FileMapping* mapping)
+{
+    if (mapping->data) {
+        munmap(mapping->data, mapping->size);
+    }
+    free(mapping);
+}
+
+const char* os_file_mapping_data(OS_FileMapping* mapping)
+{
+    return mapping->data;
+}
+
+size_t os_file_mapping_size(OS_FileMapping* mapping)
+{
+    return mapping->size;
+}
+
+//limits.h only has it with _XOPEN_SOURCE, 1024 is what linux allows
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+struct OS_FileWriter
+{
+    int fd;
+    char* path;
+    char* temp_path;
+};
+
+OS_FileWriter* os_file_writer_create(const char* path)
+{
+    OS_FileWriter* writer = malloc(sizeof(OS_FileWriter));
+    writer->path = strdup(path);
+
+    //temporary file has to be on the same file system for rename to be atomic
+    size_t temp_path_size = strlen(path) + sizeof(".XXXXXX");
+    writer->temp_path = malloc(temp_path_size);
+    snprintf(writer->temp_path, temp_path_size, "%s.XXXXXX", path);
+
+    writer->fd = mkstemp(writer->temp_path);
+    if (writer->fd < 0) {
+        fprintf(stderr, "%s:%d:ERROR : Failed to create %s : %s\n", __FILE__, __LINE__, writer->temp_path, strerror(errno));
+        free(writer->temp_path);
+        free(writer->path);
+        free(writer);
+        return NULL;
+    }
+
+    //mkstemp only lets the owner read it, keep the permissions of the file it replaces
+    //new file gets what open would give it
+    mode_t mask = umask(0);
+    umask(mask);
+    mode_t mode = 0666 & ~mask;
+
+    struct stat file_stat;
+    if (stat(path, &file_stat) == 0) {
+        mode = file_stat.st_mode & 07777;
+    }
+    fchmod(writer->fd, mode);
+
+    return writer;
+}
+
+bool os_file_writer_write(OS_FileWriter* writer, const OS_WriteBuffer* buffers, size_t count)
+{
+    struct iovec iov[IOV_MAX];
+
+    size_t next = 0;
+    while (next < count) {
+        int iov_count = 0;
+        for (; next < count && iov_count < IOV_MAX; next++) {
+            if (buffers[next].size == 0) {
+                continue;
+            }
+            iov[iov_count].iov_base = (void*)buffers[next].data;
+            iov[iov_count].iov_len = buffers[next].size;
+            iov_count++;
+        }
+
+        //writev can stop in the middle of a buffer
+        struct iovec* pending = iov;
+        while (iov_count > 0) {
+            ssize_t written = writev(writer->fd, pending, iov_count);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                fprintf(stderr, "%s:%d:ERROR : Failed to write %s : %s\n", __FILE__, __LINE__, writer->temp_path, strerror(errno));
+                return false;
+            }
+
+            while (iov_count > 0 && (size_t)written >= pending->iov_len) {
+                written -= pending->iov_len;
+                pending++;
+                iov_count--;
+            }
+            if (iov_count > 0) {
+                pending->iov_base = (char*)pending->iov_base + written;
+                pending->iov_len -= written;
+            }
+        }
+    }
+
+    return true;
+}
+
+static void os_file_writer_free(OS_FileWriter* writer)
+{
+    free(writer->temp_path);
+    free(writer->path);
+    free(writer);
+}
+
+bool os_file_writer_commit(OS_FileWriter* writer)
+{
+    if (fsync(writer->fd) != 0) {
+        fprintf(stderr, "%s:%d:ERROR : Failed to flush %s : %s\n", __FILE__, __LINE__, writer->temp_path, strerror(errno));
+        os_file_writer_abort(writer);
+        return false;
+    }
+    close(writer->fd);
+    writer->fd = -1;
+
+    if (rename(writer->temp_path, writer->path) != 0) {
+        fprintf(stderr, "%s:%d:ERROR : Failed to replace %s : %s\n", __FILE__, __LINE__, writer->path, strerror(errno));
+        os_file_writer_abort(writer);
+        return false;
+    }
+
+    //rename itself is only on the disk once the directory is flushed
+    char* dir_path_buffer = strdup(writer->path);
+    int dir_fd = open(dirname(dir_path_buffer), O_RDONLY | O_DIRECTORY);
+    if (dir_fd >= 0) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+    free(dir_path_buffer);
+
+    os_file_writer_free(writer);
+    return true;
+}
+
+void os_file_writer_abort(OS_FileWriter* writer)
+{
+    if (writer->fd >= 0) {
+        close(writer->fd);
+    }
+    unlink(writer->temp_path);
+    os_file_writer_free(writer);
+}
+
+struct OS_AppendFile
+{
+    int fd;
+    char* path;
+};
+
+OS_AppendFile* os_append_file_open(const char* path)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0666);
+    if (fd < 0) {
+        fprintf(stderr, "%s:%d:ERROR : Failed to open %s : %s\n", __FILE__, __LINE__, path, strerror(errno));
+        return NULL;
+    }
+
+    OS_AppendFile* file = malloc(sizeof(OS_AppendFile));
+    file->fd = fd;
+    file->path = strdup(path);
+    return file;
+}
+
+void os_append_file_close(OS_AppendFile* file)
+{
+    close(file->fd);
+    free(file->path);
+    free(file);
+}
+
+bool os_append_file_write(OS_AppendFile* file, const void* data, size_t size)
+{
+    const char* pending = data;
+    while (size > 0) {
+        ssize_t written = write(file->fd, pending, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "%s:%d:ERROR : Failed to write %s : %s\n", __FILE__, __LINE__, file->path, strerror(errno));
+            return false;
+        }
+        pending += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool os_append_file_sync(OS_AppendFile* file)
+{
+    //size changes with every write, so it has to be flushed too, fdatasync does that
+    if (fdatasync(file->fd) != 0) {
+        fprintf(stderr, "%s:%d:ERROR : Failed to flush %s : %s\n", __FILE__, __LINE__, file->path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+struct OS_FileFollower
+{
+    int fd;
+    int inotify_fd;
+    char* path;
+
+    size_t offset;
+    //last read filled the buffer, so there is more to read even without a new event
+    bool has_more;
+};
+
+OS_FileFollower* os_file_follower_create(const char* path, size_t offset)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "%s:%d:ERROR : Failed to open %s : %s\n", __FILE__, __LINE__, path, strerror(errno));
+        return NULL;
+    }
+
+    int inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0 || inotify_add_watch(inotify_fd, path, IN_MODIFY) < 0) {
+        fprintf(stderr, "%s:%d:ERROR : Failed to watch %s : %s\n", __FILE__, __LINE__, path, strerror(errno));
+        if (inotify_fd >= 0) {
+            close(inotify_fd);
+        }
+        close(fd);
+        return NULL;
+    }
+
+    OS_FileFollower* follower = malloc(sizeof(OS_FileFollower));
+    follower->fd = fd;
+    follower->inotify_fd = inotify_fd;
+    follower->path = strdup(path);
+    follower->offset = offset;
+    //file could have grown before the watch was added
+    follower->has_more = true;
+    return follower;
+}
+
+void os_file_follower_destroy(OS_FileFollower* follower)
+{
+    close(follower->inotify_fd);
+    close(follower->fd);
+    free(follower->path);
+    free(follower);
+}
+
+size_t os_file_follower_read(OS_FileFollower* follower, char* buffer, size_t buffer_size)
+{
+    //many writes end up as one read of the events, only whether there were any matters
+    bool was_modified = false;
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (read(follower->inotify_fd, events, sizeof(events)) > 0) {
+        was_modified = true;
+    }
+
+    if (!was_modified && !follower->has_more) {
+        return 0;
+    }
+
+    ssize_t read_size = pread(follower->fd, buffer, buffer_size, follower->offset);
+    if (read_size < 0) {
+        if (errno != EINTR) {
+            fprintf(stderr, "%s:%d:ERROR : Failed to read %s : %s\n", __FILE__, __LINE__, follower->path, strerror(errno));
+        }
+        follower->has_more = false;
+        return 0;
+    }
+
+    //file was truncated, what was written from then on is read from its new end
+    if (read_size == 0 && was_modified) {
+        struct stat file_stat;
+        if (fstat(follower->fd, &file_stat) == 0 && (size_t)file_stat.st_size < follower->offset) {
+            follower->offset = file_stat.st_size;
+        }
+    }
+
+    follower->offset += read_size;
+    follower->has_more = (size_t)read_size == buffer_size;
+    return read_size;
+}
+
+bool os_get_file_stamp(const char* path, OS_FileStamp* stamp)
+{
+    struct stat file_stat;
+    if (stat(path, &file_stat) != 0) {
+        return false;
+    }
+    stamp->modified_time = (uint64_t)file_stat.st_mtim.tv_sec * 1000000000 + file_stat.st_mtim.tv_nsec;
+    stamp->size = file_stat.st_size;
+    return true;
+}
+
+bool os_create_temp_file(const char* prefix, char* path, size_t path_size)
+{
+    const char* dir = getenv("TMPDIR");
+    if (!dir || dir[0] == '\0') {
+        dir = "/tmp";
+    }
+
+    int size = snprintf(path, path_size, "%s/%s.XXXXXX", dir, prefix);
+    if (size < 0 || (size_t)size >= path_size) {
+        return false;
+    }
+
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        fprintf(stderr, "%s:%d:ERROR : Failed to create %s : %s\n", __FILE__, __LINE__, path, strerror(errno));
+        return false;
+    }
+    close(fd);
+    return true;
 }
 
 ////////////////////////////////
@@ -184,7 +709,11 @@ static const struct
     {XK_Escape, OS_KEY_ESC},
     {XK_Tab, OS_KEY_TAB},
     {XK_BackSpace, OS_KEY_BACKSPACE},
-    {XK_Return, OS_KEY_ENTER}
+    {XK_Return, OS_KEY_ENTER},
+    {XK_Page_Up, OS_KEY_PAGE_UP},
+    {XK_Page_Down, OS_KEY_PAGE_DOWN},
+    {XK_Home, OS_KEY_HOME},
+    {XK_End, OS_KEY_END}
 };
 
 //TODO : Perhaps it should read scancode instead of keysym....
@@ -246,21 +775,650 @@ static bool x11_keysym_to_os_keymod(KeySym xkeysym, OS_Keymod* out_os_keymod)
 //except new line
 
 //TODO : maybe check more rigorously
+static bool is_contorl_character(uint32_t char_code)
+{
+    return ((char_code >= 0x0001 && char_code <=0x001f) || (char_code >= 0x007f && char_code <=0x009f)) && char_code != '\n';
+}
+
 void remove_contorl_characters(UTFString* str){
-    size_t char_index = 0;
-    while(char_index < str->count){
-        UTFStringView sv = utf_sv_sub_str(str, char_index, char_index+1);
-        //uint32_t char_code_at = utf8_to_32(sv.data, sv.data_size);
-        uint32_t char_code_at = 0;
-        size_t size = 1;
-        utf8_to_32(sv.data, sv.data_size, &char_code_at, &size);
-        if( ((char_code_at >= 0x0001 && char_code_at <=0x001f) || (char_code_at >= 0x007f && char_code_at <=0x009f)) && char_code_at != '\n'){
-            utf_erase_range(str, char_index, char_index+1);
+    //kept characters are copied in runs to a new string,
+    //erasing them one by one moves the rest of the string every time
+    UTFStringView sv = utf_sv_from_str(str);
+    UTFString* kept = NULL;
+    size_t run_start = 0;
+
+    UTFIterator it = utf_iter_begin(sv);
+    UTFChar c;
+    while(utf_iter_next(&it, &c)){
+        if(is_contorl_character(c.codepoint)){
+            if(!kept){
+                kept = utf_from_cstr("");
+            }
+            utf_append_sv(kept, utf_sv_sub_sv_bytes(sv, run_start, c.byte_offset));
+            run_start = it.byte_offset;
+        }
+    }
+
+    if(kept){
+        utf_append_sv(kept, utf_sv_sub_sv_bytes(sv, run_start, sv.data_size));
+        utf_set_str(str, kept);
+        utf_destroy(kept);
+    }
+}
+
+////////////////////////////////
+//Clipboard pasting
+////////////////////////////////
+
+//Validates utf8 bytes and appends valid and printable characters to out.
+//Invalid bytes, null and control characters are dropped.
+//Returns how many bytes were consumed, bytes after that are an incomplete
+//character that continues in the next chunk.
+static size_t clipboard_filter_utf8(const unsigned char* data, size_t size, UTFString* out)
+{
+    size_t run_start = 0;
+    size_t run_count = 0;
+    size_t i = 0;
+
+    while(i < size){
+        unsigned char byte = data[i];
+        size_t char_size = 0;
+        uint32_t char_code = 0;
+        uint32_t min_code = 0;
+
+        if((byte & 0b10000000) == 0){
+            char_size = 1;
+            char_code = byte;
+        }
+        else if((byte & 0b11100000) == 0b11000000){
+            char_size = 2;
+            char_code = byte & 0b00011111;
+            min_code = 0x80;
+        }
+        else if((byte & 0b11110000) == 0b11100000){
+            char_size = 3;
+            char_code = byte & 0b00001111;
+            min_code = 0x800;
+        }
+        else if((byte & 0b11111000) == 0b11110000){
+            char_size = 4;
+            char_code = byte & 0b00000111;
+            min_code = 0x10000;
+        }
+
+        bool valid = char_size > 0;
+        size_t checked = 1;
+        while(valid && checked < char_size && i + checked < size){
+            if((data[i + checked] & 0b11000000) != 0b10000000){
+                valid = false;
+                break;
+            }
+            char_code = (char_code << 6) | (data[i + checked] & 0b00111111);
+            checked++;
+        }
+
+        //character continues in the next chunk
+        if(valid && checked < char_size){
+            break;
+        }
+
+        //reject overlong encodings and surrogates
+        valid = valid && char_code >= min_code && char_code <= 0x10FFFF;
+        valid = valid && !(char_code >= 0xD800 && char_code <= 0xDFFF);
+
+        if(!valid || char_code == 0 || is_contorl_character(char_code)){
+            if(i > run_start){
+                UTFStringView run = {.data = (const char*)data + run_start, .data_size = i - run_start, .count = run_count};
+                utf_append_sv(out, run);
+            }
+            //for invalid sequence, skip only the leading byte and try again from the next one
+            i += valid ? char_size : 1;
+            run_start = i;
+            run_count = 0;
+            continue;
+        }
+
+        i += char_size;
+        run_count++;
+    }
+
+    if(i > run_start){
+        UTFStringView run = {.data = (const char*)data + run_start, .data_size = i - run_start, .count = run_count};
+        utf_append_sv(out, run);
+    }
+
+    return i;
+}
+
+//Appends a chunk of clipboard property to the paste buffer
+static void clipboard_push_chunk(OS* os, const unsigned char* data, size_t size)
+{
+    if(os->clipboard_paste_carry_size > 0){
+        //finish the character that was cut in the previous chunk
+        unsigned char joined[8];
+        size_t carry_size = os->clipboard_paste_carry_size;
+        size_t from_data = size < 4 ? size : 4;
+
+        memcpy(joined, os->clipboard_paste_carry, carry_size);
+        memcpy(joined + carry_size, data, from_data);
+
+        size_t joined_size = carry_size + from_data;
+        size_t consumed = clipboard_filter_utf8(joined, joined_size, os->clipboard_paste_text);
+
+        if(consumed < carry_size){
+            //still incomplete, which means whole chunk was in joined
+            os->clipboard_paste_carry_size = joined_size - consumed;
+            memmove(os->clipboard_paste_carry, joined + consumed, os->clipboard_paste_carry_size);
+            return;
+        }
+
+        os->clipboard_paste_carry_size = 0;
+        data += consumed - carry_size;
+        size -= consumed - carry_size;
+    }
+
+    size_t consumed = clipboard_filter_utf8(data, size, os->clipboard_paste_text);
+
+    os->clipboard_paste_carry_size = size - consumed;
+    memcpy(os->clipboard_paste_carry, data + consumed, os->clipboard_paste_carry_size);
+}
+
+//Reads the whole property in CLIPBOARD_READ_SIZE pieces and pushes utf8 text to the paste buffer.
+//Property is deleted after reading as ICCCM asks requestor to do.
+//Returns type of the property.
+static Atom clipboard_read_property(Atom property, size_t* read_size)
+{
+    Atom type = None;
+    long offset = 0;
+    size_t total_size = 0;
+
+    while(true){
+        Atom actual_type = None;
+        int actual_format = 0;
+        unsigned long nitems = 0;
+        unsigned long bytes_after = 0;
+        unsigned char *ret = NULL;
+
+        int result = XGetWindowProperty(GLOBAL_OS->display, GLOBAL_OS->window, property,
+                                        offset, CLIPBOARD_READ_SIZE / 4, False, AnyPropertyType,
+                                        &actual_type, &actual_format, &nitems, &bytes_after,
+                                        &ret);
+        if(result != Success){
+            fprintf(stderr, "%s:%d:ERROR : Failed to read clipboard property\n", __FILE__, __LINE__);
+            break;
+        }
+
+        if(offset == 0){
+            type = actual_type;
+        }
+
+        //we won't try to pass anything unless it's utf8
+        //TODO : Maybe try to parse thing if format is different
+        bool is_text = actual_type == UTF8_ATOM && actual_format == 8;
+
+        if(is_text){
+            clipboard_push_chunk(GLOBAL_OS, ret, nitems);
+            total_size += nitems;
+            offset += nitems / 4;
+        }
+
+        if(ret){
+            XFree(ret);
+        }
+
+        if(!is_text || bytes_after == 0){
+            break;
+        }
+    }
+
+    XDeleteProperty(GLOBAL_OS->display, GLOBAL_OS->window, property);
+
+    if(read_size){
+        *read_size = total_size;
+    }
+
+    return type;
+}
+
+//Inserts next piece of the pasted text to the text box.
+//Pieces go right after each other and are undone together even while the owner is still sending the rest.
+//Returns true if something was inserted.
+static bool clipboard_insert_pending_paste()
+{
+    UTFString* pending = GLOBAL_OS->clipboard_paste_text;
+    size_t start = GLOBAL_OS->clipboard_paste_offset;
+
+    if(GLOBAL_OS->clipboard_paste_incr && os_get_time() - GLOBAL_OS->clipboard_paste_time > CLIPBOARD_PASTE_TIMEOUT){
+        fprintf(stderr, "%s:%d:ERROR : Clipboard owner stopped sending, paste is cut short\n", __FILE__, __LINE__);
+        GLOBAL_OS->clipboard_paste_incr = false;
+        GLOBAL_OS->clipboard_paste_carry_size = 0;
+    }
+
+    //text box has to hear that the paste is over even if the last piece had nothing in it
+    bool is_over = GLOBAL_OS->clipboard_paste_is_inserting && !GLOBAL_OS->clipboard_paste_incr;
+
+    if(start >= pending->data_size && !is_over){
+        return false;
+    }
+
+    size_t end = start + CLIPBOARD_INSERT_SIZE;
+    if(end >= pending->data_size){
+        end = pending->data_size;
+    }
+    else{
+        //cut at the line boundary if we can, otherwise at the character boundary
+        size_t line_end = end;
+        while(line_end > start && pending->data[line_end - 1] != '\n'){
+            line_end--;
+        }
+        if(line_end > start){
+            end = line_end;
         }
         else{
-            char_index++;
+            while(end > start && (pending->data[end] & 0b11000000) == 0b10000000){
+                end--;
+            }
         }
     }
+
+    UTFStringView sv = {.data = pending->data + start, .data_size = end - start};
+    sv.count = utf_sv_count(sv);
+
+    GLOBAL_OS->clipboard_paste_offset = end;
+    GLOBAL_OS->clipboard_paste_is_inserting = GLOBAL_OS->clipboard_paste_incr || end < pending->data_size;
+
+    OS_TextPasteEvent paste_event = {.paste_sv = sv, .more_to_come = GLOBAL_OS->clipboard_paste_is_inserting};
+    OS_Event wrapped_paste_event = {.text_paste_event = paste_event, .type = OS_TEXT_PASTE_EVENT};
+
+    text_box_handle_event(GLOBAL_BOX, &wrapped_paste_event);
+
+    //everything that came so far is inserted, reuse the buffer for the rest
+    if(end >= pending->data_size){
+        utf_set_cstr(pending, "");
+        GLOBAL_OS->clipboard_paste_offset = 0;
+    }
+
+    return true;
+}
+
+//Owner answered our paste request
+static void clipboard_handle_selection_notify(XSelectionEvent* selection_event)
+{
+    //text is validated and filtered while it's being read
+    //and inserted to the text box across frames
+    if(selection_event->property == None){
+        return;
+    }
+
+    //drop incomplete character from previous paste
+    GLOBAL_OS->clipboard_paste_carry_size = 0;
+    GLOBAL_OS->clipboard_paste_incr = false;
+
+    Atom type = clipboard_read_property(selection_event->property, NULL);
+
+    //text was too big to send at once so owner will send it in pieces
+    //deleting the property(which clipboard_read_property did) tells owner to start
+    if(type == INCR_ATOM){
+        GLOBAL_OS->clipboard_paste_incr = true;
+        GLOBAL_OS->clipboard_paste_property = selection_event->property;
+        GLOBAL_OS->clipboard_paste_time = os_get_time();
+    }
+}
+
+//Owner put next piece of INCR transfer to the property
+static void clipboard_handle_paste_property(XPropertyEvent* property_event)
+{
+    if(!GLOBAL_OS->clipboard_paste_incr ||
+       property_event->atom != GLOBAL_OS->clipboard_paste_property ||
+       property_event->state != PropertyNewValue)
+    {
+        return;
+    }
+
+    size_t read_size = 0;
+    clipboard_read_property(property_event->atom, &read_size);
+    GLOBAL_OS->clipboard_paste_time = os_get_time();
+
+    //zero length piece means transfer is over
+    if(read_size == 0){
+        GLOBAL_OS->clipboard_paste_incr = false;
+        GLOBAL_OS->clipboard_paste_carry_size = 0;
+    }
+}
+
+static void put_text_box_image(XImage* ximage)
+{
+    text_box_render(GLOBAL_BOX);
+    bool locked = false;
+    if(SDL_MUSTLOCK(GLOBAL_BOX->render_surface)){
+        locked = true;
+        SDL_LockSurface(GLOBAL_BOX->render_surface);
+    }
+
+    XPutImage(GLOBAL_OS->display, GLOBAL_OS->window, XDefaultGC(GLOBAL_OS->display, GLOBAL_OS->screen), ximage, 0, 0, 0, 0, GLOBAL_BOX->w, GLOBAL_BOX->h);
+
+    if(locked){
+        SDL_UnlockSurface(GLOBAL_BOX->render_surface);
+    }
+}
+
+////////////////////////////////
+//Clipboard copying
+////////////////////////////////
+
+static size_t clipboard_copy_size()
+{
+    if(GLOBAL_OS->clipboard_from_text_box){
+        return text_box_clipboard_size(GLOBAL_BOX);
+    }
+    return GLOBAL_OS->clipboard_copy_text->data_size;
+}
+
+static ClipboardReader clipboard_copy_reader()
+{
+    if(GLOBAL_OS->clipboard_from_text_box){
+        return text_box_clipboard_reader(GLOBAL_BOX);
+    }
+    ClipboardReader reader = {0};
+    return reader;
+}
+
+static size_t clipboard_copy_read(bool from_text_box, ClipboardReader* reader, char* buffer, size_t buffer_size)
+{
+    if(from_text_box){
+        return text_box_clipboard_read(GLOBAL_BOX, reader, buffer, buffer_size);
+    }
+
+    UTFString* copy_text = GLOBAL_OS->clipboard_copy_text;
+    if(reader->position >= copy_text->data_size){
+        return 0;
+    }
+    size_t to_read = copy_text->data_size - reader->position;
+    if(to_read > buffer_size){
+        to_read = buffer_size;
+    }
+    memcpy(buffer, copy_text->data + reader->position, to_read);
+    reader->position += to_read;
+    return to_read;
+}
+
+static bool clipboard_start_transfer(Window requestor, Atom property)
+{
+    ClipboardTransfer* transfer = NULL;
+    for(size_t i=0; i<CLIPBOARD_MAX_TRANSFERS; i++){
+        ClipboardTransfer* t = &GLOBAL_OS->clipboard_transfers[i];
+        //requestor asked again with the same property, so restart it
+        if(t->active && t->requestor == requestor && t->property == property){
+            transfer = t;
+            break;
+        }
+        if(!t->active && !transfer){
+            transfer = t;
+        }
+    }
+
+    if(!transfer){
+        fprintf(stderr, "%s:%d:ERROR : Too many clipboard transfers\n", __FILE__, __LINE__);
+        return false;
+    }
+
+    transfer->active = true;
+    transfer->requestor = requestor;
+    transfer->property = property;
+    transfer->from_text_box = GLOBAL_OS->clipboard_from_text_box;
+    transfer->reader = clipboard_copy_reader();
+
+    //we need to know when requestor deletes the property
+    //(don't touch our own window's event mask when we paste from ourselves)
+    if(requestor != GLOBAL_OS->window){
+        XSelectInput(GLOBAL_OS->display, requestor, PropertyChangeMask);
+    }
+
+    return true;
+}
+
+//requestor deleted the property which means it's ready for the next piece
+static void clipboard_continue_transfer(Window requestor, Atom property)
+{
+    for(size_t i=0; i<CLIPBOARD_MAX_TRANSFERS; i++){
+        ClipboardTransfer* transfer = &GLOBAL_OS->clipboard_transfers[i];
+        if(!transfer->active || transfer->requestor != requestor || transfer->property != property){
+            continue;
+        }
+
+        size_t read_size = clipboard_copy_read(transfer->from_text_box, &transfer->reader,
+                                               GLOBAL_OS->clipboard_send_buffer, CLIPBOARD_SEND_SIZE);
+
+        //zero length piece tells requestor that transfer is over
+        XChangeProperty(GLOBAL_OS->display, requestor, property, UTF8_ATOM, 8, PropModeReplace,
+                        (unsigned char *)GLOBAL_OS->clipboard_send_buffer, read_size);
+
+        if(read_size == 0){
+            transfer->active = false;
+            if(requestor != GLOBAL_OS->window){
+                XSelectInput(GLOBAL_OS->display, requestor, NoEventMask);
+            }
+        }
+    }
+}
+
+//requestor window can be destroyed in the middle of transfer
+//so don't let Xlib kill us for that
+static int x_error_handler(Display* display, XErrorEvent* error)
+{
+    char error_text[256];
+    XGetErrorText(display, error->error_code, error_text, sizeof(error_text));
+    fprintf(stderr, "%s:%d:ERROR : X error : %s\n", __FILE__, __LINE__, error_text);
+    return 0;
+}
+
+void clipboard_paste_test()
+{
+    OS os = {0};
+    os.clipboard_paste_text = utf_from_cstr("");
+
+    //control characters and invalid bytes are dropped
+    const unsigned char dirty[] = {'a', 0x01, 'b', 0xFF, '\r', '\n', 0xC0, 0x80, 'c'};
+    clipboard_push_chunk(&os, dirty, sizeof(dirty));
+    assert(utf_sv_cmp(utf_sv_from_str(os.clipboard_paste_text), utf_sv_from_cstr(u8"ab\nc")));
+    assert(os.clipboard_paste_carry_size == 0);
+
+    //character that is cut between chunks
+    utf_set_cstr(os.clipboard_paste_text, "");
+    const char* text = u8"x😀고양이";
+    size_t text_size = strlen(text);
+    for(size_t i=0; i<text_size; i++){
+        clipboard_push_chunk(&os, (const unsigned char*)text + i, 1);
+    }
+    assert(utf_sv_cmp(utf_sv_from_str(os.clipboard_paste_text), utf_sv_from_cstr(text)));
+    assert(os.clipboard_paste_text->count == 5);
+    assert(os.clipboard_paste_carry_size == 0);
+
+    //carry followed by a big chunk
+    utf_set_cstr(os.clipboard_paste_text, "");
+    clipboard_push_chunk(&os, (const unsigned char*)text, 2);
+    assert(os.clipboard_paste_carry_size == 1);
+    clipboard_push_chunk(&os, (const unsigned char*)text + 2, text_size - 2);
+    assert(utf_sv_cmp(utf_sv_from_str(os.clipboard_paste_text), utf_sv_from_cstr(text)));
+    assert(os.clipboard_paste_carry_size == 0);
+
+    utf_destroy(os.clipboard_paste_text);
+}
+
+//Selection owner for clipboard_transfer_test
+//it sends its text with INCR protocol in pieces that cut characters in half
+typedef struct ClipboardTestOwner
+{
+    Display* display;
+    Window window;
+    const char* text;
+    size_t text_size;
+    size_t sent_size;
+    bool is_sending;
+    Window requestor;
+    Atom property;
+} ClipboardTestOwner;
+
+#define CLIPBOARD_TEST_PIECE_SIZE 4001
+#define CLIPBOARD_TEST_TIMEOUT 30.0
+
+static void clipboard_test_owner_poll(ClipboardTestOwner* owner)
+{
+    while(XPending(owner->display)){
+        XEvent xevent;
+        XNextEvent(owner->display, &xevent);
+
+        if(xevent.type == SelectionRequest){
+            XSelectionRequestEvent request = xevent.xselectionrequest;
+            owner->requestor = request.requestor;
+            owner->property = request.property;
+            owner->sent_size = 0;
+            owner->is_sending = true;
+
+            //requestor deletes the property when it wants the next piece
+            XSelectInput(owner->display, request.requestor, PropertyChangeMask);
+            long incr_size = owner->text_size;
+            XChangeProperty(owner->display, request.requestor, request.property, INCR_ATOM, 32, PropModeReplace,
+                            (unsigned char *)&incr_size, 1);
+
+            XEvent reply = {0};
+            reply.xselection.type = SelectionNotify;
+            reply.xselection.requestor = request.requestor;
+            reply.xselection.selection = request.selection;
+            reply.xselection.target = request.target;
+            reply.xselection.property = request.property;
+            reply.xselection.time = request.time;
+            XSendEvent(owner->display, request.requestor, True, 0, &reply);
+        }
+
+        if(xevent.type == PropertyNotify && owner->is_sending &&
+           xevent.xproperty.window == owner->requestor && xevent.xproperty.atom == owner->property &&
+           xevent.xproperty.state == PropertyDelete)
+        {
+            size_t piece_size = owner->text_size - owner->sent_size;
+            if(piece_size > CLIPBOARD_TEST_PIECE_SIZE){
+                piece_size = CLIPBOARD_TEST_PIECE_SIZE;
+            }
+            //zero length piece ends the transfer
+            XChangeProperty(owner->display, owner->requestor, owner->property, UTF8_ATOM, 8, PropModeReplace,
+                            (const unsigned char *)owner->text + owner->sent_size, piece_size);
+            owner->sent_size += piece_size;
+            if(piece_size == 0){
+                owner->is_sending = false;
+                XSelectInput(owner->display, owner->requestor, NoEventMask);
+            }
+        }
+    }
+    XFlush(owner->display);
+}
+
+//Pastes text that an owner on another connection sends with INCR protocol to the empty text box.
+//It needs an X server, run it on a virtual one with xvfb-run kewl --clipboard-test.
+//Returns false if there is no X server to connect to.
+bool clipboard_transfer_test(TextBox* box)
+{
+    Display* display = XOpenDisplay(NULL);
+    Display* owner_display = XOpenDisplay(NULL);
+    if(!display || !owner_display){
+        fprintf(stderr, "%s:%d:ERROR : Failed to open x display for clipboard test\n", __FILE__, __LINE__);
+        if(display) {XCloseDisplay(display);}
+        if(owner_display) {XCloseDisplay(owner_display);}
+        return false;
+    }
+
+    OS os = {0};
+    os.display = display;
+    os.screen = DefaultScreen(display);
+    os.window = XCreateSimpleWindow(display, XDefaultRootWindow(display), 0, 0, 1, 1, 0, 0, 0);
+    XSelectInput(display, os.window, PropertyChangeMask);
+    os.clipboard_paste_text = utf_from_cstr("");
+
+    GLOBAL_OS = &os;
+    GLOBAL_BOX = box;
+
+    CLIPBOARD_ATOM = XInternAtom(display, "CLIPBOARD", false);
+    UTF8_ATOM = XInternAtom(display, "UTF8_STRING", false);
+    INCR_ATOM = XInternAtom(display, "INCR", false);
+
+    //many lines and then a line that is longer than a piece we insert per frame,
+    //control characters and carriage returns are dropped
+    UTFString* text = utf_from_cstr("");
+    UTFString* expected = utf_from_cstr("");
+    for(size_t i=0; i<20000; i++){
+        utf_append_cstr(text, u8"줄 \x01line 😀\r\n");
+        utf_append_cstr(expected, u8"줄 line 😀\n");
+    }
+    for(size_t i=0; i<30000; i++){
+        utf_append_cstr(text, u8"고");
+        utf_append_cstr(expected, u8"고");
+    }
+
+    ClipboardTestOwner owner = {0};
+    owner.display = owner_display;
+    owner.window = XCreateSimpleWindow(owner_display, XDefaultRootWindow(owner_display), 0, 0, 1, 1, 0, 0, 0);
+    owner.text = text->data;
+    owner.text_size = text->data_size;
+    XSetSelectionOwner(owner_display, CLIPBOARD_ATOM, owner.window, CurrentTime);
+    XSync(owner_display, False);
+
+    os_request_text_paste();
+
+    size_t insert_count = 0;
+    double start_time = os_get_time();
+    while(true){
+        assert(os_get_time() - start_time < CLIPBOARD_TEST_TIMEOUT);
+
+        clipboard_test_owner_poll(&owner);
+
+        while(XPending(display)){
+            XEvent xevent;
+            XNextEvent(display, &xevent);
+            if(xevent.type == SelectionNotify){
+                clipboard_handle_selection_notify(&xevent.xselection);
+            }
+            if(xevent.type == PropertyNotify){
+                clipboard_handle_paste_property(&xevent.xproperty);
+            }
+        }
+
+        if(clipboard_insert_pending_paste()){
+            //typing while the paste comes in doesn't cut it in half
+            if(insert_count == 0){
+                OS_TextInputEvent input_event = {.text_sv = utf_sv_from_cstr("x")};
+                OS_Event input_event_wrapped = {.text_input_event = input_event, .type = OS_TEXT_INPUT_EVENT};
+                text_box_handle_event(box, &input_event_wrapped);
+            }
+            insert_count++;
+        }
+        else if(insert_count > 0 && !os.clipboard_paste_incr && !os.clipboard_paste_is_inserting){
+            break;
+        }
+    }
+
+    //it took a frame per piece, and all of it went to one place
+    assert(insert_count > expected->data_size / CLIPBOARD_INSERT_SIZE);
+    assert(!box->is_pasting);
+    TextCursor end = text_box_move_cursor_document_end(box, box->cursor);
+    Selection all = {.end_line_number = end.line_number, .end_char = end.char_offset};
+    UTFString* pasted = text_box_get_selection_str(box, all);
+    assert(utf_sv_cmp(utf_sv_from_str(pasted), utf_sv_from_str(expected)));
+    utf_destroy(pasted);
+
+    //and it's undone at once
+    assert(box->undo.undo_count == 1);
+    assert(text_box_undo(box));
+    assert(box->line_count == 1 && box->cursor.char_offset == 0);
+
+    utf_destroy(text);
+    utf_destroy(expected);
+    utf_destroy(os.clipboard_paste_text);
+    XDestroyWindow(owner_display, owner.window);
+    XDestroyWindow(display, os.window);
+    XCloseDisplay(owner_display);
+    XCloseDisplay(display);
+    GLOBAL_OS = NULL;
+
+    return true;
 }
 
 #pragma GCC diagnostic push
@@ -281,7 +1439,18 @@ int linux_main(TextBox* _box, int argc, char* argv[]) {
 
     //create empty text for clipboard
     GLOBAL_OS->clipboard_paste_text = utf_from_cstr("");
+    GLOBAL_OS->clipboard_paste_offset = 0;
+    GLOBAL_OS->clipboard_paste_is_inserting = false;
+    GLOBAL_OS->clipboard_paste_carry_size = 0;
+    GLOBAL_OS->clipboard_paste_incr = false;
+    GLOBAL_OS->clipboard_paste_property = None;
+    GLOBAL_OS->clipboard_paste_time = 0;
     GLOBAL_OS->clipboard_copy_text = utf_from_cstr("");
+    GLOBAL_OS->clipboard_from_text_box = false;
+    for(size_t i=0; i<CLIPBOARD_MAX_TRANSFERS; i++){
+        GLOBAL_OS->clipboard_transfers[i].active = false;
+    }
+    GLOBAL_OS->clipboard_send_buffer = malloc(CLIPBOARD_SEND_SIZE);
 
     /* fallback to LC_CTYPE in env */
     setlocale(LC_CTYPE, "");
@@ -289,6 +1458,8 @@ int linux_main(TextBox* _box, int argc, char* argv[]) {
      * XMODIFIERS in env */
     XSetLocaleModifiers("");
 
+    XSetErrorHandler(x_error_handler);
+
     /* setting up a simple window */
     GLOBAL_OS->display = XOpenDisplay(NULL);
     GLOBAL_OS->screen = DefaultScreen(GLOBAL_OS->display);
@@ -326,7 +1497,7 @@ int linux_main(TextBox* _box, int argc, char* argv[]) {
     XSetICFocus(GLOBAL_OS->xic);
     /* capture the input */
     XSelectInput(GLOBAL_OS->display, GLOBAL_OS->window,
-        KeyPressMask | KeyReleaseMask | ExposureMask | StructureNotifyMask);
+        KeyPressMask | KeyReleaseMask | ExposureMask | StructureNotifyMask | PropertyChangeMask);
 
     WM_QUIT_ATOM = XInternAtom(GLOBAL_OS->display, "WM_DELETE_WINDOW", false);
     XSetWMProtocols(GLOBAL_OS->display, GLOBAL_OS->window, &WM_QUIT_ATOM, 1);
@@ -365,6 +1536,12 @@ int linux_main(TextBox* _box, int argc, char* argv[]) {
         init_success = false;
     }
 
+    INCR_ATOM = XInternAtom(GLOBAL_OS->display, "INCR", false);
+    if(INCR_ATOM == None){
+        fprintf(stderr, "%s:%d:Failed to get incr atom\n", __FILE__, __LINE__);
+        init_success = false;
+    }
+
 
     //TODO : For now we use char_buffer and tmp_str to store and parse string that came from xlib event
     //But I think we can handle it using only tmp_str
@@ -524,45 +1701,18 @@ int linux_main(TextBox* _box, int argc, char* argv[]) {
                 case SelectionNotify:
                 {
                     //handle pasting event
-                    //TOOD : This is probably not safe we should check if text is malicious or not
-                    XSelectionEvent selection_event = xevent.xselection;
-                    //selection_event.
-                    if(selection_event.property != None){
-                        //shamelessly copied from https://github.com/edrosten/x_clipboard/blob/master/paste.cc
-                        Atom actual_type;
-                        int actual_format;
-                        unsigned long nitems;
-                        unsigned long bytes_after;
-                        unsigned char *ret = 0;
-
-                        int read_bytes = 1024;
-
-                        //Keep trying to read the property until there are no
-                        //bytes unread.
-                        do
-                        {
-                            if(ret != 0)
-                                XFree(ret);
-                            XGetWindowProperty(GLOBAL_OS->display, GLOBAL_OS->window, selection_event.property, 0, read_bytes, False, AnyPropertyType,
-                                                &actual_type, &actual_format, &nitems, &bytes_after,
-                                                &ret);
-
-                            read_bytes *= 2;
-                        }while(bytes_after != 0);
-
-                        //we won't try to pass anything unless it's utf8
-                        //TODO : Maybe try to parse thing if format is different
-                        if(actual_type == UTF8_ATOM){
-                            utf_set_cstr(GLOBAL_OS->clipboard_paste_text, (char *)ret);
-
-                            remove_contorl_characters(GLOBAL_OS->clipboard_paste_text);
-
-                            OS_TextPasteEvent paste_event = {.paste_sv = utf_sv_from_str(GLOBAL_OS->clipboard_paste_text)};
-                            OS_Event wrapped_paste_event = {.text_paste_event = paste_event, .type = OS_TEXT_PASTE_EVENT};
-
-                            text_box_handle_event(GLOBAL_BOX, &wrapped_paste_event);
-                        }
-                        XFree(ret);
+                    clipboard_handle_selection_notify(&xevent.xselection);
+                }break;
+
+                case PropertyNotify:
+                {
+                    //handle pieces of INCR transfer
+                    XPropertyEvent property_event = xevent.xproperty;
+                    clipboard_handle_paste_property(&property_event);
+
+                    //handle pieces of INCR transfer we are sending
+                    if(property_event.state == PropertyDelete){
+                        clipboard_continue_transfer(property_event.window, property_event.atom);
                     }
                 }break;
 
@@ -595,9 +1745,23 @@ int linux_main(TextBox* _box, int argc, char* argv[]) {
 
 					if(selection_request.target == UTF8_ATOM && selection_request.property != None){
 						printf("Got utf8\n");
-						reply.xselection.property = property;
-						XChangeProperty(display, requestor, property, target, 8, PropModeReplace,
-								(unsigned char *)GLOBAL_OS->clipboard_copy_text->data, GLOBAL_OS->clipboard_copy_text->data_size);
+						//copied text is serialized here, not when it was copied
+						size_t copy_size = clipboard_copy_size();
+						if(copy_size <= CLIPBOARD_SEND_SIZE){
+							ClipboardReader reader = clipboard_copy_reader();
+							size_t read_size = clipboard_copy_read(GLOBAL_OS->clipboard_from_text_box, &reader,
+																   GLOBAL_OS->clipboard_send_buffer, CLIPBOARD_SEND_SIZE);
+							reply.xselection.property = property;
+							XChangeProperty(display, requestor, property, target, 8, PropModeReplace,
+									(unsigned char *)GLOBAL_OS->clipboard_send_buffer, read_size);
+						}
+						else if(clipboard_start_transfer(requestor, property)){
+							//too big to send at once, send it in pieces
+							reply.xselection.property = property;
+							long incr_size = copy_size;
+							XChangeProperty(display, requestor, property, INCR_ATOM, 32, PropModeReplace,
+									(unsigned char *)&incr_size, 1);
+						}
 					}
 					else if (selection_request.target == TARGETS_ATOM && selection_request.property != None){
 						printf("Got targets\n");
@@ -621,20 +1785,43 @@ int linux_main(TextBox* _box, int argc, char* argv[]) {
 					XSendEvent(display, xevent.xselectionrequest.requestor, True, 0, &reply);
                 }break;
             }
-            text_box_render(GLOBAL_BOX);
-            bool locked = false;
-            if(SDL_MUSTLOCK(GLOBAL_BOX->render_surface)){
-                locked = true;
-                SDL_LockSurface(GLOBAL_BOX->render_surface);
-            }
+            put_text_box_image(ximage);
+        }
+
+        //big paste is inserted a piece per frame so editor can keep handling events
+        if(clipboard_insert_pending_paste()){
+            put_text_box_image(ximage);
+        }
 
-            XPutImage(GLOBAL_OS->display, GLOBAL_OS->window, XDefaultGC(GLOBAL_OS->display, GLOBAL_OS->screen), ximage, 0, 0, 0, 0, GLOBAL_BOX->w, GLOBAL_BOX->h);
+        //free lines that were deleted, a bit per frame
+        text_box_free_removed_lines(GLOBAL_BOX, FREE_REMOVED_LINES_PER_FRAME);
 
-            if(locked){
-                SDL_UnlockSurface(GLOBAL_BOX->render_surface);
-            }
+        //matches are shown as they are found
+        if(text_box_find_poll(GLOBAL_BOX)){
+            put_text_box_image(ximage);
+        }
+
+        //opened file is split on a worker thread, line count grows as it goes,
+        //reloaded file is diffed on one and its hunks are replaced when it's done
+        if(text_box_load_poll(GLOBAL_BOX)){
+            put_text_box_image(ximage);
+        }
+
+        //document is written on a worker thread every now and then
+        text_box_autosave_poll(GLOBAL_BOX);
+
+        //so are the edits, a batch at a time
+        text_box_journal_poll(GLOBAL_BOX);
+
+        //followed file shows what is written to it as it's written
+        if(text_box_follow_poll(GLOBAL_BOX)){
+            put_text_box_image(ximage);
         }
 
+        //file someone else changed is diffed on the load worker, text_box_load_poll puts the new lines in
+        if(text_box_reload_poll(GLOBAL_BOX)){
+            put_text_box_image(ximage);
+        }
     }
 
 cleanup: ;
@@ -644,6 +1831,7 @@ cleanup: ;
 
     if(GLOBAL_OS->clipboard_paste_text) {utf_destroy(GLOBAL_OS->clipboard_paste_text);}
     if(GLOBAL_OS->clipboard_copy_text) {utf_destroy(GLOBAL_OS->clipboard_copy_text);}
+    if(GLOBAL_OS->clipboard_send_buffer) {free(GLOBAL_OS->clipboard_send_buffer);}
 
     if(GLOBAL_OS->xic) {XDestroyIC(GLOBAL_OS->xic);}
     if(GLOBAL_OS->window) {XDestroyWindow(GLOBAL_OS->display,GLOBAL_OS->window);}
@@ -5,4 +5,8 @@
 
 int linux_main(TextBox* box,int argc, char* argv[]);
 
+void clipboard_paste_test();
+//needs an X server, returns false if there isn't one
+bool clipboard_transfer_test(TextBox* box);
+
 #endif
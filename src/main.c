@@ -3,6 +3,7 @@
 #include <stdbool.h>
 #include <assert.h>
 #include <locale.h>
+#include <string.h>
 
 //Please don't define main to something else SDL...
 #define SDL_MAIN_HANDLED
@@ -18,6 +19,7 @@
 #define HEIGHT 500
 
 #include "TextBox.h"
+#include "TextBoxBenchmark.h"
 
 #if _WIN32
 #include "windows/WindowsMain.h"
@@ -27,11 +29,74 @@
 #include "linux/LinuxMain.h"
 #endif
 
-int main(int argc, char* argv[])
+//tests that only touch memory, they run on every start
+static void run_tests()
 {
     text_line_test();
+    text_find_test();
+    regex_test();
+    text_undo_test();
+    text_load_test();
+    text_diff_test();
+    text_word_test();
+    text_grapheme_test();
     utf_test();
+#if __linux__
+    clipboard_paste_test();
+#endif
+}
+
+//tests that write temporary files, they only run with --self-test
+//returns false if a file couldn't be written
+static bool run_file_tests()
+{
+    bool success = true;
+    success = text_snapshot_test() && success;
+    success = text_journal_test() && success;
+    success = text_index_cache_test() && success;
+    return success;
+}
+
+int main(int argc, char* argv[])
+{
+    utf_validation_init_from_env();
+
+    if (argc > 1 && strcmp(argv[1], "--self-test") == 0) {
+        run_tests();
+        bool success = run_file_tests();
+        printf("self test %s\n", success ? "passed" : "failed, couldn't write temporary files");
+        return success ? 0 : 1;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "--utf-validation-benchmark") == 0) {
+        utf_validation_benchmark();
+        return 0;
+    }
 
+    if (argc > 1 && strcmp(argv[1], "--utf-iter-benchmark") == 0) {
+        utf_iter_benchmark();
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "--regex-benchmark") == 0) {
+        regex_benchmark();
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "--grapheme-benchmark") == 0) {
+        text_grapheme_benchmark();
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "--autosave-benchmark") == 0) {
+        text_snapshot_benchmark();
+        return 0;
+    }
+
+    run_tests();
+
+    //benchmarks below jump to cleanup, so it's set before them
+    int ret_val = 0;
     bool init_success = true;
 
     ////////////////////////////////
@@ -74,9 +139,74 @@ int main(int argc, char* argv[])
         goto cleanup;
     }
 
-    text_box_render(box);
+    //replay lays lines out with the font, so it needs the text box
+    if (argc > 1 && strcmp(argv[1], "--journal-benchmark") == 0) {
+        text_box_journal_benchmark(box);
+        goto cleanup;
+    }
 
-    int ret_val = 0;
+    //so does following a file
+    if (argc > 1 && strcmp(argv[1], "--follow-benchmark") == 0) {
+        text_box_follow_benchmark(box);
+        goto cleanup;
+    }
+
+    //and reloading one
+    if (argc > 1 && strcmp(argv[1], "--reload-benchmark") == 0) {
+        text_box_reload_benchmark(box);
+        goto cleanup;
+    }
+
+    //and viewing one
+    if (argc > 1 && strcmp(argv[1], "--view-benchmark") == 0) {
+        text_box_view_benchmark(box);
+        goto cleanup;
+    }
+
+    //and moving around in one
+    if (argc > 1 && strcmp(argv[1], "--navigation-benchmark") == 0) {
+        text_box_navigation_benchmark(box);
+        goto cleanup;
+    }
+
+    //pastes from another X client, so it needs an X server as well
+    if (argc > 1 && strcmp(argv[1], "--clipboard-test") == 0) {
+#if __linux__
+        bool success = clipboard_transfer_test(box);
+        printf("clipboard test %s\n", success ? "passed" : "failed, couldn't connect to X server");
+        ret_val = success ? 0 : 1;
+#endif
+        goto cleanup;
+    }
+
+    //anything that is not an option is a file to open
+    if (argc > 1 && strncmp(argv[1], "--", 2) != 0)
+    {
+        if (!text_box_open_file(box, argv[1]))
+        {
+            printf("ERROR: Failed to open %s\n", argv[1]);
+        }
+    }
+
+    //--follow file opens the file and keeps showing what is written to it
+    if (argc > 2 && strcmp(argv[1], "--follow") == 0)
+    {
+        if (!text_box_open_file(box, argv[2]) || !text_box_start_follow(box))
+        {
+            printf("ERROR: Failed to follow %s\n", argv[2]);
+        }
+    }
+
+    //--view file opens the file read only, its line index is cached next to it
+    if (argc > 2 && strcmp(argv[1], "--view") == 0)
+    {
+        if (!text_box_view_file(box, argv[2]))
+        {
+            printf("ERROR: Failed to view %s\n", argv[2]);
+        }
+    }
+
+    text_box_render(box);
 
 #if _WIN32
     ret_val = windows_main(box, argc, argv);
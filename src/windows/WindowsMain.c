@@ -20,6 +20,9 @@ typedef struct OS
     bool received_pair_low;
 } OS;
 
+//how many removed lines we free at once while idle
+#define FREE_REMOVED_LINES_PER_FRAME 4096
+
 OS* GLOBAL_OS;
 
 TextBox* GLOBAL_BOX;
@@ -93,7 +96,11 @@ static const struct
     {VK_ESCAPE, OS_KEY_ESC},
     {VK_TAB, OS_KEY_TAB},
     {VK_BACK, OS_KEY_BACKSPACE},
-    {VK_RETURN, OS_KEY_ENTER}
+    {VK_RETURN, OS_KEY_ENTER},
+    {VK_PRIOR, OS_KEY_PAGE_UP},
+    {VK_NEXT, OS_KEY_PAGE_DOWN},
+    {VK_HOME, OS_KEY_HOME},
+    {VK_END, OS_KEY_END}
 };
 
 static const struct
@@ -263,17 +270,16 @@ UTFString* replace_lf_to_crlf(UTFStringView sv) {
     ret_str->data_size = data_index;
     ret_str->raw_size = raw_size;
     ret_str->count = sv.count + replace_count;
+    ret_str->index = NULL;
+    ret_str->index_size = 0;
+    ret_str->index_capacity = 0;
 
     return ret_str;
 }
 
-void os_set_clipboard_text(UTFStringView sv)
+//text as the clipboard keeps it(utf16 with \r\n), NULL if it couldn't be allocated
+static HGLOBAL clipboard_text_from_sv(UTFStringView sv)
 {
-    if (!OpenClipboard(GLOBAL_OS->hwnd)) {
-        return;
-    }
-
-    EmptyClipboard();
     // replace \n to \r\n
     UTFString* copy = replace_lf_to_crlf(sv);
 
@@ -287,29 +293,492 @@ void os_set_clipboard_text(UTFStringView sv)
 
     // Allocate a global memory object for the text. 
 
-    uint16_t* clipboard_str = GlobalAlloc(GMEM_MOVEABLE, utf16_str_size * sizeof(uint16_t));
-    if (clipboard_str == NULL)
+    HGLOBAL clipboard_str = GlobalAlloc(GMEM_MOVEABLE, utf16_str_size * sizeof(uint16_t));
+    if (clipboard_str != NULL)
     {
-        CloseClipboard();
-        return FALSE;
+        // Lock the handle and copy the text to the buffer. 
+
+        LPTSTR  lock_copy = GlobalLock(clipboard_str);
+        memcpy(lock_copy, utf16_str, utf16_str_size * sizeof(uint16_t));
+        GlobalUnlock(clipboard_str);
     }
 
-    // Lock the handle and copy the text to the buffer. 
+    //free memories
+    free(utf16_str);
+    utf_destroy(copy);
+    return clipboard_str;
+}
+
+void os_set_clipboard_text(UTFStringView sv)
+{
+    if (!OpenClipboard(GLOBAL_OS->hwnd)) {
+        return;
+    }
 
-    LPTSTR  lock_copy = GlobalLock(clipboard_str);
-    memcpy(lock_copy, utf16_str, utf16_str_size * sizeof(uint16_t));
-    GlobalUnlock(clipboard_str);
+    EmptyClipboard();
 
     // Place the handle on the clipboard. 
+    HGLOBAL clipboard_str = clipboard_text_from_sv(sv);
+    if (clipboard_str != NULL) {
+        SetClipboardData(CF_UNICODETEXT, clipboard_str);
+    }
+
+    CloseClipboard();
+}
 
-    SetClipboardData(CF_UNICODETEXT, clipboard_str);
+void os_claim_clipboard()
+{
+    if (!OpenClipboard(GLOBAL_OS->hwnd)) {
+        return;
+    }
+
+    EmptyClipboard();
+    //delayed rendering, text is only converted when someone pastes it(WM_RENDERFORMAT)
+    SetClipboardData(CF_UNICODETEXT, NULL);
 
     CloseClipboard();
+}
 
-    //free memories
-    free(utf16_str);
-    utf_destroy(copy);
-    return;
+//puts the text box's copied text on the clipboard, it has to be open already
+//text is read from the snapshot, text box doesn't keep it serialized
+static void clipboard_render_text_box()
+{
+    size_t size = text_box_clipboard_size(GLOBAL_BOX);
+    char* data = malloc(size + 1);
+    if (data == NULL) {
+        return;
+    }
+    ClipboardReader reader = text_box_clipboard_reader(GLOBAL_BOX);
+    UTFStringView sv = { .data = data, .data_size = text_box_clipboard_read(GLOBAL_BOX, &reader, data, size) };
+    data[sv.data_size] = 0;
+    sv.count = utf_sv_count(sv);
+
+    HGLOBAL clipboard_str = clipboard_text_from_sv(sv);
+    free(data);
+    if (clipboard_str != NULL) {
+        SetClipboardData(CF_UNICODETEXT, clipboard_str);
+    }
+}
+
+struct OS_Thread
+{
+    HANDLE handle;
+    OS_ThreadFunction function;
+    void* data;
+};
+
+struct OS_Mutex
+{
+    CRITICAL_SECTION critical_section;
+};
+
+static DWORD WINAPI os_thread_start(LPVOID data)
+{
+    OS_Thread* thread = data;
+    thread->function(thread->data);
+    return 0;
+}
+
+OS_Thread* os_thread_create(OS_ThreadFunction function, void* data)
+{
+    OS_Thread* thread = malloc(sizeof(OS_Thread));
+    thread->function = function;
+    thread->data = data;
+    thread->handle = CreateThread(NULL, 0, os_thread_start, thread, 0, NULL);
+    if (thread->handle == NULL) {
+        fprintf(stderr, "%s:%d:ERROR: Failed to create a thread\n", __FILE__, __LINE__);
+        free(thread);
+        return NULL;
+    }
+    return thread;
+}
+
+void os_thread_join(OS_Thread* thread)
+{
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+    free(thread);
+}
+
+OS_Mutex* os_mutex_create()
+{
+    OS_Mutex* mutex = malloc(sizeof(OS_Mutex));
+    InitializeCriticalSection(&mutex->critical_section);
+    return mutex;
+}
+
+void os_mutex_destroy(OS_Mutex* mutex)
+{
+    DeleteCriticalSection(&mutex->critical_section);
+    free(mutex);
+}
+
+void os_mutex_lock(OS_Mutex* mutex)
+{
+    EnterCriticalSection(&mutex->critical_section);
+}
+
+void os_mutex_unlock(OS_Mutex* mutex)
+{
+    LeaveCriticalSection(&mutex->critical_section);
+}
+
+size_t os_get_processor_count()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+}
+
+double os_get_time()
+{
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+
+void os_sleep(double seconds)
+{
+    Sleep((DWORD)(seconds * 1000));
+}
+
+struct OS_FileMapping
+{
+    HANDLE file;
+    HANDLE mapping;
+    const char* data;
+    size_t size;
+};
+
+OS_FileMapping* os_map_file(const char* path)
+{
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "%s:%d:ERROR: Failed to open %s\n", __FILE__, __LINE__, path);
+        return NULL;
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size)) {
+        fprintf(stderr, "%s:%d:ERROR: Failed to get size of %s\n", __FILE__, __LINE__, path);
+        CloseHandle(file);
+        return NULL;
+    }
+
+    OS_FileMapping* mapping = malloc(sizeof(OS_FileMapping));
+    mapping->file = file;
+    mapping->mapping = NULL;
+    mapping->data = NULL;
+    mapping->size = (size_t)file_size.QuadPart;
+
+    //CreateFileMapping fails on an empty file
+    if (mapping->size > 0) {
+        mapping->mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping->mapping != NULL) {
+            mapping->data = MapViewOfFile(mapping->mapping, FILE_MAP_READ, 0, 0, 0);
+        }
+        if (mapping->data == NULL) {
+            fprintf(stderr, "%s:%d:ERROR: Failed to map %s\n", __FILE__, __LINE__, path);
+            if (mapping->mapping) {
+                CloseHandle(mapping->mapping);
+            }
+            CloseHandle(file);
+            free(mapping);
+            return NULL;
+        }
+    }
+
+    return mapping;
+}
+
+void os_unmap_file(OS_FileMapping* mapping)
+{
+    if (mapping->data) {
+        UnmapViewOfFile(mapping->data);
+    }
+    if (mapping->mapping) {
+        CloseHandle(mapping->mapping);
+    }
+    CloseHandle(mapping->file);
+    free(mapping);
+}
+
+const char* os_file_mapping_data(OS_FileMapping* mapping)
+{
+    return mapping->data;
+}
+
+size_t os_file_mapping_size(OS_FileMapping* mapping)
+{
+    return mapping->size;
+}
+
+//small buffers are gathered here so each line doesn't become its own WriteFile call
+#define FILE_WRITER_STAGING_SIZE (64 * 1024)
+
+struct OS_FileWriter
+{
+    HANDLE file;
+    char* path;
+    char* temp_path;
+
+    char* staging;
+    size_t staging_size;
+};
+
+OS_FileWriter* os_file_writer_create(const char* path)
+{
+    OS_FileWriter* writer = malloc(sizeof(OS_FileWriter));
+    writer->path = _strdup(path);
+
+    //temporary file has to be on the same volume for the move to be atomic
+    size_t temp_path_size = strlen(path) + sizeof(".tmp");
+    writer->temp_path = malloc(temp_path_size);
+    snprintf(writer->temp_path, temp_path_size, "%s.tmp", path);
+
+    writer->file = CreateFileA(writer->temp_path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (writer->file == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "%s:%d:ERROR: Failed to create %s\n", __FILE__, __LINE__, writer->temp_path);
+        free(writer->temp_path);
+        free(writer->path);
+        free(writer);
+        return NULL;
+    }
+
+    writer->staging = malloc(FILE_WRITER_STAGING_SIZE);
+    writer->staging_size = 0;
+
+    return writer;
+}
+
+static bool os_file_writer_write_all(OS_FileWriter* writer, const char* data, size_t size)
+{
+    while (size > 0) {
+        DWORD to_write = size > MAXDWORD ? MAXDWORD : (DWORD)size;
+        DWORD written = 0;
+        if (!WriteFile(writer->file, data, to_write, &written, NULL)) {
+            fprintf(stderr, "%s:%d:ERROR: Failed to write %s\n", __FILE__, __LINE__, writer->temp_path);
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+static bool os_file_writer_flush_staging(OS_FileWriter* writer)
+{
+    bool success = os_file_writer_write_all(writer, writer->staging, writer->staging_size);
+    writer->staging_size = 0;
+    return success;
+}
+
+bool os_file_writer_write(OS_FileWriter* writer, const OS_WriteBuffer* buffers, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        const char* data = buffers[i].data;
+        size_t size = buffers[i].size;
+
+        if (writer->staging_size + size > FILE_WRITER_STAGING_SIZE) {
+            if (!os_file_writer_flush_staging(writer)) {
+                return false;
+            }
+        }
+
+        //big buffers are written as they are
+        if (size > FILE_WRITER_STAGING_SIZE / 2) {
+            if (!os_file_writer_write_all(writer, data, size)) {
+                return false;
+            }
+            continue;
+        }
+
+        memcpy(writer->staging + writer->staging_size, data, size);
+        writer->staging_size += size;
+    }
+    return true;
+}
+
+static void os_file_writer_free(OS_FileWriter* writer)
+{
+    free(writer->staging);
+    free(writer->temp_path);
+    free(writer->path);
+    free(writer);
+}
+
+bool os_file_writer_commit(OS_FileWriter* writer)
+{
+    if (!os_file_writer_flush_staging(writer) || !FlushFileBuffers(writer->file)) {
+        fprintf(stderr, "%s:%d:ERROR: Failed to flush %s\n", __FILE__, __LINE__, writer->temp_path);
+        os_file_writer_abort(writer);
+        return false;
+    }
+    CloseHandle(writer->file);
+    writer->file = INVALID_HANDLE_VALUE;
+
+    //fails if the target is still mapped by someone
+    if (!MoveFileExA(writer->temp_path, writer->path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        fprintf(stderr, "%s:%d:ERROR: Failed to replace %s\n", __FILE__, __LINE__, writer->path);
+        os_file_writer_abort(writer);
+        return false;
+    }
+
+    os_file_writer_free(writer);
+    return true;
+}
+
+void os_file_writer_abort(OS_FileWriter* writer)
+{
+    if (writer->file != INVALID_HANDLE_VALUE) {
+        CloseHandle(writer->file);
+    }
+    DeleteFileA(writer->temp_path);
+    os_file_writer_free(writer);
+}
+
+struct OS_AppendFile
+{
+    HANDLE file;
+    char* path;
+};
+
+OS_AppendFile* os_append_file_open(const char* path)
+{
+    //with only FILE_APPEND_DATA every write goes to the end of the file
+    HANDLE handle = CreateFileA(path, FILE_APPEND_DATA, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "%s:%d:ERROR: Failed to open %s\n", __FILE__, __LINE__, path);
+        return NULL;
+    }
+
+    OS_AppendFile* file = malloc(sizeof(OS_AppendFile));
+    file->file = handle;
+    file->path = _strdup(path);
+    return file;
+}
+
+void os_append_file_close(OS_AppendFile* file)
+{
+    CloseHandle(file->file);
+    free(file->path);
+    free(file);
+}
+
+bool os_append_file_write(OS_AppendFile* file, const void* data, size_t size)
+{
+    const char* pending = data;
+    while (size > 0) {
+        DWORD to_write = size > MAXDWORD ? MAXDWORD : (DWORD)size;
+        DWORD written = 0;
+        if (!WriteFile(file->file, pending, to_write, &written, NULL)) {
+            fprintf(stderr, "%s:%d:ERROR: Failed to write %s\n", __FILE__, __LINE__, file->path);
+            return false;
+        }
+        pending += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool os_append_file_sync(OS_AppendFile* file)
+{
+    if (!FlushFileBuffers(file->file)) {
+        fprintf(stderr, "%s:%d:ERROR: Failed to flush %s\n", __FILE__, __LINE__, file->path);
+        return false;
+    }
+    return true;
+}
+
+struct OS_FileFollower
+{
+    HANDLE file;
+    char* path;
+    size_t offset;
+};
+
+OS_FileFollower* os_file_follower_create(const char* path, size_t offset)
+{
+    //writer of the file has to be able to keep writing it
+    HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "%s:%d:ERROR: Failed to open %s\n", __FILE__, __LINE__, path);
+        return NULL;
+    }
+
+    OS_FileFollower* follower = malloc(sizeof(OS_FileFollower));
+    follower->file = handle;
+    follower->path = _strdup(path);
+    follower->offset = offset;
+    return follower;
+}
+
+void os_file_follower_destroy(OS_FileFollower* follower)
+{
+    CloseHandle(follower->file);
+    free(follower->path);
+    free(follower);
+}
+
+size_t os_file_follower_read(OS_FileFollower* follower, char* buffer, size_t buffer_size)
+{
+    //there is no inotify, but asking for the size is as cheap as reading an event
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(follower->file, &file_size)) {
+        return 0;
+    }
+    if ((size_t)file_size.QuadPart < follower->offset) {
+        //file was truncated, what was written from then on is read from its new end
+        follower->offset = (size_t)file_size.QuadPart;
+        return 0;
+    }
+    if ((size_t)file_size.QuadPart == follower->offset) {
+        return 0;
+    }
+
+    OVERLAPPED overlapped = { 0 };
+    overlapped.Offset = (DWORD)(follower->offset & 0xFFFFFFFF);
+    overlapped.OffsetHigh = (DWORD)((uint64_t)follower->offset >> 32);
+
+    DWORD to_read = buffer_size > MAXDWORD ? MAXDWORD : (DWORD)buffer_size;
+    DWORD read_size = 0;
+    if (!ReadFile(follower->file, buffer, to_read, &read_size, &overlapped)) {
+        fprintf(stderr, "%s:%d:ERROR: Failed to read %s\n", __FILE__, __LINE__, follower->path);
+        return 0;
+    }
+
+    follower->offset += read_size;
+    return read_size;
+}
+
+bool os_get_file_stamp(const char* path, OS_FileStamp* stamp)
+{
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &attributes)) {
+        return false;
+    }
+    stamp->modified_time = ((uint64_t)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+    stamp->size = ((uint64_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+    return true;
+}
+
+bool os_create_temp_file(const char* prefix, char* path, size_t path_size)
+{
+    //GetTempFileNameA writes up to MAX_PATH characters
+    if (path_size < MAX_PATH) {
+        return false;
+    }
+
+    char dir[MAX_PATH + 1];
+    DWORD dir_size = GetTempPathA(sizeof(dir), dir);
+    if (dir_size == 0 || dir_size > sizeof(dir)) {
+        return false;
+    }
+
+    //it creates the file, so the name can't be taken by someone else
+    return GetTempFileNameA(dir, prefix, 0, path) != 0;
 }
 
 LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
@@ -405,6 +874,41 @@ int windows_main(TextBox* _box, int argc, char* argv[])
     {
         TranslateMessage(&msg);
         DispatchMessageW(&msg);
+
+        //free lines that were deleted and search for find matches
+        //while there are no messages to handle
+        while (!PeekMessageW(&msg, NULL, 0, 0, PM_NOREMOVE))
+        {
+            bool freed = text_box_free_removed_lines(GLOBAL_BOX, FREE_REMOVED_LINES_PER_FRAME);
+            if (text_box_find_poll(GLOBAL_BOX)) {
+                //matches are shown as they are found
+                InvalidateRect(GLOBAL_OS->hwnd, NULL, FALSE);
+            }
+            if (text_box_load_poll(GLOBAL_BOX)) {
+                //line count grows while the opened file is being split
+                InvalidateRect(GLOBAL_OS->hwnd, NULL, FALSE);
+            }
+            bool autosaving = text_box_autosave_poll(GLOBAL_BOX);
+            bool journaling = text_box_journal_poll(GLOBAL_BOX);
+            if (text_box_follow_poll(GLOBAL_BOX)) {
+                //followed file grew
+                InvalidateRect(GLOBAL_OS->hwnd, NULL, FALSE);
+            }
+            if (text_box_reload_poll(GLOBAL_BOX)) {
+                //someone else changed the opened file
+                InvalidateRect(GLOBAL_OS->hwnd, NULL, FALSE);
+            }
+            if (!text_find_is_done(&GLOBAL_BOX->find) || GLOBAL_BOX->load || autosaving || journaling || GLOBAL_BOX->follower || GLOBAL_BOX->reload_job) {
+                //search, loading, autosave, journal and reload run on worker threads and followed file can grow,
+                //check on them again a bit later
+                //unless a message comes in first
+                MsgWaitForMultipleObjects(0, NULL, FALSE, 16, QS_ALLINPUT);
+                continue;
+            }
+            if (!freed) {
+                break;
+            }
+        }
     }
 
 cleanup:
@@ -560,6 +1064,26 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
         return 0;
     }break;
 
+    case WM_RENDERFORMAT:
+    {
+        //someone pastes what os_claim_clipboard copied, clipboard is opened for us
+        if (wParam == CF_UNICODETEXT) {
+            clipboard_render_text_box();
+        }
+    }break;
+
+    case WM_RENDERALLFORMATS:
+    {
+        //window is going away, copied text has to stay on the clipboard
+        if (OpenClipboard(hwnd)) {
+            //unless something else was copied since then
+            if (GetClipboardOwner() == hwnd) {
+                clipboard_render_text_box();
+            }
+            CloseClipboard();
+        }
+    }break;
+
     case WM_SIZE: {
         UINT width = LOWORD(lParam);
         UINT height = HIWORD(lParam);